@@ -3,6 +3,7 @@
 LIBARCH_SOURCES := \
         simd_vector.cc \
 	simd_vector_avx.cc \
+	simd_vector_avx2.cc \
         demangle.cc \
 	tick_counter.cc \
 	cpuid.cc \
@@ -43,6 +44,9 @@ $(eval $(call library,gc,$(LIBGC_SOURCES),rt arch))
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
 
+# Only called when the CPU is detected to support AVX2 and FMA
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma))
+
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
 $(eval $(call library,node_exception_tracing,node_exception_tracing.cc,exception_hook arch dl))
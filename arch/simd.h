@@ -53,6 +53,11 @@ JML_ALWAYS_INLINE bool has_avx2()
     return cpuid(7, 0).ebx & (1 << 5);
 }
 
+JML_ALWAYS_INLINE bool has_fma()
+{
+    return has_avx() && cpu_info().fma;
+}
+
 #endif // __i686__
 
 } // namespace ML
@@ -10,6 +10,7 @@
 #include "exception.h"
 #include "simd_vector.h"
 #include "simd_vector_avx.h"
+#include "simd_vector_avx2.h"
 #include "mldb/compiler/compiler.h"
 #include <iostream>
 #include <cmath>
@@ -1010,6 +1011,54 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
     }
 }
 
+void vec_dotprod_dp_rows(const float * x, const float * const * rows,
+                         size_t numRows, size_t n, double * r)
+{
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_dotprod_dp_rows(x, rows, numRows, n, r);
+    }
+    else {
+        for (size_t i = 0;  i < numRows;  ++i)
+            r[i] = vec_dotprod_dp(x, rows[i], n);
+    }
+}
+
+void vec_dotprod_dp_rows(const float * x, const float * rows, size_t stride,
+                         size_t numRows, size_t n, double * r)
+{
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_dotprod_dp_rows(x, rows, stride, numRows, n, r);
+    }
+    else {
+        for (size_t i = 0;  i < numRows;  ++i)
+            r[i] = vec_dotprod_dp(x, rows + i * stride, n);
+    }
+}
+
+void vec_euclid_rows(const float * x, const float * const * rows,
+                     size_t numRows, size_t n, double * r)
+{
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_euclid_rows(x, rows, numRows, n, r);
+    }
+    else {
+        for (size_t i = 0;  i < numRows;  ++i)
+            r[i] = vec_euclid(x, rows[i], n);
+    }
+}
+
+void vec_euclid_rows(const float * x, const float * rows, size_t stride,
+                     size_t numRows, size_t n, double * r)
+{
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_euclid_rows(x, rows, stride, numRows, n, r);
+    }
+    else {
+        for (size_t i = 0;  i < numRows;  ++i)
+            r[i] = vec_euclid(x, rows + i * stride, n);
+    }
+}
+
 double vec_sum_dp(const float * x, size_t n)
 {
     double res = 0.0;
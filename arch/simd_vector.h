@@ -171,6 +171,28 @@ void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n);
 // Euclidean distance squared: sum((p - q)^2)
 double vec_euclid(const float * p, const float * q, size_t n);
 
+// Dot product of x with each of numRows vectors of length n, with internal
+// summation in double precision: r[i] = sum_j x[j] * rows[i][j].  The rows
+// are processed several at a time, which is faster than calling
+// vec_dotprod_dp on each one.  The result for a row is the same whichever
+// of the two vectors is x.
+void vec_dotprod_dp_rows(const float * x, const float * const * rows,
+                         size_t numRows, size_t n, double * r);
+
+// As above, but the rows are stored contiguously in row-major order, with
+// row i starting at rows + i * stride
+void vec_dotprod_dp_rows(const float * x, const float * rows, size_t stride,
+                         size_t numRows, size_t n, double * r);
+
+// Euclidean distance squared between x and each of numRows vectors of
+// length n: r[i] = sum_j (x[j] - rows[i][j])^2
+void vec_euclid_rows(const float * x, const float * const * rows,
+                     size_t numRows, size_t n, double * r);
+
+// As above, with the rows stored contiguously in row-major order
+void vec_euclid_rows(const float * x, const float * rows, size_t stride,
+                     size_t numRows, size_t n, double * r);
+
 } // namespace Generic
 
 #if JML_USE_SSE1
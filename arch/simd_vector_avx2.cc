@@ -0,0 +1,202 @@
+/** simd_vector_avx2.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    SIMD vector operations; AVX2 and FMA specializations.  This file is
+    compiled with -mavx2 -mfma, and its functions must only be called once
+    the processor has been checked for both.
+*/
+
+#include "simd_vector_avx2.h"
+#include <immintrin.h>
+
+namespace ML {
+namespace SIMD {
+namespace Avx2 {
+
+namespace {
+
+/// Rows given as an array of pointers
+struct RowPointers {
+    const float * const * rows;
+
+    const float * operator [] (size_t i) const
+    {
+        return rows[i];
+    }
+};
+
+/// Rows stored contiguously in row-major order
+struct StridedRows {
+    const float * rows;
+    size_t stride;
+
+    const float * operator [] (size_t i) const
+    {
+        return rows + i * stride;
+    }
+};
+
+/// Accumulate x * y, in double precision
+struct DotProduct {
+    typedef __m256d Acc;
+    static constexpr size_t WIDTH = 4;
+
+    static Acc zero()
+    {
+        return _mm256_setzero_pd();
+    }
+
+    static Acc accum(Acc acc, __m256d x, const float * y)
+    {
+        return _mm256_fmadd_pd(x, _mm256_cvtps_pd(_mm_loadu_ps(y)), acc);
+    }
+
+    static __m256d load(const float * x)
+    {
+        return _mm256_cvtps_pd(_mm_loadu_ps(x));
+    }
+
+    static double finish(Acc acc)
+    {
+        double vals[4];
+        _mm256_storeu_pd(vals, acc);
+        return (vals[0] + vals[1]) + (vals[2] + vals[3]);
+    }
+
+    static double accum(double acc, float x, float y)
+    {
+        return acc + (double)x * y;
+    }
+};
+
+/// Accumulate (x - y)^2.  As for vec_euclid, the vector part is accumulated
+/// in single precision, which is accurate enough as all terms are positive.
+struct Euclid {
+    typedef __m256 Acc;
+    static constexpr size_t WIDTH = 8;
+
+    static Acc zero()
+    {
+        return _mm256_setzero_ps();
+    }
+
+    static __m256 load(const float * x)
+    {
+        return _mm256_loadu_ps(x);
+    }
+
+    static Acc accum(Acc acc, __m256 x, const float * y)
+    {
+        __m256 d = _mm256_sub_ps(x, _mm256_loadu_ps(y));
+        return _mm256_fmadd_ps(d, d, acc);
+    }
+
+    static double finish(Acc acc)
+    {
+        float vals[8];
+        _mm256_storeu_ps(vals, acc);
+        return ((double)vals[0] + vals[1]) + ((double)vals[2] + vals[3])
+            + ((double)vals[4] + vals[5]) + ((double)vals[6] + vals[7]);
+    }
+
+    static double accum(double acc, float x, float y)
+    {
+        double d = (double)x - y;
+        return acc + d * d;
+    }
+};
+
+/** Apply the operation between x and each of the rows.  Each row is summed
+    in exactly the same order whether it's processed in a group of four or
+    on its own, and the operations are symmetric, so the result for a row
+    doesn't depend upon the number of rows or which vector is x.
+*/
+template<typename Op, typename Rows>
+void rowsKernel(const float * x, const Rows & rows, size_t numRows, size_t n,
+                double * r)
+{
+    const size_t W = Op::WIDTH;
+    size_t row = 0;
+
+    // Four rows at a time, so that each load of x is used four times
+    for (; row + 4 <= numRows;  row += 4) {
+        const float * r0 = rows[row + 0];
+        const float * r1 = rows[row + 1];
+        const float * r2 = rows[row + 2];
+        const float * r3 = rows[row + 3];
+
+        typename Op::Acc acc0 = Op::zero(), acc1 = acc0, acc2 = acc0,
+            acc3 = acc0;
+
+        size_t i = 0;
+        for (; i + W <= n;  i += W) {
+            auto xx = Op::load(x + i);
+            acc0 = Op::accum(acc0, xx, r0 + i);
+            acc1 = Op::accum(acc1, xx, r1 + i);
+            acc2 = Op::accum(acc2, xx, r2 + i);
+            acc3 = Op::accum(acc3, xx, r3 + i);
+        }
+
+        double res0 = Op::finish(acc0), res1 = Op::finish(acc1);
+        double res2 = Op::finish(acc2), res3 = Op::finish(acc3);
+
+        for (; i < n;  ++i) {
+            res0 = Op::accum(res0, x[i], r0[i]);
+            res1 = Op::accum(res1, x[i], r1[i]);
+            res2 = Op::accum(res2, x[i], r2[i]);
+            res3 = Op::accum(res3, x[i], r3[i]);
+        }
+
+        r[row + 0] = res0;
+        r[row + 1] = res1;
+        r[row + 2] = res2;
+        r[row + 3] = res3;
+    }
+
+    for (; row < numRows;  ++row) {
+        const float * r0 = rows[row];
+
+        typename Op::Acc acc0 = Op::zero();
+
+        size_t i = 0;
+        for (; i + W <= n;  i += W)
+            acc0 = Op::accum(acc0, Op::load(x + i), r0 + i);
+
+        double res0 = Op::finish(acc0);
+        for (; i < n;  ++i)
+            res0 = Op::accum(res0, x[i], r0[i]);
+
+        r[row] = res0;
+    }
+}
+
+} // file scope
+
+void vec_dotprod_dp_rows(const float * x, const float * const * rows,
+                         size_t numRows, size_t n, double * r)
+{
+    rowsKernel<DotProduct>(x, RowPointers{rows}, numRows, n, r);
+}
+
+void vec_dotprod_dp_rows(const float * x, const float * rows, size_t stride,
+                         size_t numRows, size_t n, double * r)
+{
+    rowsKernel<DotProduct>(x, StridedRows{rows, stride}, numRows, n, r);
+}
+
+void vec_euclid_rows(const float * x, const float * const * rows,
+                     size_t numRows, size_t n, double * r)
+{
+    rowsKernel<Euclid>(x, RowPointers{rows}, numRows, n, r);
+}
+
+void vec_euclid_rows(const float * x, const float * rows, size_t stride,
+                     size_t numRows, size_t n, double * r)
+{
+    rowsKernel<Euclid>(x, StridedRows{rows, stride}, numRows, n, r);
+}
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace ML
@@ -0,0 +1,34 @@
+/** simd_vector_avx2.h                                             -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    SIMD vector operations; AVX2 and FMA specializations.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace ML {
+namespace SIMD {
+namespace Avx2 {
+
+/// Dot product of x with each of the rows, summed in double precision
+void vec_dotprod_dp_rows(const float * x, const float * const * rows,
+                         size_t numRows, size_t n, double * r);
+
+/// Same, with contiguous rows
+void vec_dotprod_dp_rows(const float * x, const float * rows, size_t stride,
+                         size_t numRows, size_t n, double * r);
+
+/// Squared euclidean distance from x to each of the rows
+void vec_euclid_rows(const float * x, const float * const * rows,
+                     size_t numRows, size_t n, double * r);
+
+/// Same, with contiguous rows
+void vec_euclid_rows(const float * x, const float * rows, size_t stride,
+                     size_t numRows, size_t n, double * r);
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace ML
@@ -886,3 +886,61 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+
+void vec_rows_test_case(int nvals, int nrows)
+{
+    cerr << "testing vec_dotprod_dp_rows and vec_euclid_rows with "
+         << nvals << " values and " << nrows << " rows" << endl;
+
+    std::vector<float> x(nvals), m(nvals * nrows);
+    std::vector<const float *> rows;
+
+    for (unsigned i = 0; i < nvals;  ++i)
+        x[i] = rand() / 16384.0 / 65536.0 - 0.5;
+    for (unsigned i = 0; i < nvals * nrows;  ++i)
+        m[i] = rand() / 16384.0 / 65536.0 - 0.5;
+    for (unsigned i = 0; i < nrows;  ++i)
+        rows.push_back(&m[i * nvals]);
+
+    std::vector<double> dp(nrows), dp2(nrows), eu(nrows), eu2(nrows);
+
+    SIMD::vec_dotprod_dp_rows(&x[0], &rows[0], nrows, nvals, &dp[0]);
+    SIMD::vec_dotprod_dp_rows(&x[0], &m[0], nvals, nrows, nvals, &dp2[0]);
+    SIMD::vec_euclid_rows(&x[0], &rows[0], nrows, nvals, &eu[0]);
+    SIMD::vec_euclid_rows(&x[0], &m[0], nvals, nrows, nvals, &eu2[0]);
+
+    for (unsigned i = 0;  i < nrows;  ++i) {
+        double expectedDp = 0.0, expectedEu = 0.0;
+        for (unsigned j = 0;  j < nvals;  ++j) {
+            expectedDp += (double)x[j] * m[i * nvals + j];
+            double d = (double)x[j] - m[i * nvals + j];
+            expectedEu += d * d;
+        }
+
+        BOOST_CHECK_SMALL(dp[i] - expectedDp, 1e-10);
+        BOOST_CHECK_CLOSE(eu[i], expectedEu, 0.001);
+
+        // Contiguous rows give exactly the same answer
+        BOOST_CHECK_EQUAL(dp[i], dp2[i]);
+        BOOST_CHECK_EQUAL(eu[i], eu2[i]);
+
+        // The result doesn't depend upon which of the vectors is x, or how
+        // many rows there are
+        double r;
+        const float * xp = &x[0];
+        SIMD::vec_dotprod_dp_rows(rows[i], &xp, 1, nvals, &r);
+        BOOST_CHECK_EQUAL(r, dp[i]);
+        SIMD::vec_euclid_rows(rows[i], &xp, 1, nvals, &r);
+        BOOST_CHECK_EQUAL(r, eu[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_rows_test )
+{
+    for(auto x : {1, 2, 3, 4, 5, 6, 8, 9, 12, 16, 123}) {
+        for (auto r: {0, 1, 3, 4, 5, 13}) {
+            vec_rows_test_case(x, r);
+        }
+    }
+}
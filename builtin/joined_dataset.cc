@@ -20,7 +20,9 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/hash_wrapper_description.h"
-#include "mldb/utils/compact_vector.h"
+#include <atomic>
+#include <mutex>
+#include <limits>
 
 using namespace std;
 
@@ -53,11 +55,12 @@ JoinedDatasetConfigDescription()
 struct JoinedDataset::Itl
     : public MatrixView, public ColumnIndex {
 
+    /** A row of the join.  Its name is made from the names of the rows
+        of the input datasets, and is only created when it's asked for.
+    */
     struct RowEntry {
         RowHash rowHash;   ///< Row hash of joined row
-        RowName rowName;   ///< Name of joined row
         RowName leftName, rightName;  ///< Names of joined rows from input datasets
-        //compact_vector<RowHash, 2> rowHashes;   ///< Row hash from input datasets
     };
 
     enum JoinSide {
@@ -84,11 +87,11 @@ struct JoinedDataset::Itl
 
         virtual const RowName & rowName(RowName & storage) const
         {
-            return iter->rowName;
+            return storage = source->getJoinedRowName(*iter);
         }
 
         virtual RowName next() {
-            return (iter++)->rowName;
+            return source->getJoinedRowName(*iter++);
         }
         
         virtual void advance() {
@@ -106,15 +109,32 @@ struct JoinedDataset::Itl
     /// Map from row hash to the row
     ML::Lightweight_Hash<RowHash, int64_t> rowIndex;
 
-    /// Index of a row hash for a left or right dataset to a list of
-    /// rows it's part of in the output.
-    typedef std::map<RowHash, compact_vector<RowName, 1> > SideRowIndex;
+    /** Index of a row hash for a left or right dataset to the list of
+        rows it's part of in the output, which is needed to return whole
+        columns.  It's only built the first time it's used, as most
+        queries read rows and never need it.
+    */
+    struct SideRowIndex {
+        /// Numbers of the joined rows, grouped by the row of the side
+        std::vector<uint32_t> rowNumbers;
 
-    /// Left row hash to list of row hashes it's present in for colummn index
-    SideRowIndex leftRowIndex;
+        /// Row hash of the side to (offset, count) in rowNumbers
+        ML::Lightweight_Hash<RowHash, std::pair<uint32_t, uint32_t> > index;
 
-    /// Right row hash to list of row hashes it's present in for colummn index
-    SideRowIndex rightRowIndex;
+        size_t memusage() const
+        {
+            return rowNumbers.capacity() * sizeof(uint32_t)
+                + index.capacity() * (sizeof(RowHash)
+                                      + sizeof(std::pair<uint32_t, uint32_t>));
+        }
+    };
+
+    /// Left and right side row indexes, built by getSideRowIndex()
+    mutable SideRowIndex sideRowIndexes[2];
+    mutable std::once_flag sideRowIndexesBuilt[2];
+
+    /// Memory used by the side row indexes that have been built
+    mutable std::atomic<size_t> sideRowIndexMemory;
 
     struct ColumnEntry {
         ColumnName columnName;       ///< Name of the column in this dataset
@@ -150,6 +170,7 @@ struct JoinedDataset::Itl
         BoundTableExpression right,
         std::shared_ptr<SqlExpression> on,
         JoinQualification qualification)
+        : sideRowIndexMemory(0)
     {
         bool debug = false;
 
@@ -252,7 +273,7 @@ struct JoinedDataset::Itl
                 RowName leftName = res->values.at(numValues-2).coerceToPath();
                 RowName rightName = res->values.at(numValues-1).coerceToPath();
 
-                recordJoinRow(leftName, leftName, rightName, rightName);
+                recordJoinRow(std::move(leftName), std::move(rightName));
                 
                 return true;
             };
@@ -316,11 +337,18 @@ struct JoinedDataset::Itl
         }
     }
 
-     /* This is called to record a new entry from the join. */
-    void recordJoinRow(const RowName & leftName, RowHash leftHash,
-                       const RowName & rightName, RowHash rightHash)
+    /** Return the name of the given joined row.  Row names are made on
+        demand, as they are longer than the names of the rows they are
+        made from put together.
+    */
+    RowName getJoinedRowName(const RowEntry & row) const
+    {
+        return getJoinedRowName(row.leftName, row.rightName);
+    }
+
+    RowName getJoinedRowName(const RowName & leftName,
+                             const RowName & rightName) const
     {
-        bool debug = false;
         RowName rowName;
 
         if (chainedJoinDepth > 0 && !leftName.empty()) {
@@ -338,41 +366,98 @@ struct JoinedDataset::Itl
             rowName = std::move(RowName(left + "[" + rightName.toUtf8String() + "]"));
         }
 
-#if 0
-        cerr << "rowName = " << rowName << endl;
-        cerr << "leftName = " << leftName << endl;
-        cerr << "rightName = " << rightName << endl;
-        if (!leftName.empty()) {
-            if (!leftDataset->getMatrixView()->knownRow(leftName)) {
-                cerr << "known names are " << jsonEncodeStr(leftDataset->getMatrixView()->getRowNames()) << endl;
-            }
-            ExcAssert(leftDataset->getMatrixView()->knownRow(leftName));
-        }
-        if (!rightName.empty())
-            ExcAssert(rightDataset->getMatrixView()->knownRow(rightName));
-#endif
+        return rowName;
+    }
 
-        RowHash rowHash(rowName);
+    /* This is called to record a new entry from the join. */
+    void recordJoinRow(RowName leftName, RowName rightName)
+    {
+        bool debug = false;
 
-        RowEntry entry;
-        entry.rowName = rowName;
-        entry.rowHash = rowHash;
-        entry.leftName = leftName;
-        entry.rightName = rightName;
+        RowHash rowHash(getJoinedRowName(leftName, rightName));
 
         if (debug)
             cerr << "added entry number " << rows.size()
-                 << " named " << "("<< rowName <<")"
+                 << " named " << "("<< getJoinedRowName(leftName, rightName)
+                 << ")"
                  << " from left (" << leftName <<")"
                  << " and right (" << rightName <<")"
                  << endl;
 
+        RowEntry entry;
+        entry.rowHash = rowHash;
+        entry.leftName = std::move(leftName);
+        entry.rightName = std::move(rightName);
+
         rows.emplace_back(std::move(entry));
         rowIndex[rowHash] = rows.size() - 1;
+    }
 
-        leftRowIndex[leftHash].push_back(rowName);
-        rightRowIndex[rightHash].push_back(rowName);
-    };
+    /** Return the index from row hashes of the given side's dataset to the
+        joined rows they are part of, building it the first time.
+    */
+    const SideRowIndex & getSideRowIndex(JoinSide side) const
+    {
+        auto build = [&] ()
+            {
+                ExcAssertLess(rows.size(),
+                              (size_t)std::numeric_limits<uint32_t>::max());
+
+                SideRowIndex & result = sideRowIndexes[side];
+
+                auto getName = [&] (const RowEntry & row) -> const RowName &
+                    {
+                        return side == JOIN_SIDE_LEFT
+                            ? row.leftName : row.rightName;
+                    };
+
+                // First pass: count the joined rows for each side row.
+                // Rows that are only on the other side of an outer join
+                // have no name on this side, and aren't indexed.
+                std::vector<RowHash> hashes(rows.size());
+                for (size_t i = 0;  i < rows.size();  ++i) {
+                    const RowName & name = getName(rows[i]);
+                    if (name.empty())
+                        continue;
+                    hashes[i] = RowHash(name);
+                    ++result.index[hashes[i]].second;
+                }
+
+                // Allocate each side row its range of rowNumbers
+                uint32_t offset = 0;
+                for (auto & e: result.index) {
+                    e.second.first = offset;
+                    offset += e.second.second;
+                    e.second.second = 0;
+                }
+
+                // Second pass: fill in the ranges
+                result.rowNumbers.resize(offset);
+                for (size_t i = 0;  i < rows.size();  ++i) {
+                    if (getName(rows[i]).empty())
+                        continue;
+                    auto & e = result.index[hashes[i]];
+                    result.rowNumbers[e.first + e.second++] = i;
+                }
+
+                sideRowIndexMemory += result.memusage();
+            };
+
+        std::call_once(sideRowIndexesBuilt[side], build);
+        return sideRowIndexes[side];
+    }
+
+    /// Return the memory used by the joined rows and their index
+    size_t getRowMemusage() const
+    {
+        size_t result = rows.capacity() * sizeof(RowEntry)
+            + rowIndex.capacity() * (sizeof(RowHash) + sizeof(int64_t));
+        for (auto & r: rows) {
+            result += r.leftName.memusage() - sizeof(RowName)
+                + r.rightName.memusage() - sizeof(RowName);
+        }
+        return result;
+    }
 
     //Easiest case with constant Where
     void makeJoinConstantWhere(AnnotatedJoinCondition& condition,
@@ -474,12 +559,12 @@ struct JoinedDataset::Itl
 
         auto recordOuterLeft = [&] (const RowName& rowName, const RowHash& rowHash)
         {
-            recordJoinRow(rowName, rowHash, RowName(), RowHash());
+            recordJoinRow(rowName, RowName());
         };
 
         auto recordOuterRight = [&] (const RowName& rowName, const RowHash& rowHash)
         {
-            recordJoinRow( RowName(), RowHash(), rowName, rowHash);
+            recordJoinRow(RowName(), rowName);
         };
 
         std::vector<std::tuple<ExpressionValue, RowName, RowHash> >
@@ -531,14 +616,12 @@ struct JoinedDataset::Itl
 
             if (val1 < val2) {
                 if (outerLeft)
-                    recordJoinRow(std::get<1>(*it1), std::get<2>(*it1),
-                                  RowName(), RowHash()); //For LEFT and FULL joins
+                    recordJoinRow(std::get<1>(*it1), RowName()); //For LEFT and FULL joins
                 ++it1;
             }
             else if (val2 < val1) {
                 if (outerRight)
-                    recordJoinRow(RowName(), RowHash(),std::get<1>(*it2),
-                                  std::get<2>(*it2)); //For RIGHT and FULL joins
+                    recordJoinRow(RowName(), std::get<1>(*it2)); //For RIGHT and FULL joins
                 ++it2;
             }
             else {
@@ -563,29 +646,25 @@ struct JoinedDataset::Itl
                         for (auto it2a = it2; it2a < erng2;  ++it2a) {
                             const RowName & leftName = std::get<1>(*it1a);
                             const RowName & rightName = std::get<1>(*it2a);
-                            const RowHash & leftHash = std::get<2>(*it1a);
-                            const RowHash & rightHash = std::get<2>(*it2a);
 
                             if (debug)
                                 cerr << "rows " << leftName << " and "
                                      << rightName << " join on value "
                                      << val1 << endl;
                             
-                            recordJoinRow(leftName, leftHash, rightName, rightHash);
+                            recordJoinRow(leftName, rightName);
                         }
                     }
                 }
                 else if (qualification != JOIN_INNER) {
                     for (auto it1a = it1; it1a < erng1 && outerLeft;  ++it1a) {
                         // For LEFT and FULL joins
-                        recordJoinRow(std::get<1>(*it1a), std::get<2>(*it1a),
-                                      RowName(), RowHash());
+                        recordJoinRow(std::get<1>(*it1a), RowName());
                     }
                     
                     for (auto it2a = it2; it2a < erng2 && outerRight;  ++it2a) {
                         // For RIGHT and FULL joins
-                        recordJoinRow(RowName(), RowHash(),std::get<1>(*it2a),
-                                      std::get<2>(*it2a));
+                        recordJoinRow(RowName(), std::get<1>(*it2a));
                     }
                 }
 
@@ -596,15 +675,13 @@ struct JoinedDataset::Itl
 
         while (outerLeft && it1 != end1) {
             // For LEFT and FULL joins
-            recordJoinRow(std::get<1>(*it1), std::get<2>(*it1),
-                          RowName(), RowHash()); 
+            recordJoinRow(std::get<1>(*it1), RowName()); 
             ++it1;
         }
 
         while (outerRight && it2 != end2) {
             // For RIGHT and FULL joins
-            recordJoinRow(RowName(), RowHash(),std::get<1>(*it2),
-                          std::get<2>(*it2));
+            recordJoinRow(RowName(), std::get<1>(*it2));
             ++it2;
         }
     }
@@ -615,7 +692,7 @@ struct JoinedDataset::Itl
         std::vector<RowName> result;
 
         for (auto & r: rows) {
-            result.push_back(r.rowName);
+            result.push_back(getJoinedRowName(r));
         }
 
         return result;
@@ -653,7 +730,7 @@ struct JoinedDataset::Itl
         
         const RowEntry & row = rows.at(it->second);
 
-        if (rowName != row.rowName)
+        if (rowName != getJoinedRowName(row))
             return MatrixNamedRow();
 
         MatrixNamedRow result;
@@ -703,7 +780,7 @@ struct JoinedDataset::Itl
 
         const RowEntry & row = rows.at(it->second);
 
-        return row.rowName;
+        return getJoinedRowName(row);
     }
 
     virtual bool knownColumn(const ColumnName & column) const
@@ -746,9 +823,11 @@ struct JoinedDataset::Itl
                                       "columnName", columnName);
         
         auto doGetColumn = [&] (const Dataset & dataset,
-                                const SideRowIndex & index,
+                                JoinSide side,
                                 const ColumnName & columnName) -> MatrixColumn
             {
+                const SideRowIndex & index = getSideRowIndex(side);
+
                 MatrixColumn result;
 
                 // First, get the column
@@ -761,21 +840,27 @@ struct JoinedDataset::Itl
 
                     // Does this row appear in the output?  If not, nothing to
                     // do with it
-                    auto it = index.find(rowHash);
-                    if (it == index.end())
+                    auto it = index.index.find(rowHash);
+                    if (it == index.index.end())
                         continue;
 
                     CellValue & value = std::get<1>(r);
                     Date ts = std::get<2>(r);
 
                     // Otherwise, copy it the number of times needed
-                    if (it->second.size() == 1) {
-                        result.rows.emplace_back(it->second[0], std::move(value), ts);
+                    uint32_t offset = it->second.first;
+                    uint32_t count = it->second.second;
+                    if (count == 1) {
+                        const RowEntry & row = rows[index.rowNumbers[offset]];
+                        result.rows.emplace_back(getJoinedRowName(row),
+                                                 std::move(value), ts);
                     }
                     else {
                         // Can't move the value to avoid it becoming null
-                        for (const RowName & outputRowName: it->second) {
-                            result.rows.emplace_back(outputRowName, value, ts);
+                        for (uint32_t i = offset;  i < offset + count;  ++i) {
+                            const RowEntry & row = rows[index.rowNumbers[i]];
+                            result.rows.emplace_back(getJoinedRowName(row),
+                                                     value, ts);
                         }
                     }
                 }
@@ -786,10 +871,12 @@ struct JoinedDataset::Itl
 
         if (it->second.bitmap == 1) {
             // on the left
-            result = doGetColumn(*leftDataset, leftRowIndex, it->second.childColumnName);
+            result = doGetColumn(*leftDataset, JOIN_SIDE_LEFT,
+                                 it->second.childColumnName);
         }
         else {
-            result = doGetColumn(*rightDataset, rightRowIndex, it->second.childColumnName);
+            result = doGetColumn(*rightDataset, JOIN_SIDE_RIGHT,
+                                 it->second.childColumnName);
         }
 
         result.columnHash = result.columnName = it->second.columnName;
@@ -940,7 +1027,12 @@ Any
 JoinedDataset::
 getStatus() const
 {
-    return Any();
+    Json::Value status;
+    status["rowCount"] = itl->getRowCount();
+    status["columnCount"] = itl->getColumnCount();
+    status["rowMemory"] = itl->getRowMemusage();
+    status["sideIndexMemory"] = itl->sideRowIndexMemory.load();
+    return status;
 }
 
 std::shared_ptr<MatrixView>
@@ -774,9 +774,37 @@ queryStructured(const SelectExpression & select,
                 ssize_t limit,
                 Utf8String alias) const
 {
-    std::mutex lock;
     std::vector<MatrixNamedRow> output;
 
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            output.emplace_back(std::move(row));
+            return true;
+        };
+
+    queryStructuredIncremental(onRow, select, when, where, orderBy, groupBy,
+                               having, rowName, offset, limit, alias);
+
+    return output;
+}
+
+bool
+Dataset::
+queryStructuredIncremental(std::function<bool (MatrixNamedRow & row)> onRow,
+                           const SelectExpression & select,
+                           const WhenExpression & when,
+                           const SqlExpression & where,
+                           const OrderByExpression & orderBy,
+                           const TupleExpression & groupBy,
+                           const SqlExpression & having,
+                           const SqlExpression & rowName,
+                           ssize_t offset,
+                           ssize_t limit,
+                           Utf8String alias) const
+{
+    // Set to false once onRow asks us to stop
+    bool keepGoing = true;
+
     if (!having.isConstantTrue() && groupBy.clauses.empty())
         throw HttpReturnException(400, "HAVING expression requires a GROUP BY expression");
 
@@ -795,8 +823,7 @@ queryStructured(const SelectExpression & select,
                 MatrixNamedRow row = row_.flattenDestructive();
                 row.rowName = getValidatedRowName(calc.at(0));
                 row.rowHash = row.rowName;
-                output.emplace_back(std::move(row));
-                return true;
+                return keepGoing = onRow(row);
             };
 
         //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
@@ -815,8 +842,7 @@ queryStructured(const SelectExpression & select,
         auto processor = [&] (NamedRowValue & row_)
             {
                 MatrixNamedRow row = row_.flattenDestructive();
-                output.emplace_back(row);
-                return true;
+                return keepGoing = onRow(row);
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
@@ -826,7 +852,7 @@ queryStructured(const SelectExpression & select,
                               nullptr);
     }
 
-    return output;
+    return keepGoing;
 }
 
 template<typename Filter>
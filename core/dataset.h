@@ -533,6 +533,23 @@ struct Dataset: public MldbEntity {
                     ssize_t limit,
                     Utf8String alias = "") const;
 
+    /** Select from the database, passing each row of the result to onRow
+        in order as it is produced rather than accumulating them.  If
+        onRow returns false, the query is stopped and false is returned.
+    */
+    virtual bool
+    queryStructuredIncremental(std::function<bool (MatrixNamedRow & row)> onRow,
+                               const SelectExpression & select,
+                               const WhenExpression & when,
+                               const SqlExpression & where,
+                               const OrderByExpression & orderBy,
+                               const TupleExpression & groupBy,
+                               const SqlExpression & having,
+                               const SqlExpression & rowName,
+                               ssize_t offset,
+                               ssize_t limit,
+                               Utf8String alias = "") const;
+
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
     queryString(const Utf8String & query) const;
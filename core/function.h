@@ -95,6 +95,10 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to each of a batch of inputs, in one call
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
 };
 
 
@@ -184,6 +188,17 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Used by the FunctionApplier to apply the function to a batch of
+        inputs at once, returning one output per input.  Functions whose
+        per-call overhead is significant (for example those that need to
+        look up a feature space or run a model) should override this to
+        process the whole batch in one pass.  The default calls apply()
+        on each input in turn.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     friend class FunctionApplier;
 };
 
@@ -70,6 +70,13 @@ requestWrite(string data, OnWritten onWritten)
     impl_->requestWrite(std::move(data), std::move(onWritten));
 }
 
+bool
+TcpSocketHandler::
+waitForPendingWrites(size_t maxPendingBytes, double timeoutSeconds)
+{
+    return impl_->waitForPendingWrites(maxPendingBytes, timeoutSeconds);
+}
+
 void
 TcpSocketHandler::
 disableNagle()
@@ -65,6 +65,13 @@ struct TcpSocketHandler {
     /* Request the sending of a given payload. */
     void requestWrite(std::string data, OnWritten onWritten = nullptr);
 
+    /* Block until no more than maxPendingBytes of the data passed to
+       requestWrite are still waiting to be written, or the connection is
+       closed.  Returns false if that didn't happen within the timeout.
+       This allows a producer of a large response to stay only a little
+       ahead of a slow client. */
+    bool waitForPendingWrites(size_t maxPendingBytes, double timeoutSeconds);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
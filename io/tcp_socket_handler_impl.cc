@@ -26,7 +26,9 @@ TcpSocketHandlerImpl(TcpSocketHandler & handler, TcpSocket && socket)
     : handler_(handler), socket_(std::move(socket.impl().socket)),
       recvBufferSize_(262144),
       recvBuffer_(new char[recvBufferSize_]),
-      closed_(false)
+      closed_(false),
+      writing_(false),
+      bytesPendingWrite_(0)
 {
     onReadSome_ = [&] (const system::error_code & ec, size_t bufferSize) {
         if (ec) {
@@ -51,6 +53,10 @@ close()
 {
     socket_.close();
     closed_ = true;
+
+    // Wake up anyone waiting for writes that won't happen
+    std::unique_lock<std::mutex> guard(writeLock_);
+    writeCond_.notify_all();
 }
 
 void
@@ -78,24 +84,80 @@ void
 TcpSocketHandlerImpl::
 requestWrite(string data, TcpSocketHandler::OnWritten onWritten)
 {
-    auto dataPtr = std::make_shared<std::string>(std::move(data));
+    std::unique_lock<std::mutex> guard(writeLock_);
+    bytesPendingWrite_ += data.size();
+    writeQueue_.push_back({ std::move(data), std::move(onWritten) });
+    if (!writing_)
+        startNextWrite(guard);
+}
+
+void
+TcpSocketHandlerImpl::
+startNextWrite(std::unique_lock<std::mutex> & guard)
+{
+    // Called with the lock held.  The completion handler is never called
+    // from within async_write, so it's safe to start it under the lock.
+    writing_ = true;
+    auto write = std::make_shared<PendingWrite>(std::move(writeQueue_.front()));
+    writeQueue_.pop_front();
+
     auto writeCompleteCond = [=] (const system::error_code & ec,
                                   std::size_t written) {
-        return written == dataPtr->size();
+        return written == write->data.size();
     };
     auto onWriteComplete = [=] (const system::error_code & ec,
-                                size_t written)
-        mutable
-    {
-        if (onWritten) {
-            onWritten(ec, written);
-        }
-        (void) dataPtr;
+                                size_t written) {
+        this->onWriteDone(write, ec, written);
     };
-    asio::const_buffers_1 writeBuffer(dataPtr->c_str(), dataPtr->size());
+    asio::const_buffers_1 writeBuffer(write->data.c_str(), write->data.size());
     async_write(socket_, writeBuffer, writeCompleteCond, onWriteComplete);
 }
 
+void
+TcpSocketHandlerImpl::
+onWriteDone(const std::shared_ptr<PendingWrite> & write,
+            const system::error_code & ec,
+            size_t written)
+{
+    if (write->onWritten) {
+        write->onWritten(ec, written);
+    }
+
+    std::deque<PendingWrite> failed;
+    {
+        std::unique_lock<std::mutex> guard(writeLock_);
+        bytesPendingWrite_ -= write->data.size();
+        if (ec) {
+            // The socket is unusable; fail everything that was queued
+            failed.swap(writeQueue_);
+            bytesPendingWrite_ = 0;
+        }
+        if (!writeQueue_.empty())
+            startNextWrite(guard);
+        else writing_ = false;
+        writeCond_.notify_all();
+    }
+
+    for (auto & w: failed) {
+        if (w.onWritten) {
+            w.onWritten(ec, 0);
+        }
+    }
+}
+
+bool
+TcpSocketHandlerImpl::
+waitForPendingWrites(size_t maxPendingBytes, double timeoutSeconds)
+{
+    std::unique_lock<std::mutex> guard(writeLock_);
+    return writeCond_.wait_for(guard,
+                               std::chrono::duration<double>(timeoutSeconds),
+                               [&] () {
+                                   return bytesPendingWrite_ <= maxPendingBytes
+                                       || closed_;
+                               });
+}
+
 void
 TcpSocketHandlerImpl::
 disableNagle()
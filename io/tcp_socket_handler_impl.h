@@ -9,6 +9,9 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <boost/asio/ip/tcp.hpp>
 #include "mldb/io/tcp_socket_handler.h"
@@ -47,6 +50,10 @@ struct TcpSocketHandlerImpl {
     void requestWrite(std::string data,
                       TcpSocketHandler::OnWritten onWritten = nullptr);
 
+    /* Wait until no more than the given number of bytes are waiting to be
+       written. */
+    bool waitForPendingWrites(size_t maxPendingBytes, double timeoutSeconds);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
@@ -66,6 +73,24 @@ private:
                                size_t bufferSize)> OnReadSome;
     OnReadSome onReadSome_;
     std::atomic<bool> closed_;
+
+    /* Writes are queued and done one after the other, as concurrent
+       async_write calls on the same socket may interleave their data. */
+    struct PendingWrite {
+        std::string data;
+        TcpSocketHandler::OnWritten onWritten;
+    };
+
+    void startNextWrite(std::unique_lock<std::mutex> & guard);
+    void onWriteDone(const std::shared_ptr<PendingWrite> & write,
+                     const boost::system::error_code & ec,
+                     size_t written);
+
+    std::mutex writeLock_;
+    std::condition_variable writeCond_;
+    std::deque<PendingWrite> writeQueue_;
+    bool writing_;
+    size_t bytesPendingWrite_;
 };
 
 } // namespace Datacratic
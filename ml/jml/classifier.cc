@@ -543,6 +543,31 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t num_examples,
+              const Optimization_Info & info,
+              float * output,
+              PredictionContext * context) const
+{
+    if (!info)
+        throw Exception("predict_batch requires optimization info");
+
+    size_t nin = info.features_in();
+    size_t nl = label_count();
+
+    float fv[info.features_out()];
+    double accum[nl];
+
+    for (size_t i = 0;  i < num_examples;  ++i) {
+        info.apply(features + i * nin, fv);
+        std::fill(accum, accum + nl, 0.0);
+        optimized_predict_impl(fv, info, accum, 1.0, context);
+        std::copy(accum, accum + nl, output + i * nl);
+    }
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
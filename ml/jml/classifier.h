@@ -360,6 +360,20 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Optimized predict for a batch of dense feature vectors.  The
+        features are num_examples vectors of info.features_in() values
+        each, one after the other (as would be passed one at a time to
+        predict(const float *, info)).  The output must have room for
+        label_count() values per example.  The default implementation
+        calls the accumulating optimized_predict_impl() for each example,
+        which avoids allocating a Label_Dist per example.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t num_examples,
+                               const Optimization_Info & info,
+                               float * output,
+                               PredictionContext * context = 0) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
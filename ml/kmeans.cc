@@ -196,11 +196,18 @@ distribution<float>
 KMeans::
 centroidDistances(const distribution<float> & point) const
 {
-    distribution<float> distances(clusters.size());
+    std::vector<const float *> centroids(clusters.size());
     for (int i=0; i < clusters.size(); ++i) {
-        distances[i] = metric->distance(point, clusters[i].centroid);
+        if (clusters[i].centroid.size() != point.size())
+            throw ML::Exception("point and centroid have different sizes");
+        centroids[i] = clusters[i].centroid.data();
     }
-    return distances;
+
+    std::vector<double> result(clusters.size());
+    metric->distances(point, centroids.data(), centroids.size(),
+                      result.data());
+
+    return distribution<float>(result.begin(), result.end());
 }
 
 int
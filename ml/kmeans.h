@@ -13,6 +13,7 @@
 #include "mldb/jml/db/persistent.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
 #include <boost/math/special_functions/fpclassify.hpp>
 
 
@@ -31,6 +32,19 @@ public:
     virtual double distance(const distribution<float> & x,
                             const distribution<float> & y) const = 0;
 
+    // Distance between x and each of numPoints points of the same size,
+    // into result.  Metrics override this to vectorize over the points.
+    virtual void distances(const distribution<float> & x,
+                           const float * const * points, size_t numPoints,
+                           double * result) const
+    {
+        distribution<float> y(x.size());
+        for (size_t i = 0;  i < numPoints;  ++i) {
+            std::copy(points[i], points[i] + x.size(), y.begin());
+            result[i] = distance(x, y);
+        }
+    }
+
     // Computes the average of a set of points
     // This should correspond to the point that as the smallest
     // sum of `distance` between  all the points
@@ -51,6 +65,15 @@ public:
                     const distribution<float> & y) const
     { return (x - y).two_norm(); }
 
+    void distances(const distribution<float> & x,
+                   const float * const * points, size_t numPoints,
+                   double * result) const
+    {
+        SIMD::vec_euclid_rows(x.data(), points, numPoints, x.size(), result);
+        for (size_t i = 0;  i < numPoints;  ++i)
+            result[i] = sqrt(result[i]);
+    }
+
     distribution<float>
     average(const std::vector<distribution<float>> & points) const
     {
@@ -102,6 +125,28 @@ public:
             return -x.dotprod(y) / y.two_norm() / x.two_norm();
     }
 
+    void distances(const distribution<float> & x,
+                   const float * const * points, size_t numPoints,
+                   double * result) const
+    {
+        if (!x.any()) {
+            KMeansMetric::distances(x, points, numPoints, result);
+            return;
+        }
+
+        double xNorm = x.two_norm();
+        SIMD::vec_dotprod_dp_rows(x.data(), points, numPoints, x.size(),
+                                  result);
+
+        for (size_t i = 0;  i < numPoints;  ++i) {
+            double yNorm = sqrt(SIMD::vec_dotprod_dp(points[i], points[i],
+                                                     x.size()));
+            if (yNorm == 0.0)
+                result[i] = 2.;
+            else result[i] = -result[i] / yNorm / xNorm;
+        }
+    }
+
     // Not perfect but probably does the trick
     // Returns the (normalized) mean of the normalized points
     distribution<float>
@@ -112,17 +112,37 @@ struct V2D_Job {
             }
         }
         else {
+            std::vector<double> XXT(i1);
             for (unsigned i = i0;  i < i1;  ++i) {
                 D[i][i] = 0.0f;
+                // accum in double precision for accuracy
+                dotprod_rows(&X[i][0], &X[0][0], d, i, d, &XXT[0]);
                 for (unsigned j = 0;  j < i;  ++j) {
-                    // accum in double precision for accuracy
-                    Float XXT = SIMD::vec_dotprod_dp(&X[i][0], &X[j][0], d);
-                    Float val = sum_X[i] + sum_X[j] - 2.0f * XXT;
+                    Float val = sum_X[i] + sum_X[j] - 2.0f * (Float)XXT[j];
                     D[i][j] = val;
                 }
             }
         }
     }
+
+    /** Dot product of x with each of the first numRows rows of the
+        matrix.  For float this uses a kernel that handles several rows
+        at once.
+    */
+    static void dotprod_rows(const float * x, const float * rows,
+                             size_t stride, size_t numRows, size_t n,
+                             double * r)
+    {
+        SIMD::vec_dotprod_dp_rows(x, rows, stride, numRows, n, r);
+    }
+
+    static void dotprod_rows(const double * x, const double * rows,
+                             size_t stride, size_t numRows, size_t n,
+                             double * r)
+    {
+        for (size_t i = 0;  i < numRows;  ++i)
+            r[i] = SIMD::vec_dotprod_dp(x, rows + i * stride, n);
+    }
 };
 
 template<typename Float>
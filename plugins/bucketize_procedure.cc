@@ -16,7 +16,7 @@
 #include "mldb/sql/execution_pipeline.h"
 #include "mldb/arch/backtrace.h"
 #include "mldb/types/any_impl.h"
-#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/server/dataset_utils.h"
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/plugins/sql_config_validator.h"
@@ -185,7 +185,7 @@ run(const ProcedureRunConfig & run,
                                 nullptr, true /*overwrite*/);
 
     typedef tuple<ColumnName, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowName, vector<Cell>>>> accum;
+    ParallelRecorder recorder(*output);
 
     auto bucketizeStep = iterationStep->nextStep(1);
     atomic<ssize_t> rowIndex(0);
@@ -198,14 +198,7 @@ run(const ProcedureRunConfig & run,
 
         auto applyFct = [&] (int64_t index) {
             ++ rowIndex;
-            auto & rows = accum.get();
-            rows.reserve(1024);
-            rows.emplace_back(orderedRowNames[index], rowValue);
-
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
+            recorder.recordRow(orderedRowNames[index], rowValue);
             if ((rowIndex.load() % 2048) == 0) {
                 float newVal = (float)(rowIndex.load()) / rowCount;
                 lock_guard<mutex> lock(progressMutex);
@@ -229,13 +222,7 @@ run(const ProcedureRunConfig & run,
         parallelMap(lowerBound, higherBound, applyFct);
     }
 
-    // record remainder
-    accum.forEach([&] (vector<pair<RowName, vector<Cell>>> * rows)
-    {
-        output->recordRows(*rows);
-    });
-
-    output->commit();
+    recorder.commit();
     return output->getStatus();
 }
 
@@ -154,6 +154,15 @@ RunOutput
 ClassifierProcedure::
 run(const ProcedureRunConfig & run,
       const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    return this->run(run, onProgress, nullptr);
+}
+
+RunOutput
+ClassifierProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress,
+    DatasetFeatureSpaceCache * featureSpaceCache) const
 {
     // 1.  Construct an applyFunctionToProcedure object
 
@@ -253,8 +262,15 @@ run(const ProcedureRunConfig & run,
 
     // TODO: it's not the feature space itself, but indeed the output of
     // the select expression that's important...
-    auto featureSpace = std::make_shared<DatasetFeatureSpace>
-        (boundDataset.dataset, labelInfo, knownInputColumns);
+    std::shared_ptr<DatasetFeatureSpace> featureSpace;
+    if (featureSpaceCache) {
+        featureSpace = featureSpaceCache->get(boundDataset.dataset, labelInfo,
+                                              knownInputColumns);
+    }
+    else {
+        featureSpace = std::make_shared<DatasetFeatureSpace>
+            (boundDataset.dataset, labelInfo, knownInputColumns);
+    }
 
     INFO_MSG(logger) << "initialized feature space in " << timer.elapsed();
 
@@ -792,50 +808,61 @@ getDetails() const
     return result;
 }
 
-std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+bool
 ClassifyFunction::
-getFeatureSet(const ExpressionValue & context, bool attemptDense) const
+getDenseFeatures(const ExpressionValue & context, float * features,
+                 Date & ts) const
 {
     auto row = context.getColumn(PathElement("features"));
 
-    Date ts = Date::negativeInfinity();
+    std::fill(features, features + itl->featureSpace->columnInfo.size(),
+              std::numeric_limits<float>::quiet_NaN());
 
     bool multiValue = false;
-    if (attemptDense) {
-        std::vector<float> denseFeatures(itl->featureSpace->columnInfo.size(),
-                                         std::numeric_limits<float>::quiet_NaN());
 
-        auto onAtom = [&] (const Path & suffix,
-                           const Path & prefix,
-                           const CellValue & value,
-                           Date tsIn)
-            {
-                ColumnName columnName(prefix + suffix);
-                ColumnHash columnHash(columnName);
-                
-                auto it = itl->featureSpace->columnInfo.find(columnHash);
-                if (it == itl->featureSpace->columnInfo.end())
-                    return true;
-
-                ts.setMax(tsIn);
-
-                if (!isnanf(denseFeatures[it->second.index])) {
-                    multiValue = true;
-                    return false;
-                }
-                
-                denseFeatures[it->second.index]
-                    = itl->featureSpace->encodeFeatureValue(columnHash, value);
+    auto onAtom = [&] (const Path & suffix,
+                       const Path & prefix,
+                       const CellValue & value,
+                       Date tsIn)
+        {
+            ColumnName columnName(prefix + suffix);
+            ColumnHash columnHash(columnName);
 
+            auto it = itl->featureSpace->columnInfo.find(columnHash);
+            if (it == itl->featureSpace->columnInfo.end())
                 return true;
-            };
 
-        row.forEachAtom(onAtom);
+            ts.setMax(tsIn);
+
+            if (!isnanf(features[it->second.index])) {
+                multiValue = true;
+                return false;
+            }
+
+            features[it->second.index]
+                = itl->featureSpace->encodeFeatureValue(columnHash, value);
+
+            return true;
+        };
+
+    row.forEachAtom(onAtom);
+
+    return !multiValue;
+}
 
-        if (!multiValue)
+std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+ClassifyFunction::
+getFeatureSet(const ExpressionValue & context, bool attemptDense) const
+{
+    Date ts = Date::negativeInfinity();
+
+    if (attemptDense) {
+        std::vector<float> denseFeatures(itl->featureSpace->columnInfo.size());
+        if (getDenseFeatures(context, denseFeatures.data(), ts))
             return std::make_tuple( std::move(denseFeatures), nullptr, ts );
     }
 
+    auto row = context.getColumn(PathElement("features"));
 
     std::vector<std::pair<ML::Feature, float> > features;
 
@@ -977,6 +1004,89 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+namespace {
+
+/** Turn the scores for each label output by the classifier into the output
+    of the classify function.
+*/
+ExpressionValue
+getClassifyOutput(const ClassifyFunction::Itl & itl,
+                  const float * scores, int labelCount, Date ts)
+{
+    StructValue result;
+    result.reserve(1);
+
+    auto cat = itl.labelInfo.categorical();
+    if (cat) {
+        vector<tuple<PathElement, ExpressionValue> > row;
+        for (unsigned i = 0;  i < labelCount;  ++i) {
+            row.emplace_back(PathElement(cat->print(i)),
+                             ExpressionValue(scores[i], ts));
+        }
+
+        result.emplace_back("scores", std::move(row));
+    }
+    else if (itl.labelInfo.type() == ML::REAL) {
+        ExcAssertEqual(labelCount, 1);
+        result.emplace_back("score", ExpressionValue(scores[0], ts));
+    }
+    else {
+        ExcAssertEqual(labelCount, 2);
+        result.emplace_back("score", ExpressionValue(scores[1], ts));
+    }
+
+    return std::move(result);
+}
+
+} // file scope
+
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    if (!applier.optInfo)
+        return Function::applyBatch(applier, inputs);
+
+    size_t numFeatures = itl->featureSpace->columnInfo.size();
+    int labelCount = itl->classifier.label_count();
+
+    // Build a dense matrix with the rows that can be represented densely,
+    // and score it in a single pass.  The others (with several values
+    // for a feature) are applied individually.
+    std::vector<float> features(numFeatures * inputs.size());
+    std::vector<Date> timestamps(inputs.size(), Date::negativeInfinity());
+    std::vector<int> denseIndex(inputs.size(), -1);
+    size_t numDense = 0;
+
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        if (getDenseFeatures(inputs[i], &features[numDense * numFeatures],
+                             timestamps[i]))
+            denseIndex[i] = numDense++;
+    }
+
+    std::vector<float> scores(numDense * labelCount);
+    if (numDense > 0) {
+        itl->classifier.impl->predict_batch(features.data(), numDense,
+                                            applier.optInfo, scores.data());
+    }
+
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        if (denseIndex[i] == -1)
+            result.emplace_back(apply(applier, inputs[i]));
+        else result.emplace_back(getClassifyOutput
+                                 (*itl, &scores[denseIndex[i] * labelCount],
+                                  labelCount, timestamps[i]));
+    }
+
+    return result;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
@@ -1135,6 +1245,15 @@ apply(const FunctionApplier & applier,
     return std::move(output);
 }
 
+std::vector<ExpressionValue>
+ExplainFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    // Explanations are made one at a time
+    return Function::applyBatch(applier, inputs);
+}
+
 FunctionInfo
 ExplainFunction::
 getFunctionInfo() const
@@ -26,6 +26,7 @@ namespace MLDB {
 
 
 class SqlExpression;
+struct DatasetFeatureSpaceCache;
 
 enum ClassifierMode {
     CM_REGRESSION,
@@ -88,6 +89,14 @@ struct ClassifierProcedure: public Procedure {
     virtual RunOutput run(const ProcedureRunConfig & run,
                           const std::function<bool (const Json::Value &)> & onProgress) const;
 
+    /** Same as run(), but the column information of the feature space is
+        taken from the given cache (if it's not null), so that it's only
+        computed once over several runs on the same dataset.
+    */
+    RunOutput run(const ProcedureRunConfig & run,
+                  const std::function<bool (const Json::Value &)> & onProgress,
+                  DatasetFeatureSpaceCache * featureSpaceCache) const;
+
     virtual Any getStatus() const;
 
     ClassifierConfig procedureConfig;
@@ -134,9 +143,26 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Score a batch of inputs.  Those that can be represented densely are
+        scored together as a single matrix using the classifier's optimized
+        predict.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Fill in the dense (optimized) feature vector for the given function
+        context, which must have room for one value per feature of the
+        feature space, and update ts with the latest timestamp of the
+        features.  Returns false if the context can't be represented
+        densely, because it has more than one value for a feature.
+    */
+    bool getDenseFeatures(const ExpressionValue & context, float * features,
+                          Date & ts) const;
+
     /** Return the feature set for the given function context.  If
         returnDense is true, then it will attempt to return an optimized
         (dense) feature vector.
@@ -173,6 +199,10 @@ struct ExplainFunction: public ClassifyFunction {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 };
@@ -10,6 +10,7 @@
 
 #include <memory>
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/jml/db/persistent_fwd.h"
 
 namespace Datacratic {
 namespace MLDB {
@@ -36,6 +37,9 @@ struct ColumnTypes {
     std::shared_ptr<ExpressionValueInfo>
     getExpressionValueInfo() const;
 
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
     uint64_t numNulls;
     uint64_t numZeros;
     
@@ -0,0 +1,169 @@
+/** csv_scanner.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Vectorized scanning of the structural characters in a line of CSV.
+*/
+
+#include "csv_scanner.h"
+#include "mldb/arch/arch.h"
+#include "mldb/arch/simd.h"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Datacratic {
+namespace MLDB {
+
+// Defined in csv_scanner_avx2.cc, which is compiled with -mavx2
+void scanCsvStructureAvx2(const char * line, size_t length,
+                          char separator, char quote,
+                          uint64_t * masks);
+
+namespace {
+
+/** Scan up to 64 characters, one at a time.  Used for the tail of the
+    line and on architectures without a vectorized version.
+*/
+void scanCsvWordScalar(const char * p, size_t n,
+                       char separator, char quote,
+                       uint64_t * masks)
+{
+    uint64_t separators = 0, quotes = 0, eightBit = 0, invalid = 0;
+
+    for (size_t i = 0;  i < n;  ++i) {
+        char c = p[i];
+        uint64_t bit = uint64_t(1) << i;
+        if (c == separator)
+            separators |= bit;
+        if (c == quote)
+            quotes |= bit;
+        if (c & 0x80)
+            eightBit |= bit;
+        if (c == 0 || c == 127)
+            invalid |= bit;
+    }
+
+    masks[CSV_SEPARATORS] = separators;
+    masks[CSV_QUOTES] = quotes;
+    masks[CSV_EIGHT_BIT] = eightBit;
+    masks[CSV_INVALID_ASCII] = invalid;
+}
+
+#ifdef __SSE2__
+
+void scanCsvStructureSse2(const char * line, size_t length,
+                          char separator, char quote,
+                          uint64_t * masks)
+{
+    const __m128i separators = _mm_set1_epi8(separator);
+    const __m128i quotes = _mm_set1_epi8(quote);
+    const __m128i nuls = _mm_setzero_si128();
+    const __m128i dels = _mm_set1_epi8(127);
+
+    size_t i = 0;
+    for (;  i + CSV_SCAN_WORD_CHARS <= length;
+         i += CSV_SCAN_WORD_CHARS, masks += CSV_NUM_MASKS) {
+        uint64_t separatorBits = 0, quoteBits = 0;
+        uint64_t eightBitBits = 0, invalidBits = 0;
+
+        for (unsigned j = 0;  j < 4;  ++j) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(line + i + j * 16));
+            unsigned shift = j * 16;
+            separatorBits |= uint64_t((uint16_t)_mm_movemask_epi8
+                                      (_mm_cmpeq_epi8(v, separators)))
+                << shift;
+            quoteBits |= uint64_t((uint16_t)_mm_movemask_epi8
+                                  (_mm_cmpeq_epi8(v, quotes)))
+                << shift;
+            eightBitBits |= uint64_t((uint16_t)_mm_movemask_epi8(v)) << shift;
+            invalidBits |= uint64_t((uint16_t)_mm_movemask_epi8
+                                    (_mm_or_si128(_mm_cmpeq_epi8(v, nuls),
+                                                  _mm_cmpeq_epi8(v, dels))))
+                << shift;
+        }
+
+        masks[CSV_SEPARATORS] = separatorBits;
+        masks[CSV_QUOTES] = quoteBits;
+        masks[CSV_EIGHT_BIT] = eightBitBits;
+        masks[CSV_INVALID_ASCII] = invalidBits;
+    }
+
+    if (i < length)
+        scanCsvWordScalar(line + i, length - i, separator, quote, masks);
+}
+
+#else // __SSE2__
+
+void scanCsvStructureScalar(const char * line, size_t length,
+                            char separator, char quote,
+                            uint64_t * masks)
+{
+    for (size_t i = 0;  i < length;
+         i += CSV_SCAN_WORD_CHARS, masks += CSV_NUM_MASKS) {
+        scanCsvWordScalar(line + i,
+                          std::min(CSV_SCAN_WORD_CHARS, length - i),
+                          separator, quote, masks);
+    }
+}
+
+#endif // __SSE2__
+
+typedef void (*ScanFunction) (const char *, size_t, char, char, uint64_t *);
+
+ScanFunction chooseScanFunction()
+{
+#if JML_INTEL_ISA
+    if (ML::has_avx() && ML::has_avx2())
+        return scanCsvStructureAvx2;
+#endif
+#ifdef __SSE2__
+    return scanCsvStructureSse2;
+#else
+    return scanCsvStructureScalar;
+#endif
+}
+
+} // file scope
+
+/** Used by the AVX2 version for the tail of the line. */
+void scanCsvWordTail(const char * p, size_t n,
+                     char separator, char quote,
+                     uint64_t * masks)
+{
+    scanCsvWordScalar(p, n, separator, quote, masks);
+}
+
+void scanCsvStructure(const char * line, size_t length,
+                      char separator, char quote,
+                      uint64_t * masks)
+{
+    // Interrogate the cpuid flags once to decide which one to use
+    static const ScanFunction scan = chooseScanFunction();
+    scan(line, length, separator, quote, masks);
+}
+
+
+/*****************************************************************************/
+/* CSV STRUCTURAL INDEX                                                      */
+/*****************************************************************************/
+
+CsvStructuralIndex::
+CsvStructuralIndex(const char * line, size_t length,
+                   char separator, char quote)
+    : line(line), length(length),
+      numWords((length + CSV_SCAN_WORD_CHARS - 1) / CSV_SCAN_WORD_CHARS),
+      masks(fixedMasks)
+{
+    if (numWords > FIXED_WORDS) {
+        dynamicMasks.reset(new uint64_t[numWords * CSV_NUM_MASKS]);
+        masks = dynamicMasks.get();
+    }
+
+    scanCsvStructure(line, length, separator, quote, masks);
+}
+
+} // namespace MLDB
+} // namespace Datacratic
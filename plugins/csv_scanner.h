@@ -0,0 +1,150 @@
+/** csv_scanner.h                                                  -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Vectorized scanning of the structural characters in a line of CSV.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* CSV SCANNER                                                               */
+/*****************************************************************************/
+
+/// Number of characters covered by one word of each mask
+static constexpr size_t CSV_SCAN_WORD_CHARS = 64;
+
+/// Masks produced for each word of input by scanCsvStructure()
+enum CsvScanMask {
+    CSV_SEPARATORS,     ///< Bit set for each separator character
+    CSV_QUOTES,         ///< Bit set for each quote character
+    CSV_EIGHT_BIT,      ///< Bit set for each character with the top bit set
+    CSV_INVALID_ASCII,  ///< Bit set for each NUL or DEL character
+    CSV_NUM_MASKS
+};
+
+/** Scan the given line, and for each 64 characters of it fill in
+    CSV_NUM_MASKS words of masks, in the order of the CsvScanMask enum.
+    Bit i of a mask word refers to character i of the 64 characters.
+    The masks array must have space for
+    CSV_NUM_MASKS * ceil(length / 64) words.
+
+    This uses AVX2 if the processor supports it, SSE2 otherwise, and
+    falls back to a scalar implementation on other architectures.
+*/
+void scanCsvStructure(const char * line, size_t length,
+                      char separator, char quote,
+                      uint64_t * masks);
+
+
+/*****************************************************************************/
+/* CSV STRUCTURAL INDEX                                                      */
+/*****************************************************************************/
+
+/** Index of where the structural characters are in a line of CSV, built
+    in a single vectorized pass over the line.  Parsing then jumps from
+    one separator or quote to the next, rather than looking at each
+    character in turn, and the encoding of each field is determined by
+    looking at the masks instead of re-examining the characters.
+
+    No memory is allocated for lines up to 4096 characters long.
+*/
+
+struct CsvStructuralIndex {
+    CsvStructuralIndex(const char * line, size_t length,
+                       char separator, char quote);
+
+    /** Return a pointer to the first separator at or after p, or the end
+        of the line if there is none.
+    */
+    const char * nextSeparator(const char * p) const
+    {
+        return next(CSV_SEPARATORS, p);
+    }
+
+    /** Return a pointer to the first quote at or after p, or the end
+        of the line if there is none.
+    */
+    const char * nextQuote(const char * p) const
+    {
+        return next(CSV_QUOTES, p);
+    }
+
+    /** Is there a character with the top bit set in [begin, end)? */
+    bool hasEightBit(const char * begin, const char * end) const
+    {
+        return any(CSV_EIGHT_BIT, begin, end);
+    }
+
+    /** Is there an ASCII character that can't be put in a string (NUL
+        or DEL) in [begin, end)?
+    */
+    bool hasInvalidAscii(const char * begin, const char * end) const
+    {
+        return any(CSV_INVALID_ASCII, begin, end);
+    }
+
+private:
+    static constexpr size_t FIXED_WORDS = 64;
+
+    const char * line;
+    size_t length;
+    size_t numWords;
+    uint64_t * masks;
+    uint64_t fixedMasks[FIXED_WORDS * CSV_NUM_MASKS];
+    std::unique_ptr<uint64_t[]> dynamicMasks;
+
+    const char * next(CsvScanMask kind, const char * p) const
+    {
+        size_t pos = p - line;
+        if (pos >= length)
+            return line + length;
+
+        size_t word = pos / CSV_SCAN_WORD_CHARS;
+        uint64_t bits = masks[word * CSV_NUM_MASKS + kind]
+            & (~uint64_t(0) << (pos % CSV_SCAN_WORD_CHARS));
+
+        while (!bits) {
+            if (++word == numWords)
+                return line + length;
+            bits = masks[word * CSV_NUM_MASKS + kind];
+        }
+
+        return line + word * CSV_SCAN_WORD_CHARS + __builtin_ctzll(bits);
+    }
+
+    bool any(CsvScanMask kind, const char * begin, const char * end) const
+    {
+        if (begin >= end)
+            return false;
+
+        size_t first = begin - line;
+        size_t last = end - line - 1;
+        size_t firstWord = first / CSV_SCAN_WORD_CHARS;
+        size_t lastWord = last / CSV_SCAN_WORD_CHARS;
+        uint64_t firstBits = ~uint64_t(0) << (first % CSV_SCAN_WORD_CHARS);
+        uint64_t lastBits = ~uint64_t(0) >> (63 - last % CSV_SCAN_WORD_CHARS);
+
+        if (firstWord == lastWord)
+            return masks[firstWord * CSV_NUM_MASKS + kind]
+                & firstBits & lastBits;
+
+        if (masks[firstWord * CSV_NUM_MASKS + kind] & firstBits)
+            return true;
+        for (size_t w = firstWord + 1;  w < lastWord;  ++w)
+            if (masks[w * CSV_NUM_MASKS + kind])
+                return true;
+        return masks[lastWord * CSV_NUM_MASKS + kind] & lastBits;
+    }
+};
+
+} // namespace MLDB
+} // namespace Datacratic
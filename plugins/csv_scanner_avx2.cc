@@ -0,0 +1,64 @@
+/** csv_scanner_avx2.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Vectorized scanning of the structural characters in a line of CSV;
+    AVX2 version.  This file is compiled with -mavx2, and the function is
+    only called once the processor has been checked for AVX2 support.
+*/
+
+#include "csv_scanner.h"
+#include <immintrin.h>
+
+namespace Datacratic {
+namespace MLDB {
+
+// Defined in csv_scanner.cc
+void scanCsvWordTail(const char * p, size_t n,
+                     char separator, char quote,
+                     uint64_t * masks);
+
+void scanCsvStructureAvx2(const char * line, size_t length,
+                          char separator, char quote,
+                          uint64_t * masks)
+{
+    const __m256i separators = _mm256_set1_epi8(separator);
+    const __m256i quotes = _mm256_set1_epi8(quote);
+    const __m256i nuls = _mm256_setzero_si256();
+    const __m256i dels = _mm256_set1_epi8(127);
+
+    auto scan32 = [&] (const char * p, uint64_t * masks, unsigned shift)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)p);
+            masks[CSV_SEPARATORS]
+                |= uint64_t((uint32_t)_mm256_movemask_epi8
+                            (_mm256_cmpeq_epi8(v, separators)))
+                << shift;
+            masks[CSV_QUOTES]
+                |= uint64_t((uint32_t)_mm256_movemask_epi8
+                            (_mm256_cmpeq_epi8(v, quotes)))
+                << shift;
+            masks[CSV_EIGHT_BIT]
+                |= uint64_t((uint32_t)_mm256_movemask_epi8(v)) << shift;
+            masks[CSV_INVALID_ASCII]
+                |= uint64_t((uint32_t)_mm256_movemask_epi8
+                            (_mm256_or_si256(_mm256_cmpeq_epi8(v, nuls),
+                                             _mm256_cmpeq_epi8(v, dels))))
+                << shift;
+        };
+
+    size_t i = 0;
+    for (;  i + CSV_SCAN_WORD_CHARS <= length;
+         i += CSV_SCAN_WORD_CHARS, masks += CSV_NUM_MASKS) {
+        for (unsigned m = 0;  m < CSV_NUM_MASKS;  ++m)
+            masks[m] = 0;
+        scan32(line + i, masks, 0);
+        scan32(line + i + 32, masks, 32);
+    }
+
+    if (i < length)
+        scanCsvWordTail(line + i, length - i, separator, quote, masks);
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -510,6 +510,45 @@ static ML::Register_Factory<ML::Feature_Space, DatasetFeatureSpace>
 DFS_REG("MLDB::DatasetFeatureSpace");
 
 
+
+/*****************************************************************************/
+/* DATASET FEATURE SPACE CACHE                                               */
+/*****************************************************************************/
+
+std::shared_ptr<DatasetFeatureSpace>
+DatasetFeatureSpaceCache::
+get(std::shared_ptr<Dataset> dataset,
+    ML::Feature_Info labelInfo,
+    const std::set<ColumnName> & includeColumns,
+    bool bucketize)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto & e = entries[std::make_tuple(dataset.get(), includeColumns,
+                                           bucketize)];
+        if (!e) {
+            e = std::make_shared<Entry>();
+            e->dataset = dataset;
+        }
+        entry = e;
+    }
+
+    // Only one caller scans the columns; the others wait for it
+    std::unique_lock<std::mutex> guard(entry->mutex);
+    if (!entry->columnInfo) {
+        DatasetFeatureSpace featureSpace(dataset, labelInfo, includeColumns,
+                                         bucketize);
+        entry->columnInfo = std::make_shared<std::unordered_map<ColumnHash, DatasetFeatureSpace::ColumnInfo> >
+            (std::move(featureSpace.columnInfo));
+    }
+
+    auto result = std::make_shared<DatasetFeatureSpace>();
+    result->columnInfo = *entry->columnInfo;
+    result->labelInfo = std::move(labelInfo);
+    return result;
+}
+
 } // namespace MLDB
 } // namespace Datacratic
 
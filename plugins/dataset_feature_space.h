@@ -15,6 +15,9 @@
 #include "mldb/core/dataset.h"
 #include "mldb/server/bucket.h"
 #include "mldb/ml/jml/label.h"
+#include <mutex>
+#include <map>
+#include <set>
 
 namespace Datacratic {
 namespace MLDB {
@@ -179,6 +182,46 @@ std::ostream & operator << (std::ostream & stream,
                             const DatasetFeatureSpace::ColumnInfo & columnInfo);
 
 
+/*****************************************************************************/
+/* DATASET FEATURE SPACE CACHE                                               */
+/*****************************************************************************/
+
+/** Cache of the column information of dataset feature spaces.  Building a
+    feature space scans the values of every one of its columns, which only
+    needs to be done once when several classifiers are trained over the
+    same dataset (for example, for each fold of an experiment).  The cached
+    information is read-only, and the cache may be used from several
+    threads at once.
+*/
+
+struct DatasetFeatureSpaceCache {
+
+    /** Return a feature space over the given columns of the dataset, with
+        the given label info.  The column information is computed by the
+        first call for the dataset and columns; later calls (including
+        concurrent ones, which wait for the first to finish) reuse it.
+    */
+    std::shared_ptr<DatasetFeatureSpace>
+    get(std::shared_ptr<Dataset> dataset,
+        ML::Feature_Info labelInfo,
+        const std::set<ColumnName> & includeColumns,
+        bool bucketize = false);
+
+private:
+    struct Entry {
+        std::mutex mutex;
+        std::shared_ptr<Dataset> dataset;  ///< Keeps the key alive
+        std::shared_ptr<const std::unordered_map<ColumnHash,
+                                                 DatasetFeatureSpace::ColumnInfo> >
+            columnInfo;
+    };
+
+    std::mutex mutex;
+    std::map<std::tuple<const Dataset *, std::set<ColumnName>, bool>,
+             std::shared_ptr<Entry> > entries;
+};
+
+
 } // namespace MLDB
 } // namespace Datacratic
 
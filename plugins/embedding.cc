@@ -9,6 +9,7 @@
 
 #include "embedding.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
+#include "hnsw_index.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -68,6 +69,23 @@ operator >> (ML::DB::Store_Reader & store, Path & coords)
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+EmbeddingIndexTypeDescription::
+EmbeddingIndexTypeDescription()
+{
+    addValue("vptree", EMBEDDING_INDEX_VPTREE,
+             "Vantage point tree.  This returns the exact nearest neighbors, "
+             "and is rebuilt from scratch on each commit.  It's a good choice "
+             "for embeddings with a small number of dimensions, like the output "
+             "of t-SNE, but becomes slow with more than about 50 dimensions.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Hierarchical navigable small world graph.  This returns "
+             "approximate nearest neighbors, and rows are added to the "
+             "existing index on each commit.  It remains fast for high "
+             "dimensional embeddings like word2vec or the SVD.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -81,6 +99,35 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Type of index used for nearest neighbors calculations.  "
+             "Options are 'vptree', which is exact, and 'hnsw', which is "
+             "approximate but much faster for high dimensional embeddings.",
+             EMBEDDING_INDEX_VPTREE);
+    addField("hnswNumNeighbors", &EmbeddingDatasetConfig::hnswNumNeighbors,
+             "Number of neighbors that each row is linked to in the 'hnsw' "
+             "index.  Higher values give better recall for a bigger index "
+             "that is slower to build.", 16);
+    addField("hnswEfConstruction", &EmbeddingDatasetConfig::hnswEfConstruction,
+             "Number of candidate neighbors considered when adding a row "
+             "to the 'hnsw' index.  Higher values give better recall for a "
+             "slower commit.", 100);
+    addField("hnswEfSearch", &EmbeddingDatasetConfig::hnswEfSearch,
+             "Number of candidate neighbors kept when searching the 'hnsw' "
+             "index (but at least the number of neighbors asked for).  Higher "
+             "values give better recall for slower queries.", 50);
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->hnswNumNeighbors < 2)
+                throw HttpReturnException
+                    (400, "hnswNumNeighbors must be at least 2 in embedding "
+                     "dataset config");
+            if (config->hnswEfConstruction < 1 || config->hnswEfSearch < 1)
+                throw HttpReturnException
+                    (400, "hnswEfConstruction and hnswEfSearch must be positive "
+                     "in embedding dataset config");
+        };
 }
 
 
@@ -89,31 +136,53 @@ EmbeddingDatasetConfigDescription()
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : config(config),
+          vpTree(new ML::VantagePointTreeT<int>()),
+          distance(DistanceMetric::create(config.metric))
     {
+        initIndex();
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnName> columnNames,
-                         MetricSpace metric)
-        : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
+                         const EmbeddingDatasetConfig & config)
+        : config(config),
+          columnNames(std::move(columnNames)), columns(this->columnNames.size()),
           vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          distance(DistanceMetric::create(config.metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
+        initIndex();
     }
 
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
-        : columnNames(other.columnNames),
+        : config(other.config),
+          columnNames(other.columnNames),
           columns(other.columns),
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          distance(DistanceMetric::create(config.metric))
+    {
+        // The distance metric caches information about each row, which
+        // needs to be there for the rows that are already recorded
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            distance->addRow(i, rows[i].coords);
+
+        // The graph index is copied, so that only the new rows need to be
+        // added to it on the next commit
+        if (other.hnsw)
+            hnsw.reset(new HnswIndex(*other.hnsw));
+    }
+
+    void initIndex()
     {
+        if (config.index == EMBEDDING_INDEX_HNSW)
+            hnsw.reset(new HnswIndex(config.hnswNumNeighbors,
+                                     config.hnswEfConstruction));
     }
 
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
@@ -176,6 +245,27 @@ struct EmbeddingDatasetRepr {
         return result;
     }
 
+    /** Distance from row1 to each of the given rows, calculated as a
+        batch so that the metric can vectorize over the rows.
+    */
+    void dist(unsigned row1, const int * rowNums, size_t numRows,
+              float * result) const
+    {
+        ExcAssertLess(row1, rows.size());
+
+        std::vector<const float *> coords(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            ExcAssertLess(rowNums[i], rows.size());
+            coords[i] = rows[rowNums[i]].coords.data();
+        }
+
+        distance->dist(row1, rows[row1].coords, rowNums, coords.data(),
+                       numRows, result);
+
+        for (size_t i = 0;  i < numRows;  ++i)
+            ExcAssert(isfinite(result[i]));
+    }
+
     float dist(unsigned row1, const ML::distribution<float> & row2) const
     {
         ExcAssertLess(row1, rows.size());
@@ -209,6 +299,8 @@ struct EmbeddingDatasetRepr {
         return { earliest, latest };
     }
     
+    EmbeddingDatasetConfig config;
+
     std::vector<ColumnName> columnNames;
     std::vector<std::vector<float> > columns;
     ML::Lightweight_Hash<ColumnHash, int> columnIndex;
@@ -217,8 +309,23 @@ struct EmbeddingDatasetRepr {
     ML::Lightweight_Hash<uint64_t, int> rowIndex;
     
     std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
+    std::unique_ptr<HnswIndex> hnsw;   ///< Only for the hnsw index type
     std::unique_ptr<DistanceMetric> distance;
 
+    /** Return the closest numNeighbors rows to the query, whose distance
+        to each row is given by dist, using the index.  The result is a
+        list of (distance, row number) pairs, closest first.
+    */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist,
+           int numNeighbors, double maxDistance) const
+    {
+        if (hnsw)
+            return hnsw->search(dist, numNeighbors, maxDistance,
+                                config.hnswEfSearch);
+        return vpTree->search(dist, numNeighbors, maxDistance);
+    }
+
     void save(const std::string & filename)
     {
         filter_ostream stream(filename);
@@ -246,21 +353,24 @@ EmbeddingDatasetRepr::
 serialize(ML::DB::Store_Writer & store) const
 {
     store << string("EMBEDDING_DATASET")
-          << ML::DB::compact_size_t(1);  // version
+          << ML::DB::compact_size_t(2);  // version
     store << columnNames << columns << rows;
-    vpTree->serialize(store);
+    store << ML::DB::compact_size_t(config.index);
+    if (hnsw)
+        hnsw->serialize(store);
+    else vpTree->serialize(store);
 }
 
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr)
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr)
     {
     }
 
     // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address)
+    Itl(const std::string & address, const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr), address(address)
     {
     }
 
@@ -269,7 +379,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -640,7 +750,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -748,7 +858,7 @@ struct EmbeddingDataset::Itl
                 
                 //cerr << "columnNames = " << columnNames << endl;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -843,12 +953,42 @@ struct EmbeddingDataset::Itl
 
         parallelMap(0, (*uncommitted).rows.size(), indexRow);
 
+        if ((*uncommitted).hnsw) {
+            // Add the rows recorded since the last commit to the graph
+            cerr << "adding " << (*uncommitted).rows.size() - (*uncommitted).hnsw->size()
+                 << " rows to HNSW index" << endl;
+            ML::Timer timer;
+
+            auto dist = [&] (int item1, int item2) -> float
+                {
+                    return (*uncommitted).dist(item1, item2);
+                };
+
+            (*uncommitted).hnsw->insert((*uncommitted).rows.size(), dist);
+
+            cerr << "HNSW index done in " << timer.elapsed() << endl;
+        }
+        else {
+            createVantagePointTree(*uncommitted);
+        }
+
+        committed.replace(uncommitted);
+        uncommitted = nullptr;
+
+        if (!address.empty()) {
+            cerr << "saving embedding" << endl;
+            committed()->save(address);
+        }
+    }
+
+    void createVantagePointTree(EmbeddingDatasetRepr & repr)
+    {
         // Create the vantage point tree
         cerr << "creating vantage point tree" << endl;
         ML::Timer timer;
         
         std::vector<int> items;
-        for (unsigned i = 0;  i < (*uncommitted).rows.size();  ++i) {
+        for (unsigned i = 0;  i < repr.rows.size();  ++i) {
             items.push_back(i);
         }
 
@@ -861,43 +1001,30 @@ struct EmbeddingDataset::Itl
 
                 ML::distribution<float> result(items.size());
 
-                auto doItem = [&] (int n)
+                auto doItems = [&] (size_t first, size_t last)
                 {
-                    int i = items[n];
-
-                    result[n] = (*uncommitted).dist(item, i);
-
-                    if (item == i)
-                        ExcAssertEqual(result[n], 0.0);
-
-                    if (!isfinite(result[n])) {
-                        cerr << "dist between " << i << " and " << item << " is "
-                             << result.back() << endl;
-                    }
-                    ExcAssert(isfinite(result[n]));
+                    repr.dist(item, items.data() + first, last - first,
+                              result.data() + first);
                 };
 
                 if (items.size() < 10000 || depth > 2) {
-                    for (unsigned n = 0;  n < items.size();  ++n)
-                        doItem(n);
+                    doItems(0, items.size());
+                }
+                else parallelMapChunked(0, items.size(), 1024, doItems);
+
+                // The distance of the item to itself is always zero
+                for (unsigned n = 0;  n < items.size();  ++n) {
+                    if (items[n] == item)
+                        ExcAssertEqual(result[n], 0.0);
                 }
-                else parallelMap(0, items.size(), doItem);
                 
                 return result;
             };
         
         // Create the VP tree for indexed lookups on distance
-        (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
+        repr.vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
 
         cerr << "VP tree done in " << timer.elapsed() << endl;
-        
-        committed.replace(uncommitted);
-        uncommitted = nullptr;
-
-        if (!address.empty()) {
-            cerr << "saving embedding" << endl;
-            committed()->save(address);
-        }
     }
 
     vector<tuple<RowName, RowHash, float> >
@@ -918,7 +1045,7 @@ struct EmbeddingDataset::Itl
 
         //ML::Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance);
 
         //cerr << "neighbors took " << timer.elapsed() << endl;
 
@@ -958,7 +1085,7 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance);
 
         vector<tuple<RowName, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -993,7 +1120,7 @@ EmbeddingDataset(MldbServer * owner,
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
 #if 1
-    itl.reset(new Itl(datasetConfig.metric));
+    itl.reset(new Itl(datasetConfig));
 #else // once persistence is done
 
     if (!config.address.empty()) {
@@ -1263,7 +1390,27 @@ applyT(const ApplierT & applier_, NearestNeighborsInput input) const
     return {ExpressionValue(std::move(neighborsOut), ts),
             ExpressionValue(std::move(distances))};
 }
-    
+
+std::vector<ExpressionValue>
+NearestNeighborsFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    // Each lookup only reads the committed index, so they can run at the
+    // same time
+    const Function & function = *this;
+    std::vector<ExpressionValue> result(inputs.size());
+
+    auto doInput = [&] (size_t i)
+        {
+            result[i] = function.apply(applier, inputs[i]);
+        };
+
+    parallelMap(0, inputs.size(), doInput);
+
+    return result;
+}
+
 std::unique_ptr<FunctionApplierT<NearestNeighborsInput, NearestNeighborsOutput> >
 NearestNeighborsFunction::
 bindT(SqlBindingScope & outerContext, const std::shared_ptr<RowValueInfo> & input) const
@@ -22,13 +22,25 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+enum EmbeddingIndexType {
+    EMBEDDING_INDEX_VPTREE,   ///< Exact vantage point tree
+    EMBEDDING_INDEX_HNSW      ///< Approximate navigable small world graph
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), index(EMBEDDING_INDEX_VPTREE),
+          hnswNumNeighbors(16), hnswEfConstruction(100), hnswEfSearch(50)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndexType index;
+    int hnswNumNeighbors;
+    int hnswEfConstruction;
+    int hnswEfSearch;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
@@ -136,7 +148,12 @@ struct NearestNeighborsFunction
 
     virtual NearestNeighborsOutput
     applyT(const ApplierT & applier, NearestNeighborsInput input) const override;
-    
+
+    /** Look up the neighbours of each input of the batch in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override;
+
     virtual std::unique_ptr<ApplierT>
     bindT(SqlBindingScope & outerContext,
           const std::shared_ptr<RowValueInfo> & input) const override;
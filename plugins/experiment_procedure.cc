@@ -21,6 +21,10 @@
 #include "mldb/plugins/sql_config_validator.h"
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/plugins/dataset_feature_space.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include <mutex>
 
 using namespace std;
 
@@ -179,6 +183,18 @@ ExperimentProcedureConfigDescription()
               "test set is very large and aggregate statistics for each unique score is "
               "sufficient, for instance to generate a ROC curve. This has no effect "
               "for other values of `mode`.", false);
+    addField("maxConcurrentFolds", &ExperimentProcedureConfig::maxConcurrentFolds,
+             "Maximum number of folds that are trained and tested at the same "
+             "time.  The default of 1 runs the folds one after the other, as "
+             "each fold that is running holds a copy of its training data; "
+             "0 runs up to one fold per CPU.", 1);
+    addField("memoryBudget", &ExperimentProcedureConfig::memoryBudget,
+             "Approximate amount of memory, in bytes, that the folds running "
+             "at the same time may use.  The memory needed by a fold is "
+             "estimated from the number of rows and columns of the input "
+             "dataset, and fewer folds are run at once if needed to stay "
+             "within the budget (but always at least one).  The default of "
+             "0 means no limit.", (uint64_t)0);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&ExperimentProcedureConfig::inputData,
@@ -296,23 +312,8 @@ run(const ProcedureRunConfig & run,
 
     auto runProcConf = applyRunConfOverProcConf(procConfig, run);
 
-    std::atomic<int> progress(0);
-
-
-    auto onProgress2 = [&] (const Json::Value & details)
-        {
-            Json::Value value;
-            value["foldNumber"] = (int)progress;
-            value["details"] = details;
-            return onProgress(value);
-        };
-
     vector<string> resourcesToDelete;
 
-    std::shared_ptr<Procedure> clsProcedure;
-    std::shared_ptr<Procedure> accuracyProc;
-
-
     Json::Value test_eval_results(Json::ValueType::arrayValue);
 
     if(!runProcConf.inputData.stm) {
@@ -363,85 +364,233 @@ run(const ProcedureRunConfig & run,
 
     ExcAssertGreater(runProcConf.datasetFolds.size(), 0);
 
-    for(auto & datasetFold : runProcConf.datasetFolds) {
-        /***
-         * TRAIN
-         * **/
-        ClassifierConfig clsProcConf;
-        clsProcConf.trainingData = runProcConf.inputData;
-        clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
-        clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
-        clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
-        clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
-
-        string baseUrl = runProcConf.modelFileUrlPattern.toString();
-        ML::replace_all(baseUrl, "$runid",
-                        ML::format("%s-%d", runProcConf.experimentName, (int)progress));
-        clsProcConf.modelFileUrl = Url(baseUrl);
-        clsProcConf.configuration = runProcConf.configuration;
-        clsProcConf.configurationFile = runProcConf.configurationFile;
-        clsProcConf.algorithm = runProcConf.algorithm;
-        clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
-        clsProcConf.mode = runProcConf.mode;
-
-
-        clsProcConf.functionName = ML::format("%s_scorer_%d", runProcConf.experimentName, (int)progress);
-
-        if(progress == 0) {
-            PolyConfig clsProcPC;
-            clsProcPC.id = runProcConf.experimentName + "_trainer";
-            clsProcPC.type = "classifier.train";
-            clsProcPC.params = jsonEncode(clsProcConf);
-
-            cerr << " >>>>> Creating training procedure" << endl;
-            clsProcedure = createProcedure(server, clsProcPC, onProgress2, true);
-            resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
-        }
+    size_t numFolds = runProcConf.datasetFolds.size();
+
+    // The folds run concurrently, so progress is reported under a lock.
+    // Each report is for one fold, and includes the phase that each of
+    // the folds is in.
+    std::mutex progressMutex;
+    Json::Value foldPhases(Json::arrayValue);
+    for (size_t i = 0;  i < numFolds;  ++i)
+        foldPhases.append("pending");
+
+    auto setPhase = [&] (int foldNumber, const std::string & phase)
+        {
+            std::unique_lock<std::mutex> guard(progressMutex);
+            foldPhases[foldNumber] = phase;
+        };
+
+    auto getFoldProgress = [&] (int foldNumber)
+        -> std::function<bool (const Json::Value &)>
+        {
+            return [&, foldNumber] (const Json::Value & details)
+            {
+                std::unique_lock<std::mutex> guard(progressMutex);
+                Json::Value value;
+                value["foldNumber"] = foldNumber;
+                value["details"] = details;
+                value["folds"] = foldPhases;
+                return onProgress(value);
+            };
+        };
+
+    auto getClassifierConfig = [&] (int foldNumber)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            ClassifierConfig clsProcConf;
+            clsProcConf.trainingData = runProcConf.inputData;
+            clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
+            clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
+            clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
+            clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
+
+            string baseUrl = runProcConf.modelFileUrlPattern.toString();
+            ML::replace_all(baseUrl, "$runid",
+                            ML::format("%s-%d", runProcConf.experimentName, foldNumber));
+            clsProcConf.modelFileUrl = Url(baseUrl);
+            clsProcConf.configuration = runProcConf.configuration;
+            clsProcConf.configurationFile = runProcConf.configurationFile;
+            clsProcConf.algorithm = runProcConf.algorithm;
+            clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
+            clsProcConf.mode = runProcConf.mode;
+            clsProcConf.functionName = ML::format("%s_scorer_%d", runProcConf.experimentName, foldNumber);
+
+            return clsProcConf;
+        };
+
+    auto getAccuracyConfig = [&] (int foldNumber, bool onTestSet)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            // create config for the accuracy procedure
+            AccuracyConfig accuracyConfig;
+            accuracyConfig.mode = runProcConf.mode;
+            accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
+
+            if(runProcConf.outputAccuracyDataset && onTestSet) {
+                PolyConfigT<Dataset> outputPC;
+                outputPC.id = ML::format("%s_results_%d", runProcConf.experimentName,
+                                                          foldNumber);
+                outputPC.type = "tabular";
+
+                {
+                    InProcessRestConnection connection;
+                    RestRequest request("DELETE", "/v1/datasets/"+outputPC.id.utf8String(),
+                                        RestParams(), "{}");
+                    server->handleRequest(connection, request);
+
+                    if(connection.responseCode != 204) {
+                        throw ML::Exception("HTTP error "+std::to_string(connection.responseCode)+
+                            " when trying to DELETE dataset '"+outputPC.id.utf8String()+"'");
+                    }
+                }
+                accuracyConfig.outputDataset.emplace(outputPC);
+            }
+
+            if(onTestSet) {
+                accuracyConfig.testingData =
+                    runProcConf.testingDataOverride ? *runProcConf.testingDataOverride
+                                                    : runProcConf.inputData;
+                accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
+                accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
+                accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
+                accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
+            }
+            else {
+                accuracyConfig.testingData = runProcConf.inputData;
+                accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
+                accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
+                accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
+                accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
+            }
+
+            return accuracyConfig;
+        };
+
+    /***
+     * create the training and testing procedures, which are shared by all
+     * of the folds.  Each fold runs them with its own configuration.
+     * **/
+    std::shared_ptr<Procedure> clsProcedure;
+    std::shared_ptr<Procedure> accuracyProc;
+
+    {
+        PolyConfig clsProcPC;
+        clsProcPC.id = runProcConf.experimentName + "_trainer";
+        clsProcPC.type = "classifier.train";
+        clsProcPC.params = jsonEncode(getClassifierConfig(0));
+
+        cerr << " >>>>> Creating training procedure" << endl;
+        clsProcedure = createProcedure(server, clsProcPC, getFoldProgress(0), true);
+        resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
 
         if(!clsProcedure) {
             throw ML::Exception("Was unable to create classifier.train procedure");
         }
 
-        // create run configuration
-        ProcedureRunConfig clsProcRunConf;
-        clsProcRunConf.id = "run_"+to_string(progress);
-        clsProcRunConf.params = jsonEncode(clsProcConf);
-        Date trainStart = Date::now();
-        RunOutput output = clsProcedure->run(clsProcRunConf, onProgress2);
-        Date trainFinish = Date::now();
+        // The configuration for the training set has no output dataset,
+        // which would otherwise be inherited by runs that don't set one
+        PolyConfig accuracyProcPC;
+        accuracyProcPC.id = runProcConf.experimentName + "_scorer";
+        accuracyProcPC.type = "classifier.test";
+        accuracyProcPC.params = getAccuracyConfig(0, false /* onTestSet */);
+
+        cerr << " >>>>> Creating testing procedure" << endl;
+        accuracyProc = createProcedure(server, accuracyProcPC, getFoldProgress(0), true);
+        resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
+
+        if(!accuracyProc)
+            throw ML::Exception("Was unable to create accuracy procedure");
+
+        // scoring functions are created during the training so only add
+        // them to the cleanup list
+        for (size_t i = 0;  i < numFolds;  ++i) {
+            resourcesToDelete.push_back("/v1/functions/"
+                                        + getClassifierConfig(i).functionName.utf8String());
+        }
+    }
 
+    // The column information of the feature space is the same for all of
+    // the folds, so it's only extracted once
+    DatasetFeatureSpaceCache featureSpaceCache;
+    auto classifierProcedure
+        = std::dynamic_pointer_cast<ClassifierProcedure>(clsProcedure);
 
-        /***
-         * scoring function
-         * created during the training so only add it to the cleanup list
-         * **/
+    // setup score expression
+    string scoreExpr;
+    if     (runProcConf.mode == CM_BOOLEAN ||
+            runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
+    else if(runProcConf.mode == CM_CATEGORICAL) scoreExpr = "\"%s\"({%s})[scores] as score";
+    else throw ML::Exception("Classifier mode %d not implemented", runProcConf.mode);
 
-        resourcesToDelete.push_back("/v1/functions/" + clsProcConf.functionName.utf8String());
+    /***
+     * work out how many folds to run at once
+     * **/
+    int maxConcurrentFolds = runProcConf.maxConcurrentFolds > 0
+        ? runProcConf.maxConcurrentFolds : numCpus();
+
+    if (runProcConf.memoryBudget > 0) {
+        SqlExpressionMldbScope context(server);
+        auto dataset = runProcConf.inputData.stm->from->bind(context).dataset;
+        if (dataset) {
+            auto matrix = dataset->getMatrixView();
+
+            // A fold holds its training rows as feature sets, with a 16 byte
+            // (feature, value) pair per column plus the label and weight.
+            // This is an upper bound, as each fold only trains on some of the
+            // rows and the features may not use every column.
+            uint64_t foldMemory = (uint64_t)matrix->getRowCount()
+                * (matrix->getColumnCount() + 2) * 16;
+
+            if (foldMemory > 0) {
+                maxConcurrentFolds
+                    = std::min<uint64_t>(maxConcurrentFolds,
+                                         std::max<uint64_t>(1, runProcConf.memoryBudget / foldMemory));
+            }
+        }
+    }
 
-        /***
-         * accuracy
-         * **/
-        auto createAccuracyProcedure = [&] (AccuracyConfig & accuracyConf)
-        {
-            PolyConfig accuracyProcPC;
-            accuracyProcPC.id = runProcConf.experimentName + "_scorer";
-            accuracyProcPC.type = "classifier.test";
-            accuracyProcPC.params = accuracyConf;
+    /***
+     * run the folds
+     * **/
+    struct FoldResult {
+        Json::Value foldRez;
+        Json::Value duration;
+    };
 
-            cerr << " >>>>> Creating testing procedure" << endl;
-            accuracyProc = createProcedure(server, accuracyProcPC, onProgress2, true);
+    std::vector<FoldResult> foldResults(numFolds);
 
-            resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
-        };
+    auto doFold = [&] (int foldNumber)
+    {
+        const DatasetFoldConfig & datasetFold
+            = runProcConf.datasetFolds[foldNumber];
+
+        auto onFoldProgress = getFoldProgress(foldNumber);
+
+        /***
+         * TRAIN
+         * **/
+        setPhase(foldNumber, "training");
 
+        ClassifierConfig clsProcConf = getClassifierConfig(foldNumber);
 
-        // setup score expression
-        string scoreExpr;
-        if     (runProcConf.mode == CM_BOOLEAN ||
-                runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
-        else if(runProcConf.mode == CM_CATEGORICAL) scoreExpr = "\"%s\"({%s})[scores] as score";
-        else throw ML::Exception("Classifier mode %d not implemented", runProcConf.mode);
+        // create run configuration
+        ProcedureRunConfig clsProcRunConf;
+        clsProcRunConf.id = "run_"+to_string(foldNumber);
+        clsProcRunConf.params = jsonEncode(clsProcConf);
+        Date trainStart = Date::now();
+        RunOutput output = classifierProcedure
+            ? classifierProcedure->run(clsProcRunConf, onFoldProgress,
+                                       &featureSpaceCache)
+            : clsProcedure->run(clsProcRunConf, onFoldProgress);
+        Date trainFinish = Date::now();
 
+        /***
+         * accuracy
+         * **/
 
         // this lambda actually runs the accuracy procedure for the given config
         auto runAccuracyFor = [&] (AccuracyConfig & accuracyConf)
@@ -460,14 +609,11 @@ run(const ProcedureRunConfig & run,
 
             ML::Timer timer;
 
-            if(!accuracyProc)
-                throw ML::Exception("Was unable to create accuracy procedure");
-
             ProcedureRunConfig accuracyProcRunConf;
-            accuracyProcRunConf.id = "run_"+to_string(progress);
+            accuracyProcRunConf.id = "run_"+to_string(foldNumber);
             accuracyProcRunConf.params = jsonEncode(accuracyConf);
             Date testStart = Date::now();
-            RunOutput accuracyOutput = accuracyProc->run(accuracyProcRunConf, onProgress2);
+            RunOutput accuracyOutput = accuracyProc->run(accuracyProcRunConf, onFoldProgress);
             Date testFinish = Date::now();
 
             cerr << "accuracy took " << timer.elapsed() << endl;
@@ -476,59 +622,9 @@ run(const ProcedureRunConfig & run,
                               testFinish.secondsSinceEpoch() - testStart.secondsSinceEpoch());
         };
 
+        setPhase(foldNumber, "testing");
 
-        auto getAccuracyConfig = [&] (bool onTestSet)
-            {
-                // create config for the accuracy procedure
-                AccuracyConfig accuracyConfig;
-                accuracyConfig.mode = runProcConf.mode;
-                accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
-
-                if(runProcConf.outputAccuracyDataset && onTestSet) {
-                    PolyConfigT<Dataset> outputPC;
-                    outputPC.id = ML::format("%s_results_%d", runProcConf.experimentName, 
-                                                              (int)progress);
-                    outputPC.type = "tabular";
-
-                    {
-                        InProcessRestConnection connection;
-                        RestRequest request("DELETE", "/v1/datasets/"+outputPC.id.utf8String(),
-                                            RestParams(), "{}");
-                        server->handleRequest(connection, request);
-
-                        if(connection.responseCode != 204) {
-                            throw ML::Exception("HTTP error "+std::to_string(connection.responseCode)+
-                                " when trying to DELETE dataset '"+outputPC.id.utf8String()+"'");
-                        }
-                    }
-                    accuracyConfig.outputDataset.emplace(outputPC);
-                }
-
-                if(onTestSet) {
-                    accuracyConfig.testingData =
-                        runProcConf.testingDataOverride ? *runProcConf.testingDataOverride
-                                                        : runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
-                }
-                else {
-                    accuracyConfig.testingData = runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
-                }
-
-                return accuracyConfig;
-            };
-
-        auto accuracyConfig = getAccuracyConfig(true);
-
-        // create empty testing procedure
-        if(progress == 0)
-            createAccuracyProcedure(accuracyConfig);
+        auto accuracyConfig = getAccuracyConfig(foldNumber, true /* onTestSet */);
 
         // run evaluation on testing
         auto accuracyOutput = runAccuracyFor(accuracyConfig);
@@ -536,8 +632,7 @@ run(const ProcedureRunConfig & run,
         // run evaluation on training
         std::tuple<RunOutput, double> accuracyOutputTrain;
         if(runProcConf.evalTrain) {
-            auto accuracyTrainingConf = getAccuracyConfig(false);
-            createAccuracyProcedure(accuracyTrainingConf);
+            auto accuracyTrainingConf = getAccuracyConfig(foldNumber, false /* onTestSet */);
             accuracyOutputTrain = runAccuracyFor(accuracyTrainingConf);
         }
 
@@ -545,7 +640,6 @@ run(const ProcedureRunConfig & run,
         duration["train"] = trainFinish.secondsSinceEpoch() - trainStart.secondsSinceEpoch();
         duration["test"] = get<1>(accuracyOutput) + (runProcConf.evalTrain ? get<1>(accuracyOutputTrain)
                                                                            : 0);
-        durationStatsGen.accumStats(duration, "");
 
         // Add results
         Json::Value foldRez;
@@ -557,16 +651,27 @@ run(const ProcedureRunConfig & run,
 
         foldRez["resultsTest"] = jsonEncode(get<0>(accuracyOutput).results);
         foldRez["durationSecs"] = duration;
-        statsGen.accumStats(foldRez["resultsTest"], "");
 
         if(runProcConf.evalTrain) {
             foldRez["resultsTrain"] = jsonEncode(get<0>(accuracyOutputTrain).results);
-            statsGenTrain.accumStats(foldRez["resultsTrain"], "");
         }
 
-        test_eval_results.append(foldRez);
+        foldResults[foldNumber].foldRez = std::move(foldRez);
+        foldResults[foldNumber].duration = std::move(duration);
+
+        setPhase(foldNumber, "finished");
+    };
+
+    parallelMap(0, numFolds, doFold, maxConcurrentFolds);
 
-        progress ++;
+    // Statistics are accumulated in fold order, so that they don't depend
+    // upon the order in which the folds finished
+    for (auto & result: foldResults) {
+        durationStatsGen.accumStats(result.duration, "");
+        statsGen.accumStats(result.foldRez["resultsTest"], "");
+        if(runProcConf.evalTrain)
+            statsGenTrain.accumStats(result.foldRez["resultsTrain"], "");
+        test_eval_results.append(result.foldRez);
     }
 
     /***
@@ -72,7 +72,9 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
           mode(CM_BOOLEAN),
           outputAccuracyDataset(true),
           uniqueScoresOnly(false),
-          evalTrain(false)
+          evalTrain(false),
+          maxConcurrentFolds(1),
+          memoryBudget(0)
     {
     }
 
@@ -111,6 +113,13 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
     bool outputAccuracyDataset;
     bool uniqueScoresOnly;
     bool evalTrain;
+
+    /// Maximum number of folds to run at once; 0 means one per CPU
+    int maxConcurrentFolds;
+
+    /// Memory in bytes that the folds running at once may use; 0 means
+    /// no limit
+    uint64_t memoryBudget;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExperimentProcedureConfig);
@@ -9,160 +9,471 @@
 #include <atomic>
 #include <exception>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <vector>
 #include "for_each_line.h"
-#include "mldb/arch/threads.h"
-#include <chrono>
 #include <thread>
 #include <cstring>
-#include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/vfs/filter_streams.h"
-#include "mldb/base/thread_pool.h"
-#include "mldb/base/exc_assert.h"
-#include "mldb/types/date.h"
 
 
 using namespace std;
-using namespace ML;
 
 
+namespace Datacratic {
+
 namespace {
 
-struct Processing {
+/// Size of the blocks of the file that are handed to each worker thread
+static constexpr size_t BLOCK_SIZE = 4000000;
+
+/// Size of each read from the stream
+static constexpr size_t READ_SIZE = 200000;
+
+
+/*****************************************************************************/
+/* LINE SCANNER                                                              */
+/*****************************************************************************/
 
-    Processing()
-        : shutdown(false), hasException_(false),
-          excPtr(nullptr), decompressedLines(16000)
+/** Finds the ends of lines.  If a quote character is given, newlines
+    within quoted CSV fields (which start with the quote character just
+    after a separator or at the beginning of a line) don't end a line,
+    following the rules used by the CSV parser.
+*/
+
+struct LineScanner {
+    LineScanner(char quoteChar, char separatorChar)
+        : quoteChar(quoteChar), separatorChar(separatorChar)
     {
     }
 
-    void takeLastException()
+    char quoteChar;
+    char separatorChar;
+
+    /** Return a pointer to the newline at the end of the line starting at
+        p, or nullptr if there is no end of line before end.
+    */
+    const char * findLineEnd(const char * p, const char * end) const
     {
-        std::lock_guard<std::mutex> guard(excPtrLock);
-        excPtr = std::current_exception();
-        hasException_ = true;
+        if (!quoteChar)
+            return (const char *)memchr(p, '\n', end - p);
+
+        enum { FIELD_START, UNQUOTED, QUOTED, QUOTE_SEEN } state = FIELD_START;
+
+        for (; p < end;  ++p) {
+            char c = *p;
+            switch (state) {
+            case QUOTED:
+                if (c == quoteChar)
+                    state = QUOTE_SEEN;
+                continue;
+            case QUOTE_SEEN:
+                // Either a doubled quote or the end of the field
+                if (c == quoteChar) {
+                    state = QUOTED;
+                    continue;
+                }
+                break;
+            case FIELD_START:
+                if (c == quoteChar) {
+                    state = QUOTED;
+                    continue;
+                }
+                break;
+            case UNQUOTED:
+                break;
+            }
+
+            if (c == '\n')
+                return p;
+            state = (c == separatorChar ? FIELD_START : UNQUOTED);
+        }
+
+        return nullptr;
     }
 
-    bool hasException()
+    /** Return a pointer just past the last end of line in the range, which
+        must start at the beginning of a line, or nullptr if the range
+        contains no end of line.
+    */
+    const char * findLastLineEnd(const char * start, const char * end) const
     {
-        return hasException_;
+        if (!quoteChar) {
+            const char * p = (const char *)memrchr(start, '\n', end - start);
+            return p ? p + 1 : nullptr;
+        }
+
+        // The quoting state depends upon everything before, so we need to
+        // scan forwards
+        const char * result = nullptr;
+        for (const char * p = start;  (p = findLineEnd(p, end));  ) {
+            result = ++p;
+        }
+        return result;
     }
+};
 
-    atomic<bool> shutdown;
-    atomic<bool> hasException_;
-    std::mutex excPtrLock;
-    std::exception_ptr excPtr;
 
-    RingBufferSWMR<pair<int64_t, vector<string> > > decompressedLines;
+/*****************************************************************************/
+/* LINE BLOCK PROCESSOR                                                      */
+/*****************************************************************************/
+
+/** A block of the input, which starts at the beginning of a line and
+    ends just after the end of a line (or at the end of the input).
+*/
+
+struct LineBlock {
+    int64_t blockNumber;
+    std::shared_ptr<const char> storage;  ///< Null if memory mapped
+    const char * start;
+    const char * end;
+    bool lastBlock;
+
+    /// Number of the first line in the block, once the previous one is split
+    std::shared_future<int64_t> startLine;
+
+    /// Set to the number of the first line of the next block
+    std::promise<int64_t> endLine;
 };
 
-}
+/** Reads the input into blocks in the calling thread, and splits them into
+    lines and processes them in worker threads.  The only copying is from
+    the stream into the blocks; memory mapped input isn't copied at all.
 
-namespace Datacratic {
+    Each worker splits its own block into lines, then waits for the
+    previous block to have been split so that it knows the number of its
+    first line.  Blocks are taken by the workers in order, so the previous
+    block is always being worked on.
+*/
 
+struct LineBlockProcessor {
+
+    typedef std::function<bool (const char * line, size_t lineLength,
+                                int64_t blockNumber, int64_t lineNumber)>
+        OnLine;
+    typedef std::function<bool (int64_t blockNumber, int64_t lineNumber)>
+        OnBlock;
+
+    LineBlockProcessor(const OnLine & onLine,
+                       const OnBlock & startBlock,
+                       const OnBlock & endBlock,
+                       int64_t maxLines,
+                       int numThreads,
+                       const LineScanner & scanner)
+        : onLine(onLine), startBlock(startBlock), endBlock(endBlock),
+          maxLines(maxLines), numThreads(std::max(numThreads, 1)),
+          scanner(scanner), includeFinalEmptyLine(false),
+          stripCarriageReturns(true), ignoreStreamExceptions(false),
+          numBlocks(0), finished(false), stop(false), hasExc(false)
+    {
+        std::promise<int64_t> first;
+        first.set_value(0);
+        nextStartLine = first.get_future().share();
+    }
 
-/*****************************************************************************/
-/* PARALLEL LINE PROCESSOR                                                   */
-/*****************************************************************************/
+    const OnLine & onLine;
+    const OnBlock & startBlock;
+    const OnBlock & endBlock;
+    int64_t maxLines;
+    int numThreads;
+    LineScanner scanner;
 
-static size_t
-readStream(std::istream & stream,
-           Processing & processing,
-           bool ignoreStreamExceptions,
-           int64_t maxLines)
-{
-    Date start = Date::now();
+    /// Does input that ends with a newline have an empty line at the end?
+    bool includeFinalEmptyLine;
 
-    pair<int64_t, vector<string> > current;
-    current.second.reserve(1000);
+    /// Remove the \r from DOS line endings?
+    bool stripCarriageReturns;
 
-    Date lastCheck = start;
+    /// Stop reading (but process what we already have) on stream errors?
+    bool ignoreStreamExceptions;
 
-    int64_t done = current.first = 0;  // 32 bit not enough
+    int64_t numBlocks;
+    std::shared_future<int64_t> nextStartLine;
 
-    try {
-        while (stream && !stream.eof() && (maxLines == -1 || done < maxLines)) {
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<std::shared_ptr<LineBlock> > queue;
+    bool finished;
 
-            if (processing.hasException()) {
-                break;
-            }
-            string line;
-            getline(stream, line);
-            current.second.emplace_back(std::move(line));
-
-            ++done;
-
-            if (current.second.size() == 1000) {
-                processing.decompressedLines.push(std::move(current));
-                current.first = done;
-                current.second.clear();
-                //current.clear();
-                ExcAssertEqual(current.second.size(), 0);
-                current.second.reserve(1000);
-            }
+    /// Set when no more blocks need to be read
+    std::atomic<bool> stop;
 
-            if (done % 1000000 == 0) {
+    std::atomic<bool> hasExc;
+    std::exception_ptr excPtr;
 
-                //cerr << "done " << done << " lines" << endl;
-                Date now = Date::now();
+    void takeException()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!hasExc) {
+            excPtr = std::current_exception();
+            hasExc = true;
+        }
+        stop = true;
+    }
 
-                double elapsed = now.secondsSince(start);
-                double instElapsed = now.secondsSince(lastCheck);
-                cerr << ML::format("doing %.3fMlines/second total, %.3f instantaneous",
-                                   done / elapsed / 1000000.0,
-                                   1000000 / instElapsed / 1000000.0)
-                     << endl;
-                lastCheck = now;
+    /** Process the whole stream.  Returns the number of lines processed. */
+    int64_t run(std::istream & stream)
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0;  i < numThreads;  ++i)
+            threads.emplace_back([&] () { this->runWorker(); });
+
+        try {
+            const char * mapped = nullptr;
+            size_t mappedSize = 0;
+
+            filter_istream * fistream = dynamic_cast<filter_istream *>(&stream);
+            if (fistream) {
+                // Can we get a memory mapped version of our stream?  It
+                // saves us having to copy data.  mapped will be set to
+                // nullptr if it's not possible to memory map this stream.
+                std::tie(mapped, mappedSize) = fistream->mapped();
             }
+
+            std::streamoff pos = mapped ? (std::streamoff)stream.tellg() : -1;
+            if (pos >= 0 && (size_t)pos <= mappedSize)
+                readMapped(mapped + pos, mapped + mappedSize);
+            else readStream(stream);
+        } catch (...) {
+            takeException();
         }
-    } catch (const std::exception & exc) {
-        if (!ignoreStreamExceptions) {
-            processing.takeLastException();
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            finished = true;
         }
-        else {
-            cerr << "stream threw ignored exception: " << exc.what() << endl;
+        queueChanged.notify_all();
+
+        for (auto & t: threads)
+            t.join();
+
+        if (hasExc)
+            std::rethrow_exception(excPtr);
+
+        int64_t numLines = nextStartLine.get();
+        if (maxLines != -1)
+            numLines = std::min(numLines, maxLines);
+        return numLines;
+    }
+
+    /** Add a block to be processed, waiting until there is space in the
+        queue.
+    */
+    void addBlock(std::shared_ptr<const char> storage,
+                  const char * start, const char * end, bool lastBlock)
+    {
+        auto block = std::make_shared<LineBlock>();
+        block->blockNumber = numBlocks++;
+        block->storage = std::move(storage);
+        block->start = start;
+        block->end = end;
+        block->lastBlock = lastBlock;
+        block->startLine = nextStartLine;
+        nextStartLine = block->endLine.get_future().share();
+
+        std::unique_lock<std::mutex> guard(mutex);
+        queueChanged.wait(guard, [&] () { return queue.size() < (size_t)numThreads; });
+        queue.emplace_back(std::move(block));
+        queueChanged.notify_all();
+    }
+
+    void readMapped(const char * current, const char * end)
+    {
+        while (!stop) {
+            if ((size_t)(end - current) <= BLOCK_SIZE) {
+                addBlock(nullptr, current, end, true /* last */);
+                return;
+            }
+
+            const char * blockEnd
+                = scanner.findLastLineEnd(current, current + BLOCK_SIZE);
+            if (!blockEnd) {
+                // Line is longer than a block
+                blockEnd = scanner.findLineEnd(current, end);
+                if (!blockEnd) {
+                    addBlock(nullptr, current, end, true /* last */);
+                    return;
+                }
+                ++blockEnd;
+            }
+
+            addBlock(nullptr, current, blockEnd, false /* last */);
+            current = blockEnd;
         }
     }
 
-    if (!current.second.empty() && !processing.hasException()) {
-        processing.decompressedLines.push(std::move(current));
+    void readStream(std::istream & stream)
+    {
+        // Partial line at the end of the last block, which is copied to
+        // the start of the next one
+        std::shared_ptr<char> carry;
+        const char * carryStart = nullptr;
+        size_t carryLength = 0;
+
+        auto newBuffer = [] (size_t size)
+            {
+                return std::shared_ptr<char>(new char[size],
+                                             [] (char * c) { delete[] c; });
+            };
+
+        bool eof = false;
+
+        while (!stop) {
+            size_t capacity = BLOCK_SIZE + carryLength;
+            std::shared_ptr<char> buffer = newBuffer(capacity);
+            std::copy(carryStart, carryStart + carryLength, buffer.get());
+            size_t used = carryLength;
+            const char * cut = nullptr;
+
+            while (!eof) {
+                try {
+                    while (used < capacity && stream) {
+                        stream.read(buffer.get() + used,
+                                    std::min(READ_SIZE, capacity - used));
+                        used += stream.gcount();
+                    }
+                    eof = !stream;
+                } catch (const std::exception & exc) {
+                    if (!ignoreStreamExceptions)
+                        throw;
+                    cerr << "stream threw ignored exception: " << exc.what()
+                         << endl;
+                    eof = true;
+                }
+
+                if (eof)
+                    break;
+
+                cut = scanner.findLastLineEnd(buffer.get(),
+                                              buffer.get() + used);
+                if (cut)
+                    break;
+
+                // A single line is bigger than the buffer; make it bigger
+                std::shared_ptr<char> bigger = newBuffer(capacity * 2);
+                std::copy(buffer.get(), buffer.get() + used, bigger.get());
+                buffer = std::move(bigger);
+                capacity *= 2;
+            }
+
+            if (eof) {
+                addBlock(buffer, buffer.get(), buffer.get() + used,
+                         true /* last */);
+                return;
+            }
+
+            addBlock(buffer, buffer.get(), cut, false /* last */);
+
+            carry = std::move(buffer);
+            carryStart = cut;
+            carryLength = carry.get() + used - cut;
+        }
     }
 
-    return done;
-};
+    void runWorker()
+    {
+        // Reused between blocks to avoid allocation
+        std::vector<const char *> lineEnds;
+
+        for (;;) {
+            std::shared_ptr<LineBlock> block;
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                queueChanged.wait(guard, [&] () { return finished || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                block = std::move(queue.front());
+                queue.pop_front();
+            }
+            queueChanged.notify_all();
 
-static void
-parseLinesThreadStr(Processing & processing,
-                    const std::function<void (const std::string &,
-                                              int64_t lineNum)> & processLine)
-{
-    while (!processing.hasException()) {
-        std::pair<int64_t, vector<string> > lines;
-        if (!processing.decompressedLines.tryPop(lines)) {
-            if (processing.shutdown) {
-                break;
+            processBlock(*block, lineEnds);
+        }
+    }
+
+    void processBlock(LineBlock & block, std::vector<const char *> & lineEnds)
+    {
+        lineEnds.clear();
+
+        try {
+            if (!hasExc) {
+                const char * p = block.start;
+                while (p < block.end) {
+                    const char * e = scanner.findLineEnd(p, block.end);
+                    if (!e) {
+                        // Last line has no newline
+                        lineEnds.push_back(block.end);
+                        break;
+                    }
+                    lineEnds.push_back(e);
+                    p = e + 1;
+                }
+                if (p == block.end && block.lastBlock && includeFinalEmptyLine)
+                    lineEnds.push_back(block.end);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            continue;
+        } catch (...) {
+            lineEnds.clear();
+            takeException();
         }
-            
-        for (unsigned i = 0;  i < lines.second.size();  ++i) {
-            if (processing.hasException()) {
-                break;
+
+        // Wait for the previous block to tell us where we start, and tell
+        // the next one where it starts.  This must always happen, even
+        // after an exception, so that the chain isn't broken.
+        int64_t startLine = block.startLine.get();
+        int64_t numLines = lineEnds.size();
+        block.endLine.set_value(startLine + numLines);
+
+        if (hasExc)
+            return;
+
+        if (maxLines != -1) {
+            if (startLine + numLines >= maxLines) {
+                // The reader has read everything we need
+                stop = true;
+                numLines = std::max<int64_t>(0, maxLines - startLine);
+                if (numLines == 0)
+                    return;
             }
-            const string & line = lines.second[i];
-            try {
-                processLine(line, lines.first + i);
-            } catch (const std::exception & exc) {
-                processing.takeLastException();
-                cerr << "error dealing with line " << line
-                     << ": " << exc.what() << endl;
-            } catch (...) {
-                processing.takeLastException();
+        }
+
+        try {
+            if (startBlock && !startBlock(block.blockNumber, startLine))
+                return;
+
+            const char * line = block.start;
+            for (int64_t i = 0;  i < numLines;  ++i) {
+                if (hasExc.load(std::memory_order_relaxed))
+                    return;
+
+                size_t len = lineEnds[i] - line;
+
+                // Skip \r for DOS line endings
+                if (stripCarriageReturns && len > 0 && line[len - 1] == '\r')
+                    --len;
+
+                if (!onLine(line, len, block.blockNumber, startLine + i))
+                    return;
+
+                line = lineEnds[i] + 1;
             }
+
+            if (endBlock)
+                endBlock(block.blockNumber, startLine + numLines);
+        } catch (...) {
+            takeException();
         }
     }
 };
 
+} // file scope
+
+
+/*****************************************************************************/
+/* PARALLEL LINE PROCESSOR                                                   */
+/*****************************************************************************/
+
 size_t
 forEachLine(std::istream & stream,
             const std::function<void (const char *, size_t,
@@ -171,12 +482,22 @@ forEachLine(std::istream & stream,
             bool ignoreStreamExceptions,
             int64_t maxLines)
 {
-    auto onLineStr = [&] (const string & line, int64_t lineNum) {
-        processLine(line.c_str(), line.size(), lineNum);
-    };
+    LineBlockProcessor::OnLine onLine
+        = [&] (const char * line, size_t length, int64_t blockNumber,
+               int64_t lineNumber)
+        {
+            processLine(line, length, lineNumber);
+            return true;
+        };
+    LineBlockProcessor::OnBlock noBlock;
 
-    return forEachLineStr(stream, onLineStr, numThreads,
-                          ignoreStreamExceptions, maxLines);
+    LineBlockProcessor processor(onLine, noBlock, noBlock, maxLines,
+                                 numThreads, LineScanner(0, 0));
+    processor.includeFinalEmptyLine = true;
+    processor.stripCarriageReturns = false;
+    processor.ignoreStreamExceptions = ignoreStreamExceptions;
+
+    return processor.run(stream);
 }
 
 size_t
@@ -187,27 +508,13 @@ forEachLineStr(std::istream & stream,
                bool ignoreStreamExceptions,
                int64_t maxLines)
 {
-    Processing processing;
-
-    std::vector<std::thread> threads;
-    for (unsigned i = 0;  i < numThreads;  ++i)
-        threads.emplace_back(std::bind(parseLinesThreadStr,
-                                       std::ref(processing),
-                                       std::ref(processLine)));
-        
-    size_t result = readStream(stream, processing,
-                               ignoreStreamExceptions, maxLines);
-        
-    processing.shutdown = true;
-
-    for (auto & t: threads)
-        t.join();
-
-    if (processing.hasException()) {
-        std::rethrow_exception(processing.excPtr);
-    }
+    auto onLine = [&] (const char * line, size_t length, int64_t lineNum)
+        {
+            processLine(string(line, length), lineNum);
+        };
 
-    return result;
+    return forEachLine(stream, onLine, numThreads,
+                       ignoreStreamExceptions, maxLines);
 }
 
 size_t
@@ -217,7 +524,7 @@ forEachLine(const std::string & filename,
             bool ignoreStreamExceptions,
             int64_t maxLines)
 {
-    filter_istream stream(filename);
+    filter_istream stream(filename, { { "mapped", "true" } });
     return forEachLine(stream, processLine, numThreads,
                        ignoreStreamExceptions, maxLines);
 }
@@ -229,7 +536,7 @@ forEachLineStr(const std::string & filename,
                bool ignoreStreamExceptions,
                int64_t maxLines)
 {
-    filter_istream stream(filename);
+    filter_istream stream(filename, { { "mapped", "true" } });
     return forEachLineStr(stream, processLine, numThreads,
                           ignoreStreamExceptions, maxLines);
 }
@@ -247,233 +554,14 @@ void forEachLineBlock(std::istream & stream,
                       int64_t maxLines,
                       int maxParallelism,
                       std::function<bool (int64_t blockNumber, int64_t lineNumber)> startBlock,
-                      std::function<bool (int64_t blockNumber, int64_t lineNumber)> endBlock)
+                      std::function<bool (int64_t blockNumber, int64_t lineNumber)> endBlock,
+                      char quoteChar,
+                      char separatorChar)
 {
-    //static constexpr int64_t BLOCK_SIZE = 100000000;  // 100MB blocks
-    static constexpr int64_t BLOCK_SIZE = 20000000;  // 20MB blocks
-    static constexpr int64_t READ_SIZE = 200000;  // read&scan 200kb to fit in cache
-
-    std::atomic<int64_t> doneLines(0); //number of lines processed but not yet returned
-    std::atomic<int64_t> returnedLines(0); //number of lines returned
-    std::atomic<int64_t> byteOffset(0);
-    std::atomic<int> chunkNumber(0);
-
-    ThreadPool tp(maxParallelism);
-
-    // Memory map if possible
-    const char * mapped = nullptr;
-    size_t mappedSize = 0;
-
-    filter_istream * fistream = dynamic_cast<filter_istream *>(&stream);
-
-    if (fistream) {
-        // Can we get a memory mapped version of our stream?  It
-        // saves us having to copy data.  mapped will be set to
-        // nullptr if it's not possible to memory map this stream.
-        std::tie(mapped, mappedSize) = fistream->mapped();
-    }
-
-    std::atomic<int> hasExc(false);
-    std::exception_ptr exc;
-
-    std::function<void ()> doBlock = [&] ()
-        {
-            //cerr << "block starting at line " << doneLines << endl;
-
-            std::shared_ptr<const char> blockOut;
-
-            int64_t startOffset = byteOffset;
-            int64_t startLine = doneLines;
-            vector<size_t> lineOffsets = {0};
-            bool lastBlock = false;
-            size_t myChunkNumber = 0;
-            
-            try {
-                //MLDB-1426
-                if (mapped && false) {
-                    const char * start = mapped + stream.tellg();
-                    const char * current = start;
-                    const char * end = mapped + mappedSize;
-
-                    while (current && current < end && (current - start) < BLOCK_SIZE
-                           && (maxLines == -1 || doneLines < maxLines)) { //stop processing new line when we have enough)
-                        current = (const char *)memchr(current, '\n', end - current);
-                        if (current && current < end) {
-                            ExcAssertEqual(*current, '\n');
-                            lineOffsets.push_back(current - start);
-                            ++doneLines;
-                            ++current;
-                        }
-                    }
-                
-                    if (current)
-                        stream.seekg(current - start, ios::cur);
-                    else {
-                        // Last line has no newline
-                        lineOffsets.push_back(end - start);
-                        ++doneLines;
-                    }
-                    
-                    myChunkNumber = chunkNumber++;
-
-                    if (current && current < end &&
-                        (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
-                        {
-                            // Ready for another chunk
-                            tp.add(doBlock);
-                        } else if (current == end) {
-                        lastBlock = true;
-                    }
-
-                    blockOut = std::shared_ptr<const char>(start,
-                                                           [] (const char *) {});
-                }
-                else {
-                    // How far through our block are we?
-                    size_t offset = 0;
-
-                    // How much extra space to allocate for the last line?
-                    static constexpr size_t EXTRA_SIZE = 10000;
-
-                    std::shared_ptr<char> block(new char[BLOCK_SIZE + EXTRA_SIZE],
-                                                [] (char * c) { delete[] c; });
-                    blockOut = block;
-
-                    // First line starts at offset 0
-
-                    while (stream && !stream.eof()
-                           && (maxLines == -1 || doneLines < maxLines)  //stop processing new line when we have enough
-                           && (byteOffset - startOffset < BLOCK_SIZE)) {
-                        
-                        stream.read((char *)block.get() + offset,
-                                    std::min<size_t>(READ_SIZE, BLOCK_SIZE - offset));
-
-                        // Check how many bytes we actually read
-                        size_t bytesRead = stream.gcount();
-                        
-                        offset += bytesRead;
-
-                        // Scan for end of line characters
-                        const char * current = block.get() + lineOffsets.back();
-                        const char * end = block.get() + offset;
-
-                        while (current && current < end) {
-                            current = (const char *)memchr(current, '\n', end - current);
-                            if (current && current < end) {
-                                ExcAssertEqual(*current, '\n');
-                                if (lineOffsets.back() != current - block.get()) {
-                                    lineOffsets.push_back(current - block.get());
-                                    //cerr << "got line at offset " << lineOffsets.back() << endl;
-                                    ++doneLines;
-                                }
-                                ++current;
-                            }
-                        }
-
-                        byteOffset += bytesRead;
-                    }
-
-                
-                    if (stream.eof()) {
-                        // If we are at the end of the stream
-                        // make sure we include the last line 
-                        // if there was no newline
-                        if (lineOffsets.back() != offset - 1) {
-                            lineOffsets.push_back(offset);
-                            ++doneLines;
-                        }
-                    }
-                    else {
-                        // If we are not at the end of the stream
-                        // get the last line, as we probably got just a partial
-                        // line in the last one
-                        std::string lastLine;
-                        getline(stream, lastLine);
-                
-                        size_t cnt = stream.gcount();
-
-                        if (cnt != 0) {
-                            // Check for overflow on the buffer size
-                            if (offset + lastLine.size() + 1 > BLOCK_SIZE + EXTRA_SIZE) {
-                                // reallocate and copy
-                                std::shared_ptr<char> newBlock(new char[offset + lastLine.size() + 1],
-                                                               [] (char * c) { delete[] c; });
-                                std::copy(block.get(), block.get() + offset,
-                                          newBlock.get());
-                                block = newBlock;
-                                blockOut = block;
-                            }
-
-                            std::copy(lastLine.data(), lastLine.data() + lastLine.length(),
-                                      block.get() + offset);
-                    
-                            lineOffsets.emplace_back(offset + lastLine.length());
-                            ++doneLines;
-                            offset += cnt;
-                        }                
-                    }
-
-                    myChunkNumber = chunkNumber++;
-
-                    if (stream && !stream.eof() &&
-                        (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
-                        {
-                            // Ready for another chunk
-                            tp.add(doBlock);
-                        } else if (stream.eof()) {
-                        lastBlock = true;
-                    }
-                }
-                    
-                //cerr << "processing block of " << lineOffsets.size() - 1
-                //     << " lines starting at " << startLine << endl;
-
-
-                int64_t chunkLineNumber = startLine;
-                size_t lastLineOffset = lineOffsets[0];
-
-                if (startBlock)
-                    if (!startBlock(myChunkNumber, chunkLineNumber))
-                        return;
-
-                for (unsigned i = 1;  i < lineOffsets.size() && (maxLines == -1 || returnedLines++ < maxLines);  ++i) {
-                    if (hasExc.load(std::memory_order_relaxed))
-                        return;
-                    const char * line = blockOut.get() + lastLineOffset;
-                    size_t len = lineOffsets[i] - lastLineOffset;
-
-                    // Skip \r for DOS line endings
-                    if (len > 0 && line[len - 1] == '\r')
-                        --len;
-
-                    // if we are not at the last line
-                    if (!lastBlock || len != 0 || i != lineOffsets.size() - 1)
-                        if (!onLine(line, len, chunkNumber, chunkLineNumber++))
-                            return;
-                
-                    lastLineOffset = lineOffsets[i] + 1;
-
-                }
-
-                if (endBlock)
-                    if (!endBlock(myChunkNumber, chunkLineNumber))
-                        return;
-
-            } JML_CATCH_ALL {
-                if (hasExc.fetch_add(1) == 0) {
-                    exc = std::current_exception();
-                }
-            }
-        };
-    
-    tp.add(doBlock);
-    tp.waitForAll();
-
-    // If there was an exception, rethrow it rather than returning
-    // cleanly
-    if (hasExc) {
-        std::rethrow_exception(exc);
-    }
+    LineBlockProcessor processor(onLine, startBlock, endBlock, maxLines,
+                                 maxParallelism,
+                                 LineScanner(quoteChar, separatorChar));
+    processor.run(stream);
 }
 
 } // namespace Datacratic
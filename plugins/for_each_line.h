@@ -19,8 +19,13 @@ namespace Datacratic {
 /** Run the given lambda over every line read from the stream, with the
     work distributed over the given number of threads.
 
+    The stream is read in large blocks (or used directly if it's a memory
+    mapped filter_istream), and the worker threads split the blocks into
+    lines themselves.
+
     The processLine function takes a string with the contents of the line,
-    without the newline, as a beginning and a length.
+    without the newline, as a beginning and a length.  The string is not
+    null terminated, and is only valid during the call.
 
     Returns the number of lines produced.
 */
@@ -101,6 +106,11 @@ forEachLineStr(const std::string & filename,
     the processing thread, at the beginning and end of the block
     respectively.
 
+    If quoteChar is non-zero, then newlines within CSV fields quoted with
+    that character (where fields are separated by separatorChar) don't end
+    a line, and the whole multi-line record is passed to onLine, embedded
+    newlines included.
+
     This is the fastest way to parse a text file.
 */
 
@@ -114,7 +124,9 @@ void forEachLineBlock(std::istream & stream,
                       std::function<bool (int64_t blockNumber, int64_t lineNumber)> startBlock
                           = nullptr,
                       std::function<bool (int64_t blockNumber, int64_t lineNumber)> endBlock
-                          = nullptr);
+                          = nullptr,
+                      char quoteChar = 0,
+                      char separatorChar = ',');
 
     
 } // namespace Datacratic
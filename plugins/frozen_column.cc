@@ -7,12 +7,17 @@
 
 #include "frozen_column.h"
 #include "tabular_dataset_column.h"
+#include "frozen_serialization.h"
 #include "mldb/arch/bitops.h"
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/jml/db/persistent.h"
+#include <unordered_map>
 #include <mutex>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
@@ -52,6 +57,20 @@ struct TableFrozenColumn: public FrozenColumn {
         }
     }
 
+    TableFrozenColumn(ML::DB::Store_Reader & metadata,
+                      const FrozenBlockReader & blocks)
+    {
+        uint64_t offset;
+        metadata >> indexBits >> numEntries >> firstEntry >> hasNulls
+                 >> offset;
+        storage = blocks.get<uint32_t>(offset, numWords() * 4);
+        ML::DB::compact_size_t tableSize(metadata);
+        table.reserve(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table.emplace_back(reconstituteCellValue(metadata));
+        columnTypes.reconstitute(metadata);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -74,6 +93,37 @@ struct TableFrozenColumn: public FrozenColumn {
         }
     }
 
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::DICTIONARY, startRow, numRows);
+        block.dictionary = table.data();
+        block.dictionarySize = table.size();
+
+        // Restrict to the range of rows that are actually stored
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry);
+        uint64_t last = std::min<uint64_t>((uint64_t)startRow + numRows,
+                                           firstEntry + numEntries);
+        if (first >= last)
+            return;
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance((first - firstEntry) * indexBits);
+        for (uint64_t r = first;  r < last;  ++r) {
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            uint32_t i = r - startRow;
+            if (hasNulls) {
+                if (index == 0)
+                    continue;
+                block.indexes[i] = index - 1;
+            }
+            else {
+                block.indexes[i] = index;
+            }
+            block.setPresent(i);
+        }
+    }
+
     virtual size_t size() const
     {
         return numEntries;
@@ -120,6 +170,23 @@ struct TableFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    size_t numWords() const
+    {
+        return ((size_t)indexBits * numEntries + 31) / 32;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t offset = blocks.write(storage.get(), numWords() * 4);
+        metadata << std::string("Table")
+                 << indexBits << numEntries << firstEntry << hasNulls
+                 << offset << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(metadata, v);
+        columnTypes.serialize(metadata);
+    }
+
     static size_t bytesRequired(const TabularDatasetColumn & column)
     {
         size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
@@ -176,6 +243,20 @@ struct SparseTableFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    SparseTableFrozenColumn(ML::DB::Store_Reader & metadata,
+                            const FrozenBlockReader & blocks)
+    {
+        uint64_t offset;
+        metadata >> rowNumBits >> indexBits >> numEntries >> firstEntry
+                 >> offset;
+        storage = blocks.get<uint32_t>(offset, numWords() * 4);
+        ML::DB::compact_size_t tableSize(metadata);
+        table.resize(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table[i] = reconstituteCellValue(metadata);
+        columnTypes.reconstitute(metadata);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -183,15 +264,6 @@ struct SparseTableFrozenColumn: public FrozenColumn {
             return result;
         rowIndex -= firstEntry;
 
-        auto getAtIndex = [&] (uint32_t n)
-            {
-                ML::Bit_Extractor<uint32_t> bits(storage.get());
-                bits.advance(n * (indexBits + rowNumBits));
-                uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
-                uint32_t index = bits.extract<uint32_t>(indexBits);
-                return std::make_pair(rowNum, index);
-            };
-
         uint32_t first = 0;
         uint32_t last  = numEntries;
 
@@ -225,6 +297,52 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         return result;
     }
 
+    /// Return the (row number, table index) of the nth entry
+    std::pair<uint32_t, uint32_t> getAtIndex(uint32_t n) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance((size_t)n * (indexBits + rowNumBits));
+        uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+        uint32_t index = bits.extract<uint32_t>(indexBits);
+        return std::make_pair(rowNum, index);
+    }
+
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::DICTIONARY, startRow, numRows);
+        block.dictionary = table.empty() ? nullptr : &table[0];
+        block.dictionarySize = table.size();
+
+        uint64_t endRow = (uint64_t)startRow + numRows;
+        if (endRow <= firstEntry)
+            return;
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry) - firstEntry;
+        uint64_t last = endRow - firstEntry;
+
+        // Binary search for the first entry within the block
+        uint32_t lo = 0, hi = numEntries;
+        while (lo < hi) {
+            uint32_t middle = (lo + hi) / 2;
+            if (getAtIndex(middle).first < first)
+                lo = middle + 1;
+            else hi = middle;
+        }
+
+        // Then read them sequentially until we're past the end
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance((size_t)lo * (indexBits + rowNumBits));
+        for (uint32_t n = lo;  n < numEntries;  ++n) {
+            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            if (rowNum >= last)
+                break;
+            uint32_t i = rowNum + firstEntry - startRow;
+            block.indexes[i] = index;
+            block.setPresent(i);
+        }
+    }
+
     virtual size_t size() const
     {
         return numEntries;
@@ -260,6 +378,24 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    size_t numWords() const
+    {
+        return ((size_t)(indexBits + rowNumBits) * numEntries + 31) / 32;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t offset = blocks.write(storage.get(), numWords() * 4);
+        metadata << std::string("SparseTable")
+                 << rowNumBits << indexBits << numEntries
+                 << (uint64_t)firstEntry
+                 << offset << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(metadata, v);
+        columnTypes.serialize(metadata);
+    }
+
     static size_t bytesRequired(const TabularDatasetColumn & column)
     {
         int indexBits = ML::highest_bit(column.indexedVals.size()) + 1;
@@ -285,7 +421,18 @@ struct SparseTableFrozenColumn: public FrozenColumn {
     ColumnTypes columnTypes;
 };
 
-/// Frozen column that stores each value as a signed 64 bit integer
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/// Frozen column that stores each value as a signed 64 bit integer, as an
+/// offset from the minimum value divided by a common multiple.
 struct IntegerFrozenColumn: public FrozenColumn {
 
     struct SizingInfo {
@@ -322,46 +469,23 @@ struct IntegerFrozenColumn: public FrozenColumn {
             numEntries = column.maxRowNumber - column.minRowNumber + 1;
             hasNulls = column.sparseIndexes.size() < numEntries;
 
+            // Look for a common multiple of the distances from the offset,
+            // which allows us to store fewer bits per entry (for example
+            // for values that are all multiples of 10 or 1000).
+            multiplier = 0;
+            for (auto & v: column.indexedVals) {
+                multiplier = gcd(multiplier,
+                                 (uint64_t)v.toInt() - (uint64_t)offset);
+            }
+            if (multiplier == 0)
+                multiplier = 1;  // only a single value
+            range /= multiplier;
+
             // If we have too much range to represent nulls then we can't
             // use this kind of column.
             if (range == -1 && hasNulls)
                 return;
-                
-#if 0 // later on... we should look for a common multiple to reduce bits used
-   
-            // Check for common multiple
-            std::vector<int64_t> offsets;
-            offsets.reserve(column.indexedVals.size());
-            for (auto & v: column.indexedVals) {
-                if (!v.empty())
-                    offsets.emplace_back(v.toInt());
-            }
-
-            std::sort(offsets.begin(), offsets.end());
-        
-            // Find the multiple
-            for (size_t i = 0;  i < offsets.size() - 1;  ++i) {
-                offsets[i] = offsets[i + 1] - offsets[i];
-            }
-            if (!offsets.empty())
-                offsets.pop_back();
-
-            // Uniquify
-            std::sort(offsets.begin(), offsets.end());
-            offsets.erase(std::unique(offsets.begin(), offsets.end()),
-                          offsets.end());
-        
-            static std::mutex mutex;
-            std::unique_lock<std::mutex> guard(mutex);
-
-            cerr << "got " << offsets.size() << " unique offsets starting at "
-                 << offsets.front() << endl;
 
-            for (size_t i = 0;  i < 100 && i < offsets.size() - 1;  ++i) {
-                cerr << "  " << offsets[i];
-            }
-            cerr << endl;
-#endif
             entryBits = ML::highest_bit(range + hasNulls) + 1;
             numWords = (entryBits * numEntries + 63) / 64;
             bytesRequired = sizeof(IntegerFrozenColumn) + numWords * 8;
@@ -375,6 +499,7 @@ struct IntegerFrozenColumn: public FrozenColumn {
         ssize_t bytesRequired;
         uint64_t range;
         int64_t offset;
+        uint64_t multiplier;
         size_t numEntries;
         bool hasNulls;
         size_t numWords;
@@ -398,6 +523,7 @@ struct IntegerFrozenColumn: public FrozenColumn {
         hasNulls = info.hasNulls;
         entryBits = info.entryBits;
         offset = info.offset;
+        multiplier = info.multiplier;
         uint64_t * data = new uint64_t[info.numWords];
         storage = std::shared_ptr<uint64_t>(data, [] (uint64_t * p) { delete[] p; });
 
@@ -411,7 +537,7 @@ struct IntegerFrozenColumn: public FrozenColumn {
                     = column.indexedVals[column.sparseIndexes[i].second].toInt();
                 //cerr << "writing " << val << " - " << offset << " = "
                 //     << val - offset << " at " << i << endl;
-                writer.write(val - offset, entryBits);
+                writer.write(encode(val), entryBits);
             }
         }
         else {
@@ -422,7 +548,7 @@ struct IntegerFrozenColumn: public FrozenColumn {
                     = column.indexedVals[r_i.second].toInt();
                 ML::Bit_Writer<uint64_t> writer(data);
                 writer.skip(r_i.first * entryBits);
-                writer.write(val - offset + 1, entryBits);
+                writer.write(encode(val) + 1, entryBits);
             }
         }
 
@@ -437,6 +563,16 @@ struct IntegerFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    IntegerFrozenColumn(ML::DB::Store_Reader & metadata,
+                        const FrozenBlockReader & blocks)
+    {
+        uint64_t storageOffset;
+        metadata >> entryBits >> numEntries >> firstEntry >> offset
+                 >> multiplier >> hasNulls >> storageOffset;
+        storage = blocks.get<uint64_t>(storageOffset, numWords() * 8);
+        columnTypes.reconstitute(metadata);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -448,15 +584,55 @@ struct IntegerFrozenColumn: public FrozenColumn {
         ExcAssertLess(rowIndex, numEntries);
         ML::Bit_Extractor<uint64_t> bits(storage.get());
         bits.advance(rowIndex * entryBits);
-        int64_t val = bits.extract<uint64_t>(entryBits);
+        uint64_t val = bits.extract<uint64_t>(entryBits);
         if (hasNulls) {
             if (val == 0)
                 return result;
-            else return result = val + offset - 1;
+            else return result = decode(val - 1);
         }
         else {
-            //cerr << "got val " << val << " " << val + offset << endl;
-            return result = val + offset;
+            //cerr << "got val " << val << " " << decode(val) << endl;
+            return result = decode(val);
+        }
+    }
+
+    /// Convert a value into the unsigned integer that's stored for it
+    uint64_t encode(int64_t val) const
+    {
+        return ((uint64_t)val - (uint64_t)offset) / multiplier;
+    }
+
+    /// Convert a stored unsigned integer back into its value
+    int64_t decode(uint64_t val) const
+    {
+        return val * multiplier + (uint64_t)offset;
+    }
+
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::INTEGERS, startRow, numRows);
+
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry);
+        uint64_t last = std::min<uint64_t>((uint64_t)startRow + numRows,
+                                           firstEntry + numEntries);
+        if (first >= last)
+            return;
+
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance((first - firstEntry) * entryBits);
+        for (uint64_t r = first;  r < last;  ++r) {
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            uint32_t i = r - startRow;
+            if (hasNulls) {
+                if (val == 0)
+                    continue;
+                block.integers[i] = decode(val - 1);
+            }
+            else {
+                block.integers[i] = decode(val);
+            }
+            block.setPresent(i);
         }
     }
 
@@ -481,24 +657,27 @@ struct IntegerFrozenColumn: public FrozenColumn {
         if (hasNulls && !fn(CellValue()))
             return false;
 
-        std::vector<int64_t> allVals;
+        std::vector<uint64_t> allVals;
         allVals.reserve(numEntries);
 
         ML::Bit_Extractor<uint64_t> bits(storage.get());
         
         for (size_t i = 0;  i < numEntries;  ++i) {
-            int64_t val = bits.extract<uint64_t>(entryBits);
-            if (val == 0 && hasNulls)
-                continue;
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            if (hasNulls) {
+                if (val == 0)
+                    continue;
+                val -= 1;
+            }
             allVals.push_back(val);
-            bits.advance(entryBits);
         }
 
+        // Stored values sort in the same order as the values themselves
         std::sort(allVals.begin(), allVals.end());
         auto endIt = std::unique(allVals.begin(), allVals.end());
 
         for (auto it = allVals.begin();  it != endIt;  ++it) {
-            if (!fn(*it + offset - hasNulls))
+            if (!fn(decode(*it)))
                 return false;
         }
 
@@ -510,6 +689,7 @@ struct IntegerFrozenColumn: public FrozenColumn {
     uint32_t numEntries;
     uint64_t firstEntry;
     int64_t offset;
+    uint64_t multiplier;
 
     bool hasNulls;
     ColumnTypes columnTypes;
@@ -519,31 +699,1183 @@ struct IntegerFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    size_t numWords() const
+    {
+        return ((size_t)entryBits * numEntries + 63) / 64;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t storageOffset = blocks.write(storage.get(), numWords() * 8);
+        metadata << std::string("Integer")
+                 << entryBits << numEntries << firstEntry << offset
+                 << multiplier << hasNulls << storageOffset;
+        columnTypes.serialize(metadata);
+    }
+
     static ssize_t bytesRequired(const TabularDatasetColumn & column)
     {
         return SizingInfo(column);
     }
 };
 
-std::shared_ptr<FrozenColumn>
-FrozenColumn::
-freeze(TabularDatasetColumn & column)
-{
-    size_t required1 = TableFrozenColumn::bytesRequired(column);
-    size_t required2 = SparseTableFrozenColumn::bytesRequired(column);
-    size_t required3 = IntegerFrozenColumn::bytesRequired(column);
+/// Frozen column that stores each value as a native IEEE floating point
+/// number.  Single precision is used when it can represent every value
+/// exactly.  Nulls are stored as a reserved signalling NaN.
+struct DoubleFrozenColumn: public FrozenColumn {
+
+    /// Bit patterns used to mark a null value
+    static constexpr uint64_t NULL_DOUBLE = 0x7ff000000000badaULL;
+    static constexpr uint32_t NULL_FLOAT = 0x7f80badaU;
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+            : bytesRequired(-1)
+        {
+            const ColumnTypes & types = column.columnTypes;
+
+            // Columns with no reals are better as integers
+            if (types.numReals == 0 || types.numStrings || types.numBlobs
+                || types.numOther)
+                return;
+
+            // Integers must be exactly representable as a double
+            if (types.hasPositiveIntegers()
+                && types.maxPositiveInteger > (1ULL << 53))
+                return;
+            if (types.hasNegativeIntegers()
+                && types.minNegativeInteger < -(1LL << 53))
+                return;
+
+            isFloat = true;
+            for (auto & v: column.indexedVals) {
+                double d = v.toDouble();
+                if (getBits(d) == NULL_DOUBLE)
+                    return;  // can't distinguish from null
+                if (!isFloat)
+                    continue;
+                if (std::isfinite(d)
+                    && std::abs(d) > std::numeric_limits<float>::max()) {
+                    isFloat = false;
+                    continue;
+                }
+                float f = d;
+                double d2 = f;
+                if (getBits(f) == NULL_FLOAT || getBits(d2) != getBits(d))
+                    isFloat = false;
+            }
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            bytesRequired = sizeof(DoubleFrozenColumn)
+                + numEntries * (isFloat ? sizeof(float) : sizeof(double));
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired;
+        bool isFloat;
+        size_t numEntries;
+    };
+
+    DoubleFrozenColumn(TabularDatasetColumn & column)
+        : columnTypes(column.columnTypes)
+    {
+        SizingInfo info(column);
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        isFloat = info.isFloat;
+        hasNulls = column.sparseIndexes.size() < numEntries;
 
-    if (required3 < std::min(required1, required2)) {
-        return std::make_shared<IntegerFrozenColumn>(column);
-        //cerr << "integer requires " << required3 << " instead of "
-        //     << std::min(required1, required2) << endl;
+        if (isFloat)
+            storage = fill<float>(column, NULL_FLOAT);
+        else storage = fill<double>(column, NULL_DOUBLE);
     }
 
-    if (required1 <= required2)
-        return std::make_shared<TableFrozenColumn>(column);
-    else return std::make_shared<SparseTableFrozenColumn>(column);
-}
+    DoubleFrozenColumn(ML::DB::Store_Reader & metadata,
+                       const FrozenBlockReader & blocks)
+    {
+        uint64_t offset;
+        metadata >> isFloat >> numEntries >> firstEntry >> hasNulls
+                 >> offset;
+        storage = blocks.get<double>(offset, storageBytes());
+        columnTypes.reconstitute(metadata);
+    }
 
-} // namespace MLDB
-} // namespace Datacratic
+    static uint64_t getBits(double d)
+    {
+        uint64_t result;
+        std::memcpy(&result, &d, sizeof(d));
+        return result;
+    }
+
+    static uint32_t getBits(float f)
+    {
+        uint32_t result;
+        std::memcpy(&result, &f, sizeof(f));
+        return result;
+    }
+
+    template<typename Float, typename Bits>
+    static std::shared_ptr<const void>
+    fill(const TabularDatasetColumn & column, Bits nullBits)
+    {
+        size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        Bits * data = new Bits[numEntries];
+        std::fill(data, data + numEntries, nullBits);
+        for (auto & r_i: column.sparseIndexes) {
+            Float val = column.indexedVals[r_i.second].toDouble();
+            std::memcpy(data + r_i.first, &val, sizeof(val));
+        }
+        return std::shared_ptr<const void>
+            (data, [] (Bits * p) { delete[] p; });
+    }
+
+    /** Extract the value of the entry with the given index into val,
+        returning false if it's null.  The bit pattern is examined before
+        it's converted, so that the NaN used for nulls isn't quietened.
+    */
+    bool extract(uint32_t index, double & val) const
+    {
+        if (isFloat) {
+            uint32_t bits;
+            std::memcpy(&bits, (const float *)storage.get() + index, 4);
+            if (bits == NULL_FLOAT)
+                return false;
+            float f;
+            std::memcpy(&f, &bits, 4);
+            val = f;
+        }
+        else {
+            uint64_t bits;
+            std::memcpy(&bits, (const double *)storage.get() + index, 8);
+            if (bits == NULL_DOUBLE)
+                return false;
+            std::memcpy(&val, &bits, 8);
+        }
+        return true;
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        double val;
+        if (extract(rowIndex, val))
+            result = val;
+        return result;
+    }
+
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::DOUBLES, startRow, numRows);
+
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry);
+        uint64_t last = std::min<uint64_t>((uint64_t)startRow + numRows,
+                                           firstEntry + numEntries);
+        for (uint64_t r = first;  r < last;  ++r) {
+            uint32_t i = r - startRow;
+            if (extract(r - firstEntry, block.doubles[i]))
+                block.setPresent(i);
+        }
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    size_t storageBytes() const
+    {
+        return (size_t)numEntries * (isFloat ? sizeof(float) : sizeof(double));
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + storageBytes();
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls && !fn(CellValue()))
+            return false;
+
+        std::vector<double> allVals;
+        allVals.reserve(numEntries);
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            double val;
+            if (extract(i, val))
+                allVals.push_back(val);
+        }
+
+        // NaNs don't compare, so we sort them to the end and treat them
+        // all as equal
+        auto less = [] (double d1, double d2)
+            {
+                return d1 < d2 || (std::isnan(d2) && !std::isnan(d1));
+            };
+        auto equal = [] (double d1, double d2)
+            {
+                return d1 == d2 || (std::isnan(d1) && std::isnan(d2));
+            };
+
+        std::sort(allVals.begin(), allVals.end(), less);
+        auto endIt = std::unique(allVals.begin(), allVals.end(), equal);
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(*it))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const void> storage;
+    bool isFloat;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t offset = blocks.write(storage.get(), storageBytes());
+        metadata << std::string("Double")
+                 << isFloat << numEntries << firstEntry << hasNulls
+                 << offset;
+        columnTypes.serialize(metadata);
+    }
+
+    static ssize_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        return SizingInfo(column);
+    }
+};
+
+constexpr uint64_t DoubleFrozenColumn::NULL_DOUBLE;
+constexpr uint32_t DoubleFrozenColumn::NULL_FLOAT;
+
+
+/// Frozen column that stores timestamps as a bit-packed integer number of
+/// ticks (seconds, milliseconds or microseconds) from the earliest one.
+struct TimestampFrozenColumn: public FrozenColumn {
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+            : bytesRequired(-1)
+        {
+            const ColumnTypes & types = column.columnTypes;
+            if (types.numIntegers || types.numReals || types.numStrings
+                || types.numBlobs || column.indexedVals.empty())
+                return;
+
+            // Find the coarsest resolution that exactly represents all of
+            // the timestamps (other types such as intervals will fail
+            // here too)
+            for (int64_t ticks: { 1, 1000, 1000000 }) {
+                if (tryResolution(column, ticks))
+                    break;
+            }
+            if (ticksPerSecond == 0)
+                return;
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+
+            if (range == -1 && hasNulls)
+                return;
+
+            entryBits = ML::highest_bit(range + hasNulls) + 1;
+            numWords = (entryBits * numEntries + 63) / 64;
+            bytesRequired = sizeof(TimestampFrozenColumn) + numWords * 8;
+        }
+
+        bool tryResolution(const TabularDatasetColumn & column,
+                           int64_t ticks)
+        {
+            ticksPerSecond = 0;
+            offset = std::numeric_limits<int64_t>::max();
+            int64_t maxTicks = std::numeric_limits<int64_t>::min();
+
+            for (auto & v: column.indexedVals) {
+                if (v.cellType() != CellValue::TIMESTAMP)
+                    return false;
+                double seconds = v.toTimestamp().secondsSinceEpoch();
+                double scaled = seconds * ticks;
+                if (!std::isfinite(scaled) || std::abs(scaled) > (1LL << 62))
+                    return false;
+                int64_t t = std::llround(scaled);
+                if (t / (double)ticks != seconds)
+                    return false;
+                offset = std::min(offset, t);
+                maxTicks = std::max(maxTicks, t);
+            }
 
+            // Look for a common multiple, for example timestamps that are
+            // all on whole minutes
+            multiplier = 0;
+            for (auto & v: column.indexedVals) {
+                int64_t t = std::llround(v.toTimestamp().secondsSinceEpoch()
+                                         * ticks);
+                multiplier = gcd(multiplier, t - offset);
+            }
+            if (multiplier == 0)
+                multiplier = 1;
+
+            range = (uint64_t)(maxTicks - offset) / multiplier;
+            ticksPerSecond = ticks;
+            return true;
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired;
+        int64_t ticksPerSecond;
+        int64_t offset;
+        uint64_t multiplier;
+        uint64_t range;
+        size_t numEntries;
+        bool hasNulls;
+        size_t numWords;
+        int entryBits;
+    };
+
+    TimestampFrozenColumn(TabularDatasetColumn & column)
+        : columnTypes(column.columnTypes)
+    {
+        SizingInfo info(column);
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        entryBits = info.entryBits;
+        ticksPerSecond = info.ticksPerSecond;
+        offset = info.offset;
+        multiplier = info.multiplier;
+
+        uint64_t * data = new uint64_t[info.numWords];
+        storage = std::shared_ptr<uint64_t>(data, [] (uint64_t * p) { delete[] p; });
+        std::fill(data, data + info.numWords, 0);
+
+        for (auto & r_i: column.sparseIndexes) {
+            Date ts = column.indexedVals[r_i.second].toTimestamp();
+            ML::Bit_Writer<uint64_t> writer(data);
+            writer.skip(r_i.first * entryBits);
+            writer.write(encode(ts) + hasNulls, entryBits);
+        }
+    }
+
+    TimestampFrozenColumn(ML::DB::Store_Reader & metadata,
+                          const FrozenBlockReader & blocks)
+    {
+        uint64_t storageOffset;
+        metadata >> entryBits >> numEntries >> firstEntry >> ticksPerSecond
+                 >> offset >> multiplier >> hasNulls >> storageOffset;
+        storage = blocks.get<uint64_t>(storageOffset, numWords() * 8);
+        columnTypes.reconstitute(metadata);
+    }
+
+    /// Convert a timestamp into the unsigned integer that's stored for it
+    uint64_t encode(Date ts) const
+    {
+        int64_t ticks = std::llround(ts.secondsSinceEpoch() * ticksPerSecond);
+        return (uint64_t)(ticks - offset) / multiplier;
+    }
+
+    /// Convert a stored unsigned integer back into seconds since the epoch
+    double decode(uint64_t val) const
+    {
+        int64_t ticks = val * multiplier + (uint64_t)offset;
+        return ticks / (double)ticksPerSecond;
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance((size_t)rowIndex * entryBits);
+        uint64_t val = bits.extract<uint64_t>(entryBits);
+        if (hasNulls) {
+            if (val == 0)
+                return result;
+            val -= 1;
+        }
+        return result = Date::fromSecondsSinceEpoch(decode(val));
+    }
+
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::TIMESTAMPS, startRow, numRows);
+
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry);
+        uint64_t last = std::min<uint64_t>((uint64_t)startRow + numRows,
+                                           firstEntry + numEntries);
+        if (first >= last)
+            return;
+
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance((first - firstEntry) * entryBits);
+        for (uint64_t r = first;  r < last;  ++r) {
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            uint32_t i = r - startRow;
+            if (hasNulls) {
+                if (val == 0)
+                    continue;
+                val -= 1;
+            }
+            block.doubles[i] = decode(val);
+            block.setPresent(i);
+        }
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + numWords() * 8;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls && !fn(CellValue()))
+            return false;
+
+        std::vector<uint64_t> allVals;
+        allVals.reserve(numEntries);
+
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            if (hasNulls) {
+                if (val == 0)
+                    continue;
+                val -= 1;
+            }
+            allVals.push_back(val);
+        }
+
+        std::sort(allVals.begin(), allVals.end());
+        auto endIt = std::unique(allVals.begin(), allVals.end());
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(Date::fromSecondsSinceEpoch(decode(*it))))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const uint64_t> storage;
+    uint32_t entryBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    int64_t ticksPerSecond;
+    int64_t offset;
+    uint64_t multiplier;
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)entryBits * numEntries + 63) / 64;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t storageOffset = blocks.write(storage.get(), numWords() * 8);
+        metadata << std::string("Timestamp")
+                 << entryBits << numEntries << firstEntry << ticksPerSecond
+                 << offset << multiplier << hasNulls << storageOffset;
+        columnTypes.serialize(metadata);
+    }
+
+    static ssize_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        return SizingInfo(column);
+    }
+};
+
+
+/// Frozen column that stores runs of the same value, each as the row
+/// number at which the run starts and an index into a lookup table.
+/// This is very compact for sorted or clustered columns, such as the
+/// timestamps of a chunk that was recorded all at once.
+struct RunLengthFrozenColumn: public FrozenColumn {
+    RunLengthFrozenColumn(TabularDatasetColumn & column)
+        : table(std::move(column.indexedVals)),
+          columnTypes(column.columnTypes)
+    {
+        firstEntry = column.minRowNumber;
+        numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        hasNulls = column.sparseIndexes.size() < numEntries;
+        numRuns = countRuns(column);
+        rowNumBits = ML::highest_bit(numEntries - 1) + 1;
+        indexBits = ML::highest_bit(table.size()) + 1;
+
+        uint32_t * data = new uint32_t[numWords()];
+        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
+        std::fill(data, data + numWords(), 0);
+
+        ML::Bit_Writer<uint32_t> writer(data);
+        auto onRun = [&] (uint32_t startRow, uint32_t index)
+            {
+                writer.write(startRow, rowNumBits);
+                writer.write(index, indexBits);
+            };
+        forEachRun(column, onRun);
+    }
+
+    RunLengthFrozenColumn(ML::DB::Store_Reader & metadata,
+                          const FrozenBlockReader & blocks)
+    {
+        uint64_t offset;
+        metadata >> rowNumBits >> indexBits >> numRuns >> numEntries
+                 >> firstEntry >> hasNulls >> offset;
+        storage = blocks.get<uint32_t>(offset, numWords() * 4);
+        ML::DB::compact_size_t tableSize(metadata);
+        table.reserve(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table.emplace_back(reconstituteCellValue(metadata));
+        columnTypes.reconstitute(metadata);
+    }
+
+    /** Call onRun(startRow, index) for each run of identical values in
+        the column, where index is zero for a run of nulls and otherwise
+        one more than the index of the value in the table.
+    */
+    template<typename Fn>
+    static void forEachRun(const TabularDatasetColumn & column, Fn && onRun)
+    {
+        uint32_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        uint32_t nextRow = 0;
+        int64_t current = -1;
+        for (auto & r_i: column.sparseIndexes) {
+            if (r_i.first != nextRow && current != 0) {
+                onRun(nextRow, 0);
+                current = 0;
+            }
+            if (current != r_i.second + 1) {
+                onRun(r_i.first, r_i.second + 1);
+                current = r_i.second + 1;
+            }
+            nextRow = r_i.first + 1;
+        }
+        if (nextRow < numEntries && current != 0)
+            onRun(nextRow, 0);
+    }
+
+    static uint32_t countRuns(const TabularDatasetColumn & column)
+    {
+        uint32_t result = 0;
+        forEachRun(column, [&] (uint32_t, uint32_t) { ++result; });
+        return result;
+    }
+
+    /// Return the (start row, index) of the nth run
+    std::pair<uint32_t, uint32_t> getRun(uint32_t n) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance((size_t)n * (rowNumBits + indexBits));
+        uint32_t startRow = bits.extract<uint32_t>(rowNumBits);
+        uint32_t index = bits.extract<uint32_t>(indexBits);
+        return std::make_pair(startRow, index);
+    }
+
+    /// Return the number of the run containing the given row
+    uint32_t findRun(uint32_t rowIndex) const
+    {
+        // The first run always starts at row zero
+        uint32_t first = 0, last = numRuns;
+        while (last - first > 1) {
+            uint32_t middle = (first + last) / 2;
+            if (getRun(middle).first <= rowIndex)
+                first = middle;
+            else last = middle;
+        }
+        return first;
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        uint32_t index = getRun(findRun(rowIndex)).second;
+        if (index == 0)
+            return result;
+        return result = table[index - 1];
+    }
+
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const
+    {
+        block.clear(FrozenColumnBlock::DICTIONARY, startRow, numRows);
+        block.dictionary = table.data();
+        block.dictionarySize = table.size();
+
+        uint64_t first = std::max<uint64_t>(startRow, firstEntry);
+        uint64_t last = std::min<uint64_t>((uint64_t)startRow + numRows,
+                                           firstEntry + numEntries);
+        if (first >= last)
+            return;
+        first -= firstEntry;
+        last -= firstEntry;
+
+        // Find the first run, then read them sequentially
+        uint32_t n = findRun(first);
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance((size_t)n * (rowNumBits + indexBits));
+        uint32_t runStart = bits.extract<uint32_t>(rowNumBits);
+        uint32_t index = bits.extract<uint32_t>(indexBits);
+
+        while (runStart < last) {
+            uint32_t runEnd = numEntries, nextIndex = 0;
+            if (n + 1 < numRuns) {
+                runEnd = bits.extract<uint32_t>(rowNumBits);
+                nextIndex = bits.extract<uint32_t>(indexBits);
+            }
+
+            if (index != 0) {
+                uint64_t end = std::min<uint64_t>(runEnd, last);
+                for (uint64_t r = std::max<uint64_t>(runStart, first);
+                     r < end;  ++r) {
+                    uint32_t i = r + firstEntry - startRow;
+                    block.indexes[i] = index - 1;
+                    block.setPresent(i);
+                }
+            }
+
+            runStart = runEnd;
+            index = nextIndex;
+            ++n;
+        }
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result = sizeof(*this) + numWords() * 4;
+
+        for (auto & v: table)
+            result += v.memusage();
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls && !fn(CellValue()))
+            return false;
+        for (auto & v: table) {
+            if (!fn(v))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const uint32_t> storage;
+    uint8_t rowNumBits;
+    uint8_t indexBits;
+    uint32_t numRuns;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    bool hasNulls;
+    std::vector<CellValue> table;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)(rowNumBits + indexBits) * numRuns + 31) / 32;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const
+    {
+        uint64_t offset = blocks.write(storage.get(), numWords() * 4);
+        metadata << std::string("RunLength")
+                 << rowNumBits << indexBits << numRuns << numEntries
+                 << firstEntry << hasNulls
+                 << offset << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(metadata, v);
+        columnTypes.serialize(metadata);
+    }
+
+    static size_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        int rowNumBits = ML::highest_bit(numEntries - 1) + 1;
+        int indexBits = ML::highest_bit(column.indexedVals.size()) + 1;
+        size_t numRuns = countRuns(column);
+
+        size_t result
+            = sizeof(RunLengthFrozenColumn)
+            + ((rowNumBits + indexBits) * numRuns + 31) / 8;
+
+        for (auto & v: column.indexedVals)
+            result += v.memusage();
+
+        return result;
+    }
+};
+
+constexpr uint32_t FrozenColumnBlock::DEFAULT_SIZE;
+
+void
+FrozenColumn::
+decodeBlock(uint32_t startRow, uint32_t numRows,
+            FrozenColumnBlock & block) const
+{
+    block.clear(FrozenColumnBlock::DICTIONARY, startRow, numRows);
+    block.ownedDictionary.reserve(numRows);
+    for (uint32_t i = 0;  i < numRows;  ++i) {
+        CellValue val = get(startRow + i);
+        if (val.empty())
+            continue;
+        block.indexes[i] = block.ownedDictionary.size();
+        block.ownedDictionary.emplace_back(std::move(val));
+        block.setPresent(i);
+    }
+    block.dictionary = block.ownedDictionary.data();
+    block.dictionarySize = block.ownedDictionary.size();
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+freeze(TabularDatasetColumn & column)
+{
+    size_t required1 = TableFrozenColumn::bytesRequired(column);
+    size_t required2 = SparseTableFrozenColumn::bytesRequired(column);
+    size_t required3 = IntegerFrozenColumn::bytesRequired(column);
+    size_t required4 = DoubleFrozenColumn::bytesRequired(column);
+    size_t required5 = TimestampFrozenColumn::bytesRequired(column);
+    size_t required6 = RunLengthFrozenColumn::bytesRequired(column);
+
+    // The specialized encodings return -1 (which is the largest size_t)
+    // when they can't represent the column.  They are used only when
+    // they're strictly smaller than the generic table encodings.
+    size_t generic = std::min(required1, required2);
+    size_t specialized = std::min({ required3, required4, required5,
+                                    required6 });
+
+    if (specialized < generic) {
+        if (required3 == specialized)
+            return std::make_shared<IntegerFrozenColumn>(column);
+        else if (required4 == specialized)
+            return std::make_shared<DoubleFrozenColumn>(column);
+        else if (required5 == specialized)
+            return std::make_shared<TimestampFrozenColumn>(column);
+        else return std::make_shared<RunLengthFrozenColumn>(column);
+    }
+
+    if (required1 <= required2)
+        return std::make_shared<TableFrozenColumn>(column);
+    else return std::make_shared<SparseTableFrozenColumn>(column);
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(ML::DB::Store_Reader & metadata,
+             const FrozenBlockReader & blocks)
+{
+    std::string type;
+    metadata >> type;
+
+    if (type == "Table")
+        return std::make_shared<TableFrozenColumn>(metadata, blocks);
+    else if (type == "SparseTable")
+        return std::make_shared<SparseTableFrozenColumn>(metadata, blocks);
+    else if (type == "Integer")
+        return std::make_shared<IntegerFrozenColumn>(metadata, blocks);
+    else if (type == "Double")
+        return std::make_shared<DoubleFrozenColumn>(metadata, blocks);
+    else if (type == "Timestamp")
+        return std::make_shared<TimestampFrozenColumn>(metadata, blocks);
+    else if (type == "RunLength")
+        return std::make_shared<RunLengthFrozenColumn>(metadata, blocks);
+
+    throw HttpReturnException(400, "Unknown frozen column type '" + type
+                              + "' reconstituting tabular dataset; file is "
+                              "probably corrupt or from a newer version");
+}
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+constexpr unsigned ColumnZoneMap::BLOOM_BITS;
+
+ColumnZoneMap::
+ColumnZoneMap()
+    : numValues(0), numNulls(0), valueClass(NO_VALUES)
+{
+    std::fill(bloom, bloom + BLOOM_BITS / 64, 0);
+}
+
+ColumnZoneMap::ValueClass
+ColumnZoneMap::
+getValueClass(const CellValue & val)
+{
+    switch (val.cellType()) {
+    case CellValue::INTEGER:
+        return NUMBERS;
+    case CellValue::FLOAT:
+        return std::isnan(val.toDouble()) ? UNORDERED : NUMBERS;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        return STRINGS;
+    case CellValue::TIMESTAMP:
+        return TIMESTAMPS;
+    default:
+        return UNORDERED;
+    }
+}
+
+uint64_t
+ColumnZoneMap::
+bloomHash(const CellValue & val)
+{
+    // 0.0 and -0.0 are equal but have different representations, and so
+    // different hashes
+    if (val.cellType() == CellValue::FLOAT && val.toDouble() == 0.0)
+        return CellValue(0.0).hash();
+    return val.hash();
+}
+
+void
+ColumnZoneMap::
+add(const CellValue & val)
+{
+    if (val.empty())
+        return;
+
+    ValueClass cls = getValueClass(val);
+    if (valueClass == NO_VALUES)
+        valueClass = cls;
+    else if (valueClass != cls)
+        valueClass = UNORDERED;
+
+    if (numValues == 0) {
+        minValue = maxValue = val;
+    }
+    else {
+        if (val < minValue)
+            minValue = val;
+        if (maxValue < val)
+            maxValue = val;
+    }
+    ++numValues;
+
+    uint64_t hash = bloomHash(val);
+    unsigned bit1 = hash % BLOOM_BITS;
+    unsigned bit2 = (hash >> 32) % BLOOM_BITS;
+    bloom[bit1 / 64] |= 1ULL << (bit1 % 64);
+    bloom[bit2 / 64] |= 1ULL << (bit2 % 64);
+}
+
+bool
+ColumnZoneMap::
+mayContain(const CellValue & val) const
+{
+    if (numValues == 0 || val.empty())
+        return false;
+
+    if (!mayContainRange(&val, true, &val, true))
+        return false;
+
+    uint64_t hash = bloomHash(val);
+    unsigned bit1 = hash % BLOOM_BITS;
+    unsigned bit2 = (hash >> 32) % BLOOM_BITS;
+    return (bloom[bit1 / 64] & (1ULL << (bit1 % 64)))
+        && (bloom[bit2 / 64] & (1ULL << (bit2 % 64)));
+}
+
+bool
+ColumnZoneMap::
+mayContainRange(const CellValue * lower, bool lowerInclusive,
+                const CellValue * upper, bool upperInclusive) const
+{
+    if (numValues == 0)
+        return false;
+    if (valueClass == UNORDERED
+        || (lower && getValueClass(*lower) != valueClass)
+        || (upper && getValueClass(*upper) != valueClass))
+        return true;
+
+    if (lower) {
+        // Everything is below the lower bound
+        if (lowerInclusive ? maxValue < *lower : !(*lower < maxValue))
+            return false;
+    }
+    if (upper) {
+        // Everything is above the upper bound
+        if (upperInclusive ? *upper < minValue : !(minValue < *upper))
+            return false;
+    }
+    return true;
+}
+
+void
+ColumnZoneMap::
+serialize(ML::DB::Store_Writer & metadata) const
+{
+    metadata << numValues << numNulls << (uint8_t)valueClass;
+    if (numValues) {
+        serializeCellValue(metadata, minValue);
+        serializeCellValue(metadata, maxValue);
+    }
+    for (auto & w: bloom)
+        metadata << w;
+}
+
+void
+ColumnZoneMap::
+reconstitute(ML::DB::Store_Reader & metadata)
+{
+    uint8_t cls;
+    metadata >> numValues >> numNulls >> cls;
+    valueClass = (ValueClass)cls;
+    if (numValues) {
+        minValue = reconstituteCellValue(metadata);
+        maxValue = reconstituteCellValue(metadata);
+    }
+    for (auto & w: bloom)
+        metadata >> w;
+}
+
+size_t
+ColumnZoneMap::
+memusage() const
+{
+    size_t result = sizeof(*this);
+    if (minValue.isString())
+        result += minValue.toStringLength();
+    if (maxValue.isString())
+        result += maxValue.toStringLength();
+    return result;
+}
+
+ColumnZoneMap
+ColumnZoneMap::
+build(const FrozenColumn & column, size_t numRows)
+{
+    ColumnZoneMap result;
+
+    FrozenColumnBlock block;
+    for (size_t start = 0;  start < numRows;
+         start += FrozenColumnBlock::DEFAULT_SIZE) {
+        uint32_t n = std::min<size_t>(numRows - start,
+                                      FrozenColumnBlock::DEFAULT_SIZE);
+        column.decodeBlock(start, n, block);
+        for (uint32_t i = 0;  i < n;  ++i) {
+            if (!block.isPresent(i))
+                ++result.numNulls;
+        }
+    }
+
+    auto onValue = [&] (const CellValue & val)
+        {
+            result.add(val);
+            return true;
+        };
+    column.forEachDistinctValue(onValue);
+
+    // add() counts distinct values; we want the number of rows
+    result.numValues = numRows - result.numNulls;
+
+    return result;
+}
+
+/*****************************************************************************/
+/* FROZEN COLUMN INDEX                                                       */
+/*****************************************************************************/
+
+void
+FrozenColumnIndex::
+addRows(size_t valueNum, std::vector<uint32_t> & rows) const
+{
+    const Postings & p = postings[valueNum];
+    if (!p.bitmap) {
+        rows.insert(rows.end(),
+                    rowNumbers.begin() + p.offset,
+                    rowNumbers.begin() + p.offset + p.count);
+        return;
+    }
+
+    const uint64_t * words = bitmaps.data() + p.offset;
+    for (uint32_t w = 0;  w < (numRows + 63) / 64;  ++w) {
+        for (uint64_t bits = words[w];  bits;  bits &= bits - 1)
+            rows.push_back(w * 64 + __builtin_ctzll(bits));
+    }
+}
+
+void
+FrozenColumnIndex::
+findRange(const CellValue * lower, bool lowerInclusive,
+          const CellValue * upper, bool upperInclusive,
+          const std::function<bool (const CellValue &)> & filter,
+          std::vector<uint32_t> & rows) const
+{
+    auto beginIt = values.begin(), endIt = values.end();
+
+    if (lower && ColumnZoneMap::getValueClass(*lower) == valueClass) {
+        beginIt = lowerInclusive
+            ? std::lower_bound(values.begin(), values.end(), *lower)
+            : std::upper_bound(values.begin(), values.end(), *lower);
+    }
+    if (upper && ColumnZoneMap::getValueClass(*upper) == valueClass) {
+        endIt = upperInclusive
+            ? std::upper_bound(beginIt, values.end(), *upper)
+            : std::lower_bound(beginIt, values.end(), *upper);
+    }
+
+    for (auto it = beginIt;  it < endIt;  ++it) {
+        if (filter(*it))
+            addRows(it - values.begin(), rows);
+    }
+}
+
+size_t
+FrozenColumnIndex::
+memusage() const
+{
+    size_t result = sizeof(*this)
+        + values.capacity() * sizeof(CellValue)
+        + postings.capacity() * sizeof(Postings)
+        + rowNumbers.capacity() * sizeof(uint32_t)
+        + bitmaps.capacity() * sizeof(uint64_t);
+    for (auto & v: values) {
+        if (v.isString())
+            result += v.toStringLength();
+    }
+    return result;
+}
+
+std::shared_ptr<const FrozenColumnIndex>
+FrozenColumnIndex::
+build(const FrozenColumn & column, size_t numRows)
+{
+    ExcAssertLessEqual(numRows, (size_t)std::numeric_limits<uint32_t>::max());
+
+    // Rows of each distinct value, in increasing order
+    std::unordered_map<CellValue, std::vector<uint32_t> > valueRows;
+    ColumnZoneMap::ValueClass valueClass = ColumnZoneMap::NO_VALUES;
+
+    FrozenColumnBlock block;
+    for (size_t start = 0;  start < numRows;
+         start += FrozenColumnBlock::DEFAULT_SIZE) {
+        uint32_t n = std::min<size_t>(numRows - start,
+                                      FrozenColumnBlock::DEFAULT_SIZE);
+        column.decodeBlock(start, n, block);
+        for (uint32_t i = 0;  i < n;  ++i) {
+            if (!block.isPresent(i))
+                continue;
+            CellValue val = block.get(i);
+            auto & rows = valueRows[val];
+            if (rows.empty()) {
+                // Values of different classes can't be sorted together
+                auto cls = ColumnZoneMap::getValueClass(val);
+                if (cls == ColumnZoneMap::UNORDERED
+                    || (valueClass != ColumnZoneMap::NO_VALUES
+                        && cls != valueClass))
+                    return nullptr;
+                valueClass = cls;
+            }
+            rows.push_back(start + i);
+        }
+    }
+
+    auto result = std::make_shared<FrozenColumnIndex>();
+    result->valueClass = valueClass;
+    result->numRows = numRows;
+
+    result->values.reserve(valueRows.size());
+    for (auto & v: valueRows)
+        result->values.push_back(v.first);
+    std::sort(result->values.begin(), result->values.end());
+
+    size_t bitmapWords = (numRows + 63) / 64;
+
+    result->postings.reserve(result->values.size());
+    for (auto & v: result->values) {
+        const std::vector<uint32_t> & rows = valueRows[v];
+        Postings p;
+        p.count = rows.size();
+
+        // The bitmap is smaller once more than one row in 32 has the value
+        p.bitmap = rows.size() * 32 > numRows;
+        if (p.bitmap) {
+            p.offset = result->bitmaps.size();
+            result->bitmaps.resize(p.offset + bitmapWords, 0);
+            uint64_t * words = result->bitmaps.data() + p.offset;
+            for (uint32_t r: rows)
+                words[r / 64] |= 1ULL << (r % 64);
+        }
+        else {
+            p.offset = result->rowNumbers.size();
+            result->rowNumbers.insert(result->rowNumbers.end(),
+                                      rows.begin(), rows.end());
+        }
+        result->postings.push_back(p);
+    }
+
+    result->bitmaps.shrink_to_fit();
+    result->rowNumbers.shrink_to_fit();
+
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -15,6 +15,107 @@ namespace Datacratic {
 namespace MLDB {
 
 struct TabularDatasetColumn;
+struct FrozenBlockWriter;
+struct FrozenBlockReader;
+
+/*****************************************************************************/
+/* FROZEN COLUMN BLOCK                                                       */
+/*****************************************************************************/
+
+/** A contiguous range of rows of a frozen column, decoded in one go into
+    typed buffers.  This allows scans to run a tight loop over the values
+    without a virtual call and a CellValue construction for each row.
+
+    Depending upon the encoding, each present row has either:
+    - INTEGERS: a 64 bit signed integer in integers[i]
+    - DOUBLES: a floating point value in doubles[i]
+    - TIMESTAMPS: a timestamp in doubles[i], as seconds since the epoch
+    - DICTIONARY: an index into the dictionary in indexes[i].  The
+      dictionary contains each distinct value only once, so that
+      predicates can be evaluated once per distinct value rather than
+      once per row.  String values can be used in place via their
+      stringChars() without being copied.
+
+    Whether a row has a value is recorded in the present bitmap.
+*/
+
+struct FrozenColumnBlock {
+    enum Encoding {
+        INTEGERS,
+        DOUBLES,
+        TIMESTAMPS,
+        DICTIONARY
+    };
+
+    /// Default number of rows to decode at once
+    static constexpr uint32_t DEFAULT_SIZE = 1024;
+
+    FrozenColumnBlock()
+        : encoding(DICTIONARY), startRow(0), numRows(0),
+          dictionary(nullptr), dictionarySize(0)
+    {
+    }
+
+    /// Reset to the given range, with no rows present
+    void clear(Encoding encoding, uint32_t startRow, uint32_t numRows)
+    {
+        this->encoding = encoding;
+        this->startRow = startRow;
+        this->numRows = numRows;
+        present.clear();
+        present.resize((numRows + 63) / 64, 0);
+        if (encoding == INTEGERS)
+            integers.resize(numRows);
+        else if (encoding == DOUBLES || encoding == TIMESTAMPS)
+            doubles.resize(numRows);
+        else indexes.resize(numRows);
+        dictionary = nullptr;
+        dictionarySize = 0;
+        ownedDictionary.clear();
+    }
+
+    bool isPresent(uint32_t i) const
+    {
+        return present[i / 64] & (1ULL << (i % 64));
+    }
+
+    void setPresent(uint32_t i)
+    {
+        present[i / 64] |= (1ULL << (i % 64));
+    }
+
+    /// Return the value for the ith row of the block
+    CellValue get(uint32_t i) const
+    {
+        if (!isPresent(i))
+            return CellValue();
+        switch (encoding) {
+        case INTEGERS:
+            return integers[i];
+        case DOUBLES:
+            return doubles[i];
+        case TIMESTAMPS:
+            return Date::fromSecondsSinceEpoch(doubles[i]);
+        case DICTIONARY:
+            break;
+        }
+        return dictionary[indexes[i]];
+    }
+
+    Encoding encoding;
+    uint32_t startRow;
+    uint32_t numRows;
+    std::vector<uint64_t> present;
+    std::vector<int64_t> integers;
+    std::vector<double> doubles;
+    std::vector<uint32_t> indexes;
+    const CellValue * dictionary;
+    size_t dictionarySize;
+
+    /// Storage for the dictionary when the column doesn't have one
+    std::vector<CellValue> ownedDictionary;
+};
+
 
 /*****************************************************************************/
 /* FROZEN COLUMN                                                             */
@@ -41,24 +142,194 @@ struct FrozenColumn {
         return this->get(index);
     }
 
+    /** Decode the rows from startRow to startRow + numRows into the given
+        block.  Row numbers are the same as those passed to get().  The
+        default implementation calls get() for each row; frozen columns
+        should override it with a sequential decoder.
+    */
+    virtual void decodeBlock(uint32_t startRow, uint32_t numRows,
+                             FrozenColumnBlock & block) const;
+
     template<typename Fn>
     bool forEach(Fn && fn) const
     {
         // TODO: sparse columns have nulls...
         size_t sz = this->size();
-        for (size_t i = 0;  i < sz;  ++i) {
-            if (!fn(i, std::move(this->get(i))))
-                return false;
-        } 
+        FrozenColumnBlock block;
+        for (size_t start = 0;  start < sz;
+             start += FrozenColumnBlock::DEFAULT_SIZE) {
+            uint32_t n = std::min<size_t>(sz - start,
+                                          FrozenColumnBlock::DEFAULT_SIZE);
+            this->decodeBlock(start, n, block);
+            for (uint32_t i = 0;  i < n;  ++i) {
+                if (!fn(start + i, block.get(i)))
+                    return false;
+            }
+        }
         return true;
     }
 
     virtual ColumnTypes getColumnTypes() const = 0;
 
+    /** Serialize the column.  Its structure goes into the metadata, and its
+        bulk storage into blocks that can be used in place once the file is
+        memory mapped.
+    */
+    virtual void serialize(ML::DB::Store_Writer & metadata,
+                           FrozenBlockWriter & blocks) const = 0;
+
     static std::shared_ptr<FrozenColumn>
     freeze(TabularDatasetColumn & column);
+
+    /** Reconstitute a column that was written by serialize().  The
+        returned column refers directly to the memory of the blocks.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(ML::DB::Store_Reader & metadata,
+                 const FrozenBlockReader & blocks);
 };
 
 
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+/** Summary of the values of a frozen column over one chunk of rows: the
+    range of its values, how many are null and a small bloom filter of its
+    distinct values.  This allows a scan to skip a whole chunk without
+    decoding it when the predicate can't match any of the chunk's values.
+
+    The tests are conservative: they may return true for a chunk that has
+    no matching values, but never return false for a chunk that has one.
+    The range uses the CellValue ordering, which is only a strict weak
+    ordering amongst numbers (without NaN), strings or timestamps, so it
+    is used only when all values and the bound are of the same class.
+*/
+
+struct ColumnZoneMap {
+    ColumnZoneMap();
+
+    /// Number of non-null values
+    uint64_t numValues;
+
+    /// Number of rows in the chunk where the column is null
+    uint64_t numNulls;
+
+    /// Smallest and largest non-null values, according to CellValue's
+    /// operator <
+    CellValue minValue;
+    CellValue maxValue;
+
+    enum ValueClass: uint8_t {
+        NO_VALUES,    ///< Only nulls so far
+        NUMBERS,      ///< Integers and floating point, excluding NaN
+        STRINGS,      ///< Ascii and UTF-8 strings
+        TIMESTAMPS,   ///< Timestamps
+        UNORDERED     ///< Anything else, or a mix of classes
+    };
+
+    /// Class of all of the values, which says whether minValue and
+    /// maxValue can be used to skip ranges
+    ValueClass valueClass;
+
+    static ValueClass getValueClass(const CellValue & val);
+
+    static constexpr unsigned BLOOM_BITS = 1024;
+
+    /// Bloom filter of the hashes of the distinct values
+    uint64_t bloom[BLOOM_BITS / 64];
+
+    /// Add a (distinct) value to the summary.  Nulls are ignored.
+    void add(const CellValue & val);
+
+    /// Can the column contain a value equal to val?
+    bool mayContain(const CellValue & val) const;
+
+    /** Can the column contain a value in the given range?  A null bound
+        means the range is unbounded on that side.
+    */
+    bool mayContainRange(const CellValue * lower, bool lowerInclusive,
+                         const CellValue * upper, bool upperInclusive) const;
+
+    void serialize(ML::DB::Store_Writer & metadata) const;
+    void reconstitute(ML::DB::Store_Reader & metadata);
+
+    size_t memusage() const;
+
+    /** Calculate the zone map of a column.  numRows is the number of rows
+        in the chunk, which is more than the number of values stored for
+        sparse columns.
+    */
+    static ColumnZoneMap build(const FrozenColumn & column, size_t numRows);
+
+private:
+    static uint64_t bloomHash(const CellValue & val);
+};
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN INDEX                                                       */
+/*****************************************************************************/
+
+/** Secondary index of the values of a frozen column over one chunk of
+    rows.  It holds the sorted distinct values of the column, and for each
+    of them the rows that contain it.  The rows are stored as a sorted
+    list, or as a bitmap over the whole chunk for values that are common
+    enough that the bitmap takes less memory.
+
+    This allows equality, IN and range predicates to find the matching
+    rows without decoding the column.
+*/
+
+struct FrozenColumnIndex {
+    /// Distinct non-null values, sorted by CellValue's operator <
+    std::vector<CellValue> values;
+
+    /// Class of the values, which are all of the same class
+    ColumnZoneMap::ValueClass valueClass;
+
+    /// Number of rows in the chunk
+    uint32_t numRows;
+
+    /// Where the rows of each value are stored.  If bitmap is true, the
+    /// bitmap starts at bitmaps[offset] and has one bit per row of the
+    /// chunk; otherwise the rows are rowNumbers[offset, offset + count).
+    struct Postings {
+        uint32_t offset;
+        uint32_t count;
+        bool bitmap;
+    };
+
+    std::vector<Postings> postings;
+    std::vector<uint32_t> rowNumbers;
+    std::vector<uint64_t> bitmaps;
+
+    /** Add to rows the number of each row whose value is in the given
+        range and for which filter returns true.  A null bound means the
+        range is unbounded on that side.  The range is only used to narrow
+        the search when the bounds are of the same class as the values;
+        filter is what decides whether a value matches.  The rows are
+        appended in no particular order.
+    */
+    void findRange(const CellValue * lower, bool lowerInclusive,
+                   const CellValue * upper, bool upperInclusive,
+                   const std::function<bool (const CellValue &)> & filter,
+                   std::vector<uint32_t> & rows) const;
+
+    size_t memusage() const;
+
+    /** Index the given column, which has numRows rows in its chunk.
+        Returns null if the column can't be indexed, which is the case
+        when its values aren't all numbers, strings or timestamps, as
+        they can't then be sorted.
+    */
+    static std::shared_ptr<const FrozenColumnIndex>
+    build(const FrozenColumn & column, size_t numRows);
+
+private:
+    void addRows(size_t valueNum, std::vector<uint32_t> & rows) const;
+};
+
 } // namespace MLDB
 } // namespace Datacratic
@@ -0,0 +1,330 @@
+/** frozen_serialization.cc                                       -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of the on-disk format for frozen columns.
+*/
+
+#include "frozen_serialization.h"
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include "mldb/types/url.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/http/http_exception.h"
+#include <sstream>
+#include <cstring>
+
+using namespace std;
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+static const char FROZEN_FILE_MAGIC[8] = { 'M', 'L', 'D', 'B', 'F', 'R', 'Z', '1' };
+static constexpr size_t FROZEN_FILE_HEADER_LENGTH = 16;
+static constexpr size_t FROZEN_FILE_FOOTER_LENGTH = 24;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* FROZEN BLOCK WRITER                                                       */
+/*****************************************************************************/
+
+FrozenBlockWriter::
+FrozenBlockWriter(std::ostream & stream, uint64_t startOffset)
+    : stream(stream), offset_(startOffset)
+{
+}
+
+uint64_t
+FrozenBlockWriter::
+write(const void * data, size_t length)
+{
+    align(8);
+    uint64_t result = offset_;
+    stream.write((const char *)data, length);
+    offset_ += length;
+    return result;
+}
+
+void
+FrozenBlockWriter::
+align(size_t alignment)
+{
+    static const char zeros[64] = { 0 };
+    ExcAssertLessEqual(alignment, sizeof(zeros));
+    size_t padding = (alignment - offset_ % alignment) % alignment;
+    stream.write(zeros, padding);
+    offset_ += padding;
+}
+
+
+/*****************************************************************************/
+/* FROZEN BLOCK READER                                                       */
+/*****************************************************************************/
+
+FrozenBlockReader::
+FrozenBlockReader(std::shared_ptr<const void> owner,
+                  const char * data, size_t length)
+    : owner(std::move(owner)), data(data), length(length)
+{
+}
+
+const char *
+FrozenBlockReader::
+getRaw(uint64_t offset, size_t length, size_t alignment) const
+{
+    if (offset > this->length || length > this->length - offset)
+        throw HttpReturnException(400, "Frozen file block is out of range; "
+                                  "the file is probably truncated or corrupt",
+                                  "offset", offset,
+                                  "length", length,
+                                  "fileLength", this->length);
+    const char * result = data + offset;
+    if ((size_t)result % alignment != 0)
+        throw HttpReturnException(400, "Frozen file block is misaligned",
+                                  "offset", offset);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* FROZEN FILES                                                              */
+/*****************************************************************************/
+
+void saveFrozenFile(const Url & url,
+                    const std::string & fileType,
+                    int version,
+                    const std::function<void (ML::DB::Store_Writer & metadata,
+                                              FrozenBlockWriter & blocks)>
+                        & writeContents)
+{
+    filter_ostream stream(url);
+
+    char header[FROZEN_FILE_HEADER_LENGTH] = { 0 };
+    std::copy(FROZEN_FILE_MAGIC, FROZEN_FILE_MAGIC + 8, header);
+    stream.write(header, FROZEN_FILE_HEADER_LENGTH);
+
+    FrozenBlockWriter blocks(stream, FROZEN_FILE_HEADER_LENGTH);
+
+    // The metadata is accumulated in memory and written after the blocks,
+    // so that the blocks can be streamed out as they are produced.
+    std::ostringstream metadataStream;
+    {
+        ML::DB::Store_Writer metadata(metadataStream);
+        metadata << fileType << version;
+        writeContents(metadata, blocks);
+    }
+
+    std::string metadata = metadataStream.str();
+    uint64_t metadataOffset = blocks.write(metadata.data(), metadata.size());
+    uint64_t metadataLength = metadata.size();
+
+    char footer[FROZEN_FILE_FOOTER_LENGTH];
+    std::memcpy(footer, &metadataOffset, 8);
+    std::memcpy(footer + 8, &metadataLength, 8);
+    std::memcpy(footer + 16, FROZEN_FILE_MAGIC, 8);
+    stream.write(footer, FROZEN_FILE_FOOTER_LENGTH);
+
+    stream.close();
+}
+
+void loadFrozenFile(const Url & url,
+                    const std::string & fileType,
+                    int version,
+                    const std::function<void (ML::DB::Store_Reader & metadata,
+                                              const FrozenBlockReader & blocks)>
+                        & readContents)
+{
+    auto stream = std::make_shared<filter_istream>
+        (url, std::map<std::string, std::string>{ { "mapped", "true" } });
+
+    const char * data;
+    size_t length;
+    std::shared_ptr<const void> owner;
+
+    std::tie(data, length) = stream->mapped();
+    if (data) {
+        owner = stream;
+    }
+    else {
+        // Not mappable (compressed or remote); read it into memory instead
+        auto contents = std::make_shared<std::string>(stream->readAll());
+        data = contents->data();
+        length = contents->size();
+        owner = contents;
+    }
+
+    if (length < FROZEN_FILE_HEADER_LENGTH + FROZEN_FILE_FOOTER_LENGTH
+        || !std::equal(FROZEN_FILE_MAGIC, FROZEN_FILE_MAGIC + 8, data)
+        || !std::equal(FROZEN_FILE_MAGIC, FROZEN_FILE_MAGIC + 8,
+                       data + length - 8)) {
+        throw HttpReturnException(400, "File does not appear to be an MLDB "
+                                  "frozen file",
+                                  "url", url);
+    }
+
+    uint64_t metadataOffset, metadataLength;
+    const char * footer = data + length - FROZEN_FILE_FOOTER_LENGTH;
+    std::memcpy(&metadataOffset, footer, 8);
+    std::memcpy(&metadataLength, footer + 8, 8);
+
+    FrozenBlockReader blocks(owner, data, length - FROZEN_FILE_FOOTER_LENGTH);
+
+    ML::DB::Store_Reader metadata(blocks.getRaw(metadataOffset, metadataLength),
+                                  metadataLength);
+
+    std::string foundFileType;
+    int foundVersion;
+    metadata >> foundFileType >> foundVersion;
+
+    if (foundFileType != fileType) {
+        throw HttpReturnException(400, "Frozen file is of the wrong type",
+                                  "url", url,
+                                  "expectedType", fileType,
+                                  "foundType", foundFileType);
+    }
+    if (foundVersion != version) {
+        throw HttpReturnException(400, ML::format(
+                    "invalid frozen file version! expected %d, got %d",
+                    version, foundVersion),
+                    "url", url);
+    }
+
+    readContents(metadata, blocks);
+}
+
+
+/*****************************************************************************/
+/* CELL VALUE AND PATH SERIALIZATION                                         */
+/*****************************************************************************/
+
+void serializeCellValue(ML::DB::Store_Writer & store, const CellValue & val)
+{
+    CellValue::CellType type = val.cellType();
+    store << (unsigned char)type;
+
+    switch (type) {
+    case CellValue::EMPTY:
+        return;
+    case CellValue::INTEGER:
+        if (val.isInt64())
+            store << false << (int64_t)val.toInt();
+        else store << true << (uint64_t)val.toUInt();
+        return;
+    case CellValue::FLOAT:
+        store << val.toDouble();
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        store << std::string(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        store << val.toTimestamp();
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        store << months << days << seconds;
+        return;
+    }
+    case CellValue::BLOB:
+        store << std::string((const char *)val.blobData(), val.blobLength());
+        return;
+    case CellValue::PATH:
+        serializePath(store, val.coerceToPath());
+        return;
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw HttpReturnException(500, "Can't serialize unknown cell type",
+                              "cellType", (int)type);
+}
+
+CellValue reconstituteCellValue(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    store >> type;
+
+    switch (type) {
+    case CellValue::EMPTY:
+        return CellValue();
+    case CellValue::INTEGER: {
+        bool isUnsigned;
+        store >> isUnsigned;
+        if (isUnsigned) {
+            uint64_t val;
+            store >> val;
+            return val;
+        }
+        int64_t val;
+        store >> val;
+        return val;
+    }
+    case CellValue::FLOAT: {
+        double val;
+        store >> val;
+        return val;
+    }
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING: {
+        std::string val;
+        store >> val;
+        return CellValue(val.data(), val.length(),
+                         type == CellValue::ASCII_STRING
+                         ? STRING_IS_VALID_ASCII
+                         : STRING_IS_VALID_UTF8_NOT_ASCII);
+    }
+    case CellValue::TIMESTAMP: {
+        Date val;
+        store >> val;
+        return val;
+    }
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        store >> months >> days >> seconds;
+        return CellValue::fromMonthDaySecond(months, days, seconds);
+    }
+    case CellValue::BLOB: {
+        std::string val;
+        store >> val;
+        return CellValue::blob(std::move(val));
+    }
+    case CellValue::PATH:
+        return CellValue(reconstitutePath(store));
+    }
+
+    throw HttpReturnException(400, "Unknown cell type reconstituting frozen "
+                              "cell value; file is probably corrupt",
+                              "cellType", (int)type);
+}
+
+void serializePath(ML::DB::Store_Writer & store, const Path & path)
+{
+    store << ML::DB::compact_size_t(path.size());
+    for (size_t i = 0;  i < path.size();  ++i)
+        store << path[i].getBytes();
+}
+
+Path reconstitutePath(ML::DB::Store_Reader & store)
+{
+    ML::DB::compact_size_t size(store);
+    PathBuilder builder;
+    for (size_t i = 0;  i < size;  ++i) {
+        std::string bytes;
+        store >> bytes;
+        builder.add(bytes.data(), bytes.length());
+    }
+    return builder.extract();
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,147 @@
+/** frozen_serialization.h                                        -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Versioned, memory mappable on-disk format for frozen columns and the
+    chunks of a tabular dataset.
+
+    A file is laid out as follows:
+
+    - A 16 byte header containing a magic number;
+    - The bulk storage blocks of the frozen columns, each aligned on an
+      8 byte boundary so that they can be used directly from a memory
+      mapping;
+    - The metadata, serialized with an ML::DB::Store_Writer, which
+      describes the structure and contains the offsets of the blocks;
+    - A 24 byte footer containing the offset and length of the metadata
+      and a copy of the magic number.
+
+    Loading a file only requires the metadata to be read; the blocks are
+    paged in lazily by the operating system the first time they're
+    scanned.  Blocks are stored in native (little endian) byte order.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <memory>
+#include <iostream>
+#include <functional>
+
+namespace Datacratic {
+
+struct Url;
+
+namespace MLDB {
+
+struct CellValue;
+struct Path;
+
+
+/*****************************************************************************/
+/* FROZEN BLOCK WRITER                                                       */
+/*****************************************************************************/
+
+/** Writes the bulk storage of frozen columns into a stream, keeping track
+    of the offset at which each block was written so that it can be
+    recorded in the metadata.
+*/
+
+struct FrozenBlockWriter {
+    FrozenBlockWriter(std::ostream & stream, uint64_t startOffset = 0);
+
+    /** Write the given block of memory, aligned on an 8 byte boundary,
+        and return the offset in the file at which it was written.
+    */
+    uint64_t write(const void * data, size_t length);
+
+    /** Pad the stream with zeros until it's aligned on the given boundary. */
+    void align(size_t alignment = 8);
+
+    /** Current offset within the file. */
+    uint64_t offset() const { return offset_; }
+
+private:
+    std::ostream & stream;
+    uint64_t offset_;
+};
+
+
+/*****************************************************************************/
+/* FROZEN BLOCK READER                                                       */
+/*****************************************************************************/
+
+/** Gives access to the blocks of a frozen file, which is normally memory
+    mapped.  Each block returned holds a reference to the underlying
+    mapping, so it stays valid as long as any column uses it.
+*/
+
+struct FrozenBlockReader {
+    FrozenBlockReader(std::shared_ptr<const void> owner,
+                      const char * data, size_t length);
+
+    /** Return a pointer to the given block, which shares ownership of the
+        underlying mapping.  Throws if the block is out of range or
+        misaligned.
+    */
+    template<typename T>
+    std::shared_ptr<const T> get(uint64_t offset, size_t length) const
+    {
+        return std::shared_ptr<const T>
+            (owner,
+             reinterpret_cast<const T *>(getRaw(offset, length, alignof(T))));
+    }
+
+    /** Return the raw pointer to the given block, checking its bounds and
+        alignment.
+    */
+    const char * getRaw(uint64_t offset, size_t length,
+                        size_t alignment = 1) const;
+
+private:
+    std::shared_ptr<const void> owner;
+    const char * data;
+    size_t length;
+};
+
+
+/*****************************************************************************/
+/* FROZEN FILES                                                              */
+/*****************************************************************************/
+
+/** Save a frozen file to the given URL.  The writeContents function is
+    called to write the blocks and the metadata; the file type and version
+    are recorded at the start of the metadata and checked on load.
+*/
+void saveFrozenFile(const Url & url,
+                    const std::string & fileType,
+                    int version,
+                    const std::function<void (ML::DB::Store_Writer & metadata,
+                                              FrozenBlockWriter & blocks)>
+                        & writeContents);
+
+/** Load a frozen file from the given URL, memory mapping it if the
+    underlying filesystem allows it and otherwise reading it into memory.
+    The readContents function is called with the metadata and the blocks.
+    Throws if the file isn't of the given type and version.
+*/
+void loadFrozenFile(const Url & url,
+                    const std::string & fileType,
+                    int version,
+                    const std::function<void (ML::DB::Store_Reader & metadata,
+                                              const FrozenBlockReader & blocks)>
+                        & readContents);
+
+
+/*****************************************************************************/
+/* CELL VALUE AND PATH SERIALIZATION                                         */
+/*****************************************************************************/
+
+void serializeCellValue(ML::DB::Store_Writer & store, const CellValue & val);
+CellValue reconstituteCellValue(ML::DB::Store_Reader & store);
+
+void serializePath(ML::DB::Store_Writer & store, const Path & path);
+Path reconstitutePath(ML::DB::Store_Reader & store);
+
+} // namespace MLDB
+} // namespace Datacratic
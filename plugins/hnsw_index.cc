@@ -0,0 +1,372 @@
+/** hnsw_index.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of the hierarchical navigable small world graph index.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include <unordered_set>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+HnswIndex::
+HnswIndex(int numNeighbors, int efConstruction)
+    : numNeighbors(numNeighbors), efConstruction(efConstruction),
+      entryPoint(-1), topLayer(-1)
+{
+    ExcAssertGreater(numNeighbors, 1);
+    ExcAssertGreater(efConstruction, 0);
+}
+
+int
+HnswIndex::
+chooseLayer(int item) const
+{
+    // We hash the item number instead of using a random number generator,
+    // so that the layers (and the index if it's built sequentially) are
+    // the same from one run to the next.  This is the splitmix64 finalizer.
+    uint64_t h = item + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h = h ^ (h >> 31);
+
+    // Uniform in (0, 1]
+    double u = ((h >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    return -std::log(u) / std::log((double)numNeighbors);
+}
+
+size_t
+HnswIndex::
+maxLinks(int layer) const
+{
+    return layer == 0 ? 2 * numNeighbors : numNeighbors;
+}
+
+void
+HnswIndex::
+getLinks(int item, int layer, std::vector<int> & links,
+         InsertLocks * locks) const
+{
+    if (locks) {
+        std::unique_lock<std::mutex> guard((*locks)[item]);
+        links = nodes[item].links[layer];
+    }
+    else {
+        links = nodes[item].links[layer];
+    }
+}
+
+HnswIndex::Candidate
+HnswIndex::
+greedySearch(const QueryDistance & dist, Candidate entry,
+             int fromLayer, int toLayer, InsertLocks * locks) const
+{
+    std::vector<int> links;
+
+    for (int layer = fromLayer;  layer > toLayer;  --layer) {
+        for (bool changed = true;  changed;  ) {
+            changed = false;
+            getLinks(entry.second, layer, links, locks);
+            for (int n: links) {
+                float d = dist(n);
+                if (d < entry.first) {
+                    entry = Candidate(d, n);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return entry;
+}
+
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+searchLayer(const QueryDistance & dist,
+            const std::vector<Candidate> & entries,
+            int ef, int layer, InsertLocks * locks) const
+{
+    std::unordered_set<int> visited;
+
+    // Nodes whose links are still to be followed, closest on top
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate> > toVisit;
+
+    // Closest nodes found so far, furthest on top
+    std::priority_queue<Candidate> found;
+
+    for (auto & e: entries) {
+        if (!visited.insert(e.second).second)
+            continue;
+        toVisit.push(e);
+        found.push(e);
+        if (found.size() > (size_t)ef)
+            found.pop();
+    }
+
+    std::vector<int> links;
+
+    while (!toVisit.empty()) {
+        Candidate current = toVisit.top();
+
+        // Nothing left to visit can bring us any closer
+        if (found.size() >= (size_t)ef && current.first > found.top().first)
+            break;
+
+        toVisit.pop();
+
+        getLinks(current.second, layer, links, locks);
+
+        for (int n: links) {
+            if (!visited.insert(n).second)
+                continue;
+
+            float d = dist(n);
+            if (found.size() < (size_t)ef || d < found.top().first) {
+                toVisit.emplace(d, n);
+                found.emplace(d, n);
+                if (found.size() > (size_t)ef)
+                    found.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result(found.size());
+    for (size_t i = result.size();  i > 0;  --i) {
+        result[i - 1] = found.top();
+        found.pop();
+    }
+
+    return result;
+}
+
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+selectNeighbors(const std::vector<Candidate> & candidates, size_t num,
+                const ItemDistance & dist) const
+{
+    std::vector<Candidate> result;
+
+    for (auto & c: candidates) {
+        if (result.size() >= num)
+            break;
+
+        bool keep = true;
+        for (auto & r: result) {
+            if (dist(c.second, r.second) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+
+        if (keep)
+            result.push_back(c);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+insertItem(int item, const ItemDistance & dist, InsertLocks * locks)
+{
+    int layer = nodes[item].links.size() - 1;
+
+    // If this node goes above the current top layer, it will become the
+    // new entry point, and no other insert can start until it's done.
+    std::unique_lock<std::mutex> entryGuard;
+    if (locks)
+        entryGuard = std::unique_lock<std::mutex>(locks->entryPointMutex);
+
+    int entry = entryPoint;
+    int currentTopLayer = topLayer;
+
+    if (entry == -1) {
+        entryPoint = item;
+        topLayer = layer;
+        return;
+    }
+
+    if (layer <= currentTopLayer && entryGuard)
+        entryGuard.unlock();
+
+    auto queryDist = [&] (int other) { return dist(item, other); };
+
+    Candidate closest
+        = greedySearch(queryDist, Candidate(queryDist(entry), entry),
+                       currentTopLayer, layer, locks);
+
+    std::vector<Candidate> entries(1, closest);
+
+    for (int l = std::min(layer, currentTopLayer);  l >= 0;  --l) {
+        entries = searchLayer(queryDist, entries, efConstruction, l, locks);
+
+        auto neighbors = selectNeighbors(entries, numNeighbors, dist);
+
+        {
+            std::vector<int> links;
+            for (auto & n: neighbors)
+                links.push_back(n.second);
+
+            std::unique_lock<std::mutex> guard;
+            if (locks)
+                guard = std::unique_lock<std::mutex>((*locks)[item]);
+            nodes[item].links[l] = std::move(links);
+        }
+
+        // Add the backwards links, pruning the neighbour's links if it now
+        // has too many
+        for (auto & n: neighbors) {
+            std::unique_lock<std::mutex> guard;
+            if (locks)
+                guard = std::unique_lock<std::mutex>((*locks)[n.second]);
+
+            std::vector<int> & links = nodes[n.second].links[l];
+
+            if (links.size() < maxLinks(l)) {
+                links.push_back(item);
+                continue;
+            }
+
+            std::vector<Candidate> candidates;
+            candidates.reserve(links.size() + 1);
+            candidates.emplace_back(n.first, item);
+            for (int o: links)
+                candidates.emplace_back(dist(n.second, o), o);
+            std::sort(candidates.begin(), candidates.end());
+
+            auto kept = selectNeighbors(candidates, maxLinks(l), dist);
+
+            links.clear();
+            for (auto & k: kept)
+                links.push_back(k.second);
+        }
+    }
+
+    if (layer > currentTopLayer) {
+        entryPoint = item;
+        topLayer = layer;
+    }
+}
+
+void
+HnswIndex::
+insert(int end, const ItemDistance & dist)
+{
+    int begin = nodes.size();
+    if (end <= begin)
+        return;
+
+    // All nodes get their layers before any insert starts, so that the
+    // node array isn't modified while other threads are reading it
+    nodes.resize(end);
+    for (int i = begin;  i < end;  ++i)
+        nodes[i].links.resize(chooseLayer(i) + 1);
+
+    if (entryPoint == -1)
+        insertItem(begin++, dist, nullptr);
+
+    // Small inserts aren't worth the overhead of the locking
+    if (end - begin < 1000) {
+        for (int i = begin;  i < end;  ++i)
+            insertItem(i, dist, nullptr);
+        return;
+    }
+
+    std::unique_ptr<InsertLocks> locks(new InsertLocks());
+
+    auto doItem = [&] (int i)
+        {
+            insertItem(i, dist, locks.get());
+        };
+
+    parallelMap(begin, end, doItem);
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const QueryDistance & dist, int numNeighbors, float maxDistance,
+       int efSearch) const
+{
+    std::vector<std::pair<float, int> > result;
+
+    if (entryPoint == -1 || numNeighbors <= 0)
+        return result;
+
+    Candidate closest
+        = greedySearch(dist, Candidate(dist(entryPoint), entryPoint),
+                       topLayer, 0, nullptr);
+
+    auto found = searchLayer(dist, { closest },
+                             std::max(efSearch, numNeighbors),
+                             0 /* layer */, nullptr);
+
+    for (auto & f: found) {
+        if (f.first > maxDistance || result.size() >= (size_t)numNeighbors)
+            break;
+        result.push_back(f);
+    }
+
+    return result;
+}
+
+size_t
+HnswIndex::
+memusage() const
+{
+    size_t result = sizeof(*this) + nodes.capacity() * sizeof(Node);
+    for (auto & n: nodes) {
+        result += n.links.capacity() * sizeof(std::vector<int>);
+        for (auto & l: n.links)
+            result += l.capacity() * sizeof(int);
+    }
+    return result;
+}
+
+void
+HnswIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << ML::DB::compact_size_t(1)  // version
+          << numNeighbors << efConstruction << entryPoint << topLayer
+          << ML::DB::compact_size_t(nodes.size());
+    for (auto & n: nodes)
+        store << n.links;
+}
+
+void
+HnswIndex::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    ML::DB::compact_size_t version(store);
+    if (version != 1)
+        throw ML::Exception("Unknown HNSW index version %d", (int)version);
+
+    store >> numNeighbors >> efConstruction >> entryPoint >> topLayer;
+
+    ML::DB::compact_size_t numNodes(store);
+    nodes.clear();
+    nodes.resize(numNodes);
+    for (auto & n: nodes)
+        store >> n.links;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
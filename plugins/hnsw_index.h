@@ -0,0 +1,158 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Approximate nearest neighbours index based upon a hierarchical navigable
+    small world graph.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <functional>
+#include <vector>
+#include <utility>
+#include <mutex>
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbours index using a Hierarchical Navigable
+    Small World graph (Malkov and Yashunin, 2016).
+
+    Each item is a node in a graph, in which it's linked to a small number
+    of its close neighbours.  A search walks the graph greedily towards
+    the query.  A sparse hierarchy of layers over the bottom one (which
+    contains every item) allows the walk to make long jumps first, so that
+    the number of nodes visited grows with the log of the number of items,
+    and unlike the vantage point tree doesn't blow up with the number of
+    dimensions.
+
+    The items are the integers from 0 to size() - 1 and are inserted in
+    that order.  The index doesn't know their coordinates; it only asks for
+    the distance between items or between the query and an item through
+    the functions that are passed in.  Items can be added to an existing
+    index without rebuilding it.
+*/
+
+struct HnswIndex {
+
+    /** Distance between two items of the index. */
+    typedef std::function<float (int item1, int item2)> ItemDistance;
+
+    /** Distance between the query and an item of the index. */
+    typedef std::function<float (int item)> QueryDistance;
+
+    /** Create an empty index.  Each node keeps links to numNeighbors
+        others (twice that on the bottom layer), and efConstruction
+        candidates are considered when choosing them.  Higher values of
+        either give better recall for a larger index and slower inserts.
+    */
+    HnswIndex(int numNeighbors = 16, int efConstruction = 100);
+
+    /** Number of items in the index. */
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    /** Insert the items from size() up to (but not including) end.  Large
+        numbers of items are inserted from several threads at once, so
+        dist needs to be thread safe.
+    */
+    void insert(int end, const ItemDistance & dist);
+
+    /** Return the (approximately) closest numNeighbors items to the query
+        as (distance, item) pairs, closest first, leaving out any further
+        away than maxDistance.  efSearch candidates (but at least
+        numNeighbors) are kept during the search; higher values give better
+        recall for slower searches.  Several searches may run at once, but
+        not at the same time as an insert.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & dist, int numNeighbors, float maxDistance,
+           int efSearch) const;
+
+    /** Approximate memory used by the index, in bytes. */
+    size_t memusage() const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    typedef std::pair<float, int> Candidate;
+
+    struct Node {
+        /// Neighbours of the node for each layer, from the bottom layer
+        /// up to the top layer of the node
+        std::vector<std::vector<int> > links;
+    };
+
+    /// Locks used while inserting in parallel.  A node's links are only
+    /// ever accessed under the lock for its stripe, and no more than one
+    /// lock is held at once.
+    struct InsertLocks {
+        static constexpr int NUM_STRIPES = 4096;
+        std::mutex stripes[NUM_STRIPES];
+        std::mutex entryPointMutex;
+
+        std::mutex & operator [] (int item)
+        {
+            return stripes[item % NUM_STRIPES];
+        }
+    };
+
+    int numNeighbors;
+    int efConstruction;
+    std::vector<Node> nodes;
+    int entryPoint;   ///< Node at which searches start, or -1 if empty
+    int topLayer;     ///< Layer of the entry point
+
+    /** Choose the top layer of an item.  Layers are exponentially
+        distributed, with each layer having 1 / numNeighbors of the nodes
+        of the one below.
+    */
+    int chooseLayer(int item) const;
+
+    /** Maximum number of links that a node keeps on the given layer. */
+    size_t maxLinks(int layer) const;
+
+    /** Copy the links of the given item on the given layer into links. */
+    void getLinks(int item, int layer, std::vector<int> & links,
+                  InsertLocks * locks) const;
+
+    /** Walk greedily from the entry on each layer from fromLayer down to
+        (but not including) toLayer, and return the closest node found.
+    */
+    Candidate greedySearch(const QueryDistance & dist, Candidate entry,
+                           int fromLayer, int toLayer,
+                           InsertLocks * locks) const;
+
+    /** Return the (approximately) ef closest nodes to the query on the
+        given layer, closest first.
+    */
+    std::vector<Candidate>
+    searchLayer(const QueryDistance & dist,
+                const std::vector<Candidate> & entries,
+                int ef, int layer, InsertLocks * locks) const;
+
+    /** Choose at most num neighbours from the candidates (which are sorted
+        closest first), leaving out those which are closer to an already
+        chosen neighbour than to the node itself, so that the links go
+        out in different directions.
+    */
+    std::vector<Candidate>
+    selectNeighbors(const std::vector<Candidate> & candidates, size_t num,
+                    const ItemDistance & dist) const;
+
+    /** Link the given item into the graph. */
+    void insertItem(int item, const ItemDistance & dist, InsertLocks * locks);
+};
+
+} // namespace MLDB
+} // namespace Datacratic
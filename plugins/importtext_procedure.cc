@@ -11,6 +11,7 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/base/parallel.h"
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/plugins/csv_scanner.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/sql/sql_expression.h"
@@ -82,9 +83,9 @@ ImportTextConfigDescription::ImportTextConfigDescription()
              SqlExpression::parse("fileTimestamp()"));
     addField("allowMultiLines", &ImportTextConfig::allowMultiLines,
              "Allows columns with multi-line quoted strings. "
-             "This option disables many optimizations and makes the procedure "
-             "run much slower. Only use if necessary. The `offset` parameter "
-             "will not be reliable when this is activated.", false);
+             "Newlines within the quoted strings are replaced by spaces. "
+             "The `offset` parameter will not be reliable when this is "
+             "activated.", false);
     addField("autoGenerateHeaders", &ImportTextConfig::autoGenerateHeaders,
              "If true, the indexes of the columns will be used to name them."
              "This cannot be set to true if headers is defined.",
@@ -428,8 +429,13 @@ parseFixedWidthCsvRow(const char * & line,
 
     //cerr << "parsing line " << string(line, length) << endl;
 
+    // Find all of the separators and quotes, and which characters need
+    // special treatment due to their encoding, in one vectorized pass.
+    // The fields are then extracted by jumping from one to the next.
+    CsvStructuralIndex index(line, length, separator, quote);
+
     auto finishString = [encoding,replaceInvalidCharactersWith]
-        (const char * start, size_t len, bool eightBit)
+        (const char * start, size_t len, bool eightBit, bool invalidAscii)
         {
             //cerr << "finishing string " << string(start, len)
             //     << " with eightBit " << eightBit
@@ -437,11 +443,12 @@ parseFixedWidthCsvRow(const char * & line,
             //     << " replaceInvalidCharactersWith " << replaceInvalidCharactersWith << endl;
 
             if (!eightBit) {
+                if (!invalidAscii || replaceInvalidCharactersWith < 0)
+                    return CellValue::parse(start, len, STRING_IS_VALID_ASCII);
+
                 char buf[len];
-                if (replaceInvalidCharactersWith >= 0) {
-                    ExcAssert(replaceInvalidCharactersWith < 256);
-                    start = findInvalidAscii(start, len, buf, (char)replaceInvalidCharactersWith);
-                }
+                ExcAssert(replaceInvalidCharactersWith < 256);
+                start = findInvalidAscii(start, len, buf, (char)replaceInvalidCharactersWith);
                 return CellValue::parse(start, len, STRING_IS_VALID_ASCII);
             }
 
@@ -478,6 +485,12 @@ parseFixedWidthCsvRow(const char * & line,
             }
         };
 
+    // Skip past the separator that ends a field at end, if there is one
+    auto skipSeparator = [lineEnd] (const char * end)
+        {
+            return end == lineEnd ? end : end + 1;
+        };
+
     while (colNum < numColumns) {
 
         ExcAssert(line <= lineEnd);
@@ -501,59 +514,61 @@ parseFixedWidthCsvRow(const char * & line,
             continue;
         }
         else if (c == quote && hasQuoteChar) {
-            // quoted string
+            // quoted string.  In the common case there are no doubled
+            // quotes inside, and the value is used directly from the
+            // line.  Otherwise, the pieces between the doubled quotes are
+            // copied into a buffer.
             static constexpr size_t FIXED_BUF_LEN = 4096;
             char sbuf[FIXED_BUF_LEN];  // holds the extracted string
             char * s = sbuf;
             size_t buflen = FIXED_BUF_LEN;
             std::unique_ptr<char[]> sdynamic;
-            int len = 0;   // and its length
-
-            bool eightBit = false;
-            bool ok = false;
+            size_t len = 0;   // and its length
+            bool copied = false;
 
-            auto pushChar = [&] (char c)
+            auto pushChars = [&] (const char * chars, size_t n)
                 {
-                    if (len == buflen) {
-                        std::unique_ptr<char[]> newBuf(new char[buflen * 2]);
+                    if (len + n > buflen) {
+                        while (len + n > buflen)
+                            buflen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[buflen]);
                         std::copy(s, s + len, newBuf.get());
                         sdynamic.swap(newBuf);
                         s = sdynamic.get();
-                        buflen *= 2;
                     }
 
-
-                    ExcAssertLess(len, buflen);
-                    eightBit = eightBit || !isascii(c);
-                    s[len++] = c;
+                    std::copy(chars, chars + n, s + len);
+                    len += n;
                 };
 
-            for (; line < lineEnd;  ++line) {
-                c = *line;
-                //cerr << "c = " << c << endl;
-                if (c == quote) {
-                    ++line;
-                    if (line >= lineEnd) {
-                        ok = true;
-                        break;
-                    }
-                    else if (*line == separator) {
-                        ok = true;
-                        ++line;
-                        break;
-                    }
-                    else if (*line == quote) {
-                        // doubled quote; take a literal value
-                        pushChar(quote);
-                    }
-                    else {
-                        // Error
-                        errorMsg = "Garbage after closing quote";
-                        break;
-                    }
+            const char * valueStart = line;
+            const char * valueEnd = lineEnd;
+            bool ok = false;
+
+            for (;;) {
+                const char * closing = index.nextQuote(line);
+                if (closing == lineEnd)
+                    break;
+
+                const char * next = closing + 1;
+                if (next == lineEnd || *next == separator) {
+                    if (copied)
+                        pushChars(line, closing - line);
+                    valueEnd = closing;
+                    line = skipSeparator(next);
+                    ok = true;
+                    break;
+                }
+                else if (*next == quote) {
+                    // doubled quote; take a literal value
+                    pushChars(line, next - line);
+                    copied = true;
+                    line = next + 1;
                 }
                 else {
-                    pushChar(c);
+                    // Error
+                    errorMsg = "Garbage after closing quote";
+                    break;
                 }
             }
 
@@ -563,9 +578,15 @@ parseFixedWidthCsvRow(const char * & line,
             if (errorMsg)
                 break;
 
+            bool eightBit = index.hasEightBit(valueStart, valueEnd);
+            bool invalidAscii = index.hasInvalidAscii(valueStart, valueEnd);
+
             //cerr << "eightBit = " << eightBit << endl;
-            //cerr << "parsing " << string(s, len) << endl;
-            values[colNum++] = finishString(s, len, eightBit);
+            if (copied)
+                values[colNum++] = finishString(s, len, eightBit, invalidAscii);
+            else values[colNum++] = finishString(valueStart,
+                                                 valueEnd - valueStart,
+                                                 eightBit, invalidAscii);
 
             //cerr << "after quoted, *line = " << *line << endl;
         }
@@ -574,32 +595,18 @@ parseFixedWidthCsvRow(const char * & line,
             // save on parsing it.  We short circuit out when we get to a length
             // where we could start to lose digits, and fall back on parsing the
             // string version.
+            const char * end = index.nextSeparator(line);
+            size_t len = end - start;
+            line = skipSeparator(end);
+
             int64_t sign = -(c == '-');
             uint64_t num = isdigit(c) ? c - '0' : 0;
-            int len = 1;
-            bool isInt = true;
-
-            bool eightBit = false;
+            bool isInt = len <= 18;  // any longer and we could lose precision
 
-            for (; line < lineEnd;  ++line, ++len) {
-                ExcAssert(line < lineEnd);
-                c = *line;
-                if (c == separator) {
-                    ++line;
-                    break;
-                }
-                if (line - start >= 18)
-                    isInt = false;  // too long; could lose precision
-                if (isInt && isdigit(c)) {
-                    num = 10 * num + (c - '0');
-                }
-                else if (!isascii(c)) {
-                    eightBit = true;
-                    isInt = false;
-                }
-                else {
-                    isInt = false;
-                }
+            for (const char * p = start + 1;  isInt && p < end;  ++p) {
+                if (isdigit(*p))
+                    num = 10 * num + (*p - '0');
+                else isInt = false;
             }
 
             if (isInt && sign == -1)
@@ -608,25 +615,20 @@ parseFixedWidthCsvRow(const char * & line,
                 values[colNum++] = num;
             else // get it from the string
                 values[colNum++]
-                    = finishString(start, len, eightBit);
+                    = finishString(start, len,
+                                   index.hasEightBit(start, end),
+                                   index.hasInvalidAscii(start, end));
         }
         else {
             // likely a non-quoted string
-
-            bool eightBit = !isascii(c);
-            size_t len = 1;
-
-            for (; line < lineEnd;  ++line, ++len) {
-                c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
-            }
-
-            values[colNum++] = finishString(start, len, eightBit);
+            const char * end
+                = isTextLine ? lineEnd : index.nextSeparator(line);
+            line = skipSeparator(end);
+
+            values[colNum++]
+                = finishString(start, end - start,
+                               index.hasEightBit(start, end),
+                               index.hasInvalidAscii(start, end));
         }
 
         //cerr << "added col " << (colNum - 1) << " val " << values[colNum - 1] << endl;
@@ -1013,6 +1015,16 @@ struct ImportTextProcedureWorkInstance
                 return handleError("empty line", actualLineNum, 0, "");
 
 
+            // Records with multi-line quoted values arrive with their
+            // embedded newlines, which are replaced by spaces
+            std::string joinedLine;
+            if (config.allowMultiLines && memchr(line, '\n', length)) {
+                joinedLine.assign(line, length);
+                std::replace(joinedLine.begin(), joinedLine.end(), '\n', ' ');
+                line = joinedLine.data();
+                length = joinedLine.size();
+            }
+
             // Values that come in from the CSV file
             // TODO: clang doesn't like a variable length array
             // here.  Find another way to allocate it on the
@@ -1032,15 +1044,6 @@ struct ImportTextProcedureWorkInstance
                                             hasQuoteChar);
 
                 if (errorMsg) {
-                    if(config.allowMultiLines) {
-                        // check if we hit an error meaning we probably
-                        // have a multiline error
-                        if(errorMsg == unclosedQuoteError ||
-                           errorMsg == notEnoughColsError) {
-                            return false;
-                        }
-                    }
-
                     return handleError(errorMsg, actualLineNum,
                                            line - lineStart + 1,
                                            string(line, length));
@@ -1105,45 +1108,15 @@ struct ImportTextProcedureWorkInstance
         };
 
 
-        if(!config.allowMultiLines) {
-            forEachLineBlock(stream, onLine, config.limit,
-                             32 /* parallelism */,
-                             startChunk, doneChunk);
-        }
-        else {
-            // very simplistic and not efficient way of doing multi-line. we send
-            // lines one by one to the 'onLine' function, and if
-            // we get an error that probably is caused by a multi-
-            // line string, we concat the current line with the next
-            // one and try again. 
-            startChunk(0, 0);
-
-            string line;
-            string t_line;
-            string prevLine;
-            int64_t lineNum = 0;
-            while(getline(stream, line)) {
-                // prepend previous line if we're tagging it along
-                if(!prevLine.empty()) {
-                    t_line.assign(std::move(line));
-                    line.assign(std::move(prevLine));
-                    line += ' ' + t_line;
-                }
+        // With multi-line values, newlines within quoted values don't end
+        // the record.  The boundaries are found by the worker threads, so
+        // this doesn't stop the file being processed in parallel.
+        char lineQuote = (config.allowMultiLines && hasQuoteChar) ? quote : 0;
 
-                if(!onLine(line.c_str(), line.size(),
-                           0 /* chunkNum */, lineNum)) {
-                    prevLine.assign(std::move(line));
-                } else {
-                    prevLine.erase();
-                    lineNum++;
-                }
-
-                if(config.limit > 0 && lineNum >= config.limit)
-                    break;
-            }
-
-            doneChunk(0, lineNum);
-        }
+        forEachLineBlock(stream, onLine, config.limit,
+                         32 /* parallelism */,
+                         startChunk, doneChunk,
+                         lineQuote, separator);
 
         //cerr << "processed " << totalLinesProcessed << " lines" << endl;
 
@@ -23,6 +23,8 @@ namespace MLDB {
 
 Logging::Category mldbJsCategory("javascript");
 
+std::atomic<uint64_t> JsIsolate::numThreadIsolates(0);
+
 void
 JsIsolate::
 init(bool forThisThreadOnly)
@@ -13,6 +13,7 @@
 #include "mldb/logging/logging.h"
 #include "mldb/server/script_output.h"
 #include <mutex>
+#include <atomic>
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/sql/path.h"
 
@@ -55,12 +56,16 @@ struct JsIsolate {
     v8::Isolate * isolate;
     std::shared_ptr<v8::Locker> locker;
 
+    /// Number of threads that have created their own isolate
+    static std::atomic<uint64_t> numThreadIsolates;
+
     static JsIsolate * getIsolateForMyThread()
     {
         static __thread JsIsolate * result = 0;
 
         if (!result) {
             result = new JsIsolate(true);
+            ++numThreadIsolates;
         }
 
         return result;
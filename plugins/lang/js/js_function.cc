@@ -15,6 +15,7 @@
 #include "mldb/sql/sql_expression.h"
 
 #include <boost/algorithm/string.hpp>
+#include <atomic>
 
 
 using namespace std;
@@ -23,9 +24,102 @@ using namespace std;
 namespace Datacratic {
 namespace MLDB {
 
+/*****************************************************************************/
+/* JSEVAL STATISTICS                                                         */
+/*****************************************************************************/
+
+/** Process-wide statistics on jseval calls, returned by jseval_stats(). */
+struct JsEvalStats {
+    JsEvalStats()
+        : functionsCompiled(0), compileNanoseconds(0),
+          calls(0), batchCalls(0), rows(0), errors(0),
+          callNanoseconds(0), maxCallNanoseconds(0)
+    {
+    }
+
+    /// Number of (thread, bound jseval expression) pairs compiled
+    std::atomic<uint64_t> functionsCompiled;
+    std::atomic<uint64_t> compileNanoseconds;
+
+    /// Number of calls into V8, of which batchCalls ran several rows
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> batchCalls;
+
+    /// Number of rows that the function was run on
+    std::atomic<uint64_t> rows;
+
+    /// Number of calls that threw an exception
+    std::atomic<uint64_t> errors;
+
+    /// Total and maximum latency of a call into V8
+    std::atomic<uint64_t> callNanoseconds;
+    std::atomic<uint64_t> maxCallNanoseconds;
+
+    void recordCompile(double seconds)
+    {
+        ++functionsCompiled;
+        compileNanoseconds += seconds * 1e9;
+    }
+
+    void recordCall(size_t numRows, double seconds)
+    {
+        uint64_t ns = seconds * 1e9;
+        ++calls;
+        if (numRows > 1)
+            ++batchCalls;
+        rows += numRows;
+        callNanoseconds += ns;
+
+        uint64_t prevMax = maxCallNanoseconds;
+        while (ns > prevMax
+               && !maxCallNanoseconds.compare_exchange_weak(prevMax, ns)) ;
+    }
+
+    ExpressionValue toRow(Date ts) const
+    {
+        uint64_t numCalls = calls, numRows = rows;
+        double callSeconds = callNanoseconds / 1e9;
+
+        std::vector<std::tuple<PathElement, ExpressionValue> > row;
+        auto add = [&] (const char * name, CellValue value)
+            {
+                row.emplace_back(PathElement(name),
+                                 ExpressionValue(std::move(value), ts));
+            };
+
+        add("isolates", (uint64_t)JsIsolate::numThreadIsolates);
+        add("functionsCompiled", (uint64_t)functionsCompiled);
+        add("compileSeconds", compileNanoseconds / 1e9);
+        add("calls", numCalls);
+        add("batchCalls", (uint64_t)batchCalls);
+        add("rows", numRows);
+        add("errors", (uint64_t)errors);
+        add("callSeconds", callSeconds);
+        add("maxCallSeconds", maxCallNanoseconds / 1e9);
+        add("meanCallMicroseconds",
+            numCalls ? callSeconds * 1e6 / numCalls : 0.0);
+        add("meanRowMicroseconds",
+            numRows ? callSeconds * 1e6 / numRows : 0.0);
+
+        return ExpressionValue(std::move(row));
+    }
+};
+
+static JsEvalStats jsEvalStats;
+
+
+/*****************************************************************************/
+/* JS FUNCTION                                                               */
+/*****************************************************************************/
+
 struct JsFunctionData;
 
-/** Data for a JS function for each thread. */
+/** Data for a JS function for each thread.  Each thread's V8 isolate is
+    created the first time it runs a JS function, and stays entered for the
+    lifetime of the thread; the context and compiled function for each bound
+    jseval expression are cached here so they are only set up once per
+    thread.
+*/
 struct JsFunctionThreadData {
     JsFunctionThreadData()
         : isolate(0), data(0)
@@ -41,12 +135,20 @@ struct JsFunctionThreadData {
     v8::Persistent<v8::Context> context;
     v8::Persistent<v8::Script> script;
     v8::Persistent<v8::Function> function;
+    v8::Persistent<v8::Function> batchFunction;
     const JsFunctionData * data;
 
     void initialize(const JsFunctionData & data);
 
     ExpressionValue run(const std::vector<ExpressionValue> & args,
                         const SqlRowScope & context) const;
+
+    /** Run the function over a batch of rows, with a single call into V8.
+        Arguments that are numbers for every row are passed in as an
+        external double array rather than being converted one by one.
+    */
+    std::vector<ExpressionValue>
+    runBatch(const std::vector<std::vector<ExpressionValue> > & args) const;
 };
 
 struct JsFunctionData {
@@ -58,6 +160,67 @@ struct JsFunctionData {
     std::shared_ptr<JsPluginContext> context;
 };
 
+namespace {
+
+/** Source of the function used to run a batch of rows.  The arguments of
+    row i are columns[0][i], columns[1][i], ...  The results are appended to
+    output one by one, so that if the function throws, the length of output
+    tells which row it was on.
+*/
+const char * batchFunctionSource =
+    "(function (fn, self, n, columns, output) {\n"
+    "    var nargs = columns.length;\n"
+    "    var argv = new Array(nargs);\n"
+    "    for (var i = 0;  i < n;  ++i) {\n"
+    "        for (var j = 0;  j < nargs;  ++j)\n"
+    "            argv[j] = columns[j][i];\n"
+    "        output[i] = fn.apply(self, argv);\n"
+    "    }\n"
+    "})";
+
+/// Storage for the external arrays to point to once they're detached
+double noNumericValues[1];
+
+v8::Handle<v8::Value> argToJs(const ExpressionValue & arg)
+{
+    if (arg.isRow()) {
+        RowValue row;
+        arg.appendToRow(Path(), row);
+        return JS::toJS(row);
+    }
+    else {
+        return JS::toJS(arg.getAtom());
+    }
+}
+
+ExpressionValue resultFromJs(const v8::Handle<v8::Value> & result, Date ts)
+{
+    if (result->IsUndefined()) {
+        return ExpressionValue::null(Date::notADate());
+    }
+    else if (result->IsString() || result->IsNumber() || result->IsNull() || result->IsDate()) {
+        CellValue res = JS::fromJS(result);
+
+        return ExpressionValue(res, ts);
+    }
+    else if (result->IsObject()) {
+        std::map<Utf8String, CellValue> cols = JS::fromJS(result);
+
+        std::vector<std::tuple<PathElement, ExpressionValue> > row;
+        row.reserve(cols.size());
+        for (auto & c: cols) {
+            row.emplace_back(c.first, ExpressionValue(std::move(c.second),
+                                                      ts));
+        }
+        return ExpressionValue(std::move(row));
+    }
+    else {
+        throw HttpReturnException(400, "Don't understand expression");
+    }
+}
+
+} // file scope
+
 void
 JsFunctionThreadData::
 initialize(const JsFunctionData & data)
@@ -67,11 +230,13 @@ initialize(const JsFunctionData & data)
     if (isolate)
         return;
 
-    isolate = JsIsolate::getIsolateForMyThread();
+    Date before = Date::now();
+
+    JsIsolate * threadIsolate = JsIsolate::getIsolateForMyThread();
     this->data = &data;
 
     //v8::Locker locker(this->isolate->isolate);
-    v8::Isolate::Scope isolate(this->isolate->isolate);
+    v8::Isolate::Scope isolateScope(threadIsolate->isolate);
 
     HandleScope handle_scope;
 
@@ -117,6 +282,19 @@ initialize(const JsFunctionData & data)
     }
 
     this->function = v8::Persistent<v8::Function>::New(compiled);
+
+    v8::Local<v8::Script> batchScript
+        = v8::Script::Compile(String::New(batchFunctionSource),
+                              String::New("<<jseval batch>>"));
+    ExcAssert(!batchScript.IsEmpty());
+    this->batchFunction = v8::Persistent<v8::Function>::New
+        (v8::Local<v8::Function>::Cast(batchScript->Run()));
+    ExcAssert(!this->batchFunction.IsEmpty());
+
+    // Only mark as initialized once everything has succeeded
+    this->isolate = threadIsolate;
+
+    jsEvalStats.recordCompile(Date::now().secondsSince(before));
 }
 
 ExpressionValue
@@ -141,14 +319,7 @@ run(const std::vector<ExpressionValue> & args,
 
     std::vector<v8::Handle<v8::Value> > argv;
     for (unsigned i = 2;  i < args.size();  ++i) {
-        if (args[i].isRow()) {
-            RowValue row;
-            args[i].appendToRow(Path(), row);
-            argv.push_back(JS::toJS(row));
-        }
-        else {
-            argv.push_back(JS::toJS(args[i].getAtom()));
-        }
+        argv.push_back(argToJs(args[i]));
         ts.setMax(args[i].getEffectiveTimestamp());
     }
 
@@ -167,28 +338,109 @@ run(const std::vector<ExpressionValue> & args,
                                   "arguments", args);
     }
 
-    if (result->IsUndefined()) {
-        return ExpressionValue::null(Date::notADate());
-    }
-    else if (result->IsString() || result->IsNumber() || result->IsNull() || result->IsDate()) {
-        CellValue res = JS::fromJS(result);
+    return resultFromJs(result, ts);
+}
 
-        return ExpressionValue(res, ts);
+std::vector<ExpressionValue>
+JsFunctionThreadData::
+runBatch(const std::vector<std::vector<ExpressionValue> > & args) const
+{
+    using namespace v8;
+
+    ExcAssert(initialized());
+
+    size_t n = args.size();
+    if (n == 0)
+        return {};
+
+    size_t nargs = args[0].size() - 2;
+
+    v8::Isolate::Scope isolate(this->isolate->isolate);
+
+    HandleScope handle_scope;
+
+    Context::Scope context_scope(this->context);
+
+    std::vector<Date> ts(n, Date::negativeInfinity());
+    for (size_t i = 0;  i < n;  ++i) {
+        ExcAssertEqual(args[i].size(), nargs + 2);
+        for (size_t j = 2;  j < args[i].size();  ++j)
+            ts[i].setMax(args[i][j].getEffectiveTimestamp());
     }
-    else if (result->IsObject()) {
-        std::map<Utf8String, CellValue> cols = JS::fromJS(result);
 
-        std::vector<std::tuple<PathElement, ExpressionValue> > row;
-        row.reserve(cols.size());
-        for (auto & c: cols) {
-            row.emplace_back(c.first, ExpressionValue(std::move(c.second),
-                                                      ts));
+    // Each argument is passed as a column with a value for each row.
+    // Numeric columns point directly to the values in numericValues.
+    std::vector<std::vector<double> > numericValues(nargs);
+    std::vector<v8::Handle<v8::Object> > externalArrays;
+    v8::Handle<v8::Array> columns = v8::Array::New((int)nargs);
+
+    for (size_t j = 0;  j < nargs;  ++j) {
+        bool isNumeric = true;
+        for (size_t i = 0;  i < n && isNumeric;  ++i) {
+            const ExpressionValue & arg = args[i][j + 2];
+            isNumeric = arg.isAtom() && arg.getAtom().isExactDouble();
+        }
+
+        if (isNumeric) {
+            std::vector<double> & values = numericValues[j];
+            values.reserve(n);
+            for (size_t i = 0;  i < n;  ++i)
+                values.push_back(args[i][j + 2].getAtom().toDouble());
+
+            v8::Handle<v8::Object> column = v8::Object::New();
+            column->SetIndexedPropertiesToExternalArrayData
+                (values.data(), v8::kExternalDoubleArray, (int)n);
+            externalArrays.push_back(column);
+            columns->Set(j, column);
+        }
+        else {
+            v8::Handle<v8::Array> column = v8::Array::New((int)n);
+            for (size_t i = 0;  i < n;  ++i)
+                column->Set(i, argToJs(args[i][j + 2]));
+            columns->Set(j, column);
         }
-        return ExpressionValue(std::move(row));
     }
-    else {
-        throw HttpReturnException(400, "Don't understand expression");
+
+    v8::Handle<v8::Array> output = v8::Array::New(0);
+
+    v8::Handle<v8::Value> argv[5] = {
+        this->function,
+        this->context->Global(),
+        v8::Integer::New((int32_t)n),
+        columns,
+        output
+    };
+
+    TryCatch trycatch;
+
+    auto result = this->batchFunction->Call(this->context->Global(), 5, argv);
+
+    // Detach the numeric values, so that a function that kept hold of
+    // one of its arguments can't see them once they're freed
+    for (auto & column: externalArrays) {
+        column->SetIndexedPropertiesToExternalArrayData
+            (noNumericValues, v8::kExternalDoubleArray, 0);
+    }
+
+    if (result.IsEmpty()) {
+        auto rep = convertException(trycatch, "Running jseval script");
+        size_t row = std::min<size_t>(output->Length(), n - 1);
+        JML_TRACE_EXCEPTIONS(false);
+        throw HttpReturnException(400, "Exception running jseval script",
+                                  "exception", rep,
+                                  "scriptSource", data->scriptSource,
+                                  "provenance", data->filenameForErrorMessages,
+                                  "arguments", args[row]);
     }
+
+    ExcAssertEqual(output->Length(), n);
+
+    std::vector<ExpressionValue> results;
+    results.reserve(n);
+    for (size_t i = 0;  i < n;  ++i)
+        results.emplace_back(resultFromJs(output->Get(i), ts[i]));
+
+    return results;
 }
 
 ExpressionValue
@@ -203,7 +455,35 @@ runJsFunction(const std::vector<ExpressionValue> & args,
         threadData->initialize(*data);
 
     // 2.  Run the function
-    return threadData->run(args, context);
+    Date before = Date::now();
+    try {
+        ExpressionValue result = threadData->run(args, context);
+        jsEvalStats.recordCall(1, Date::now().secondsSince(before));
+        return result;
+    } catch (...) {
+        ++jsEvalStats.errors;
+        throw;
+    }
+}
+
+std::vector<ExpressionValue>
+runJsFunctionBatch(std::vector<std::vector<ExpressionValue> > & args,
+                   const shared_ptr<JsFunctionData> & data)
+{
+    JsFunctionThreadData * threadData = data->threadInfo.get();
+
+    if (!threadData->initialized())
+        threadData->initialize(*data);
+
+    Date before = Date::now();
+    try {
+        std::vector<ExpressionValue> result = threadData->runBatch(args);
+        jsEvalStats.recordCall(args.size(), Date::now().secondsSince(before));
+        return result;
+    } catch (...) {
+        ++jsEvalStats.errors;
+        throw;
+    }
 }
 
 BoundFunction bindJsEval(const Utf8String & name,
@@ -227,6 +507,11 @@ BoundFunction bindJsEval(const Utf8String & name,
     string params = args[1].constantValue().toString();
     boost::split(runner->params, params,
                  boost::is_any_of(","));
+
+    // Compile it for this thread, which reports syntax errors when the
+    // expression is bound and warms up the isolate of the binding thread,
+    // which is often the one that runs it
+    runner->threadInfo.get()->initialize(*runner);
     
     // 3.  We don't know what it returns; TODO: allow it to be specified
     auto info = std::make_shared<AnyValueInfo>();
@@ -238,11 +523,38 @@ BoundFunction bindJsEval(const Utf8String & name,
             return runJsFunction(args, context, runner);
         };
 
+    BoundFunction result(std::move(fn), std::move(info));
+
+    result.execBatch
+        = [=] (std::vector<std::vector<ExpressionValue> > & args,
+               const std::vector<const SqlRowScope *> & rows)
+        {
+            return runJsFunctionBatch(args, runner);
+        };
+
     // 5.  Return it
-    return { std::move(fn), std::move(info) };
+    return result;
 }
 
 RegisterFunction registerJs(Utf8String("jseval"), bindJsEval);
 
+BoundFunction bindJsEvalStats(const Utf8String & name,
+                              const std::vector<BoundSqlExpression> & args,
+                              const SqlBindingScope & context)
+{
+    if (!args.empty())
+        throw HttpReturnException(400, "jseval_stats expected no arguments, got " + to_string(args.size()));
+
+    auto fn = [=] (const std::vector<ExpressionValue> & args,
+                   const SqlRowScope & context) -> ExpressionValue
+        {
+            return jsEvalStats.toRow(Date::now());
+        };
+
+    return { std::move(fn), std::make_shared<UnknownRowValueInfo>() };
+}
+
+RegisterFunction registerJsStats(Utf8String("jseval_stats"), bindJsEvalStats);
+
 } // namespace Datacratic
 } // namespace MLDB
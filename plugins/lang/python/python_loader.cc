@@ -559,6 +559,115 @@ class mldb_wrapper(object):
         def __str__(self):
             return self.text
 
+    @staticmethod
+    def decode_columnar(data):
+        """Decode a query result in the columnar format into a dict from
+        column name to values, with None where there is no value, like the
+        soa format.  Integer and float columns with no missing values are
+        returned as array.array objects, which can be wrapped by
+        numpy.frombuffer without copying.  Timestamps are returned as
+        seconds since the epoch.
+        """
+        import array, struct, sys
+
+        def padded(pos):
+            return (pos + 7) & ~7
+
+        def read_array(typecode, pos, count):
+            result = array.array(typecode)
+            result.fromstring(data[pos:pos + result.itemsize * count])
+            if sys.byteorder == 'big':
+                result.byteswap()
+            return result
+
+        if data[:8] != 'MLDBCOLS':
+            raise ValueError('not a columnar query result')
+        version, = struct.unpack_from('<I', data, 8)
+        if version != 1:
+            raise ValueError('unknown columnar version %d' % version)
+
+        pieces = {}  # column name -> list of arrays and lists
+        total = 0
+        pos = 16
+        while True:
+            if pos + 8 > len(data):
+                raise ValueError('truncated columnar query result')
+            num_rows, num_cols = struct.unpack_from('<II', data, pos)
+            pos += 8
+            if num_rows == 0 and num_cols == 0:
+                break
+
+            seen = set()
+            for _ in range(num_cols):
+                name_len, col_type = struct.unpack_from('<IB', data, pos)
+                pos += 8
+                name = data[pos:pos + name_len].decode('utf-8')
+                pos = padded(pos + name_len)
+
+                if col_type == 0:
+                    values = [None] * num_rows
+                else:
+                    num_bytes = (num_rows + 7) // 8
+                    bitmap = bytearray(data[pos:pos + num_bytes])
+                    pos = padded(pos + num_bytes)
+                    all_present = (bitmap.count(0xff) == num_rows // 8
+                                   and (num_rows % 8 == 0
+                                        or bitmap[-1] == (1 << num_rows % 8) - 1))
+
+                    if col_type in (1, 2, 3):
+                        values = read_array('q' if col_type == 1 else 'd',
+                                            pos, num_rows)
+                        pos += 8 * num_rows
+                    elif col_type in (4, 5, 6):
+                        dict_size, = struct.unpack_from('<I', data, pos)
+                        pos += 8
+                        offsets = read_array('I', pos, dict_size + 1)
+                        pos = padded(pos + 4 * (dict_size + 1))
+                        dict_data = data[pos:pos + offsets[-1]]
+                        pos = padded(pos + offsets[-1])
+                        entries = [dict_data[offsets[i]:offsets[i + 1]]
+                                   for i in range(dict_size)]
+                        if col_type == 4:
+                            entries = [e.decode('utf-8') for e in entries]
+                        elif col_type == 6:
+                            entries = [mldb_wrapper.jsonlib.loads(e)
+                                       for e in entries]
+                        codes = read_array('I', pos, num_rows)
+                        pos = padded(pos + 4 * num_rows)
+                        values = [entries[c] if entries else None
+                                  for c in codes]
+                    else:
+                        raise ValueError('unknown column type %d' % col_type)
+
+                    if not all_present:
+                        values = [v if bitmap[i >> 3] & (1 << (i & 7))
+                                  else None
+                                  for i, v in enumerate(values)]
+
+                if name not in pieces:
+                    pieces[name] = [[None] * total] if total else []
+                pieces[name].append(values)
+                seen.add(name)
+
+            for name, column in pieces.items():
+                if name not in seen:
+                    column.append([None] * num_rows)
+            total += num_rows
+
+        result = {}
+        for name, column in pieces.items():
+            if all(isinstance(p, array.array) for p in column) \
+               and len(set(p.typecode for p in column)) == 1:
+                values = array.array(column[0].typecode)
+                for p in column:
+                    values.extend(p)
+            else:
+                values = []
+                for p in column:
+                    values.extend(p)
+            result[name] = values
+        return result
+
     class wrap(object):
         def __init__(self, mldb):
             self._mldb = mldb
@@ -639,6 +748,15 @@ class mldb_wrapper(object):
             return self._perform('GET', '/v1/query', [['format', 'table']],
                                  {'q' : query}).json()
 
+        def query_columnar(self, query):
+            url = '/v1/query'
+            status, content_type, data = self._mldb.perform_raw(
+                'GET', url, [['format', 'columnar']], {'q' : query})
+            if status != 200:
+                raise mldb_wrapper.ResponseException(mldb_wrapper.Response(
+                    url, {'statusCode' : status, 'response' : data}))
+            return mldb_wrapper.decode_columnar(data)
+
         def run_tests(self):
             import StringIO
             io_stream = StringIO.StringIO()
@@ -936,6 +1054,7 @@ struct AtInit {
         mldb.def("perform", perform4); // for 4 args
         mldb.def("perform", perform3); // for 3 args
         mldb.def("perform", perform2); // for 2 args
+        mldb.def("perform_raw", performRaw);
         mldb.def("read_lines", readLines);
         mldb.def("read_lines", readLines1);
         mldb.def("ls", ls);
@@ -333,13 +333,17 @@ perform4(MldbPythonContext * mldbCon,
 }
 
     
-Json::Value
-perform(MldbPythonContext * mldbCon,
-        const std::string & verb,
-        const std::string & resource,
-        const RestParams & params,
-        Json::Value payload,
-        const RestParams & headers)
+/** Run the given request against the server, putting the response in
+    connection.
+*/
+static void
+performRequest(MldbPythonContext * mldbCon,
+               const std::string & verb,
+               const std::string & resource,
+               const RestParams & params,
+               Json::Value payload,
+               const RestParams & headers,
+               InProcessRestConnection & connection)
 {
     HttpHeader header;
     header.verb = verb;
@@ -349,7 +353,6 @@ perform(MldbPythonContext * mldbCon,
         header.headers.insert({h.first.toLower().extractAscii(), h.second.extractAscii()});
         
     RestRequest request(header, payload.toString());
-    InProcessRestConnection connection;
     
     // add magic token to notify the receiver that this is a child call
     if(resource.find("/plugins/") != std::string::npos) {
@@ -378,6 +381,19 @@ perform(MldbPythonContext * mldbCon,
     // relock and restore thread state
     PyEval_AcquireLock();
     PyThreadState_Swap(threadState);
+}
+
+Json::Value
+perform(MldbPythonContext * mldbCon,
+        const std::string & verb,
+        const std::string & resource,
+        const RestParams & params,
+        Json::Value payload,
+        const RestParams & headers)
+{
+    InProcessRestConnection connection;
+    performRequest(mldbCon, verb, resource, params, payload, headers,
+                   connection);
 
     Json::Value result;
     result["statusCode"] = connection.responseCode;
@@ -400,6 +416,29 @@ perform(MldbPythonContext * mldbCon,
     return result;
 }
 
+boost::python::tuple
+performRaw(MldbPythonContext * mldbCon,
+           const std::string & verb,
+           const std::string & resource,
+           const RestParams & params,
+           Json::Value payload)
+{
+    InProcessRestConnection connection;
+    performRequest(mldbCon, verb, resource, params, payload, RestParams(),
+                   connection);
+
+    // A str holds the bytes as they are, unlike the Json::Value returned
+    // by perform()
+    boost::python::object response
+        (boost::python::handle<>
+         (PyString_FromStringAndSize(connection.response.data(),
+                                     connection.response.size())));
+
+    return boost::python::make_tuple(connection.responseCode,
+                                     connection.contentType,
+                                     response);
+}
+
 Json::Value
 readLines1(MldbPythonContext * mldbCon,
           const std::string & path)
@@ -418,7 +457,7 @@ readLines(MldbPythonContext * mldbCon,
                        size_t length,
                        int64_t lineNum)
         {
-            lines.append(line);
+            lines.append(std::string(line, length));
         };
 
     forEachLine(stream, onLine, 1 /* numThreads */, false /* ignore exc */,
@@ -177,6 +177,16 @@ perform(MldbPythonContext * mldbCon,
         Json::Value payload=Json::Value(),
         const RestParams & header=RestParams());
 
+/** Like perform, but returns a (statusCode, contentType, response) tuple
+    with the response as a str of bytes, for responses that aren't text.
+*/
+boost::python::tuple
+performRaw(MldbPythonContext * mldbCon,
+           const std::string & verb,
+           const std::string & resource,
+           const RestParams & params,
+           Json::Value payload);
+
 Json::Value
 readLines1(MldbPythonContext * mldbCon,
           const std::string & path);
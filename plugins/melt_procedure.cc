@@ -20,6 +20,7 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/server/bound_queries.h"
+#include "mldb/server/dataset_utils.h"
 
 using namespace std;
 
@@ -137,7 +138,7 @@ run(const ProcedureRunConfig & run,
     ColumnName keyColumnName(runProcConf.keyColumnName);
     ColumnName valueColumnName(runProcConf.valueColumnName);
 
-    std::mutex recordMutex;
+    ParallelRecorder recorder(*outputDataset);
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
@@ -175,8 +176,8 @@ run(const ProcedureRunConfig & run,
 
                 RowName rowName = row.rowName + std::get<0>(col);
 
-                std::unique_lock<std::mutex> guard(recordMutex);
-                outputDataset->recordRow(rowName, currOutputRow);
+                recorder.recordRowDestructive(std::move(rowName),
+                                              std::move(currOutputRow));
             }
             return true;
         };
@@ -193,7 +194,7 @@ run(const ProcedureRunConfig & run,
                  runProcConf.inputData.stm->limit,
                  nullptr /* progress */);
 
-    outputDataset->commit();
+    recorder.commit();
 
     return RunOutput();
 }
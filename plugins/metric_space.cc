@@ -58,10 +58,97 @@ create(MetricSpace space)
 }
 
 
+void
+DistanceMetric::
+dist(int rowNum, const ML::distribution<float> & coords,
+     const int * rowNums, const float * const * rows,
+     size_t numRows, float * result) const
+{
+    ML::distribution<float> coords2(coords.size());
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        std::copy(rows[i], rows[i] + coords.size(), coords2.begin());
+        result[i] = dist(rowNum, rowNums ? rowNums[i] : -1, coords, coords2);
+    }
+}
+
+void
+DistanceMetric::
+dist(int rowNum, const ML::distribution<float> & coords,
+     int firstRowNum, const float * matrix, size_t numRows,
+     float * result) const
+{
+    std::vector<const float *> rows(numRows);
+    std::vector<int> rowNums(numRows);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        rows[i] = matrix + i * coords.size();
+        rowNums[i] = firstRowNum == -1 ? -1 : firstRowNum + i;
+    }
+
+    dist(rowNum, coords, firstRowNum == -1 ? nullptr : rowNums.data(),
+         rows.data(), numRows, result);
+}
+
+
 /*****************************************************************************/
 /* EUCLIDEAN DISTANCE METRIC                                                 */
 /*****************************************************************************/
 
+namespace {
+
+/** Dot product of two vectors, done with the same kernel as the batched
+    versions so that they give identical results.
+*/
+double dotprod(const float * x, const float * y, size_t n)
+{
+    double result;
+    ML::SIMD::vec_dotprod_dp_rows(x, &y, 1, n, &result);
+    return result;
+}
+
+/** Squared euclidean distance between two vectors, with the same kernel as
+    the batched version.
+*/
+double euclidSquared(const float * x, const float * y, size_t n)
+{
+    double result;
+    ML::SIMD::vec_euclid_rows(x, &y, 1, n, &result);
+    return result;
+}
+
+/** Distance between two different known rows, given their dot product and
+    their cached squared norms.  Row 1 must have the lower number, so that
+    the rounding is the same whichever way around the rows are passed.
+*/
+float euclidFromDotProduct(double dp, double sumDist1, double sumDist2)
+{
+    /*  Given two points x and y, whose coordinates are coords[x] and
+        coords[y], this will calculate the euclidian distance
+        ||x - y|| = sqrt(sum_i (x[i] - y[i])^2)
+                  = sqrt(sum_i (x[i]^2 + y[i]^2 - 2 x[i]y[i]) )
+                  = sqrt(sum_i x[i]^2 + sum_i y[i]^2 - 2 sum x[i]y[i])
+                  = sqrt(||x||^2 + ||y||^2 - 2 x . y)
+            
+        Must satisfy the triangle inequality, so the sqrt is important.  We
+        also take pains to ensure that dist(x,y) === dist(y,x) *exactly*,
+        and that dist(x,x) == 0.
+    */
+
+    float dpResult = -2.0 * dp;
+    ExcAssert(isfinite(dpResult));
+
+    float distSquared = dpResult + sumDist1 + sumDist2;
+    ExcAssert(isfinite(distSquared));
+
+    // Deal with rounding errors
+    if (distSquared < 0.0)
+        distSquared = 0.0;
+
+    return sqrtf(distSquared);
+}
+
+} // file scope
+
 void
 EuclideanDistanceMetric::
 addRow(int rowNum, const ML::distribution<float> & coords)
@@ -77,8 +164,7 @@ EuclideanDistanceMetric::
 calc(const ML::distribution<float> & coords1,
      const ML::distribution<float> & coords2)
 {
-    return sqrt(ML::SIMD::vec_euclid(coords1.data(), coords2.data(), coords1.size()));
-    return (coords2 - coords1).two_norm();
+    return sqrt(euclidSquared(coords1.data(), coords2.data(), coords1.size()));
 }
 
 float
@@ -101,34 +187,46 @@ dist(int rowNum1, int rowNum2,
     if (rowNum1 == rowNum2)
         return 0.0;
 
-    /*  Given two points x and y, whose coordinates are coords[x] and
-        coords[y], this will calculate the euclidian distance
-        ||x - y|| = sqrt(sum_i (x[i] - y[i])^2)
-                  = sqrt(sum_i (x[i]^2 + y[i]^2 - 2 x[i]y[i]) )
-                  = sqrt(sum_i x[i]^2 + sum_i y[i]^2 - 2 sum x[i]y[i])
-                  = sqrt(||x||^2 + ||y||^2 - 2 x . y)
-            
-        Must satisfy the triangle inequality, so the sqrt is important.  We
-        also take pains to ensure that dist(x,y) === dist(y,x) *exactly*,
-        and that dist(x,x) == 0.
-    */
-        
     // Use the optimized version, since we know the sum
-    float dpResult = -2.0 * ML::SIMD::vec_dotprod_dp(&coords1[0],
-                                                     &coords2[0],
-                                                     coords1.size());
-    ExcAssert(isfinite(dpResult));
-
-
-
-    float distSquared = dpResult + sum_dist.at(rowNum1) + sum_dist.at(rowNum2);
-    ExcAssert(isfinite(distSquared));
+    return euclidFromDotProduct(dotprod(&coords1[0], &coords2[0],
+                                        coords1.size()),
+                                sum_dist.at(rowNum1), sum_dist.at(rowNum2));
+}
 
-    // Deal with rounding errors
-    if (distSquared < 0.0)
-        distSquared = 0.0;
+void
+EuclideanDistanceMetric::
+dist(int rowNum, const ML::distribution<float> & coords,
+     const int * rowNums, const float * const * rows,
+     size_t numRows, float * result) const
+{
+    size_t n = coords.size();
+    std::vector<double> accum(numRows);
+
+    if (rowNum == -1 || !rowNums) {
+        ML::SIMD::vec_euclid_rows(coords.data(), rows, numRows, n,
+                                  accum.data());
+        for (size_t i = 0;  i < numRows;  ++i)
+            result[i] = sqrt(accum[i]);
+        return;
+    }
 
-    return sqrtf(distSquared);
+    ML::SIMD::vec_dotprod_dp_rows(coords.data(), rows, numRows, n,
+                                  accum.data());
+    
+    double sumDist = sum_dist.at(rowNum);
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        int rowNum2 = rowNums[i];
+        if (rowNum2 == -1)
+            result[i] = sqrt(euclidSquared(coords.data(), rows[i], n));
+        else if (rowNum2 == rowNum)
+            result[i] = 0.0;
+        else if (rowNum < rowNum2)
+            result[i] = euclidFromDotProduct(accum[i], sumDist,
+                                             sum_dist.at(rowNum2));
+        else result[i] = euclidFromDotProduct(accum[i], sum_dist.at(rowNum2),
+                                              sumDist);
+    }
 }
 
 
@@ -136,6 +234,36 @@ dist(int rowNum1, int rowNum2,
 /* COSINE DISTANCE METRIC                                                    */
 /*****************************************************************************/
 
+namespace {
+
+/** Distance between two different known rows, given their dot product and
+    the reciprocals of their two norms.  As for the euclidean distance,
+    row 1 must have the lower number.
+*/
+float cosineFromDotProduct(double dp, double recip1, double recip2)
+{
+    // If both are zero vectors the distance is zero; if only one of them
+    // is it's one.
+    if (!isfinite(recip1) && !isfinite(recip2)) {
+        return 0.0;
+    }
+    if (!isfinite(recip1) || !isfinite(recip2)) {
+        return 1.0;
+    }
+
+    float result = 1.0 - dp * recip1 * recip2;
+    if (result < 0.0) {
+        result = 0.0;
+    }
+
+    ExcAssert(isfinite(result));
+    ExcAssertGreaterEqual(result, 0.0);
+
+    return result;
+}
+
+} // file scope
+
 void
 CosineDistanceMetric::
 addRow(int rowNum, const ML::distribution<float> & coords)
@@ -219,31 +347,51 @@ dist(int rowNum1, int rowNum2,
     if (rowNum1 == rowNum2)
         return 0.0;
 
-    if (!isfinite(two_norm_recip.at(rowNum1))
-        && !isfinite(two_norm_recip.at(rowNum2))) {
-        return 0.0;
-    }
-    if (!isfinite(two_norm_recip.at(rowNum1))
-        || !isfinite(two_norm_recip.at(rowNum2))) {
-        return 1.0;
-    }
+    double recip1 = two_norm_recip.at(rowNum1);
+    double recip2 = two_norm_recip.at(rowNum2);
 
-    float result = 1.0 - coords1.dotprod(coords2) * two_norm_recip.at(rowNum1) * two_norm_recip.at(rowNum2);
-    if (result < 0.0) {
-        result = 0.0;
-#if 0
-        cerr << "rowNum1 = " << rowNum1 << endl;
-        cerr << "rowNum2 = " << rowNum2 << endl;
-        cerr << "coords1 = " << coords1 << endl;
-        cerr << "coords2 = " << coords2 << endl;
-        cerr << "result = " << result << endl;
-#endif
-    }
+    // Zero vectors have a non-finite reciprocal; avoid the dot product
+    if (!isfinite(recip1) || !isfinite(recip2))
+        return cosineFromDotProduct(0.0, recip1, recip2);
 
-    ExcAssert(isfinite(result));
-    ExcAssertGreaterEqual(result, 0.0);
+    return cosineFromDotProduct(dotprod(&coords1[0], &coords2[0],
+                                        coords1.size()),
+                                recip1, recip2);
+}
 
-    return result;
+void
+CosineDistanceMetric::
+dist(int rowNum, const ML::distribution<float> & coords,
+     const int * rowNums, const float * const * rows,
+     size_t numRows, float * result) const
+{
+    // Unknown rows have no cached norm, and are rare enough (they come from
+    // queries) that they can use the unbatched version
+    if (rowNum == -1 || !rowNums) {
+        DistanceMetric::dist(rowNum, coords, rowNums, rows, numRows, result);
+        return;
+    }
+
+    std::vector<double> dp(numRows);
+    ML::SIMD::vec_dotprod_dp_rows(coords.data(), rows, numRows, coords.size(),
+                                  dp.data());
+
+    double recip = two_norm_recip.at(rowNum);
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        int rowNum2 = rowNums[i];
+        if (rowNum2 == -1) {
+            DistanceMetric::dist(rowNum, coords, rowNums + i, rows + i, 1,
+                                 result + i);
+        }
+        else if (rowNum2 == rowNum)
+            result[i] = 0.0;
+        else if (rowNum < rowNum2)
+            result[i] = cosineFromDotProduct(dp[i], recip,
+                                             two_norm_recip.at(rowNum2));
+        else result[i] = cosineFromDotProduct(dp[i], two_norm_recip.at(rowNum2),
+                                              recip);
+    }
 }
 
 
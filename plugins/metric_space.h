@@ -44,6 +44,26 @@ struct DistanceMetric {
                        const ML::distribution<float> & coords1,
                        const ML::distribution<float> & coords2) const = 0;
 
+    /** Calculate the distance between one row and each of a batch of
+        numRows rows, whose coordinates are given by pointers to vectors
+        of the same length as coords.  rowNums gives the number of each
+        of the rows, or -1 if it's not known, and may be null if none of
+        them are known.  The result is identical to calling the pairwise
+        dist() for each row, but the default implementation does exactly
+        that; metrics override it to vectorize over the rows.
+    */
+    virtual void dist(int rowNum, const ML::distribution<float> & coords,
+                      const int * rowNums, const float * const * rows,
+                      size_t numRows, float * result) const;
+
+    /** Same, but with the rows stored contiguously in row-major order.
+        Their row numbers are consecutive starting from firstRowNum, or
+        unknown if firstRowNum is -1.
+    */
+    void dist(int rowNum, const ML::distribution<float> & coords,
+              int firstRowNum, const float * matrix, size_t numRows,
+              float * result) const;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -55,12 +75,18 @@ struct DistanceMetric {
 
 struct EuclideanDistanceMetric: public DistanceMetric {
 
+    using DistanceMetric::dist;
+
     void addRow(int rowNum, const ML::distribution<float> & coords);
 
     float dist(int rowNum1, int rowNum2,
                const ML::distribution<float> & coords1,
                const ML::distribution<float> & coords2) const;
 
+    void dist(int rowNum, const ML::distribution<float> & coords,
+              const int * rowNums, const float * const * rows,
+              size_t numRows, float * result) const;
+
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
@@ -77,12 +103,18 @@ struct EuclideanDistanceMetric: public DistanceMetric {
 
 struct CosineDistanceMetric: public DistanceMetric {
 
+    using DistanceMetric::dist;
+
     void addRow(int rowNum, const ML::distribution<float> & coords);
 
     float dist(int rowNum1, int rowNum2,
                const ML::distribution<float> & coords1,
                const ML::distribution<float> & coords2) const;
 
+    void dist(int rowNum, const ML::distribution<float> & coords,
+              const int * rowNums, const float * const * rows,
+              size_t numRows, float * result) const;
+
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
@@ -0,0 +1,1203 @@
+/** persistent_sparse_matrix.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Base matrix for the sparse matrix dataset that persists its data on
+    disk.
+*/
+
+#include "persistent_sparse_matrix.h"
+#include "mldb/jml/utils/file_functions.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/ext/highwayhash.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/utils/json_utils.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include <unordered_map>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <set>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+
+/*****************************************************************************/
+/* FILE FORMATS                                                              */
+/*****************************************************************************/
+
+/* Each record in the log is a LogRecordHeader followed by numRows rows.
+   A row is its row number (uint64_t) and number of entries (uint32_t),
+   followed by the entries.  An entry is its rowcol, timestamp and val
+   (uint64_t each), tag and number of metadata items (uint32_t each), and
+   then for each metadata item its length (uint32_t) and bytes.
+
+   A segment contains the entries of each row, in order of row number,
+   with exactly the same encoding.  That means that entries can be copied
+   from one segment to another without being decoded.  The entries are
+   followed by the index, which is an array of SegmentIndexEntry sorted by
+   row number, and then by the SegmentFooter.
+*/
+
+static constexpr uint32_t LOG_RECORD_MAGIC = 0x474f4c4d;  // "MLOG"
+static const char SEGMENT_MAGIC[8] = { 'M', 'L', 'D', 'B', 'S', 'M', 'S', '1' };
+
+struct LogRecordHeader {
+    uint32_t magic;
+    uint32_t numRows;
+    uint64_t length;     ///< Length of the rows that follow, in bytes
+    uint64_t checksum;   ///< Hash of the rows that follow
+};
+
+struct SegmentIndexEntry {
+    uint64_t row;        ///< Row number
+    uint64_t offset;     ///< Offset of the row's entries in the file
+    uint64_t length;     ///< Length of the row's entries in bytes
+    uint64_t count;      ///< Number of entries in the row
+};
+
+struct SegmentFooter {
+    char magic[8];
+    uint64_t numRows;
+    uint64_t numEntries;
+    uint64_t indexOffset;  ///< Offset of the index in the file
+};
+
+template<typename T>
+void appendPod(std::string & out, const T & val)
+{
+    out.append((const char *)&val, sizeof(val));
+}
+
+template<typename T>
+const char * readPod(const char * p, const char * end, T & val)
+{
+    if (end - p < (ssize_t)sizeof(T))
+        throw HttpReturnException(500, "Sparse matrix data is truncated");
+    memcpy(&val, p, sizeof(T));
+    return p + sizeof(T);
+}
+
+void appendEntry(std::string & out, const BaseEntry & entry)
+{
+    appendPod(out, entry.rowcol);
+    appendPod(out, entry.timestamp);
+    appendPod(out, entry.val);
+    appendPod(out, entry.tag);
+    appendPod(out, (uint32_t)entry.metadata.size());
+    for (auto & m: entry.metadata) {
+        appendPod(out, (uint32_t)m.size());
+        out.append(m);
+    }
+}
+
+const char * readEntry(const char * p, const char * end, BaseEntry & entry)
+{
+    p = readPod(p, end, entry.rowcol);
+    p = readPod(p, end, entry.timestamp);
+    p = readPod(p, end, entry.val);
+    p = readPod(p, end, entry.tag);
+    uint32_t numMetadata;
+    p = readPod(p, end, numMetadata);
+    entry.metadata.clear();
+    for (uint32_t i = 0;  i < numMetadata;  ++i) {
+        uint32_t len;
+        p = readPod(p, end, len);
+        if (end - p < len)
+            throw HttpReturnException(500, "Sparse matrix data is truncated");
+        entry.metadata.emplace_back(p, p + len);
+        p += len;
+    }
+    return p;
+}
+
+uint64_t checksum(const char * data, size_t length)
+{
+    return highwayHash(defaultSeedStable.u64, data, length);
+}
+
+/** Make sure that a rename or unlink in the given directory is durable. */
+void syncDirectory(const std::string & directory)
+{
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1)
+        throw ML::Exception(errno, "open directory " + directory);
+    int res = fsync(fd);
+    ::close(fd);
+    if (res == -1)
+        throw ML::Exception(errno, "fsync directory " + directory);
+}
+
+
+/*****************************************************************************/
+/* SEGMENT                                                                   */
+/*****************************************************************************/
+
+/** An immutable, memory mapped file of rows sorted by row number. */
+
+struct Segment {
+    Segment(const std::string & name, const std::string & path)
+        : name(name), buffer(path)
+    {
+        if (buffer.size() < sizeof(SegmentFooter))
+            throw HttpReturnException(500, "Sparse matrix segment is truncated",
+                                      "path", path);
+        memcpy(&footer, buffer.end() - sizeof(footer), sizeof(footer));
+        if (memcmp(footer.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0)
+            throw HttpReturnException(500, "Sparse matrix segment is corrupt",
+                                      "path", path);
+        if (footer.indexOffset % sizeof(uint64_t) != 0
+            || footer.indexOffset + footer.numRows * sizeof(SegmentIndexEntry)
+               != buffer.size() - sizeof(footer))
+            throw HttpReturnException(500, "Sparse matrix segment has a "
+                                      "corrupt index", "path", path);
+        index = (const SegmentIndexEntry *)(buffer.start() + footer.indexOffset);
+    }
+
+    std::string name;
+    ML::File_Read_Buffer buffer;
+    SegmentFooter footer;
+    const SegmentIndexEntry * index;
+
+    size_t numRows() const
+    {
+        return footer.numRows;
+    }
+
+    const SegmentIndexEntry * findRow(uint64_t rowNum) const
+    {
+        auto end = index + footer.numRows;
+        auto it = std::lower_bound(index, end, rowNum,
+                                   [] (const SegmentIndexEntry & e, uint64_t row)
+                                   {
+                                       return e.row < row;
+                                   });
+        if (it == end || it->row != rowNum)
+            return nullptr;
+        return it;
+    }
+
+    bool iterateRow(uint64_t rowNum,
+                    const std::function<bool (const BaseEntry & entry)> & onEntry) const
+    {
+        const SegmentIndexEntry * row = findRow(rowNum);
+        if (!row)
+            return true;
+
+        const char * p = buffer.start() + row->offset;
+        const char * end = p + row->length;
+        BaseEntry entry;
+        for (uint64_t i = 0;  i < row->count;  ++i) {
+            p = readEntry(p, end, entry);
+            if (!onEntry(entry))
+                return false;
+        }
+        return true;
+    }
+};
+
+typedef std::unordered_map<uint64_t, compact_vector<BaseEntry, 1> > RowsEntry;
+
+
+/*****************************************************************************/
+/* VERSION                                                                   */
+/*****************************************************************************/
+
+/** Immutable state of the matrix at a point in time, which is what a
+    transaction sees.  Data is in segments, then in the tables that are
+    being compacted into a new segment, then in the tables of the current
+    log.  Each of these is ordered from oldest to newest.
+*/
+
+struct Version {
+    Version()
+        : activeEntries(0), cachedRowCount(-1)
+    {
+    }
+
+    std::vector<std::shared_ptr<const Segment> > segments;
+    std::vector<std::shared_ptr<const RowsEntry> > compacting;
+    std::vector<std::shared_ptr<const RowsEntry> > active;
+    size_t activeEntries;
+
+    mutable std::atomic<int64_t> cachedRowCount;
+
+    /** Return a copy that can be modified to become the next version. */
+    std::shared_ptr<Version> derive() const
+    {
+        auto result = std::make_shared<Version>();
+        result->segments = segments;
+        result->compacting = compacting;
+        result->active = active;
+        result->activeEntries = activeEntries;
+        return result;
+    }
+
+    bool isSingleSegment() const
+    {
+        return segments.size() == 1 && compacting.empty() && active.empty();
+    }
+
+    template<typename Fn>
+    bool forEachTable(Fn && onTable) const
+    {
+        for (auto & t: compacting)
+            if (!onTable(*t))
+                return false;
+        for (auto & t: active)
+            if (!onTable(*t))
+                return false;
+        return true;
+    }
+
+    bool iterateRow(uint64_t rowNum,
+                    const std::function<bool (const BaseEntry & entry)> & onEntry) const
+    {
+        for (auto & s: segments) {
+            if (!s->iterateRow(rowNum, onEntry))
+                return false;
+        }
+
+        return forEachTable([&] (const RowsEntry & table)
+            {
+                auto it = table.find(rowNum);
+                if (it == table.end())
+                    return true;
+                for (auto & e: it->second) {
+                    if (!onEntry(e))
+                        return false;
+                }
+                return true;
+            });
+    }
+
+    bool knownRow(uint64_t rowNum) const
+    {
+        for (auto & s: segments) {
+            if (s->findRow(rowNum))
+                return true;
+        }
+
+        return !forEachTable([&] (const RowsEntry & table)
+                             {
+                                 return !table.count(rowNum);
+                             });
+    }
+
+    /** Return all of the row numbers, sorted and without duplicates. */
+    std::vector<uint64_t> allRows() const
+    {
+        std::vector<uint64_t> result;
+
+        for (auto & s: segments) {
+            for (size_t i = 0;  i < s->numRows();  ++i)
+                result.push_back(s->index[i].row);
+        }
+
+        forEachTable([&] (const RowsEntry & table)
+                     {
+                         for (auto & r: table)
+                             result.push_back(r.first);
+                         return true;
+                     });
+
+        if (!isSingleSegment()) {
+            parallelQuickSortRecursive(result);
+            result.erase(std::unique(result.begin(), result.end()),
+                         result.end());
+        }
+
+        return result;
+    }
+
+    size_t rowCount() const
+    {
+        if (isSingleSegment())
+            return segments[0]->numRows();
+        int64_t r = cachedRowCount.load();
+        if (r != -1)
+            return r;
+        r = allRows().size();
+        cachedRowCount = r;
+        return r;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PERSISTENT BASE MATRIX INTERNALS                                          */
+/*****************************************************************************/
+
+struct PersistentBaseMatrix::Itl {
+
+    Itl(const std::string & directory, size_t compactionThreshold)
+        : directory(directory),
+          compactionThreshold(compactionThreshold),
+          logFd(-1),
+          nextFileNumber(0),
+          compactionRequested(false),
+          fullCompactionRequested(false),
+          compactionRunning(false),
+          shutdown(false)
+    {
+        makeUriDirectory(directory + "/");
+
+        auto version = std::make_shared<Version>();
+        std::set<std::string> liveFiles;
+
+        std::string manifestPath = directory + "/manifest.json";
+        if (ML::fileExists(manifestPath)) {
+            filter_istream stream(manifestPath);
+            Json::Value manifest = Json::parse(stream.readAll());
+
+            nextFileNumber = manifest["nextFileNumber"].asUInt();
+
+            for (auto & s: manifest["segments"]) {
+                std::string name = s.asString();
+                version->segments.emplace_back
+                    (std::make_shared<Segment>(name, directory + "/" + name));
+                liveFiles.insert(name);
+            }
+
+            // Whatever is in the logs goes back into memory, to be
+            // compacted into a segment in the background
+            auto replayed = std::make_shared<RowsEntry>();
+            for (auto & l: manifest["logs"]) {
+                std::string name = l.asString();
+                version->activeEntries
+                    += replayLog(directory + "/" + name, *replayed);
+                logs.push_back(name);
+                liveFiles.insert(name);
+            }
+
+            if (!replayed->empty()) {
+                version->active.emplace_back(std::move(replayed));
+                compactionRequested = true;
+            }
+            else {
+                // Logs with nothing in them are dropped from the manifest
+                // written below, and removed once it is in place
+                logs.clear();
+            }
+        }
+
+        // Remove anything left behind by a compaction that was interrupted
+        // before or after it updated the manifest
+        removeFilesExcept(liveFiles);
+
+        current = version;
+        startNewLog();
+
+        liveFiles.clear();
+        liveFiles.insert(logs.begin(), logs.end());
+        for (auto & s: current->segments)
+            liveFiles.insert(s->name);
+        removeFilesExcept(liveFiles);
+
+        compactionThread = std::thread(&Itl::runCompactions, this);
+    }
+
+    ~Itl()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            shutdown = true;
+            compactionCond.notify_all();
+        }
+
+        compactionThread.join();
+
+        if (logFd != -1) {
+            fdatasync(logFd);
+            ::close(logFd);
+        }
+    }
+
+    std::string directory;
+    size_t compactionThreshold;
+
+    /// Protects everything below
+    mutable std::mutex mutex;
+
+    /// Current state, as seen by new transactions
+    std::shared_ptr<const Version> current;
+
+    /// Live logs, oldest first.  Writes are appended to the last one.
+    std::vector<std::string> logs;
+
+    /// File descriptor of the log being written
+    int logFd;
+
+    /// Number used to name the next file created
+    uint64_t nextFileNumber;
+
+    std::thread compactionThread;
+    std::condition_variable compactionCond;
+    bool compactionRequested;
+    bool fullCompactionRequested;
+    bool compactionRunning;
+    bool shutdown;
+    std::exception_ptr compactionError;
+
+    std::shared_ptr<const Version> getVersion() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return current;
+    }
+
+    std::string newFileName(const std::string & prefix)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%s-%08llu", prefix.c_str(),
+                 (unsigned long long)nextFileNumber++);
+        return buf;
+    }
+
+    /** Replace the manifest with one that describes the given segments
+        and the current logs.  Must be called with the lock held.
+    */
+    void writeManifest(const std::vector<std::shared_ptr<const Segment> > & segments)
+    {
+        Json::Value manifest;
+        manifest["version"] = 1;
+        manifest["nextFileNumber"] = (Json::UInt)nextFileNumber;
+        manifest["segments"] = Json::arrayValue;
+        for (auto & s: segments)
+            manifest["segments"].append(s->name);
+        manifest["logs"] = Json::arrayValue;
+        for (auto & l: logs)
+            manifest["logs"].append(l);
+
+        std::string path = directory + "/manifest.json";
+        {
+            filter_ostream stream(path + ".tmp");
+            stream << manifest.toStyledString();
+        }
+        ML::syncFile(path + ".tmp");
+        if (::rename((path + ".tmp").c_str(), path.c_str()) == -1)
+            throw ML::Exception(errno, "rename manifest " + path);
+        syncDirectory(directory);
+    }
+
+    void removeFilesExcept(const std::set<std::string> & liveFiles)
+    {
+        DIR * dir = opendir(directory.c_str());
+        if (!dir)
+            throw ML::Exception(errno, "opendir " + directory);
+
+        std::vector<std::string> toRemove;
+        while (dirent * entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (liveFiles.count(name))
+                continue;
+            if (name.find("segment-") == 0 || name.find("log-") == 0)
+                toRemove.push_back(name);
+        }
+        closedir(dir);
+
+        for (auto & name: toRemove)
+            ::unlink((directory + "/" + name).c_str());
+    }
+
+    /** Start writing to a new log.  Must be called with the lock held. */
+    void startNewLog()
+    {
+        if (logFd != -1) {
+            if (fdatasync(logFd) == -1)
+                throw ML::Exception(errno, "fdatasync sparse matrix log");
+            ::close(logFd);
+            logFd = -1;
+        }
+
+        std::string name = newFileName("log");
+        std::string path = directory + "/" + name;
+        logFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                       0666);
+        if (logFd == -1)
+            throw ML::Exception(errno, "open sparse matrix log " + path);
+
+        logs.push_back(name);
+        writeManifest(current->segments);
+    }
+
+    /** Read the records in the given log into rows, returning the number
+        of entries read.  Reading stops at the first incomplete or corrupt
+        record, which is what is left behind when a process dies while
+        appending.
+    */
+    static size_t replayLog(const std::string & path, RowsEntry & rows)
+    {
+        ML::File_Read_Buffer buffer(path);
+        const char * p = buffer.start();
+        const char * end = buffer.end();
+        size_t numEntries = 0;
+
+        while (end - p >= (ssize_t)sizeof(LogRecordHeader)) {
+            LogRecordHeader header;
+            memcpy(&header, p, sizeof(header));
+            const char * record = p + sizeof(header);
+            if (header.magic != LOG_RECORD_MAGIC
+                || header.length > (uint64_t)(end - record)
+                || checksum(record, header.length) != header.checksum)
+                break;
+
+            const char * recordEnd = record + header.length;
+            for (uint32_t i = 0;  i < header.numRows;  ++i) {
+                uint64_t rowNum;
+                uint32_t count;
+                record = readPod(record, recordEnd, rowNum);
+                record = readPod(record, recordEnd, count);
+                auto & row = rows[rowNum];
+                for (uint32_t j = 0;  j < count;  ++j) {
+                    BaseEntry entry;
+                    record = readEntry(record, recordEnd, entry);
+                    row.emplace_back(std::move(entry));
+                }
+                numEntries += count;
+            }
+
+            p = recordEnd;
+        }
+
+        if (p != end) {
+            cerr << "warning: ignoring " << (end - p) << " bytes of "
+                 << "incomplete writes at the end of sparse matrix log "
+                 << path << endl;
+        }
+
+        return numEntries;
+    }
+
+    void appendToLog(const std::string & record)
+    {
+        const char * p = record.data();
+        size_t left = record.size();
+        while (left > 0) {
+            ssize_t res = ::write(logFd, p, left);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw ML::Exception(errno, "writing sparse matrix log");
+            }
+            p += res;
+            left -= res;
+        }
+    }
+
+    /** Add the given table to the active tables, keeping them in
+        decreasing order of size with each at most half the size of the
+        one before, so that an insertion has amortized constant cost.
+        This is the same scheme as MutableBaseData::insertBalanced().
+    */
+    static void insertBalanced(std::vector<std::shared_ptr<const RowsEntry> > & tables,
+                               std::shared_ptr<RowsEntry> written)
+    {
+        std::vector<std::shared_ptr<const RowsEntry> > newTables;
+        std::shared_ptr<const RowsEntry> current = std::move(written);
+
+        for (int i = tables.size() - 1;  i >= 0;  --i) {
+            std::shared_ptr<const RowsEntry> rows = tables[i];
+
+            if (!current) {
+                newTables.push_back(rows);
+                continue;
+            }
+
+            double ratio = 1.0 * current->size() / rows->size();
+            if (ratio <= 0.5) {
+                newTables.emplace_back(std::move(current));
+                current.reset();
+                newTables.push_back(rows);
+                continue;
+            }
+
+            // Merge the two together, keeping the older entries first
+            auto merged = std::make_shared<RowsEntry>(*rows);
+            for (auto & rowIn: *current) {
+                auto & rowOut = (*merged)[rowIn.first];
+                rowOut.insert(rowOut.end(),
+                              rowIn.second.begin(), rowIn.second.end());
+            }
+            current = merged;
+        }
+
+        if (current)
+            newTables.emplace_back(std::move(current));
+
+        std::reverse(newTables.begin(), newTables.end());
+        tables = std::move(newTables);
+    }
+
+    /** Commit the given writes.  They are appended to the log, and then
+        become visible atomically.
+    */
+    void commit(std::shared_ptr<RowsEntry> written)
+    {
+        if (written->empty())
+            return;
+
+        // Serialize outside of the lock
+        std::string record(sizeof(LogRecordHeader), '\0');
+        size_t numEntries = 0;
+        for (auto & r: *written) {
+            appendPod(record, r.first);
+            appendPod(record, (uint32_t)r.second.size());
+            for (auto & e: r.second)
+                appendEntry(record, e);
+            numEntries += r.second.size();
+        }
+
+        LogRecordHeader header;
+        header.magic = LOG_RECORD_MAGIC;
+        header.numRows = written->size();
+        header.length = record.size() - sizeof(header);
+        header.checksum = checksum(record.data() + sizeof(header),
+                                   header.length);
+        memcpy(&record[0], &header, sizeof(header));
+
+        std::unique_lock<std::mutex> guard(mutex);
+        appendToLog(record);
+
+        auto next = current->derive();
+        insertBalanced(next->active, std::move(written));
+        next->activeEntries += numEntries;
+        current = next;
+
+        if (next->activeEntries >= compactionThreshold) {
+            compactionRequested = true;
+            compactionCond.notify_all();
+        }
+    }
+
+    void optimize(bool full)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (fdatasync(logFd) == -1)
+            throw ML::Exception(errno, "fdatasync sparse matrix log");
+        compactionRequested = true;
+        if (full)
+            fullCompactionRequested = true;
+        compactionCond.notify_all();
+    }
+
+    void waitForCompaction()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        compactionCond.wait(guard, [&] ()
+                            {
+                                return !compactionRequested
+                                    && !compactionRunning;
+                            });
+        if (compactionError) {
+            std::exception_ptr exc = compactionError;
+            compactionError = nullptr;
+            std::rethrow_exception(exc);
+        }
+    }
+
+    void runCompactions()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        for (;;) {
+            compactionCond.wait(guard, [&] ()
+                                {
+                                    return shutdown || compactionRequested;
+                                });
+            if (shutdown)
+                return;
+
+            compactionRequested = false;
+            compactionRunning = true;
+            try {
+                compact(guard);
+            } catch (const std::exception & exc) {
+                cerr << "error compacting sparse matrix in " << directory
+                     << ": " << exc.what() << endl;
+                compactionError = std::current_exception();
+            }
+            compactionRunning = false;
+            compactionCond.notify_all();
+        }
+    }
+
+    /** Write the active tables into a new segment, merging in the most
+        recent segments if they are not much bigger.  Called with the lock
+        held; it's released while the segment is being written.
+    */
+    void compact(std::unique_lock<std::mutex> & guard)
+    {
+        bool full = fullCompactionRequested;
+        fullCompactionRequested = false;
+
+        if (current->active.empty()
+            && (!full || current->segments.size() <= 1))
+            return;
+
+        // Freeze the active tables.  Writes that happen while compacting
+        // go into a new log, so that the current ones can be deleted once
+        // the segment is written.
+        size_t numCompactedLogs = 0;
+        auto frozen = current->derive();
+        ExcAssert(frozen->compacting.empty());
+        uint64_t compactedEntries = frozen->activeEntries;
+        uint64_t mergedEntries = compactedEntries;
+
+        if (!frozen->active.empty()) {
+            numCompactedLogs = logs.size();
+            frozen->compacting = std::move(frozen->active);
+            frozen->active.clear();
+            frozen->activeEntries = 0;
+            current = frozen;
+            startNewLog();
+        }
+
+        // Merge in segments while they are less than twice the size of
+        // what has been merged so far, or all of them for a full
+        // compaction
+        const auto & segments = frozen->segments;
+        size_t firstMerged = segments.size();
+        while (firstMerged > 0
+               && (full
+                   || mergedEntries * 2 > segments[firstMerged - 1]->footer.numEntries)) {
+            --firstMerged;
+            mergedEntries += segments[firstMerged]->footer.numEntries;
+        }
+
+        std::vector<std::shared_ptr<const Segment> >
+            toMerge(segments.begin() + firstMerged, segments.end());
+        std::string name = newFileName("segment");
+
+        guard.unlock();
+        std::shared_ptr<const Segment> segment;
+        try {
+            segment = writeSegment(name, toMerge, frozen->compacting);
+        } catch (...) {
+            // Put the tables back so that the next compaction can retry.
+            // Their logs are still in the manifest, so nothing is lost.
+            guard.lock();
+            auto next = current->derive();
+            next->active.insert(next->active.begin(),
+                                next->compacting.begin(),
+                                next->compacting.end());
+            next->activeEntries += compactedEntries;
+            next->compacting.clear();
+            current = next;
+            throw;
+        }
+        guard.lock();
+
+        auto next = current->derive();
+        next->segments.erase(next->segments.begin() + firstMerged,
+                             next->segments.end());
+        next->segments.push_back(segment);
+        next->compacting.clear();
+
+        logs.erase(logs.begin(), logs.begin() + numCompactedLogs);
+        writeManifest(next->segments);
+        current = next;
+
+        // Now that the manifest no longer refers to them, the files can be
+        // removed.  Transactions that still use the merged segments keep
+        // them mapped until they are done.
+        for (auto & s: toMerge)
+            ::unlink((directory + "/" + s->name).c_str());
+        std::set<std::string> liveFiles(logs.begin(), logs.end());
+        for (auto & s: next->segments)
+            liveFiles.insert(s->name);
+        removeFilesExcept(liveFiles);
+    }
+
+    /** Write a segment containing the rows of the given segments and
+        tables, with entries for the same row concatenated from oldest to
+        newest, and return it.
+    */
+    std::shared_ptr<const Segment>
+    writeSegment(const std::string & name,
+                 const std::vector<std::shared_ptr<const Segment> > & segments,
+                 const std::vector<std::shared_ptr<const RowsEntry> > & tables)
+    {
+        std::vector<uint64_t> rows;
+        for (auto & s: segments) {
+            for (size_t i = 0;  i < s->numRows();  ++i)
+                rows.push_back(s->index[i].row);
+        }
+        for (auto & t: tables) {
+            for (auto & r: *t)
+                rows.push_back(r.first);
+        }
+        parallelQuickSortRecursive(rows);
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        std::string path = directory + "/" + name;
+        std::string tmpPath = path + ".tmp";
+
+        std::vector<SegmentIndexEntry> index;
+        index.reserve(rows.size());
+        uint64_t offset = 0;
+        uint64_t numEntries = 0;
+
+        {
+            filter_ostream stream(tmpPath);
+
+            // Each segment's rows are sorted, so we just need to keep track
+            // of where we're up to in each one
+            std::vector<size_t> positions(segments.size(), 0);
+            std::string buf;
+
+            for (uint64_t rowNum: rows) {
+                SegmentIndexEntry entry;
+                entry.row = rowNum;
+                entry.offset = offset;
+                entry.count = 0;
+                buf.clear();
+
+                for (size_t i = 0;  i < segments.size();  ++i) {
+                    const Segment & segment = *segments[i];
+                    size_t & pos = positions[i];
+                    if (pos == segment.numRows()
+                        || segment.index[pos].row != rowNum)
+                        continue;
+                    // Entries are copied across without being decoded
+                    const SegmentIndexEntry & row = segment.index[pos++];
+                    buf.append(segment.buffer.start() + row.offset,
+                               row.length);
+                    entry.count += row.count;
+                }
+
+                for (auto & t: tables) {
+                    auto it = t->find(rowNum);
+                    if (it == t->end())
+                        continue;
+                    for (auto & e: it->second)
+                        appendEntry(buf, e);
+                    entry.count += it->second.size();
+                }
+
+                entry.length = buf.size();
+                stream.write(buf.data(), buf.size());
+                offset += buf.size();
+                numEntries += entry.count;
+                index.push_back(entry);
+            }
+
+            // Align the index so that it can be accessed in place
+            while (offset % sizeof(uint64_t) != 0) {
+                stream.put(0);
+                ++offset;
+            }
+
+            SegmentFooter footer;
+            memcpy(footer.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+            footer.numRows = index.size();
+            footer.numEntries = numEntries;
+            footer.indexOffset = offset;
+
+            stream.write((const char *)index.data(),
+                         index.size() * sizeof(SegmentIndexEntry));
+            stream.write((const char *)&footer, sizeof(footer));
+        }
+
+        ML::syncFile(tmpPath);
+        if (::rename(tmpPath.c_str(), path.c_str()) == -1)
+            throw ML::Exception(errno, "rename sparse matrix segment " + path);
+
+        return std::make_shared<Segment>(name, path);
+    }
+};
+
+
+/*****************************************************************************/
+/* PERSISTENT TRANSACTIONS                                                   */
+/*****************************************************************************/
+
+namespace {
+
+struct SegmentStream: public MatrixReadTransaction::Stream {
+
+    SegmentStream(std::shared_ptr<const Segment> segment)
+        : segment(std::move(segment)), pos(0)
+    {
+    }
+
+    virtual std::shared_ptr<MatrixReadTransaction::Stream> clone() const
+    {
+        return std::make_shared<SegmentStream>(segment);
+    }
+
+    virtual void initAt(size_t start)
+    {
+        pos = start;
+    }
+
+    virtual uint64_t next()
+    {
+        return segment->index[pos++].row;
+    }
+
+    virtual uint64_t current() const
+    {
+        return segment->index[pos].row;
+    }
+
+    std::shared_ptr<const Segment> segment;
+    size_t pos;
+};
+
+struct PersistentWriteTransaction: public MatrixWriteTransaction {
+
+    PersistentWriteTransaction(std::shared_ptr<PersistentBaseMatrix::Itl> itl)
+        : itl(itl),
+          version(itl->getVersion()),
+          written(new RowsEntry())
+    {
+    }
+
+    std::shared_ptr<PersistentBaseMatrix::Itl> itl;
+    std::shared_ptr<const Version> version;
+    std::shared_ptr<RowsEntry> written;
+
+    virtual bool
+    iterateRow(uint64_t rowNum,
+               const std::function<bool (const BaseEntry & entry)> & onEntry)
+    {
+        if (!version->iterateRow(rowNum, onEntry))
+            return false;
+
+        auto it = written->find(rowNum);
+        if (it != written->end()) {
+            for (auto & e: it->second) {
+                if (!onEntry(e))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint64_t> allRows() const
+    {
+        std::vector<uint64_t> result = version->allRows();
+        if (written->empty())
+            return result;
+        for (auto & r: *written)
+            result.push_back(r.first);
+        parallelQuickSortRecursive(result);
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    virtual bool iterateRows(const std::function<bool (uint64_t row)> & onRow)
+    {
+        for (uint64_t row: allRows()) {
+            if (!onRow(row))
+                return false;
+        }
+        return true;
+    }
+
+    virtual bool knownRow(uint64_t rowNum)
+    {
+        return written->count(rowNum) || version->knownRow(rowNum);
+    }
+
+    virtual size_t rowCount() const
+    {
+        if (written->empty())
+            return version->rowCount();
+        return allRows().size();
+    }
+
+    virtual void recordRow(uint64_t rowNum, const BaseEntry * entries, int n)
+    {
+        auto & row = (*written)[rowNum];
+        for (unsigned i = 0;  i < n;  ++i) {
+            row.emplace_back(entries[i]);
+        }
+    }
+
+    virtual void recordRow(uint64_t rowNum, BaseEntry * entries, int n)
+    {
+        auto & row = (*written)[rowNum];
+        for (unsigned i = 0;  i < n;  ++i) {
+            row.emplace_back(std::move(entries[i]));
+        }
+    }
+
+    virtual void recordCol(uint64_t colNum, const BaseEntry * entries, int n)
+    {
+        for (unsigned i = 0;  i < n;  ++i) {
+            BaseEntry e = entries[i];
+            auto & row = (*written)[e.rowcol];
+            e.rowcol = colNum;
+            row.emplace_back(std::move(e));
+        }
+    }
+
+    virtual void recordCol(uint64_t colNum, BaseEntry * entries, int n)
+    {
+        for (unsigned i = 0;  i < n;  ++i) {
+            BaseEntry & e = entries[i];
+            auto & row = (*written)[e.rowcol];
+            e.rowcol = colNum;
+            row.emplace_back(std::move(e));
+        }
+    }
+
+    // Serializing a big transaction into the log takes a while
+    virtual bool commitNeedsThread() const
+    {
+        return written->size() > 10000;
+    }
+
+    virtual void commit()
+    {
+        itl->commit(std::move(written));
+        written.reset(new RowsEntry());
+    }
+
+    virtual std::shared_ptr<MatrixWriteTransaction> startWriteTransaction() const
+    {
+        return std::make_shared<PersistentWriteTransaction>(itl);
+    }
+
+    virtual std::shared_ptr<MatrixReadTransaction::Stream> getStream() const
+    {
+        ExcAssert(false);
+        return std::shared_ptr<MatrixReadTransaction::Stream>();
+    }
+};
+
+struct PersistentReadTransaction: public MatrixReadTransaction {
+
+    PersistentReadTransaction(std::shared_ptr<PersistentBaseMatrix::Itl> itl)
+        : itl(itl), version(itl->getVersion())
+    {
+    }
+
+    std::shared_ptr<PersistentBaseMatrix::Itl> itl;
+    std::shared_ptr<const Version> version;
+
+    virtual bool iterateRow(uint64_t rowNum,
+                            const std::function<bool (const BaseEntry & entry)> & onEntry)
+    {
+        return version->iterateRow(rowNum, onEntry);
+    }
+
+    virtual bool iterateRows(const std::function<bool (uint64_t row)> & onRow)
+    {
+        for (uint64_t row: version->allRows()) {
+            if (!onRow(row))
+                return false;
+        }
+        return true;
+    }
+
+    virtual bool knownRow(uint64_t rowNum)
+    {
+        return version->knownRow(rowNum);
+    }
+
+    virtual size_t rowCount() const
+    {
+        return version->rowCount();
+    }
+
+    virtual std::shared_ptr<MatrixReadTransaction::Stream> getStream() const
+    {
+        ExcAssert(version->isSingleSegment());
+        return std::make_shared<SegmentStream>(version->segments[0]);
+    }
+
+    virtual std::shared_ptr<MatrixWriteTransaction> startWriteTransaction() const
+    {
+        return std::make_shared<PersistentWriteTransaction>(itl);
+    }
+
+    virtual bool isSingleReadEntry() const
+    {
+        return version->isSingleSegment();
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PERSISTENT BASE MATRIX                                                    */
+/*****************************************************************************/
+
+PersistentBaseMatrix::
+PersistentBaseMatrix(const std::string & directory,
+                     size_t compactionThreshold)
+    : itl(new Itl(directory, compactionThreshold))
+{
+}
+
+PersistentBaseMatrix::
+~PersistentBaseMatrix()
+{
+}
+
+std::shared_ptr<MatrixReadTransaction>
+PersistentBaseMatrix::
+startReadTransaction() const
+{
+    return std::make_shared<PersistentReadTransaction>(itl);
+}
+
+std::shared_ptr<MatrixWriteTransaction>
+PersistentBaseMatrix::
+startWriteTransaction()
+{
+    return std::make_shared<PersistentWriteTransaction>(itl);
+}
+
+void
+PersistentBaseMatrix::
+optimize()
+{
+    itl->optimize(false /* full */);
+}
+
+void
+PersistentBaseMatrix::
+compactAll()
+{
+    itl->optimize(true /* full */);
+}
+
+void
+PersistentBaseMatrix::
+waitForCompaction()
+{
+    itl->waitForCompaction();
+}
+
+size_t
+PersistentBaseMatrix::
+segmentCount() const
+{
+    return itl->getVersion()->segments.size();
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,95 @@
+/** persistent_sparse_matrix.h                                     -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Base matrix for the sparse matrix dataset that persists its data on
+    disk.
+*/
+
+#pragma once
+
+#include "sparse_matrix.h"
+#include <string>
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PERSISTENT BASE MATRIX                                                    */
+/*****************************************************************************/
+
+/** Base matrix whose contents are stored in a directory on the local
+    filesystem, so that they survive a restart and may be larger than the
+    available memory.
+
+    The directory contains:
+    - An append-only log.  Each committed write transaction is appended
+      to it (with a checksum) before it becomes visible.  What is in the
+      log is also held in memory, in hash tables like those of the
+      mutable base matrix.
+    - A set of immutable segments.  Each holds its rows sorted by row
+      number, followed by an index.  They are memory mapped, so that the
+      OS can page them in and out as needed.
+    - A manifest listing the live segments and logs, which is replaced
+      atomically.
+
+    A background thread compacts the in-memory contents of the log into
+    a new segment once enough of it has accumulated, or when optimize()
+    or compactAll() is called.  The most recent segments are merged in when they are of a
+    similar size, which keeps the number of segments logarithmic in the
+    size of the data.  Once the new segment is in the manifest, the logs
+    that it covers are deleted.
+
+    Transactions have snapshot isolation.  A read transaction sees the
+    state as of when it was started, whatever is committed or compacted
+    afterwards.  A write transaction sees that state plus its own writes,
+    which become visible atomically when it commits.
+*/
+
+struct PersistentBaseMatrix: public BaseMatrix {
+
+    /** Open the matrix stored in the given directory, creating it if
+        necessary.  Once more than compactionThreshold entries have been
+        written to the log, they are compacted into a segment in the
+        background.
+    */
+    PersistentBaseMatrix(const std::string & directory,
+                         size_t compactionThreshold = 1000000);
+
+    virtual ~PersistentBaseMatrix();
+
+    virtual std::shared_ptr<MatrixReadTransaction> startReadTransaction() const;
+    virtual std::shared_ptr<MatrixWriteTransaction> startWriteTransaction();
+
+    /** Make sure that everything that has been committed is durable, and
+        start compacting what is in the log into a segment in the
+        background, merging in the most recent segments as usual.  This
+        is called on every commit, so it doesn't rewrite the older
+        segments.
+    */
+    virtual void optimize();
+
+    /** Make sure that everything that has been committed is durable, and
+        start compacting it and all existing segments into a single
+        segment in the background.  This rewrites all of the data, and so
+        should only be done once recording has finished.
+    */
+    void compactAll();
+
+    /** Wait for any compaction that has been started to finish.  Rethrows
+        the exception if a compaction has failed.
+    */
+    void waitForCompaction();
+
+    /** Return the number of segments that the data is currently in. */
+    size_t segmentCount() const;
+
+    struct Itl;
+
+private:
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
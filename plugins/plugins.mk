@@ -7,8 +7,10 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	dataset_feature_space.cc \
 	accuracy.cc \
 	metric_space.cc \
+	hnsw_index.cc \
 	sqlite_dataset.cc \
 	sparse_matrix_dataset.cc \
+	persistent_sparse_matrix.cc \
 	script_procedure.cc \
 	permuter_procedure.cc \
 	external_python_procedure.cc \
@@ -27,8 +29,11 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	ranking_procedure.cc \
 	fetcher.cc \
 	importtext_procedure.cc \
+	csv_scanner.cc \
+	csv_scanner_avx2.cc \
 	tabular_dataset.cc \
 	frozen_column.cc \
+	frozen_serialization.cc \
 	column_types.cc \
 	tabular_dataset_column.cc \
 	randomforest_procedure.cc \
@@ -53,6 +58,9 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	summary_statistics_proc.cc \
 
 
+# Only called when the CPU is detected to support AVX2
+$(eval $(call set_single_compile_option,csv_scanner_avx2.cc,-mavx2))
+
 # Needed so that Python plugin can find its header
 $(eval $(call set_compile_option,python_plugin_loader.cc,-I$(PYTHON_INCLUDE_PATH)))
 
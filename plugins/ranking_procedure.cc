@@ -16,7 +16,7 @@
 #include "mldb/sql/execution_pipeline.h"
 #include "mldb/arch/backtrace.h"
 #include "mldb/types/any_impl.h"
-#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/server/dataset_utils.h"
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/plugins/sql_config_validator.h"
@@ -131,7 +131,7 @@ run(const ProcedureRunConfig & run,
                                 nullptr, true /*overwrite*/);
 
     typedef tuple<ColumnName, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowName, vector<Cell> > > > accum;
+    ParallelRecorder recorder(*output);
     const ColumnName columnName(runProcConf.rankingColumnName);
     function<void(int64_t)> applyFct;
     float countD100 = (rowCount) / 100.0;
@@ -146,13 +146,8 @@ run(const ProcedureRunConfig & run,
                                   (idx + 1) / countD100,
                                   globalMaxOrderByTimestamp);
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
-
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
+            recorder.recordRowDestructive(orderedRowNames[idx],
+                                          std::move(rowValue));
         };
     }
     else {
@@ -164,25 +159,15 @@ run(const ProcedureRunConfig & run,
                                   idx,
                                   globalMaxOrderByTimestamp);
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
-
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
+            recorder.recordRowDestructive(orderedRowNames[idx],
+                                          std::move(rowValue));
         };
     }
 
 
     parallelMap(0, rowCount, applyFct);
 
-    // record remainder
-    accum.forEach([&] (vector<pair<RowName, vector<Cell> > > * rows)
-    {
-        output->recordRows(*rows);
-    });
-    output->commit();
+    recorder.commit();
     return output->getStatus();
 }
 
@@ -12,6 +12,7 @@
 #include "mldb/types/compact_vector_description.h"
 #include "mldb/types/map_description.h"
 #include "sparse_matrix.h"
+#include "persistent_sparse_matrix.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/any_impl.h"
@@ -1573,6 +1574,12 @@ MutableSparseMatrixDatasetConfigDescription()
              "Whether to favor reads or writes.  Only has effect for when "
              "`consistencyLevel` is set to `consistentAfterWrite`.",
              TF_FAVOR_READS);
+    addField("dataDirectoryUrl", &MutableSparseMatrixDatasetConfig::dataDirectoryUrl,
+             "URI (must be file://) of a directory under which the dataset "
+             "persists its data.  If it contains data from a previous run, "
+             "that data is loaded.  Data is held in memory only if this is "
+             "empty.  When set, `consistencyLevel` and `favor` are ignored, "
+             "as each write becomes readable once it has been persisted.");
 }
 
 /*****************************************************************************/
@@ -1584,8 +1591,27 @@ struct MutableSparseMatrixDataset::Itl
 
     Itl(double timeQuantumSeconds,
         WriteTransactionLevel consistencyLevel,
-        TransactionFavor favor) 
+        TransactionFavor favor,
+        const Url & dataDirectoryUrl)
     {
+        SparseMatrixDataset::Itl::timeQuantumSeconds = timeQuantumSeconds;
+
+        if (!dataDirectoryUrl.empty()) {
+            if (dataDirectoryUrl.scheme() != "file")
+                throw HttpReturnException(400, "Sparse matrix dataset "
+                                          "requires file:// URI for "
+                                          "dataDirectoryUrl, passed '"
+                                          + dataDirectoryUrl.toUtf8String()
+                                          + "'");
+
+            std::string directory = dataDirectoryUrl.path();
+            init(std::make_shared<PersistentBaseMatrix>(directory + "/metadata"),
+                 std::make_shared<PersistentBaseMatrix>(directory + "/matrix"),
+                 std::make_shared<PersistentBaseMatrix>(directory + "/inverse"),
+                 std::make_shared<PersistentBaseMatrix>(directory + "/values"));
+            return;
+        }
+
         CommitMode mode;
         if (consistencyLevel == WT_READ_AFTER_COMMIT)
             mode = READ_ON_COMMIT;
@@ -1593,7 +1619,6 @@ struct MutableSparseMatrixDataset::Itl
             mode = READ_FAST;
         else mode = WRITE_FAST;
 
-        SparseMatrixDataset::Itl::timeQuantumSeconds = timeQuantumSeconds;
         init(std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode),
@@ -1610,7 +1635,8 @@ MutableSparseMatrixDataset(MldbServer * owner,
     : SparseMatrixDataset(owner)
 {
     auto params = config.params.convert<MutableSparseMatrixDatasetConfig>();
-    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel, params.favor));
+    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel,
+                      params.favor, params.dataDirectoryUrl));
 }
 
 static RegisterDatasetType<MutableSparseMatrixDataset,
@@ -93,6 +93,9 @@ struct MutableSparseMatrixDatasetConfig
 
     /// Transaction favor.  When reads and writes are mixed, which do we favor?
     TransactionFavor favor;
+
+    /// Directory under which the data is persisted; empty means memory only
+    Url dataDirectoryUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableSparseMatrixDatasetConfig);
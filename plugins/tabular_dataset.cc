@@ -10,6 +10,7 @@
 #include "frozen_column.h"
 #include "tabular_dataset_column.h"
 #include "tabular_dataset_chunk.h"
+#include "frozen_serialization.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/ml/jml/training_index_entry.h"
@@ -20,9 +21,19 @@
 #include "mldb/server/bucket.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/hash_wrapper_description.h"
+#include "mldb/types/vector_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/types/url.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
+#include "mldb/sql/compiled_expression.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/jml/utils/environment.h"
 #include <mutex>
+#include <unordered_set>
 
 using namespace std;
 
@@ -31,6 +42,107 @@ namespace MLDB {
 
 static constexpr size_t TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK=65536;
 static constexpr size_t NUM_PARALLEL_CHUNKS=16;
+static const std::string TABULAR_DATASET_FILE_TYPE="MLDB Tabular Dataset";
+static constexpr int TABULAR_DATASET_FILE_VERSION=2;
+
+/// Maximum number of full chunks that can be waiting to be frozen in the
+/// background.  Once there are this many, recording threads help to freeze
+/// them rather than allocating new chunks, which bounds the memory used by
+/// unfrozen rows during an import.
+static ML::Env_Option<size_t>
+MLDB_TABULAR_MAX_UNFROZEN_CHUNKS("MLDB_TABULAR_MAX_UNFROZEN_CHUNKS", 32);
+
+
+/*****************************************************************************/
+/* TABULAR DATASET CHUNK                                                     */
+/*****************************************************************************/
+
+void
+TabularDatasetChunk::
+serialize(ML::DB::Store_Writer & metadata,
+          FrozenBlockWriter & blocks) const
+{
+    metadata << ML::DB::compact_size_t(columns.size());
+    for (size_t i = 0;  i < columns.size();  ++i) {
+        columns[i]->serialize(metadata, blocks);
+        zoneMaps.at(i).serialize(metadata);
+    }
+
+    metadata << ML::DB::compact_size_t(sparseColumns.size());
+    for (auto & c: sparseColumns) {
+        serializePath(metadata, columnNameTable->getPath(c.first));
+        c.second->serialize(metadata, blocks);
+        sparseZoneMaps.at(c.first).serialize(metadata);
+    }
+
+    timestamps->serialize(metadata, blocks);
+
+    ExcAssert(rowNames);
+
+    // Integer row names are a flat array, so they go into a block.  Other
+    // row names need to be reconstituted one by one.
+    const std::vector<uint64_t> & integerRowNames = rowNames->integerNames;
+    uint64_t integerRowNamesOffset
+        = blocks.write(integerRowNames.data(),
+                       integerRowNames.size() * sizeof(uint64_t));
+    metadata << ML::DB::compact_size_t(integerRowNames.size())
+             << integerRowNamesOffset;
+
+    metadata << ML::DB::compact_size_t(rowNames->names.size());
+    for (auto & r: rowNames->names)
+        serializePath(metadata, r);
+}
+
+TabularDatasetChunk
+TabularDatasetChunk::
+reconstitute(ML::DB::Store_Reader & metadata,
+             const FrozenBlockReader & blocks,
+             std::shared_ptr<PathInternTable> columnNameTable)
+{
+    TabularDatasetChunk result;
+    result.columnNameTable = std::move(columnNameTable);
+
+    ML::DB::compact_size_t numColumns(metadata);
+    result.columns.reserve(numColumns);
+    result.zoneMaps.resize(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        result.columns.emplace_back(FrozenColumn::reconstitute(metadata, blocks));
+        result.zoneMaps[i].reconstitute(metadata);
+    }
+
+    ML::DB::compact_size_t numSparseColumns(metadata);
+    result.sparseColumns.reserve(numSparseColumns);
+    for (size_t i = 0;  i < numSparseColumns;  ++i) {
+        ColumnName columnName = reconstitutePath(metadata);
+        auto column = FrozenColumn::reconstitute(metadata, blocks);
+        uint32_t id = result.columnNameTable->intern(columnName);
+        result.sparseColumns.emplace(id, std::move(column));
+        result.sparseZoneMaps[id].reconstitute(metadata);
+    }
+
+    result.timestamps = FrozenColumn::reconstitute(metadata, blocks);
+
+    ML::DB::compact_size_t numIntegerRowNames(metadata);
+    uint64_t integerRowNamesOffset;
+    metadata >> integerRowNamesOffset;
+    const uint64_t * integerRowNames
+        = reinterpret_cast<const uint64_t *>
+        (blocks.getRaw(integerRowNamesOffset,
+                       numIntegerRowNames * sizeof(uint64_t),
+                       alignof(uint64_t)));
+    auto rowNames = std::make_shared<RowNames>();
+    rowNames->integerNames.assign(integerRowNames,
+                                  integerRowNames + numIntegerRowNames);
+
+    ML::DB::compact_size_t numRowNames(metadata);
+    rowNames->names.reserve(numRowNames);
+    for (size_t i = 0;  i < numRowNames;  ++i)
+        rowNames->names.emplace_back(reconstitutePath(metadata));
+
+    result.rowNames = std::move(rowNames);
+
+    return result;
+}
 
 
 /*****************************************************************************/
@@ -43,8 +155,12 @@ static constexpr size_t NUM_PARALLEL_CHUNKS=16;
 
 struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
-    TabularDataStore(TabularDatasetConfig config)
-        : rowCount(0), config(std::move(config)),
+    TabularDataStore(TabularDatasetConfig config,
+                     std::shared_ptr<PathInternTable> columnNameTable
+                         = std::make_shared<PathInternTable>())
+        : rowCount(0), columnNameTable(std::move(columnNameTable)),
+          config(std::move(config)),
+          committed(false), frozenRowCount(0),
           backgroundJobsActive(0)
     {
     }
@@ -54,8 +170,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     */
     struct TabularDataStoreRowStream : public RowStream {
 
-        TabularDataStoreRowStream(TabularDataStore * store)
-            : store(store)
+        TabularDataStoreRowStream(std::shared_ptr<TabularDataStore> store)
+            : store(std::move(store))
         {
         }
 
@@ -229,7 +345,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return extractT<CellValue>(numValues, columnNames, output);
         }
 
-        TabularDataStore* store;
+        std::shared_ptr<TabularDataStore> store;
         std::vector<TabularDatasetChunk>::const_iterator chunkiter;
         size_t rowIndex;   ///< Number of row within this chunk
         size_t rowCount;   ///< Total number of rows within this chunk
@@ -272,6 +388,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     /// List of all chunks in the dataset
     std::vector<TabularDatasetChunk> chunks;
 
+    /// Table of the names of the sparse columns of the chunks.  It belongs
+    /// to the dataset, and is shared with its snapshots.
+    std::shared_ptr<PathInternTable> columnNameTable;
+
     /** This structure handles a list of chunks that allows for them to be
         recorded in parallel.  It's used for the old recordRow interface.
         Most datasets should instead use the chunk oriented interface, and
@@ -351,6 +471,25 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     TabularDatasetConfig config;
 
+    /// Set once the dataset has been committed (or loaded), after which it
+    /// is read directly rather than through a snapshot.  Protected by the
+    /// dataset lock.
+    bool committed;
+
+    /// Latest read-only snapshot of the rows frozen before the commit.
+    /// Protected by the dataset lock.
+    std::shared_ptr<TabularDataStore> snapshot;
+
+    /// Held while a snapshot is being built, so that only one is built at
+    /// once.  Taken before the dataset lock.
+    std::mutex snapshotMutex;
+
+    /// Number of rows and set of sparse column names in frozenChunks, so
+    /// that the status can be returned without building a snapshot.
+    /// Protected by the dataset lock.
+    uint64_t frozenRowCount;
+    std::unordered_set<uint32_t> frozenSparseColumns;
+
     // Return the value of the column for all rows
     virtual MatrixColumn getColumn(const ColumnName & column) const override
     {
@@ -691,28 +830,598 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return { earliestTs, latestTs };
     }
 
+    /** Optimize a WHERE clause by scanning the frozen storage of the
+        columns it reads block by block, rather than reconstituting each
+        row.  Returns an empty function if it can't be optimized so that
+        the generic implementation is used instead.
+    */
     GenerateRowsWhereFunction
-    generateRowsWhere(const SqlBindingScope & context,
-                      const SqlExpression & where,
-                      ssize_t offset,
-                      ssize_t limit) const
+    generateRowsWhere(const Dataset & dataset,
+                      const Utf8String & alias,
+                      const SqlExpression & where) const
     {
-        GenerateRowsWhereFunction result;
+        GenerateRowsWhereFunction result
+            = generateColumnComparison(alias, where);
+        if (!result)
+            result = generateCompiledWhere(dataset, alias, where);
         return result;
     }
 
+    /** Optimize a WHERE clause of the form "column op constant" (or
+        "constant op column"), "column BETWEEN constant AND constant" or
+        "column IN (constant, ...)".  Chunks whose zone map shows that
+        they can't contain a matching value are skipped without being
+        decoded, and chunks with a secondary index on the column look up
+        the matching rows in the index.  Otherwise the column is decoded,
+        and for dictionary encoded blocks the test is done once per
+        distinct value.
+    */
+    GenerateRowsWhereFunction
+    generateColumnComparison(const Utf8String & alias,
+                             const SqlExpression & where) const
+    {
+        const ReadColumnExpression * variable = nullptr;
+
+        // Test of a single non-null value of the column
+        std::function<bool (const CellValue &)> matches;
+
+        // Test of whether a chunk may contain a matching value
+        std::function<bool (const ColumnZoneMap &)> mayMatch;
+
+        // Add the rows of a chunk that match to the given list, using the
+        // chunk's index of the column
+        std::function<void (const FrozenColumnIndex &, std::vector<uint32_t> &)>
+            lookup;
+
+        // For comparisons with a (signed) integer constant, integer blocks
+        // can be compared without creating a CellValue
+        enum { EQ, NE, LT, LE, GT, GE } cmp = EQ;
+        bool intConstant = false;
+        int64_t intValue = 0;
+
+        Utf8String description;
+
+        if (auto comparison
+            = dynamic_cast<const ComparisonExpression *>(&where)) {
+            variable = dynamic_cast<const ReadColumnExpression *>
+                (comparison->lhs.get());
+            auto constant = dynamic_cast<const ConstantExpression *>
+                (comparison->rhs.get());
+            std::string op = comparison->op;
+
+            if (!variable || !constant) {
+                // Try the other way around, reversing the comparison
+                variable = dynamic_cast<const ReadColumnExpression *>
+                    (comparison->rhs.get());
+                constant = dynamic_cast<const ConstantExpression *>
+                    (comparison->lhs.get());
+                if (!variable || !constant)
+                    return GenerateRowsWhereFunction();
+                if (op == "<") op = ">";
+                else if (op == ">") op = "<";
+                else if (op == "<=") op = ">=";
+                else if (op == ">=") op = "<=";
+            }
+
+            if (!constant->constant.isAtom())
+                return GenerateRowsWhereFunction();
+
+            CellValue value = constant->constant.getAtom();
+
+            // Comparisons with null are never true
+            if (value.empty())
+                return {[=] (ssize_t numToGenerate, Any token,
+                             const BoundParameters & params)
+                        -> std::pair<std::vector<RowName>, Any>
+                        {
+                            return { {}, Any() };
+                        },
+                        "tabular dataset: comparison with null",
+                        GenerateRowsWhereFunction::CONSTANT };
+
+            if (op == "=" || op == "==") cmp = EQ;
+            else if (op == "!=") cmp = NE;
+            else if (op == "<") cmp = LT;
+            else if (op == "<=") cmp = LE;
+            else if (op == ">") cmp = GT;
+            else if (op == ">=") cmp = GE;
+            else return GenerateRowsWhereFunction();
+
+            // Same semantics as ComparisonExpression, which compares atoms
+            // with the CellValue operators
+            matches = [=] (const CellValue & val) -> bool
+                {
+                    switch (cmp) {
+                    case EQ: return val == value;
+                    case NE: return val != value;
+                    case LT: return val < value;
+                    case LE: return val <= value;
+                    case GT: return val > value;
+                    case GE: return val >= value;
+                    }
+                    return false;
+                };
+
+            mayMatch = [=] (const ColumnZoneMap & zone) -> bool
+                {
+                    switch (cmp) {
+                    case EQ: return zone.mayContain(value);
+                    case NE: return zone.numValues > 0;
+                    case LT: return zone.mayContainRange(nullptr, false,
+                                                         &value, false);
+                    case LE: return zone.mayContainRange(nullptr, false,
+                                                         &value, true);
+                    case GT: return zone.mayContainRange(&value, false,
+                                                         nullptr, false);
+                    case GE: return zone.mayContainRange(&value, true,
+                                                         nullptr, false);
+                    }
+                    return true;
+                };
+
+            lookup = [=] (const FrozenColumnIndex & index,
+                          std::vector<uint32_t> & rows)
+                {
+                    switch (cmp) {
+                    case EQ:
+                        index.findRange(&value, true, &value, true,
+                                        matches, rows);
+                        return;
+                    case NE:
+                        index.findRange(nullptr, false, nullptr, false,
+                                        matches, rows);
+                        return;
+                    case LT:
+                    case LE:
+                        index.findRange(nullptr, false, &value, cmp == LE,
+                                        matches, rows);
+                        return;
+                    case GT:
+                    case GE:
+                        index.findRange(&value, cmp == GE, nullptr, false,
+                                        matches, rows);
+                        return;
+                    }
+                };
+
+            intConstant = value.isInteger() && value.isInt64();
+            intValue = intConstant ? value.toInt() : 0;
+
+            description = Utf8String(op) + " " + value.toUtf8String();
+        }
+        else if (auto between
+                 = dynamic_cast<const BetweenExpression *>(&where)) {
+            variable = dynamic_cast<const ReadColumnExpression *>
+                (between->expr.get());
+            auto lower = dynamic_cast<const ConstantExpression *>
+                (between->lower.get());
+            auto upper = dynamic_cast<const ConstantExpression *>
+                (between->upper.get());
+            if (!variable || !lower || !upper || between->notBetween
+                || !lower->constant.isAtom() || !upper->constant.isAtom())
+                return GenerateRowsWhereFunction();
+
+            CellValue lowerValue = lower->constant.getAtom();
+            CellValue upperValue = upper->constant.getAtom();
+
+            // BETWEEN with a null bound is never true
+            if (lowerValue.empty() || upperValue.empty())
+                return GenerateRowsWhereFunction();
+
+            // Same semantics as BetweenExpression
+            matches = [=] (const CellValue & val) -> bool
+                {
+                    return !(val < lowerValue) && !(upperValue < val);
+                };
+
+            mayMatch = [=] (const ColumnZoneMap & zone) -> bool
+                {
+                    return zone.mayContainRange(&lowerValue, true,
+                                                &upperValue, true);
+                };
+
+            lookup = [=] (const FrozenColumnIndex & index,
+                          std::vector<uint32_t> & rows)
+                {
+                    index.findRange(&lowerValue, true, &upperValue, true,
+                                    matches, rows);
+                };
+
+            description = "between " + lowerValue.toUtf8String() + " and "
+                + upperValue.toUtf8String();
+        }
+        else if (auto in = dynamic_cast<const InExpression *>(&where)) {
+            variable = dynamic_cast<const ReadColumnExpression *>
+                (in->expr.get());
+            if (!variable || in->kind != InExpression::TUPLE || in->isnegative)
+                return GenerateRowsWhereFunction();
+
+            // Null items never match, so they are left out
+            std::vector<CellValue> values;
+            for (auto & item: in->tuple->clauses) {
+                auto constant = dynamic_cast<const ConstantExpression *>
+                    (item.get());
+                if (!constant || !constant->constant.isAtom())
+                    return GenerateRowsWhereFunction();
+                if (!constant->constant.empty())
+                    values.emplace_back(constant->constant.getAtom());
+            }
+
+            // Same semantics as InExpression
+            matches = [=] (const CellValue & val) -> bool
+                {
+                    for (auto & v: values)
+                        if (val == v)
+                            return true;
+                    return false;
+                };
+
+            mayMatch = [=] (const ColumnZoneMap & zone) -> bool
+                {
+                    for (auto & v: values)
+                        if (zone.mayContain(v))
+                            return true;
+                    return false;
+                };
+
+            lookup = [=] (const FrozenColumnIndex & index,
+                          std::vector<uint32_t> & rows)
+                {
+                    for (auto & v: values) {
+                        index.findRange(&v, true, &v, true,
+                                        [&] (const CellValue & val)
+                                        {
+                                            return val == v;
+                                        },
+                                        rows);
+                    }
+                };
+
+            description = "in " + in->tuple->surface;
+        }
+        else return GenerateRowsWhereFunction();
+
+        ColumnName columnName(removeTableName(alias, variable->columnName));
+
+        // If the column isn't known, it may be the prefix of a structured
+        // column, which we can't deal with here
+        auto it = columnIndex.find(columnName.newHash());
+        if (it == columnIndex.end())
+            return GenerateRowsWhereFunction();
+
+        int columnNum = it->second;
+
+        auto matchesInt = [=] (int64_t val) -> bool
+            {
+                switch (cmp) {
+                case EQ: return val == intValue;
+                case NE: return val != intValue;
+                case LT: return val < intValue;
+                case LE: return val <= intValue;
+                case GT: return val > intValue;
+                case GE: return val >= intValue;
+                }
+                return false;
+            };
+
+        const ColumnEntry * entry = &columns[it->second];
+
+        Utf8String scanType = "block scan";
+        if (std::find(config.indexedColumns.begin(),
+                      config.indexedColumns.end(), columnName)
+            != config.indexedColumns.end())
+            scanType = "index lookup";
+
+        auto scanColumn = [=] (const FrozenColumn & column,
+                               const TabularDatasetChunk & chunk,
+                               std::vector<RowName> & output)
+            {
+                // Skip the whole chunk if it can't contain a match
+                const ColumnZoneMap * zone
+                    = chunk.maybeGetZoneMap(columnNum, columnName);
+                if (zone && !mayMatch(*zone))
+                    return;
+
+                // Use the index if there is one
+                if (const FrozenColumnIndex * index
+                        = chunk.maybeGetIndex(columnName)) {
+                    std::vector<uint32_t> rows;
+                    lookup(*index, rows);
+
+                    // The same row can be found twice if the IN list has
+                    // duplicates
+                    std::sort(rows.begin(), rows.end());
+                    rows.erase(std::unique(rows.begin(), rows.end()),
+                               rows.end());
+
+                    output.reserve(output.size() + rows.size());
+                    for (uint32_t r: rows)
+                        output.emplace_back(chunk.getRowName(r));
+                    return;
+                }
+
+                FrozenColumnBlock block;
+
+                // Dictionaries are normally shared between all of the blocks
+                // of a column, so we only evaluate each entry once
+                const CellValue * lastDictionary = nullptr;
+                std::vector<char> dictionaryMatches;
+
+                // Note that column.size() is the number of stored values
+                // for sparse columns, so we use the size of the chunk
+                size_t sz = chunk.rowCount();
+                for (size_t start = 0;  start < sz;
+                     start += FrozenColumnBlock::DEFAULT_SIZE) {
+                    uint32_t n = std::min<size_t>(sz - start,
+                                                  FrozenColumnBlock::DEFAULT_SIZE);
+                    column.decodeBlock(start, n, block);
+
+                    if (block.encoding == FrozenColumnBlock::DICTIONARY
+                        && (block.dictionary != lastDictionary
+                            || !block.ownedDictionary.empty())) {
+                        dictionaryMatches.resize(block.dictionarySize);
+                        for (size_t i = 0;  i < block.dictionarySize;  ++i)
+                            dictionaryMatches[i] = matches(block.dictionary[i]);
+                        lastDictionary = block.dictionary;
+                    }
+
+                    for (uint32_t i = 0;  i < n;  ++i) {
+                        if (!block.isPresent(i))
+                            continue;
+                        bool match;
+                        switch (block.encoding) {
+                        case FrozenColumnBlock::DICTIONARY:
+                            match = dictionaryMatches[block.indexes[i]];
+                            break;
+                        case FrozenColumnBlock::INTEGERS:
+                            if (intConstant)
+                                match = matchesInt(block.integers[i]);
+                            else match = matches(block.integers[i]);
+                            break;
+                        default:
+                            match = matches(block.get(i));
+                        }
+                        if (match)
+                            output.emplace_back(chunk.getRowName(start + i));
+                    }
+                }
+            };
+
+        return {[=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params)
+                -> std::pair<std::vector<RowName>, Any>
+                {
+                    std::vector<std::vector<RowName> >
+                        chunkRows(entry->chunks.size());
+
+                    auto doChunk = [&] (size_t i)
+                        {
+                            const auto & c = entry->chunks[i];
+                            scanColumn(*c.second, chunks.at(c.first),
+                                       chunkRows[i]);
+                        };
+
+                    parallelMap(0, entry->chunks.size(), doChunk);
+
+                    std::vector<RowName> result;
+                    for (auto & rows: chunkRows) {
+                        result.insert(result.end(),
+                                      std::make_move_iterator(rows.begin()),
+                                      std::make_move_iterator(rows.end()));
+                    }
+
+                    return { std::move(result), Any() };
+                },
+                "tabular dataset: " + scanType + " of column '"
+                    + columnName.toUtf8String() + "' " + description,
+                GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
+    /** Optimize a WHERE clause made up of arithmetic, comparisons and
+        boolean operators over known columns by compiling it into a
+        CompiledSqlExpression, and running it over blocks of decoded
+        column values.  Rows with values the compiled expression can't
+        handle (strings, timestamps, ...) are evaluated using the bound
+        expression instead.
+    */
+    GenerateRowsWhereFunction
+    generateCompiledWhere(const Dataset & dataset,
+                          const Utf8String & alias,
+                          const SqlExpression & where) const
+    {
+        std::shared_ptr<const CompiledSqlExpression> compiled
+            = CompiledSqlExpression::compile(where, alias);
+        if (!compiled
+            || compiled->resultType != CompiledSqlExpression::BOOLEAN)
+            return GenerateRowsWhereFunction();
+
+        // For each input, the frozen column in each chunk (or null if the
+        // chunk doesn't contain the column)
+        std::vector<std::vector<const FrozenColumn *> > inputColumns;
+        for (auto & columnName: compiled->inputs) {
+            auto it = columnIndex.find(columnName.newHash());
+            if (it == columnIndex.end())
+                return GenerateRowsWhereFunction();
+            std::vector<const FrozenColumn *> chunkColumns(chunks.size());
+            for (auto & c: columns[it->second].chunks)
+                chunkColumns.at(c.first) = c.second.get();
+            inputColumns.emplace_back(std::move(chunkColumns));
+        }
+
+        // Bound version of the expression, for the rows that the compiled
+        // version can't deal with
+        auto scope = std::make_shared<SqlExpressionDatasetScope>
+            (dataset, alias);
+        BoundSqlExpression whereBound = where.bind(*scope);
+
+        /** Dictionary of a column converted into values and states for the
+            compiled expression.  Dictionaries are normally shared between
+            all of the blocks of a column, so each entry is only converted
+            once per chunk.
+        */
+        struct LoadedDictionary {
+            LoadedDictionary()
+                : dictionary(nullptr)
+            {
+            }
+
+            const CellValue * dictionary;
+            std::vector<CompiledSqlExpression::State> states;
+            std::vector<double> values;
+
+            void load(const FrozenColumnBlock & block)
+            {
+                if (block.dictionary == dictionary
+                    && block.ownedDictionary.empty())
+                    return;
+                states.resize(block.dictionarySize);
+                values.resize(block.dictionarySize);
+                for (size_t i = 0;  i < block.dictionarySize;  ++i) {
+                    states[i] = CompiledSqlExpression::loadCell
+                        (block.dictionary[i], values[i]);
+                }
+                // A dictionary owned by the block isn't shared with the
+                // next one, so it can't be cached
+                dictionary = block.ownedDictionary.empty()
+                    ? block.dictionary : nullptr;
+            }
+        };
+
+        // Load a decoded block into the given input register
+        auto loadBlock = [] (const FrozenColumnBlock & block,
+                             double * values,
+                             CompiledSqlExpression::State * states,
+                             LoadedDictionary & dictionary)
+            {
+                const std::vector<CompiledSqlExpression::State> &
+                    dictionaryStates = dictionary.states;
+                const std::vector<double> & dictionaryValues
+                    = dictionary.values;
+
+                if (block.encoding == FrozenColumnBlock::DICTIONARY)
+                    dictionary.load(block);
+
+                for (uint32_t i = 0;  i < block.numRows;  ++i) {
+                    if (!block.isPresent(i)) {
+                        states[i] = CompiledSqlExpression::NULL_VALUE;
+                        continue;
+                    }
+                    switch (block.encoding) {
+                    case FrozenColumnBlock::INTEGERS:
+                        states[i] = CompiledSqlExpression::loadInteger
+                            (block.integers[i], values[i]);
+                        break;
+                    case FrozenColumnBlock::DOUBLES:
+                        values[i] = block.doubles[i];
+                        states[i] = CompiledSqlExpression::VALUE;
+                        break;
+                    case FrozenColumnBlock::DICTIONARY:
+                        values[i] = dictionaryValues[block.indexes[i]];
+                        states[i] = dictionaryStates[block.indexes[i]];
+                        break;
+                    default:
+                        states[i] = CompiledSqlExpression::UNSUPPORTED;
+                    }
+                }
+            };
+
+        auto scanChunk = [=] (size_t chunkIndex,
+                              std::vector<RowName> & output)
+            {
+                const TabularDatasetChunk & chunk = chunks[chunkIndex];
+
+                CompiledSqlExpression::Registers registers;
+                compiled->initRegisters(registers,
+                                        FrozenColumnBlock::DEFAULT_SIZE);
+                FrozenColumnBlock block;
+                std::vector<LoadedDictionary> dictionaries(inputColumns.size());
+
+                size_t sz = chunk.rowCount();
+                for (size_t start = 0;  start < sz;
+                     start += FrozenColumnBlock::DEFAULT_SIZE) {
+                    uint32_t n = std::min<size_t>(sz - start,
+                                                  FrozenColumnBlock::DEFAULT_SIZE);
+
+                    for (size_t i = 0;  i < inputColumns.size();  ++i) {
+                        const FrozenColumn * column = inputColumns[i][chunkIndex];
+                        if (!column) {
+                            std::fill(registers.state(i),
+                                      registers.state(i) + n,
+                                      CompiledSqlExpression::NULL_VALUE);
+                            continue;
+                        }
+                        column->decodeBlock(start, n, block);
+                        loadBlock(block, registers.value(i),
+                                  registers.state(i), dictionaries[i]);
+                    }
+
+                    compiled->execute(registers, n);
+
+                    const double * values = registers.value(compiled->result);
+                    const CompiledSqlExpression::State * states
+                        = registers.state(compiled->result);
+
+                    for (uint32_t i = 0;  i < n;  ++i) {
+                        bool keep;
+                        switch (states[i]) {
+                        case CompiledSqlExpression::VALUE:
+                            keep = values[i];
+                            break;
+                        case CompiledSqlExpression::NULL_VALUE:
+                            keep = false;
+                            break;
+                        default: {
+                            MatrixNamedRow row;
+                            row.rowName = chunk.getRowName(start + i);
+                            row.rowHash = row.rowName;
+                            row.columns = chunk.getRow(start + i,
+                                                       fixedColumns);
+                            auto rowScope = scope->getRowScope(row);
+                            keep = whereBound(rowScope, GET_LATEST).isTrue();
+                        }
+                        }
+                        if (keep)
+                            output.emplace_back(chunk.getRowName(start + i));
+                    }
+                }
+            };
+
+        return {[=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params)
+                -> std::pair<std::vector<RowName>, Any>
+                {
+                    std::vector<std::vector<RowName> >
+                        chunkRows(chunks.size());
+
+                    auto doChunk = [&] (size_t i)
+                        {
+                            scanChunk(i, chunkRows[i]);
+                        };
+
+                    parallelMap(0, chunks.size(), doChunk);
+
+                    std::vector<RowName> result;
+                    for (auto & rows: chunkRows) {
+                        result.insert(result.end(),
+                                      std::make_move_iterator(rows.begin()),
+                                      std::make_move_iterator(rows.end()));
+                    }
+
+                    return { std::move(result), Any() };
+                },
+                "tabular dataset: compiled block scan of "
+                    + where.print(),
+                GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
     void finalize(std::vector<TabularDatasetChunk> & inputChunks,
                   uint64_t totalRows)
     {
         // NOTE: must be called with the lock held
 
-        rowCount = totalRows;
-        
-        chunks.reserve(inputChunks.size());
+        ExcAssert(chunks.empty());
 
-        for (auto & c: inputChunks) {
-            chunks.emplace_back(std::move(c));
-        }
+        rowCount = 0;
 
         columns.reserve(fixedColumns.size());
         for (size_t i = 0;  i < fixedColumns.size();  ++i) {
@@ -724,23 +1433,46 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             columnHashIndex[c] = i;
         }
 
+        addChunks(inputChunks);
+
+        ExcAssertEqual(rowCount, totalRows);
+    }
+
+    /** Add the given frozen chunks after those already in the store,
+        updating the column and row indexes for just the new chunks.
+    */
+    void addChunks(std::vector<TabularDatasetChunk> & inputChunks)
+    {
+        size_t firstChunk = chunks.size();
+
+        chunks.reserve(firstChunk + inputChunks.size());
+
+        for (auto & c: inputChunks) {
+            rowCount += c.rowCount();
+            chunks.emplace_back(std::move(c));
+        }
+
         // Create the column index.  This should be rapid, as there shouldn't
         // be too many columns.
-        for (size_t i = 0;  i < chunks.size();  ++i) {
+        for (size_t i = firstChunk;  i < chunks.size();  ++i) {
             const TabularDatasetChunk & chunk = chunks[i];
             ExcAssertEqual(fixedColumns.size(), chunk.columns.size());
             for (size_t j = 0;  j < chunk.columns.size();  ++j) {
                 columns[j].chunks.emplace_back(i, chunk.columns[j]);
             }
             for (auto & c: chunk.sparseColumns) {
-                auto it = columnIndex.insert(make_pair(c.first.newHash(),
+                // The interned name's hash is cached, so there is no need
+                // to rehash the name for each chunk
+                const PathInternTable & names = *columnNameTable;
+                auto it = columnIndex.insert(make_pair(names.getNewHash(c.first),
                                                        columns.size()))
                     .first;
                 if (it->second == columns.size()) {
                     ColumnEntry entry;
-                    entry.columnName = c.first;
+                    entry.columnName = names.getPath(c.first);
                     columns.emplace_back(entry);
-                    columnHashIndex[c.first] = it->second;
+                    columnHashIndex[ColumnHash(names.getHash(c.first))]
+                        = it->second;
                 }
                 columns[it->second].chunks.emplace_back(i, c.second);
             }
@@ -791,7 +1523,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 }
             };
         
-        parallelMap(0, chunks.size(), indexChunk);
+        parallelMap(firstChunk, chunks.size(), indexChunk);
         
 #if 0
         //cerr << "creating row index" << endl;
@@ -813,6 +1545,73 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     }
 
+    /** Save the committed contents of the dataset to the given file.
+        Must be called with the lock held.
+    */
+    void save(const Url & url) const
+    {
+        auto writeContents = [&] (ML::DB::Store_Writer & metadata,
+                                  FrozenBlockWriter & blocks)
+            {
+                metadata << ML::DB::compact_size_t(fixedColumns.size());
+                for (auto & c: fixedColumns)
+                    serializePath(metadata, c);
+
+                metadata << rowCount << ML::DB::compact_size_t(chunks.size());
+                for (auto & c: chunks)
+                    c.serialize(metadata, blocks);
+            };
+
+        saveFrozenFile(url, TABULAR_DATASET_FILE_TYPE,
+                       TABULAR_DATASET_FILE_VERSION, writeContents);
+    }
+
+    /** Load the contents of the dataset from the given file, which was
+        written by save().  Only the metadata is read; the column data is
+        used directly from the (normally memory mapped) file.  The loaded
+        dataset is committed and can't be recorded to.
+    */
+    void load(const Url & url)
+    {
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        std::vector<ColumnName> columnNames;
+        std::vector<TabularDatasetChunk> loadedChunks;
+        int64_t totalRows = 0;
+
+        auto readContents = [&] (ML::DB::Store_Reader & metadata,
+                                 const FrozenBlockReader & blocks)
+            {
+                ML::DB::compact_size_t numColumns(metadata);
+                columnNames.reserve(numColumns);
+                for (size_t i = 0;  i < numColumns;  ++i)
+                    columnNames.emplace_back(reconstitutePath(metadata));
+
+                metadata >> totalRows;
+                ML::DB::compact_size_t numChunks(metadata);
+                loadedChunks.reserve(numChunks);
+                for (size_t i = 0;  i < numChunks;  ++i) {
+                    loadedChunks.emplace_back
+                        (TabularDatasetChunk::reconstitute(metadata, blocks,
+                                                           columnNameTable));
+                }
+            };
+
+        loadFrozenFile(url, TABULAR_DATASET_FILE_TYPE,
+                       TABULAR_DATASET_FILE_VERSION, readContents);
+
+        initialize(std::move(columnNames));
+
+        // Indexes aren't saved in the file, so they're rebuilt here
+        if (!config.indexedColumns.empty()) {
+            parallelMap(0, loadedChunks.size(),
+                        [&] (size_t i) { buildIndexes(loadedChunks[i]); });
+        }
+
+        finalize(loadedChunks, totalRows);
+        committed = true;
+    }
+
     void initialize(vector<ColumnName> columnNames)
     {
         ExcAssert(this->fixedColumns.empty());
@@ -827,6 +1626,35 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         }
     }
 
+    /** Build the secondary indexes of the given frozen chunk for the
+        columns listed in the indexedColumns configuration.
+    */
+    void buildIndexes(TabularDatasetChunk & chunk) const
+    {
+        for (auto & columnName: config.indexedColumns) {
+            const FrozenColumn * column = nullptr;
+            auto it = fixedColumnIndex.find(columnName.newHash());
+            if (it != fixedColumnIndex.end()
+                && it->second < chunk.columns.size()) {
+                column = chunk.columns[it->second].get();
+            }
+            else {
+                auto jt = chunk.sparseColumns.find
+                    (columnNameTable->find(columnName));
+                if (jt != chunk.sparseColumns.end())
+                    column = jt->second.get();
+            }
+            if (!column)
+                continue;
+
+            auto index = FrozenColumnIndex::build(*column, chunk.rowCount());
+            if (index) {
+                chunk.indexes[columnNameTable->intern(columnName)]
+                    = std::move(index);
+            }
+        }
+    }
+
     /** This is a recorder that allows parallel records from multiple
         threads. */
     struct BasicRecorder: public Recorder {
@@ -975,7 +1803,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             auto rowVals = store->prepareRow(vals);
 
             std::vector<CellValue> & orderedVals = std::get<0>(rowVals);
-            std::vector<std::pair<ColumnName, CellValue> > & newColumns
+            std::vector<std::pair<uint32_t, CellValue> > & newColumns
                 = std::get<1>(rowVals);
             Date ts = std::get<2>(rowVals);
 
@@ -990,7 +1818,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 ExcAssertEqual(written,
                                MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                 finishedChunk();
-                chunk.reset(new MutableTabularDatasetChunk(orderedVals.size(), 65536));
+                chunk.reset(new MutableTabularDatasetChunk(orderedVals.size(), 65536,
+                                                           store->columnNameTable));
             }
         }
 
@@ -1028,8 +1857,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         {
             if (!chunk || chunk->rowCount() == 0)
                 return;
-            auto frozen = chunk->freeze();
-            store->addFrozenChunk(std::move(frozen));
+            // The chunk is handed over to be frozen, so the next row
+            // recorded will create a new one
+            store->freezeChunkInBackground(std::move(chunk));
         }
 
         virtual
@@ -1067,18 +1897,25 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     }
                     ExcAssert(chunk);
 
+                    std::vector<std::pair<uint32_t, CellValue> > extraIds;
+                    extraIds.reserve(extra.size());
+                    for (auto & e: extra)
+                        extraIds.emplace_back
+                            (store->columnNameTable->intern(e.first),
+                             std::move(e.second));
 
                     for (;;) {
                         int written = chunk->add(rowName, timestamp,
                                                  vals, numVals,
-                                                 extra);
+                                                 extraIds);
                         if (written == MutableTabularDatasetChunk::ADD_SUCCEEDED)
                             break;
                         
                         ExcAssertEqual(written,
                                        MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                         finishedChunk();
-                        chunk.reset(new MutableTabularDatasetChunk(columnNames.size(), 65536));
+                        chunk.reset(new MutableTabularDatasetChunk(columnNames.size(), 65536,
+                                                                   store->columnNameTable));
                     }
                 };
         }
@@ -1116,6 +1953,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         // to access it.
         std::unique_lock<std::mutex> guard(datasetMutex);
 
+        // Readers now see the committed dataset rather than a snapshot
+        snapshot.reset();
+
         // At this point, nobody can see oldMutableChunks or its contents
         // apart from this thread.  So we can perform operations unlocked
         // on it without any problem.
@@ -1127,8 +1967,12 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             totalRows += c.rowCount();
 
         finalize(frozenChunks, totalRows);
+        committed = true;
 
-        size_t mem = 0;
+        // The sparse column names are stored once for all chunks.  A
+        // table shared with other datasets isn't counted against this one.
+        size_t mem = config.sharedColumnNames
+            ? 0 : columnNameTable->memusage();
         for (auto & c: chunks) {
             mem += c.memusage();
         }
@@ -1150,6 +1994,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
              << 1.0 * mem / rowCount << " bytes/row" << endl;
         cerr << "column memory is " << columnMem << endl;
 
+        if (!config.dataFileUrl.empty())
+            save(config.dataFileUrl);
     }
 
     /// The number of background jobs that we're currently waiting for
@@ -1157,12 +2003,17 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     // freezes a new chunk in the background, and adds it to frozenChunks.
     // Updates the number of background jobs atomically so that we can know
-    // when everything is finished.
+    // when everything is finished.  If too many chunks are already waiting
+    // to be frozen, the calling thread helps with the work first, which
+    // applies backpressure to the recorders.
     void freezeChunkInBackground(std::shared_ptr<MutableTabularDatasetChunk> chunk)
     {
         if (chunk->rowCount() == 0)
             return;
 
+        while (backgroundJobsActive >= MLDB_TABULAR_MAX_UNFROZEN_CHUNKS)
+            ThreadPool::instance().work();
+
         auto job = [=] ()
             {
                 Scope_Exit(--this->backgroundJobsActive);
@@ -1182,10 +2033,121 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void addFrozenChunk(TabularDatasetChunk frozen)
     {
         ExcAssertNotEqual(frozen.rowCount(), 0);
+        buildIndexes(frozen);
         std::unique_lock<std::mutex> guard(datasetMutex);
+        frozenRowCount += frozen.rowCount();
+        for (auto & c: frozen.sparseColumns) {
+            // Sparse columns with the name of a fixed column are merged
+            // with it by finalize(), so they aren't counted twice
+            uint64_t hash = columnNameTable->getNewHash(c.first);
+            if (!fixedColumnIndex.count(hash))
+                frozenSparseColumns.insert(c.first);
+        }
         frozenChunks.emplace_back(std::move(frozen));
     }
 
+    /** Return a read-only store containing the rows that have been frozen
+        so far, or null if the dataset has been committed and can be read
+        directly.  This allows an uncommitted dataset to be queried while
+        it's being recorded; each query sees a consistent snapshot.
+
+        The snapshot shares the frozen columns and row names with the
+        dataset.  When more chunks have been frozen since the last one,
+        only the new chunks are added to its indexes: in place if nobody
+        else holds the last snapshot, or otherwise to a copy of it.
+    */
+    std::shared_ptr<TabularDataStore> getSnapshot()
+    {
+        // Only one snapshot is built at once; other readers wait for it
+        // rather than building their own
+        std::unique_lock<std::mutex> snapshotGuard(snapshotMutex);
+
+        std::shared_ptr<TabularDataStore> result;
+        std::vector<TabularDatasetChunk> newChunks;
+        std::vector<ColumnName> snapshotColumns;
+
+        {
+            std::unique_lock<std::mutex> guard(datasetMutex);
+            if (committed)
+                return nullptr;
+            if (snapshot
+                && snapshot->fixedColumns.size() == fixedColumns.size()) {
+                if (snapshot->chunks.size() == frozenChunks.size())
+                    return snapshot;
+                result = snapshot;
+            }
+            else snapshotColumns = fixedColumns;
+
+            size_t firstChunk = result ? result->chunks.size() : 0;
+            newChunks.assign(frozenChunks.begin() + firstChunk,
+                             frozenChunks.end());
+        }
+
+        // Index the new chunks without the lock, so that the chunks that
+        // are being frozen in the background can still be added.  Nobody
+        // else can get hold of the last snapshot while we hold the
+        // snapshot mutex, so if the only other reference is our own it
+        // can be modified in place.
+        if (!result) {
+            uint64_t totalRows = 0;
+            for (auto & c: newChunks)
+                totalRows += c.rowCount();
+
+            result = std::make_shared<TabularDataStore>(config,
+                                                        columnNameTable);
+            result->initialize(std::move(snapshotColumns));
+            result->finalize(newChunks, totalRows);
+            result->committed = true;
+        }
+        else {
+            if (result.use_count() > 2) {
+                auto copy = std::make_shared<TabularDataStore>
+                    (config, columnNameTable);
+                copy->copyFrom(*result);
+                copy->committed = true;
+                result = std::move(copy);
+            }
+            result->addChunks(newChunks);
+        }
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+        if (!committed)
+            snapshot = result;
+
+        return result;
+    }
+
+    /** Copy the chunks and indexes of another read-only store, so that
+        more chunks can be added to the copy without modifying the original.
+        The chunks share their frozen columns and row names with it.
+    */
+    void copyFrom(const TabularDataStore & other)
+    {
+        rowCount = other.rowCount;
+        columnIndex = other.columnIndex;
+        columnHashIndex = other.columnHashIndex;
+        columns = other.columns;
+        fixedColumns = other.fixedColumns;
+        fixedColumnIndex = other.fixedColumnIndex;
+        chunks = other.chunks;
+        for (size_t i = 0;  i < ROW_INDEX_SHARDS;  ++i)
+            rowIndex[i] = other.rowIndex[i];
+        earliestTs = other.earliestTs;
+        latestTs = other.latestTs;
+    }
+
+    /** Return the number of rows and columns that queries can currently
+        see, without needing to build a snapshot before the commit.
+    */
+    std::pair<uint64_t, size_t> getRowAndColumnCount()
+    {
+        std::unique_lock<std::mutex> guard(datasetMutex);
+        if (committed)
+            return { (uint64_t)rowCount, columns.size() };
+        return { frozenRowCount,
+                 fixedColumns.size() + frozenSparseColumns.size() };
+    }
+
     std::shared_ptr<MutableTabularDatasetChunk>
     createNewChunk(size_t expectedSize)
     {
@@ -1195,13 +2157,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return nullptr;
 
         return std::make_shared<MutableTabularDatasetChunk>
-            (fixedColumns.size(), expectedSize);
+            (fixedColumns.size(), expectedSize, columnNameTable);
     }
 
     /** Analyze the first row to know what the columns are. */
     void createFirstChunks(const std::vector<std::tuple<ColumnName, CellValue, Date> > & vals)
     {
         // Must be done with the dataset lock held
+        if (rowCount > 0)
+            throw HttpReturnException(400, "Tabular dataset has already been committed, cannot add more rows");
+
         if (!mutableChunks.load()) {
             //need to create the mutable chunk
             vector<ColumnName> columnNames;
@@ -1224,7 +2189,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             for (auto & c: *newChunks) {
                 auto newChunk = std::make_shared<MutableTabularDatasetChunk>
                     (fixedColumns.size(),
-                     TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK);
+                     TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK,
+                     columnNameTable);
                 c.store(std::move(newChunk));
             }
             
@@ -1238,14 +2204,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     // rvalue or non-const reference (in which case we move)
     template<typename Vals>
     std::tuple<std::vector<CellValue>,
-               std::vector<std::pair<ColumnName, CellValue> >,
+               std::vector<std::pair<uint32_t, CellValue> >,
                Date>
     prepareRow(Vals&& vals)
     {
         std::vector<CellValue> orderedVals(fixedColumns.size());
         Date ts = Date::negativeInfinity();
 
-        std::vector<std::pair<ColumnName, CellValue> > newColumns;
+        // New columns are keyed by the id of their name, so that it's
+        // interned once here rather than on each attempt to add the row
+        std::vector<std::pair<uint32_t, CellValue> > newColumns;
 
         for (unsigned i = 0;  i < vals.size();  ++i) {
             const ColumnName & c = std::get<0>(vals[i]);
@@ -1262,8 +2230,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 case UC_IGNORE:
                     continue;
                 case UC_ADD:
-                    newColumns.emplace_back(std::move(std::get<0>(vals[i])),
-                                            std::move(std::get<1>(vals[i])));
+                    newColumns.emplace_back
+                        (columnNameTable->intern(std::get<0>(vals[i])),
+                         std::move(std::get<1>(vals[i])));
                     continue;
                 }
             }
@@ -1285,7 +2254,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                    Vals&& vals)
     {
         if (rowCount > 0)
-            HttpReturnException(400, "Tabular dataset has already been committed, cannot add more rows");
+            throw HttpReturnException(400, "Tabular dataset has already been committed, cannot add more rows");
 
         auto mc = mutableChunks.load();
 
@@ -1301,7 +2270,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         auto rowVals = prepareRow(vals);
 
         std::vector<CellValue> & orderedVals = std::get<0>(rowVals);
-        std::vector<std::pair<ColumnName, CellValue> > & newColumns
+        std::vector<std::pair<uint32_t, CellValue> > & newColumns
             = std::get<1>(rowVals);
         Date ts = std::get<2>(rowVals);
 
@@ -1321,7 +2290,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                      == MutableTabularDatasetChunk::ADD_PERFORM_ROTATION) {
                 // We need a rotation, and we've been selected to do it
                 auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                    (fixedColumns.size(), TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK);
+                    (fixedColumns.size(), TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK,
+                     columnNameTable);
                 if (mc->chunks[chunkNum]
                     .compare_exchange_strong(chunkPtr, newChunk)) {
                     // Successful rotation.  First we background freeze
@@ -1341,7 +2311,17 @@ TabularDataset(MldbServer * owner,
                const std::function<bool (const Json::Value &)> & onProgress)
     : Dataset(owner)
 {
-    itl = make_shared<TabularDataStore>(config.params.convert<TabularDatasetConfig>());
+    auto datasetConfig = config.params.convert<TabularDatasetConfig>();
+    itl = make_shared<TabularDataStore>
+        (datasetConfig,
+         datasetConfig.sharedColumnNames
+         ? PathInternTable::global()
+         : std::make_shared<PathInternTable>());
+
+    if (!datasetConfig.dataFileUrl.empty()
+        && tryGetUriObjectInfo(datasetConfig.dataFileUrl.toString())) {
+        itl->load(datasetConfig.dataFileUrl);
+    }
 }
 
 TabularDataset::
@@ -1353,9 +2333,14 @@ Any
 TabularDataset::
 getStatus() const
 {
+    auto counts = itl->getRowAndColumnCount();
     Json::Value status;
-    status["rowCount"] = itl->rowCount;
-    status["columnCount"] = itl->columns.size();
+    status["rowCount"] = counts.first;
+    status["columnCount"] = counts.second;
+    size_t indexMemory = 0;
+    for (auto & c: store->chunks)
+        indexMemory += c.indexMemusage();
+    status["indexMemory"] = indexMemory;
     return status;
 }
 
@@ -1363,21 +2348,21 @@ std::pair<Date, Date>
 TabularDataset::
 getTimestampRange() const
 {
-    return itl->getTimestampRange();
+    return getReadStore()->getTimestampRange();
 }
 
 std::shared_ptr<MatrixView>
 TabularDataset::
 getMatrixView() const
 {
-    return itl;
+    return getReadStore();
 }
 
 std::shared_ptr<ColumnIndex>
 TabularDataset::
 getColumnIndex() const
 {
-    return itl;
+    return getReadStore();
 }
 
 std::shared_ptr<RowStream> 
@@ -1385,7 +2370,7 @@ TabularDataset::
 getRowStream() const 
 { 
     return std::make_shared<TabularDataStore::TabularDataStoreRowStream>
-        (itl.get()); 
+        (getReadStore()); 
 } 
 
 GenerateRowsWhereFunction
@@ -1396,18 +2381,37 @@ generateRowsWhere(const SqlBindingScope & context,
                   ssize_t offset,
                   ssize_t limit) const
 {
+    auto store = getReadStore();
     GenerateRowsWhereFunction fn
-        = itl->generateRowsWhere(context, where, offset, limit);
+        = store->generateRowsWhere(*this, alias, where);
+    if (fn && store != itl) {
+        // The function refers to the snapshot, which must stay alive for
+        // as long as the function
+        auto exec = std::move(fn.exec);
+        fn.exec = [exec, store] (ssize_t numToGenerate, Any token,
+                                 const BoundParameters & params)
+            {
+                return exec(numToGenerate, std::move(token), params);
+            };
+    }
     if (!fn)
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
     return fn;
 }
 
+std::shared_ptr<TabularDataset::TabularDataStore>
+TabularDataset::
+getReadStore() const
+{
+    auto snapshot = itl->getSnapshot();
+    return snapshot ? snapshot : itl;
+}
+
 KnownColumn
 TabularDataset::
 getKnownColumnInfo(const ColumnName & columnName) const
 {
-    return itl->getKnownColumnInfo(columnName);
+    return getReadStore()->getKnownColumnInfo(columnName);
 }
 
 void
@@ -1457,6 +2461,7 @@ TabularDatasetConfig::
 TabularDatasetConfig()
 {
     unknownColumns = UC_ERROR;
+    sharedColumnNames = false;
 }
 
 DEFINE_ENUM_DESCRIPTION(UnknownColumnAction);
@@ -1481,6 +2486,27 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file in which to persist the dataset.  If the file "
+             "exists when the dataset is created, the dataset is loaded "
+             "from it and can't be recorded to; otherwise the dataset is "
+             "written to it when it's committed.  Files on `file://` are "
+             "memory mapped, so loading is very fast and the data is only "
+             "read from disk as it's used.");
+    addField("indexedColumns", &TabularDatasetConfig::indexedColumns,
+             "Columns on which to build a secondary index of their values.  "
+             "Queries with a WHERE clause that compares one of these "
+             "columns to a constant, with `=`, `!=`, `<`, `<=`, `>`, `>=`, "
+             "`BETWEEN` or `IN`, look up the matching rows in the index "
+             "instead of scanning the column.  Each index takes memory "
+             "proportional to the number of rows of the dataset.");
+    addField("sharedColumnNames", &TabularDatasetConfig::sharedColumnNames,
+             "If true, the names of the sparse columns added with "
+             "`unknownColumns` set to `add` are kept in a table shared by "
+             "all datasets of the process, rather than one belonging to "
+             "this dataset.  This saves memory when many datasets have the "
+             "same sparse columns, but the names are never freed.",
+             false);
 }
 
 namespace {
@@ -13,6 +13,7 @@
 
 #include "mldb/core/dataset.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/types/url.h"
 
 namespace Datacratic {
 namespace MLDB {
@@ -33,6 +34,9 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+    Url dataFileUrl;
+    std::vector<ColumnName> indexedColumns;
+    bool sharedColumnNames;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -79,6 +83,12 @@ protected:
 
     struct TabularDataStore;
     std::shared_ptr<TabularDataStore> itl;
+
+    /** Return the store that queries should read from: the dataset itself
+        once it's committed, or a snapshot of the rows frozen so far while
+        it's still being recorded.
+    */
+    std::shared_ptr<TabularDataStore> getReadStore() const;
 };
 
 
@@ -9,11 +9,15 @@
 
 #include <unordered_map>
 #include "frozen_column.h"
+#include "mldb/sql/path_intern_table.h"
 #include <mutex>
 
 namespace Datacratic {
 namespace MLDB {
 
+struct FrozenBlockWriter;
+struct FrozenBlockReader;
+
 
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
@@ -35,6 +39,9 @@ struct TabularDatasetChunk {
         swap(other);
     }
 
+    /// Copying a chunk shares its (immutable) frozen columns and row names
+    TabularDatasetChunk(const TabularDatasetChunk & other) = default;
+
     TabularDatasetChunk & operator = (TabularDatasetChunk && other) noexcept
     {
         swap(other);
@@ -45,14 +52,20 @@ struct TabularDatasetChunk {
     {
         columns.swap(other.columns);
         sparseColumns.swap(other.sparseColumns);
+        zoneMaps.swap(other.zoneMaps);
+        sparseZoneMaps.swap(other.sparseZoneMaps);
+        indexes.swap(other.indexes);
+        columnNameTable.swap(other.columnNameTable);
         rowNames.swap(other.rowNames);
-        integerRowNames.swap(other.integerRowNames);
         std::swap(timestamps, other.timestamps);
     }
 
     size_t rowCount() const
     {
-        return std::max(rowNames.size(), integerRowNames.size());
+        if (!rowNames)
+            return 0;
+        return std::max(rowNames->names.size(),
+                        rowNames->integerNames.size());
     }
 
     size_t memusage() const
@@ -66,16 +79,27 @@ struct TabularDatasetChunk {
         //cerr << columns.size() << " columns took " << result - before << endl;
         before = result;
         
+        // The names of the sparse columns are in columnNameTable, which is
+        // shared with the other chunks, so the dataset counts them once
         for (auto & c: sparseColumns)
-            result += c.first.memusage() + c.second->memusage();
+            result += sizeof(c.first) + c.second->memusage();
 
         //cerr << sparseColumns.size() << " sparse columns took "
         //     << result - before << endl;
         before = result;
 
-        for (auto & r: rowNames)
-            result += r.memusage();
-        result += integerRowNames.capacity() * sizeof(uint64_t);
+        for (auto & z: zoneMaps)
+            result += z.memusage();
+        for (auto & z: sparseZoneMaps)
+            result += sizeof(z.first) + z.second.memusage();
+
+        result += indexMemusage();
+
+        if (rowNames) {
+            for (auto & r: rowNames->names)
+                result += r.memusage();
+            result += rowNames->integerNames.capacity() * sizeof(uint64_t);
+        }
 
         //cerr << rowNames.size() << " row names took "
         //     << result - before << endl;
@@ -97,7 +121,8 @@ struct TabularDatasetChunk {
             return columns[columnIndex].get();
         }
         else {
-            auto it = sparseColumns.find(columnName);
+            auto it = sparseColumns.find
+                (columnNameTable->find(columnName));
             if (it == sparseColumns.end())
                 return nullptr;
             return it->second.get();
@@ -107,19 +132,21 @@ struct TabularDatasetChunk {
     /// Return an owned version of the rowname
     RowName getRowName(size_t index) const
     {
-        if (rowNames.empty()) {
-            return PathElement(integerRowNames.at(index));
+        ExcAssert(rowNames);
+        if (rowNames->names.empty()) {
+            return PathElement(rowNames->integerNames.at(index));
         }
-        else return rowNames.at(index);
+        else return rowNames->names.at(index);
     }
 
     /// Return a reference to the rowName, stored in storage if it's a temp
     const RowName & getRowName(size_t index, RowName & storage) const
     {
-        if (rowNames.empty()) {
-            return storage = PathElement(integerRowNames.at(index));
+        ExcAssert(rowNames);
+        if (rowNames->names.empty()) {
+            return storage = PathElement(rowNames->integerNames.at(index));
         }
-        else return rowNames.at(index);
+        else return rowNames->names.at(index);
     }
 
     const FrozenColumn *
@@ -129,7 +156,8 @@ struct TabularDatasetChunk {
             return columns.at(columnIndex).get();
         }
         else {
-            auto it = sparseColumns.find(columnName);
+            auto it = sparseColumns.find
+                (columnNameTable->find(columnName));
             if (it == sparseColumns.end())
                 return nullptr;
             return it->second.get();
@@ -137,10 +165,73 @@ struct TabularDatasetChunk {
     }
 
     std::vector<std::shared_ptr<FrozenColumn> > columns;
-    std::unordered_map<ColumnName, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
+
+    /// Table of the names of the sparse columns, shared by all of the
+    /// chunks of the dataset
+    std::shared_ptr<PathInternTable> columnNameTable;
+
+    /// Sparse columns, keyed by the id of their name in columnNameTable, so
+    /// that the names aren't copied into every chunk
+    std::unordered_map<uint32_t, std::shared_ptr<FrozenColumn> > sparseColumns;
+
+    /// Zone maps of the dense columns, in the same order as columns
+    std::vector<ColumnZoneMap> zoneMaps;
+
+    /// Zone maps of the sparse columns, with the same keys as sparseColumns
+    std::unordered_map<uint32_t, ColumnZoneMap> sparseZoneMaps;
+
+    /// Return the zone map of the given column, or null if the column isn't
+    /// in this chunk.  Arguments are as for maybeGetColumn().
+    const ColumnZoneMap *
+    maybeGetZoneMap(size_t columnIndex, const Path & columnName) const
+    {
+        if (columnIndex < zoneMaps.size()) {
+            return &zoneMaps[columnIndex];
+        }
+        else {
+            auto it = sparseZoneMaps.find
+                (columnNameTable->find(columnName));
+            if (it == sparseZoneMaps.end())
+                return nullptr;
+            return &it->second;
+        }
+    }
+
+    /// Secondary indexes of the columns that are configured to be
+    /// indexed, keyed by the id of their name in columnNameTable.  Columns
+    /// that couldn't be indexed are absent.
+    std::unordered_map<uint32_t, std::shared_ptr<const FrozenColumnIndex> >
+        indexes;
+
+    /// Return the index of the given column, or null if it has none
+    const FrozenColumnIndex * maybeGetIndex(const Path & columnName) const
+    {
+        if (indexes.empty())
+            return nullptr;
+        auto it = indexes.find(columnNameTable->find(columnName));
+        if (it == indexes.end())
+            return nullptr;
+        return it->second.get();
+    }
+
+    size_t indexMemusage() const
+    {
+        size_t result = 0;
+        for (auto & i: indexes)
+            result += sizeof(i.first) + i.second->memusage();
+        return result;
+    }
+
 private:
-    std::vector<RowName> rowNames;
-    std::vector<uint64_t> integerRowNames;
+    /// Names of the rows, either as integers or as full names.  They're
+    /// immutable once the chunk is frozen, so copies of the chunk share
+    /// them.
+    struct RowNames {
+        std::vector<RowName> names;
+        std::vector<uint64_t> integerNames;
+    };
+
+    std::shared_ptr<const RowNames> rowNames;
 public:
     std::shared_ptr<FrozenColumn> timestamps;
 
@@ -163,7 +254,8 @@ public:
             CellValue val = c.second->get(index);
             if (val.empty())
                 continue;
-            result.emplace_back(c.first, std::move(val), ts);
+            result.emplace_back(columnNameTable->getPath(c.first),
+                                std::move(val), ts);
 
         }
         return result;
@@ -188,7 +280,8 @@ public:
             CellValue val = c.second->get(index);
             if (val.empty())
                 continue;
-            result.emplace_back(c.first, std::move(val), ts);
+            result.emplace_back(columnNameTable->getPath(c.first),
+                                std::move(val), ts);
 
         }
         return std::move(result);
@@ -204,7 +297,8 @@ public:
         if (columnIndex < columns.size())
             col = columns[columnIndex].get();
         else {
-            auto it = sparseColumns.find(colName);
+            auto it = sparseColumns.find
+                (columnNameTable->find(colName));
             if (it == sparseColumns.end()) {
                 if (dense) {
                     for (unsigned i = 0;  i < rowCount();  ++i) {
@@ -228,14 +322,31 @@ public:
         }
     }
 
+    /** Serialize the chunk into a frozen file.  See frozen_serialization.h
+        for the format.
+    */
+    void serialize(ML::DB::Store_Writer & metadata,
+                   FrozenBlockWriter & blocks) const;
+
+    /** Reconstitute a chunk written by serialize().  The columns refer
+        directly to the memory of the blocks, and the names of the sparse
+        columns are interned in columnNameTable.
+    */
+    static TabularDatasetChunk
+    reconstitute(ML::DB::Store_Reader & metadata,
+                 const FrozenBlockReader & blocks,
+                 std::shared_ptr<PathInternTable> columnNameTable);
+
     friend class MutableTabularDatasetChunk;
 };
 
 struct MutableTabularDatasetChunk {
 
-    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize)
+    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize,
+                               std::shared_ptr<PathInternTable> columnNameTable)
         : maxSize(maxSize), rowCount_(0),
           columns(numColumns), isFrozen(false),
+          columnNameTable(std::move(columnNameTable)),
           addFailureNotified(false)
     {
         timestamps.reserve(maxSize);
@@ -254,6 +365,7 @@ struct MutableTabularDatasetChunk {
         ExcAssert(!isFrozen);
 
         TabularDatasetChunk result;
+        result.columnNameTable = columnNameTable;
         result.columns.resize(columns.size());
         result.sparseColumns.reserve(sparseColumns.size());
 
@@ -262,10 +374,20 @@ struct MutableTabularDatasetChunk {
         for (auto & c: sparseColumns)
             result.sparseColumns.emplace(c.first, c.second.freeze());
 
+        result.zoneMaps.reserve(result.columns.size());
+        for (auto & c: result.columns)
+            result.zoneMaps.emplace_back(ColumnZoneMap::build(*c, rowCount_));
+        result.sparseZoneMaps.reserve(result.sparseColumns.size());
+        for (auto & c: result.sparseColumns)
+            result.sparseZoneMaps.emplace
+                (c.first, ColumnZoneMap::build(*c.second, rowCount_));
+
         result.timestamps = timestamps.freeze();
 
-        result.rowNames = std::move(rowNames);
-        result.integerRowNames = std::move(integerRowNames);
+        auto names = std::make_shared<TabularDatasetChunk::RowNames>();
+        names->names = std::move(rowNames);
+        names->integerNames = std::move(integerRowNames);
+        result.rowNames = std::move(names);
 
         isFrozen = true;
 
@@ -291,8 +413,12 @@ struct MutableTabularDatasetChunk {
 
     bool isFrozen;
 
-    /// Set of sparse columns
-    std::unordered_map<ColumnName, TabularDatasetColumn> sparseColumns;
+    /// Table of the names of the sparse columns, shared by all of the
+    /// chunks of the dataset
+    std::shared_ptr<PathInternTable> columnNameTable;
+
+    /// Set of sparse columns, keyed by the id of their name in columnNameTable
+    std::unordered_map<uint32_t, TabularDatasetColumn> sparseColumns;
 
     /// One per row, or empty if all are simple integers
     std::vector<RowName> rowNames;
@@ -318,9 +444,9 @@ struct MutableTabularDatasetChunk {
         - vals: the values of all cells at this row, for dense values
         - numVals: the number of dense values.  Used to verify that the
           right number were passed.
-        - extra: extra columns and their values, for when we accept an open
-          schema.  These will be stored less efficiently and will normally
-          be sparse.  It takes a reference as the operation can fail and we
+        - extra: extra columns, as the id of their name in columnNameTable,
+          and their values, for when we accept an open schema.  These will
+          be stored less efficiently and will normally be sparse.  It takes a reference as the operation can fail and we
           may need to retry.  If it returns false, extra is untouched,
           otherwise it is destroyed.
 
@@ -335,7 +461,7 @@ struct MutableTabularDatasetChunk {
             Date ts,
             CellValue * vals,
             size_t numVals,
-            std::vector<std::pair<ColumnName, CellValue> > & extra)
+            std::vector<std::pair<uint32_t, CellValue> > & extra)
         __attribute__((warn_unused_result))
     {
         std::unique_lock<std::mutex> guard(mutex);
@@ -377,7 +503,8 @@ struct MutableTabularDatasetChunk {
         }
 
         for (auto & e: extra) {
-            auto it = sparseColumns.emplace(std::move(e.first), TabularDatasetColumn()).first;
+            auto it = sparseColumns.emplace(e.first, TabularDatasetColumn())
+                .first;
             it->second.add(numRows, std::move(e.second));
         }
 
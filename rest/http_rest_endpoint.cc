@@ -14,6 +14,7 @@
 #include "http_rest_endpoint.h"
 #include "mldb/utils/log.h"
 #include <iomanip>
+#include <cstdio>
 
 using namespace std;
 
@@ -246,7 +247,16 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Each chunk is preceded by its length in hex; an empty chunk marks
+    // the end of the response
+    char header[32];
+    snprintf(header, sizeof(header), "%zx\r\n", chunk.size());
+    std::string framed;
+    framed.reserve(chunk.size() + 24);
+    framed.append(header);
+    framed.append(chunk);
+    framed.append("\r\n");
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
 }
 
 inline void
@@ -188,6 +188,18 @@ sendPayload(std::string payload)
         http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
     }
     else http->send(std::move(payload));
+
+    // Don't get too far ahead of the client, so that the memory used by a
+    // large response sent in pieces stays bounded.  This is checked for
+    // every payload, however long the client takes.  We may be running on
+    // one of the event loop's threads, but the thread pool starts more
+    // threads when its threads are busy, so the writes still make
+    // progress while we wait.
+    static const size_t MAX_PENDING_BYTES = 4 * 1024 * 1024;
+    while (!http->waitForPendingWrites(MAX_PENDING_BYTES, 1.0)) {
+        if (!http->isConnected())
+            break;
+    }
 }
 
 void
@@ -206,6 +218,20 @@ finishResponse()
     responseSent_ = true;
 }
 
+void
+HttpRestConnection::
+abortResponse(const std::string & error)
+{
+    cerr << "aborted response: " << error << endl;
+
+    // Close without the terminating chunk, so that the transfer is
+    // visibly incomplete
+    keepAlive = false;
+    http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+
+    responseSent_ = true;
+}
+
 std::shared_ptr<RestConnection>
 HttpRestConnection::
 capture(std::function<void ()> onDisconnect)
@@ -106,6 +106,8 @@ struct HttpRestConnection: public RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse();
 
+    virtual void abortResponse(const std::string & error);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -92,6 +92,15 @@ finishResponse()
 {
 }
 
+void InProcessRestConnection::
+abortResponse(const std::string & error)
+{
+    Json::Value details;
+    details["error"] = "Response aborted after it was started: " + error;
+    headers.clear();
+    sendErrorResponse(500, details);
+}
+
 /** Send the given error string back on the connection. */
 void InProcessRestConnection::
 sendErrorResponse(int responseCode,
@@ -54,6 +54,11 @@ struct InProcessRestConnection: public HttpRestConnection {
 
     virtual void finishResponse();
 
+    /** Replaces what has been sent so far with a 500 error, as there is
+        no connection to close.
+    */
+    virtual void abortResponse(const std::string & error);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
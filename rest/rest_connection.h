@@ -84,6 +84,12 @@ struct RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse() = 0;
 
+    /** Abandon a response whose header has already been sent, because of
+        the given error.  The connection is closed without finishing the
+        response, so that the client can tell that it's incomplete.
+    */
+    virtual void abortResponse(const std::string & error) = 0;
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
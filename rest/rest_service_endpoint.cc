@@ -219,6 +219,20 @@ finishResponse()
     itl->responseSent = true;
 }
 
+void
+RestServiceEndpoint::ConnectionId::
+abortResponse(const std::string & error)
+{
+    cerr << "aborted response: " << error << endl;
+
+    // Close without the terminating chunk, so that the transfer is
+    // visibly incomplete
+    itl->keepAlive = false;
+    itl->http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+
+    itl->responseSent = true;
+}
+
 std::shared_ptr<RestConnection>
 RestServiceEndpoint::ConnectionId::
 capture(std::function<void ()> onDisconnect)
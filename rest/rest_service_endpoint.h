@@ -141,6 +141,8 @@ struct RestServiceEndpoint {
         /** Finish the response, recycling or closing the connection. */
         void finishResponse();
 
+        void abortResponse(const std::string & error);
+
         /** Send the given error string back on the connection. */
         void sendErrorResponse(int responseCode,
                                std::string error,
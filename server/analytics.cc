@@ -324,17 +324,33 @@ std::vector<MatrixNamedRow>
 queryFromStatement(SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params)
+{
+    std::vector<MatrixNamedRow> rows;
+
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            rows.emplace_back(std::move(row));
+            return true;
+        };
+
+    queryFromStatementIncremental(onRow, stm, scope, params);
+
+    return rows;
+}
+
+bool
+queryFromStatementIncremental(std::function<bool (MatrixNamedRow & row)> onRow,
+                              SelectStatement & stm,
+                              SqlBindingScope & scope,
+                              BoundParameters params)
 {
     BoundTableExpression table = stm.from->bind(scope);
     
     if (table.dataset) {
-        return table.dataset->queryStructured(stm.select, stm.when,
-                                              *stm.where,
-                                              stm.orderBy, stm.groupBy,
-                                              *stm.having,
-                                              *stm.rowName,
-                                              stm.offset, stm.limit, 
-                                              table.asName);
+        return table.dataset->queryStructuredIncremental
+            (onRow, stm.select, stm.when, *stm.where, stm.orderBy,
+             stm.groupBy, *stm.having, *stm.rowName,
+             stm.offset, stm.limit, table.asName);
     }
     else if (table.table.runQuery && stm.from) {
 
@@ -353,8 +369,6 @@ queryFromStatement(SelectStatement & stm,
 
         auto executor = boundPipeline->start(params);
         
-        std::vector<MatrixNamedRow> rows;
-
         ssize_t limit = stm.limit;
         ssize_t offset = stm.offset;
 
@@ -379,14 +393,19 @@ queryFromStatement(SelectStatement & stm,
                 .coerceToPath(); 
             row.rowHash = row.rowName;
             output->values.back().mergeToRowDestructive(row.columns);
-            rows.emplace_back(std::move(row));
+            if (!onRow(row))
+                return false;
         }
-            
-        return rows;
+        
+        return true;
     }
     else {
         // No from at all
-        return queryWithoutDataset(stm, scope);
+        for (auto & row: queryWithoutDataset(stm, scope)) {
+            if (!onRow(row))
+                return false;
+        }
+        return true;
     }
 }
 
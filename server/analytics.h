@@ -148,6 +148,16 @@ queryFromStatement(SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params = nullptr);
 
+/** Select from the given statement, passing each row of the result to
+    onRow in order as it is produced.  Returns false if onRow returned
+    false to stop the query.
+*/
+bool
+queryFromStatementIncremental(std::function<bool (MatrixNamedRow & row)> onRow,
+                              SelectStatement & stm,
+                              SqlBindingScope & scope,
+                              BoundParameters params = nullptr);
+
 /** Build a RowName from an expression value and throw if
     it is not valid (row, empty, etc)
 */
@@ -17,7 +17,19 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/plugins/frozen_serialization.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/jml/db/persistent.h"
 #include <boost/algorithm/string.hpp>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <sstream>
 
 #include "mldb/jml/utils/profile.h"
 
@@ -36,8 +48,378 @@ namespace MLDB {
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
 
+// Environment variable giving the default memory budget, in bytes, for the
+// groups of a GROUP BY query before they start to be spilled to disk.
+ML::Env_Option<size_t> MLDB_GROUP_BY_MEMORY_BUDGET
+("MLDB_GROUP_BY_MEMORY_BUDGET", 4ULL * 1024 * 1024 * 1024);
+
+// Environment variable giving the default memory budget, in bytes, for the
+// rows of an ORDER BY query before sorted runs start to be spilled to disk.
+ML::Env_Option<size_t> MLDB_ORDER_BY_MEMORY_BUDGET
+("MLDB_ORDER_BY_MEMORY_BUDGET", 4ULL * 1024 * 1024 * 1024);
+
+// Maximum number of sorted runs of an ORDER BY query that are merged at
+// once.  Once this many runs of the same size have been spilled, they are
+// merged into a single bigger run, which keeps the number of open spill
+// files logarithmic in the number of runs.
+const size_t SORT_RUN_FAN_IN = 16;
+
+// Number of rows that are processed together when some of the expressions
+// of a query (such as calls to user functions) can process a batch of rows
+// more efficiently than each row individually.
+const size_t ROWS_PER_BATCH = 256;
+
 __thread int QueryThreadTracker::depth = 0;
 
+namespace {
+
+/** Do any of the given expressions benefit from being executed over a
+    batch of rows at once?
+*/
+bool hasBatchExecution(const BoundSqlExpression & boundSelect,
+                       const std::vector<BoundSqlExpression> & boundCalc)
+{
+    if (boundSelect.execBatch)
+        return true;
+    for (auto & c: boundCalc)
+        if (c.execBatch)
+            return true;
+    return false;
+}
+
+/*****************************************************************************/
+/* SPILL SERIALIZATION                                                       */
+/*****************************************************************************/
+
+/** Spilled rows are written in the binary ML::DB Store format.  Unlike
+    JSON, this keeps the exact type of every value (timestamps, blobs, NaN
+    and embeddings all come back as they went in), so spilled rows compare
+    and aggregate exactly like the in-memory ones.  Embeddings of numbers
+    are written in native byte order, which is fine as the files never
+    leave the process that wrote them.
+*/
+
+enum SpillValueType : unsigned char {
+    SPILL_ATOM,
+    SPILL_STRUCTURED,
+    SPILL_EMBEDDING,
+    SPILL_SUPERPOSITION
+};
+
+/// Width of each element of an embedding that is written as raw bytes,
+/// or zero if its elements are written as CellValues.
+size_t spillStorageWidth(StorageType storage)
+{
+    switch (storage) {
+    case ST_INT8:
+    case ST_UINT8:    return 1;
+    case ST_INT16:
+    case ST_UINT16:   return 2;
+    case ST_FLOAT32:
+    case ST_INT32:
+    case ST_UINT32:   return 4;
+    case ST_FLOAT64:
+    case ST_INT64:
+    case ST_UINT64:   return 8;
+    default:          return 0;
+    }
+}
+
+void serializeSpill(ML::DB::Store_Writer & store, const ExpressionValue & val)
+{
+    Date ts = val.getEffectiveTimestamp();
+
+    if (val.isAtom()) {
+        store << (unsigned char)SPILL_ATOM << ts;
+        serializeCellValue(store, val.getAtom());
+    }
+    else if (val.isEmbedding()) {
+        StorageType storage
+            = val.getSpecializedValueInfo()->getEmbeddingType();
+        DimsVector shape = val.getEmbeddingShape();
+        size_t length = 1;
+
+        store << (unsigned char)SPILL_EMBEDDING << ts << (int)storage
+              << ML::DB::compact_size_t(shape.size());
+        for (auto & s: shape) {
+            store << ML::DB::compact_size_t(s);
+            length *= s;
+        }
+
+        if (size_t width = spillStorageWidth(storage)) {
+            std::string bytes(length * width, '\0');
+            val.convertEmbedding(&bytes[0], length, storage);
+            store << bytes;
+        }
+        else {
+            for (auto & c: val.getEmbeddingCell(length))
+                serializeCellValue(store, c);
+        }
+    }
+    else if (val.isRow()) {
+        store << (unsigned char)SPILL_STRUCTURED << ts
+              << ML::DB::compact_size_t(val.rowLength());
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & columnValue)
+            {
+                store << columnName.getBytes();
+                serializeSpill(store, columnValue);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+    else {
+        std::vector<const ExpressionValue *> values;
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                values.push_back(&v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+
+        store << (unsigned char)SPILL_SUPERPOSITION << ts
+              << ML::DB::compact_size_t(values.size());
+        for (auto * v: values)
+            serializeSpill(store, *v);
+    }
+}
+
+void reconstituteSpill(ML::DB::Store_Reader & store, ExpressionValue & val)
+{
+    unsigned char type;
+    Date ts;
+    store >> type >> ts;
+
+    switch (type) {
+    case SPILL_ATOM:
+        val = ExpressionValue(reconstituteCellValue(store), ts);
+        return;
+
+    case SPILL_EMBEDDING: {
+        int storageInt;
+        store >> storageInt;
+        StorageType storage = (StorageType)storageInt;
+        ML::DB::compact_size_t numDims(store);
+        DimsVector shape;
+        size_t length = 1;
+        for (size_t i = 0;  i < numDims;  ++i) {
+            ML::DB::compact_size_t s(store);
+            shape.push_back(s);
+            length *= s;
+        }
+
+        if (spillStorageWidth(storage)) {
+            std::string bytes;
+            store >> bytes;
+            std::shared_ptr<char> data(new char[bytes.size()],
+                                       [] (char * p) { delete[] p; });
+            std::memcpy(data.get(), bytes.data(), bytes.size());
+            val = ExpressionValue::embedding(ts, std::move(data), storage,
+                                             std::move(shape));
+        }
+        else {
+            std::vector<CellValue> cells;
+            cells.reserve(length);
+            for (size_t i = 0;  i < length;  ++i)
+                cells.emplace_back(reconstituteCellValue(store));
+            val = ExpressionValue(std::move(cells), ts, std::move(shape));
+        }
+        return;
+    }
+
+    case SPILL_STRUCTURED: {
+        ML::DB::compact_size_t numColumns(store);
+        StructValue columns;
+        columns.reserve(numColumns);
+        for (size_t i = 0;  i < numColumns;  ++i) {
+            std::string bytes;
+            store >> bytes;
+            ExpressionValue columnValue;
+            reconstituteSpill(store, columnValue);
+            columns.emplace_back(PathElement(bytes.data(), bytes.length()),
+                                 std::move(columnValue));
+        }
+        val = ExpressionValue(std::move(columns));
+        val.setEffectiveTimestamp(ts);
+        return;
+    }
+
+    case SPILL_SUPERPOSITION: {
+        ML::DB::compact_size_t numValues(store);
+        std::vector<ExpressionValue> values(numValues);
+        for (auto & v: values)
+            reconstituteSpill(store, v);
+        val = ExpressionValue::superpose(std::move(values));
+        val.setEffectiveTimestamp(ts);
+        return;
+    }
+    }
+
+    throw HttpReturnException(500, "Unknown value type in spill file",
+                              "type", (int)type);
+}
+
+void serializeSpill(ML::DB::Store_Writer & store,
+                    const std::vector<ExpressionValue> & vals)
+{
+    store << ML::DB::compact_size_t(vals.size());
+    for (auto & v: vals)
+        serializeSpill(store, v);
+}
+
+void reconstituteSpill(ML::DB::Store_Reader & store,
+                       std::vector<ExpressionValue> & vals)
+{
+    ML::DB::compact_size_t size(store);
+    vals.resize(size);
+    for (auto & v: vals)
+        reconstituteSpill(store, v);
+}
+
+void serializeSpill(ML::DB::Store_Writer & store, const NamedRowValue & row)
+{
+    serializePath(store, row.rowName);
+    store << (uint64_t)row.rowHash
+          << ML::DB::compact_size_t(row.columns.size());
+    for (auto & c: row.columns) {
+        store << std::get<0>(c).getBytes();
+        serializeSpill(store, std::get<1>(c));
+    }
+}
+
+void reconstituteSpill(ML::DB::Store_Reader & store, NamedRowValue & row)
+{
+    row.rowName = reconstitutePath(store);
+    uint64_t rowHash;
+    store >> rowHash;
+    row.rowHash = RowHash(rowHash);
+    ML::DB::compact_size_t numColumns(store);
+    row.columns.clear();
+    row.columns.reserve(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        std::string bytes;
+        store >> bytes;
+        ExpressionValue columnValue;
+        reconstituteSpill(store, columnValue);
+        row.columns.emplace_back(PathElement(bytes.data(), bytes.length()),
+                                 std::move(columnValue));
+    }
+}
+
+template<typename A, typename B, typename C>
+void serializeSpill(ML::DB::Store_Writer & store,
+                    const std::tuple<A, B, C> & row)
+{
+    serializeSpill(store, std::get<0>(row));
+    serializeSpill(store, std::get<1>(row));
+    serializeSpill(store, std::get<2>(row));
+}
+
+template<typename A, typename B, typename C>
+void reconstituteSpill(ML::DB::Store_Reader & store,
+                       std::tuple<A, B, C> & row)
+{
+    reconstituteSpill(store, std::get<0>(row));
+    reconstituteSpill(store, std::get<1>(row));
+    reconstituteSpill(store, std::get<2>(row));
+}
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+/** Temporary file used to spill rows of a query that don't fit within its
+    memory budget to disk.  Each row is stored as its length followed by
+    its binary serialization (see serializeSpill() above).  The file is
+    removed when it's closed.
+*/
+template<typename Row>
+struct SpillFile {
+    SpillFile(const std::string & operation)
+        : file(std::tmpfile()), operation(operation), numRows(0), rowsRead(0)
+    {
+        if (!file)
+            throw HttpReturnException(500, "Couldn't create temporary file "
+                                      "to spill " + operation + " to disk",
+                                      "error", string(strerror(errno)));
+    }
+
+    ~SpillFile()
+    {
+        std::fclose(file);
+    }
+
+    /** Append a row.  May be called from multiple threads at once. */
+    void write(const Row & row)
+    {
+        std::ostringstream stream;
+        {
+            ML::DB::Store_Writer store(stream);
+            serializeSpill(store, row);
+        }
+        std::string encoded = stream.str();
+        uint64_t length = encoded.size();
+
+        std::unique_lock<std::mutex> guard(mutex);
+        if (std::fwrite(&length, sizeof(length), 1, file) != 1
+            || std::fwrite(encoded.data(), 1, length, file) != length)
+            throw HttpReturnException(500, "Error writing " + operation
+                                      + " spill file",
+                                      "error", string(strerror(errno)));
+        ++numRows;
+    }
+
+    /** Go back to the start of the file, so that read() returns the rows
+        in the order they were written.
+    */
+    void rewind()
+    {
+        std::rewind(file);
+        rowsRead = 0;
+    }
+
+    /** Read the next row into row, returning false once all rows have
+        been read.
+    */
+    bool read(Row & row)
+    {
+        if (rowsRead == numRows)
+            return false;
+
+        uint64_t length;
+        if (std::fread(&length, sizeof(length), 1, file) != 1)
+            throw HttpReturnException(500, "Error reading " + operation
+                                      + " spill file");
+        buffer.resize(length);
+        if (std::fread(&buffer[0], 1, length, file) != length)
+            throw HttpReturnException(500, "Error reading " + operation
+                                      + " spill file");
+        ML::DB::Store_Reader store(buffer.data(), buffer.size());
+        reconstituteSpill(store, row);
+        ++rowsRead;
+        return true;
+    }
+
+    /** Read each of the rows back, in the order they were written. */
+    void forEachRow(const std::function<void (const Row &)> & onRow)
+    {
+        rewind();
+        Row row;
+        while (read(row))
+            onRow(row);
+    }
+
+    std::FILE * file;
+    std::string operation;
+    std::mutex mutex;
+    size_t numRows;
+    size_t rowsRead;
+    std::string buffer;
+};
+
+} // file scope
+
 
 /*****************************************************************************/
 /* BOUND SELECT QUERY                                                        */
@@ -64,6 +446,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
     BoundSqlExpression boundSelect;
     std::vector<BoundSqlExpression> boundCalc;
     int numBuckets;
+    bool batched;  ///< Process rows in batches with processRows()
     typedef std::function<bool (NamedRowValue & output,
                                              std::vector<ExpressionValue> & calcd,
                                              int rowNum)> ExecutorAggregator;
@@ -82,7 +465,8 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
           whenBound(std::move(whenBound)),
           boundSelect(std::move(boundSelect)),
           boundCalc(std::move(boundCalc)),
-          numBuckets(numBuckets)
+          numBuckets(numBuckets),
+          batched(hasBatchExecution(this->boundSelect, this->boundCalc))
     {
     }
 
@@ -149,6 +533,26 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 return processor(std::get<0>(output), std::get<1>(output), bucketNumber);
             };
 
+        // Same as doRow, but for a batch of rows at once
+        auto doRows = [&] (size_t begin, size_t end) -> bool
+            {
+                std::vector<MatrixNamedRow> batchRows;
+                batchRows.reserve(end - begin);
+                for (size_t i = begin;  i < end;  ++i)
+                    batchRows.emplace_back(matrix->getRow(rows[i]));
+
+                auto outputs = processRows(batchRows, selectStar);
+
+                for (size_t i = begin;  i < end;  ++i) {
+                    int bucketNumber = numBuckets > 0 ? std::min((size_t)(i/numPerBucket), (size_t)(numBuckets-1)) : -1;
+                    auto & output = outputs[i - begin];
+                    if (!processor(std::get<0>(output), std::get<1>(output),
+                                   bucketNumber))
+                        return false;
+                }
+                return true;
+            };
+
         if (numBuckets > 0) {
             ExcAssert(processInParallel);
             ExcAssertEqual(limit, -1);
@@ -158,10 +562,18 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 {
                     size_t it = bucketNumber * numPerBucket;
                     int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
-                    for (; it < stopIt; ++it)
-                    {
-                        if (!doRow(it))
-                            return false;
+                    if (batched) {
+                        for (; it < stopIt; it += ROWS_PER_BATCH) {
+                            if (!doRows(it, std::min<size_t>(stopIt, it + ROWS_PER_BATCH)))
+                                return false;
+                        }
+                    }
+                    else {
+                        for (; it < stopIt; ++it)
+                        {
+                            if (!doRow(it))
+                                return false;
+                        }
                     }
 
                     if (onProgress) {
@@ -181,7 +593,9 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
 
             if (offset <= upper) {
                 if (processInParallel) {
-                    parallelMap(offset, upper, doRow);
+                    if (batched)
+                        parallelMapChunked(offset, upper, ROWS_PER_BATCH, doRows);
+                    else parallelMap(offset, upper, doRow);
                 }
                 else {
                     // TODO: to reduce memory usage, we should fill blocks of
@@ -201,7 +615,21 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                         output[rowNum-offset] = std::move(outputRow);
                     };
 
-                    parallelMap(offset, upper, copyRow);
+                    auto copyRows = [&] (size_t begin, size_t end)
+                    {
+                        std::vector<MatrixNamedRow> batchRows;
+                        batchRows.reserve(end - begin);
+                        for (size_t i = begin;  i < end;  ++i)
+                            batchRows.emplace_back(matrix->getRow(rows[i]));
+
+                        auto outputRows = processRows(batchRows, selectStar);
+                        std::move(outputRows.begin(), outputRows.end(),
+                                  output.begin() + (begin - offset));
+                    };
+
+                    if (batched)
+                        parallelMapChunked(offset, upper, ROWS_PER_BATCH, copyRows);
+                    else parallelMap(offset, upper, copyRow);
 
                     for (size_t i = offset; i < upper; ++i) {
                         auto& outputRow = output[i-offset];
@@ -321,6 +749,60 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         return output;
     }
 
+    /** Same as processRow, but for a batch of rows, so that expressions
+        that are more efficient over a batch get to process them together.
+    */
+    std::vector<std::tuple<NamedRowValue, std::vector<ExpressionValue> > >
+    processRows(std::vector<MatrixNamedRow> & rows,
+                bool selectStar)
+    {
+        size_t n = rows.size();
+
+        std::vector<SqlExpressionDatasetScope::RowScope> rowScopes;
+        rowScopes.reserve(n);
+        std::vector<const SqlRowScope *> scopes;
+        scopes.reserve(n);
+
+        for (auto & row: rows) {
+            rowScopes.emplace_back(context.getRowScope(row));
+            whenBound.filterInPlace(row, rowScopes.back());
+            scopes.push_back(&rowScopes.back());
+        }
+
+        std::vector<std::tuple<NamedRowValue, std::vector<ExpressionValue> > >
+            output(n);
+        for (auto & o: output)
+            std::get<1>(o).resize(boundCalc.size());
+
+        // Run the extra calculations
+        for (unsigned i = 0;  i < boundCalc.size();  ++i) {
+            std::vector<ExpressionValue> vals
+                = boundCalc[i].applyBatch(scopes, GET_LATEST);
+            for (size_t j = 0;  j < n;  ++j)
+                std::get<1>(output[j])[i] = std::move(vals[j]);
+        }
+
+        std::vector<ExpressionValue> selectOutputs;
+        if (!selectStar)
+            selectOutputs = boundSelect.applyBatch(scopes, GET_ALL);
+
+        for (size_t j = 0;  j < n;  ++j) {
+            NamedRowValue & outputRow = std::get<0>(output[j]);
+            outputRow.rowName = rows[j].rowName;
+            outputRow.rowHash = rows[j].rowName;
+
+            if (selectStar) {
+                ExpressionValue structured(std::move(rows[j].columns));
+                structured.mergeToRowDestructive(outputRow.columns);
+            }
+            else {
+                selectOutputs[j].mergeToRowDestructive(outputRow.columns);
+            }
+        }
+
+        return output;
+    }
+
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const
     {
         return boundSelect.info;
@@ -336,6 +818,7 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
     BoundSqlExpression boundSelect;
     std::vector<BoundSqlExpression> boundCalc;
     OrderByExpression newOrderBy;
+    size_t memoryBudget;
 
     OrderedExecutor(std::shared_ptr<MatrixView> matrix,
                     GenerateRowsWhereFunction whereGenerator,
@@ -343,17 +826,65 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                     BoundWhenExpression whenBound,
                     BoundSqlExpression boundSelect,
                     std::vector<BoundSqlExpression> boundCalc,
-                    OrderByExpression newOrderBy)
+                    OrderByExpression newOrderBy,
+                    size_t memoryBudget)
         : matrix(std::move(matrix)),
           whereGenerator(std::move(whereGenerator)),
           context(context),
           whenBound(std::move(whenBound)),
           boundSelect(std::move(boundSelect)),
           boundCalc(std::move(boundCalc)),
-          newOrderBy(std::move(newOrderBy))
+          newOrderBy(std::move(newOrderBy)),
+          memoryBudget(memoryBudget)
     {
     }
 
+    typedef std::tuple<std::vector<ExpressionValue>, NamedRowValue, std::vector<ExpressionValue> > SortedRow;
+    typedef std::vector<SortedRow> SortedRows;
+
+    /// Rows accumulated by one thread, with an estimate of their memory
+    struct ThreadRows {
+        ThreadRows()
+            : memory(0)
+        {
+        }
+
+        SortedRows rows;
+        size_t memory;
+    };
+
+    /// Sorted run of rows that has been spilled to disk
+    typedef SpillFile<SortedRow> SortRunFile;
+
+    /** Rough estimate of the memory used by a value, used to decide when
+        the rows need to be spilled to disk.
+    */
+    static size_t estimateMemory(const ExpressionValue & val)
+    {
+        size_t result = sizeof(ExpressionValue);
+        if (val.isAtom()) {
+            if (val.getAtom().isString())
+                result += val.getAtom().toStringLength();
+        }
+        else {
+            result += val.rowLength()
+                * (sizeof(PathElement) + sizeof(ExpressionValue));
+        }
+        return result;
+    }
+
+    static size_t estimateMemory(const SortedRow & row)
+    {
+        size_t result = sizeof(SortedRow);
+        for (auto & v: std::get<0>(row))
+            result += estimateMemory(v);
+        for (auto & c: std::get<1>(row).columns)
+            result += sizeof(PathElement) + estimateMemory(std::get<1>(c));
+        for (auto & v: std::get<2>(row))
+            result += estimateMemory(v);
+        return result;
+    }
+
     virtual void execute(std::function<bool (NamedRowValue & output,
                                              std::vector<ExpressionValue> & calcd, 
                                              int rowNum)> processor,
@@ -384,13 +915,96 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
    
         // For each one, generate the order by key
 
-        typedef std::tuple<std::vector<ExpressionValue>, NamedRowValue, std::vector<ExpressionValue> > SortedRow;
-        typedef std::vector<SortedRow> SortedRows;
-        
-        PerThreadAccumulator<SortedRows> accum;
+        PerThreadAccumulator<ThreadRows> accum;
 
         std::atomic<int64_t> rowsAdded(0);
 
+        ExcAssertGreaterEqual(offset, 0);
+
+        // Compare two rows according to the sort criteria
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
+            {
+                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+            };
+
+        // Once the rows in memory go over the budget, the threads holding
+        // at least their share of the budget sort the rows they have
+        // accumulated and spill them to disk as a sorted run.  Runs are
+        // kept by level: once SORT_RUN_FAN_IN runs of a level have been
+        // written, they are merged into one run of the next level.  The
+        // runs that are left are merged at the end.
+        std::atomic<size_t> memoryUsed(0);
+        size_t minRunMemory
+            = std::max<size_t>(memoryBudget / std::max(numCpus(), 1), 1);
+        std::vector<std::vector<std::shared_ptr<SortRunFile> > > runLevels;
+        std::mutex runsMutex;
+
+        // With a limit, rows after the first offset + limit of a run can
+        // never be output
+        size_t maxRunRows = limit == -1
+            ? std::numeric_limits<size_t>::max() : offset + limit;
+
+        auto addRun = [&] (std::shared_ptr<SortRunFile> run)
+            {
+                size_t level = 0;
+                for (;;) {
+                    std::vector<std::shared_ptr<SortRunFile> > toMerge;
+                    {
+                        std::unique_lock<std::mutex> guard(runsMutex);
+                        if (runLevels.size() <= level)
+                            runLevels.resize(level + 1);
+                        runLevels[level].emplace_back(std::move(run));
+                        if (runLevels[level].size() < SORT_RUN_FAN_IN)
+                            return;
+                        toMerge.swap(runLevels[level]);
+                    }
+
+                    // Merge them outside of the lock, into the next level
+                    run = std::make_shared<SortRunFile>("ORDER BY");
+                    std::vector<RunReader> readers;
+                    for (auto & r: toMerge)
+                        readers.emplace_back(fileRunReader(r));
+                    size_t numWritten = 0;
+                    mergeReaders(readers, compareRows,
+                                 [&] (SortedRow & row)
+                                 {
+                                     run->write(row);
+                                     return ++numWritten < maxRunRows;
+                                 });
+                    ++level;
+                }
+            };
+
+        auto spillRun = [&] (ThreadRows & threadRows)
+            {
+                std::sort(threadRows.rows.begin(), threadRows.rows.end(),
+                          compareRows);
+
+                size_t numToWrite
+                    = std::min(threadRows.rows.size(), maxRunRows);
+
+                auto run = std::make_shared<SortRunFile>("ORDER BY");
+                for (size_t i = 0;  i < numToWrite;  ++i)
+                    run->write(threadRows.rows[i]);
+
+                memoryUsed -= threadRows.memory;
+                SortedRows().swap(threadRows.rows);
+                threadRows.memory = 0;
+
+                addRun(std::move(run));
+            };
+
+        // Account for the memory of rows added by this thread, spilling
+        // them if the budget is exceeded
+        auto addMemory = [&] (ThreadRows & threadRows, size_t memory)
+            {
+                threadRows.memory += memory;
+                if (memoryUsed.fetch_add(memory) + memory > memoryBudget
+                    && threadRows.memory >= minRunMemory)
+                    spillRun(threadRows);
+            };
+
         auto doWhere = [&] (int rowNum) -> bool
             {
                 QueryThreadTracker childTracker = parentTracker.child();
@@ -403,8 +1017,6 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                     onProgress(progress);
                 }
 
-                // Check it matches the where expression.  If not, we don't process
-                // it.
                 auto rowContext = context.getRowScope(row);
 
                 //where already checked in whereGenerator
@@ -414,17 +1026,15 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                 NamedRowValue outputRow;
                 outputRow.rowName = row.rowName;
                 outputRow.rowHash = row.rowName;
-            
-                auto selectRowScope = context.getRowScope(row);
-             
+
                 // Run the bound select expressions
                 ExpressionValue selectOutput
-                = boundSelect(selectRowScope, GET_ALL);
+                    = boundSelect(rowContext, GET_ALL);
                 selectOutput.mergeToRowDestructive(outputRow.columns);
 
                 vector<ExpressionValue> calcd(boundCalc.size());
                 for (unsigned i = 0;  i < boundCalc.size();  ++i) {
-                    calcd[i] = std::move(boundCalc[i](selectRowScope, GET_LATEST));
+                    calcd[i] = std::move(boundCalc[i](rowContext, GET_LATEST));
                 }
 
                 // Get the order by context, which can read from both the result
@@ -435,30 +1045,117 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                 std::vector<ExpressionValue> sortFields
                     = boundOrderBy.apply(orderByRowScope);
 
-                SortedRows * sortedRows = &accum.get();
-                sortedRows->emplace_back(std::move(sortFields),
-                                         std::move(outputRow),
-                                         std::move(calcd));
+                ThreadRows & threadRows = accum.get();
+                threadRows.rows.emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd));
+                addMemory(threadRows, estimateMemory(threadRows.rows.back()));
 
                 ++rowsAdded;
                 return true;
             };
 
+        // Version that processes a batch of rows at once, used when some
+        // of the expressions can process a batch more efficiently
+        auto doWhereBatch = [&] (size_t begin, size_t end)
+            {
+                QueryThreadTracker childTracker = parentTracker.child();
+
+                size_t n = end - begin;
+
+                std::vector<MatrixNamedRow> batchRows;
+                batchRows.reserve(n);
+                for (size_t i = begin;  i < end;  ++i)
+                    batchRows.emplace_back(matrix->getRow(rows[i]));
+
+                std::vector<SqlExpressionDatasetScope::RowScope> rowScopes;
+                rowScopes.reserve(n);
+                std::vector<const SqlRowScope *> scopes;
+                scopes.reserve(n);
+
+                for (auto & row: batchRows) {
+                    rowScopes.emplace_back(context.getRowScope(row));
+
+                    //where already checked in whereGenerator
+
+                    whenBound.filterInPlace(row, rowScopes.back());
+                    scopes.push_back(&rowScopes.back());
+                }
+
+                // Run the bound select expressions
+                std::vector<ExpressionValue> selectOutputs
+                    = boundSelect.applyBatch(scopes, GET_ALL);
+
+                std::vector<std::vector<ExpressionValue> > calcOutputs;
+                calcOutputs.reserve(boundCalc.size());
+                for (auto & c: boundCalc)
+                    calcOutputs.emplace_back(c.applyBatch(scopes, GET_LATEST));
+
+                ThreadRows & threadRows = accum.get();
+                SortedRows * sortedRows = &threadRows.rows;
+                size_t batchMemory = 0;
+
+                for (size_t i = 0;  i < n;  ++i) {
+                    if (onProgress && rowsAdded % 1000 == 0) {
+                        Json::Value progress;
+                        progress["percent"] = (float) rowsAdded / rows.size();
+                        onProgress(progress);
+                    }
+
+                    NamedRowValue outputRow;
+                    outputRow.rowName = batchRows[i].rowName;
+                    outputRow.rowHash = batchRows[i].rowName;
+
+                    selectOutputs[i].mergeToRowDestructive(outputRow.columns);
+
+                    vector<ExpressionValue> calcd(boundCalc.size());
+                    for (unsigned j = 0;  j < boundCalc.size();  ++j)
+                        calcd[j] = std::move(calcOutputs[j][i]);
+
+                    // Get the order by context, which can read from both the
+                    // result of the select and the underlying row.
+                    auto orderByRowScope
+                        = orderByContext.getRowScope(rowScopes[i], outputRow);
+
+                    std::vector<ExpressionValue> sortFields
+                        = boundOrderBy.apply(orderByRowScope);
+
+                    sortedRows->emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd));
+                    batchMemory += estimateMemory(sortedRows->back());
+
+                    ++rowsAdded;
+                }
+
+                addMemory(threadRows, batchMemory);
+            };
+
         ML::Timer timer;
 
-        parallelMap(0, rows.size(), doWhere);
+        if (hasBatchExecution(boundSelect, boundCalc))
+            parallelMapChunked(0, rows.size(), ROWS_PER_BATCH, doWhereBatch);
+        else parallelMap(0, rows.size(), doWhere);
 
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
+
+        std::vector<std::shared_ptr<SortRunFile> > runs;
+        for (auto & level: runLevels)
+            runs.insert(runs.end(), level.begin(), level.end());
+
+        if (!runs.empty()) {
+            mergeRuns(accum, runs, compareRows, processor, offset, limit);
+            cerr << "merge of " << runs.size() << " spilled runs took "
+                 << timer.elapsed() << endl;
+            return;
+        }
         
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
-            {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
-            };
-            
-        auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
+        std::vector<std::shared_ptr<SortedRows> > threadRows;
+        for (auto & t: accum.threads)
+            threadRows.emplace_back(t, &t->rows);
+
+        auto rowsSorted = parallelMergeSort(threadRows, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
         timer.restart();
@@ -476,18 +1173,128 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         if (limit == -1)
             limit = rowsSorted.size();
 
-        ExcAssertGreaterEqual(offset, 0);
-
         ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
         ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
 
         for (unsigned i = begin;  i < end;  ++i) {
-            doSelect(i);
+            if (!doSelect(i))
+                break;
         }
 
         cerr << "reduce took " << timer.elapsed() << endl;
     }
 
+    /** Source of sorted rows for the merge, either from memory or from a
+        spilled run.  Calling it moves the next row into its argument and
+        returns true, or returns false once there are no more rows.
+    */
+    typedef std::function<bool (SortedRow &)> RunReader;
+
+    /// Reader for rows that are sorted in memory
+    struct MemoryRunReader {
+        std::shared_ptr<ThreadRows> rows;
+        size_t pos;
+
+        bool operator () (SortedRow & row)
+        {
+            if (pos == rows->rows.size())
+                return false;
+            row = std::move(rows->rows[pos++]);
+            return true;
+        }
+    };
+
+    /// Reader for a sorted run that was spilled to disk
+    static RunReader fileRunReader(std::shared_ptr<SortRunFile> run)
+    {
+        run->rewind();
+        return [=] (SortedRow & row) { return run->read(row); };
+    }
+
+    /** Merge the rows from the given sorted readers, passing them to onRow
+        in order until it returns false.  Only one row per reader is held
+        in memory at once.
+    */
+    template<typename Compare, typename OnRow>
+    static void mergeReaders(std::vector<RunReader> & readers,
+                             const Compare & compareRows,
+                             const OnRow & onRow)
+    {
+        // Heap of the readers, ordered by their current row, with the
+        // smallest at the top
+        std::vector<SortedRow> current(readers.size());
+        std::vector<size_t> heap;
+        for (size_t i = 0;  i < readers.size();  ++i) {
+            if (readers[i](current[i]))
+                heap.push_back(i);
+        }
+
+        auto heapCompare = [&] (size_t i1, size_t i2) -> bool
+            {
+                return compareRows(current[i2], current[i1]);
+            };
+
+        std::make_heap(heap.begin(), heap.end(), heapCompare);
+
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), heapCompare);
+            size_t reader = heap.back();
+            SortedRow & row = current[reader];
+
+            if (!onRow(row))
+                break;
+
+            if (readers[reader](row))
+                std::push_heap(heap.begin(), heap.end(), heapCompare);
+            else heap.pop_back();
+        }
+    }
+
+    /** Merge the rows still in memory with the sorted runs that were spilled
+        to disk, streaming those between offset and offset + limit to the
+        processor.  The merge stops as soon as the limit is reached.
+    */
+    template<typename Compare, typename Processor>
+    void mergeRuns(PerThreadAccumulator<ThreadRows> & accum,
+                   std::vector<std::shared_ptr<SortRunFile> > & runs,
+                   const Compare & compareRows,
+                   const Processor & processor,
+                   ssize_t offset,
+                   ssize_t limit)
+    {
+        // Sort what each thread has left in memory, in parallel
+        auto & threads = accum.threads;
+        auto sortThread = [&] (size_t i)
+            {
+                std::sort(threads[i]->rows.begin(), threads[i]->rows.end(),
+                          compareRows);
+            };
+        parallelMap(0, threads.size(), sortThread);
+
+        std::vector<RunReader> readers;
+        for (auto & t: threads)
+            readers.emplace_back(MemoryRunReader{t, 0});
+        for (auto & r: runs)
+            readers.emplace_back(fileRunReader(r));
+
+        ssize_t end = limit == -1
+            ? std::numeric_limits<ssize_t>::max() : offset + limit;
+
+        ssize_t rowNum = 0;
+        mergeReaders(readers, compareRows,
+                     [&] (SortedRow & row) -> bool
+                     {
+                         if (rowNum >= end)
+                             return false;
+                         if (rowNum >= offset
+                             && !processor(std::get<1>(row),
+                                           std::get<2>(row), rowNum))
+                             return false;
+                         ++rowNum;
+                         return true;
+                     });
+    }
+
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const
     {
         return boundSelect.info;
@@ -943,6 +1750,13 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
     }
 };
 
+size_t
+BoundSelectQuery::
+defaultSortMemoryBudget()
+{
+    return MLDB_ORDER_BY_MEMORY_BUDGET;
+}
+
 BoundSelectQuery::
 BoundSelectQuery(const SelectExpression & select,
                  const Dataset & from,
@@ -951,9 +1765,11 @@ BoundSelectQuery(const SelectExpression & select,
                  const SqlExpression & where,
                  const OrderByExpression & orderBy,
                  std::vector<std::shared_ptr<SqlExpression> > calc,
-                 int  numBuckets)
+                 int  numBuckets,
+                 size_t sortMemoryBudget)
     : select(select), from(from), when(when), where(where), calc(calc),
-      orderBy(orderBy), context(new SqlExpressionDatasetScope(from, std::move(alias)))
+      orderBy(orderBy), context(new SqlExpressionDatasetScope(from, std::move(alias))),
+      sortMemoryBudget(sortMemoryBudget)
 {
     try {
         SqlExpressionWhenScope whenScope(*context);
@@ -1018,7 +1834,8 @@ BoundSelectQuery(const SelectExpression & select,
                                                std::move(whenBound),
                                                std::move(boundSelect),
                                                std::move(boundCalc),
-                                               std::move(newOrderBy)));
+                                               std::move(newOrderBy),
+                                               sortMemoryBudget));
         } else {
             executor.reset(new UnorderedExecutor(std::move(matrix),
                                                  std::move(whereGenerator),
@@ -1123,13 +1940,19 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     struct RowScope: public SqlRowScope {
         RowScope(NamedRowValue & output,
-                   const std::vector<ExpressionValue> & currentGroupKey)
-            : output(output), currentGroupKey(currentGroupKey)
+                 const std::vector<ExpressionValue> & currentGroupKey,
+                 const GroupMapValue & aggData)
+            : output(output), currentGroupKey(currentGroupKey),
+              aggData(aggData)
         {
         }
 
         NamedRowValue & output;
         const std::vector<ExpressionValue> & currentGroupKey;
+
+        /// Aggregator state for the current group.  This lives in the
+        /// scope so that several groups can be output in parallel.
+        const GroupMapValue & aggData;
     };
 
     virtual BoundFunction doGetFunction(const Utf8String & tableName,
@@ -1221,8 +2044,9 @@ struct GroupContext: public SqlExpressionDatasetScope {
             return {[&,aggIndex] (const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & context)
                     {
+                        auto & row = context.as<RowScope>();
                         return outputAgg[aggIndex]
-                            .aggregate.extract(aggData[aggIndex].get());
+                            .aggregate.extract(row.aggData[aggIndex].get());
                     },
                     // TODO: get it from the value info for the group keys...
                     std::make_shared<AnyValueInfo>()};
@@ -1312,9 +2136,10 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     RowScope
     getRowScope(NamedRowValue & output,
-                  const std::vector<ExpressionValue> & currentGroupKey) const
+                const std::vector<ExpressionValue> & currentGroupKey,
+                const GroupMapValue & aggData) const
     {
-        return RowScope(output, currentGroupKey);
+        return RowScope(output, currentGroupKey, aggData);
     }
 
     // Represents a clause that is output by the program TODO: Rename this
@@ -1363,17 +2188,200 @@ struct GroupContext: public SqlExpressionDatasetScope {
              
 
     std::vector<OutputAggregator> outputAgg;    
-    std::vector<std::shared_ptr<void> > aggData;  //working buffers for the above
     int argCounter;
     int argOffset;
     bool evaluateEmptyGroups;
 };
 
 
+/*****************************************************************************/
+/* GROUP HASH TABLE                                                          */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::vector<ExpressionValue> RowKey;
+
+/// Number of bits of the group key hash used to partition the groups.  Each
+/// partition is merged, spilled and replayed independently of the others.
+static constexpr int GROUP_PARTITION_BITS = 6;
+static constexpr size_t NUM_GROUP_PARTITIONS = 1 << GROUP_PARTITION_BITS;
+
+/// Number of groups output by each task when evaluating HAVING, the select
+/// and the ORDER BY clauses in parallel.
+static constexpr size_t GROUPS_PER_OUTPUT_TASK = 256;
+
+/// Range of the number of groups evaluated at once for a partition when
+/// its output rows are produced.
+static constexpr size_t MIN_GROUPS_PER_OUTPUT_BLOCK = GROUPS_PER_OUTPUT_TASK;
+static constexpr size_t MAX_GROUPS_PER_OUTPUT_BLOCK = 16 * GROUPS_PER_OUTPUT_TASK;
+
+/// Estimate of the memory used by the state of a single aggregator, which
+/// is opaque to us.
+static constexpr size_t AGGREGATOR_MEMORY_ESTIMATE = 64;
+
+inline uint64_t mixHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/** Hash one element of a group key.  Any two values that compare equal
+    must have the same hash, so timestamps are ignored and the columns of
+    a row are combined in an order-independent manner.
+*/
+uint64_t hashKeyElement(const ExpressionValue & val)
+{
+    if (val.isAtom()) {
+        const CellValue & cell = val.getAtom();
+        if (cell.isInteger())
+            return mixHash(cell.isInt64() ? cell.toInt() : cell.toUInt());
+        return cell.hash().hash();
+    }
+
+    uint64_t result = 0;
+    auto onAtom = [&] (const Path & columnName,
+                       const Path & prefix,
+                       const CellValue & val,
+                       Date ts)
+        {
+            result += mixHash(columnName.hash() * 31 + prefix.hash()
+                              + val.hash().hash());
+            return true;
+        };
+    val.forEachAtom(onAtom);
+    return result;
+}
+
+template<typename It>
+uint64_t hashKey(It first, It last)
+{
+    uint64_t result = 0x9e3779b97f4a7c15ULL;
+    for (; first != last;  ++first)
+        result = mixHash(result ^ hashKeyElement(*first));
+    return result;
+}
+
+/** Keys are equivalent under the same rules as std::map used to group
+    them, which is different from operator == for values like NaN.
+*/
+inline bool keyElementsEquivalent(const ExpressionValue & val1,
+                                  const ExpressionValue & val2)
+{
+    return val1 == val2 || (!(val1 < val2) && !(val2 < val1));
+}
+
+/** Open addressing hash table (with linear probing) holding the partial
+    aggregates of a set of groups, keyed on the group key and its
+    precomputed hash.  The groups are stored contiguously in insertion
+    order, and the slots contain only their index.
+*/
+struct GroupHashTable {
+    struct Group {
+        uint64_t hash;
+        RowKey key;
+        GroupMapValue aggs;
+    };
+
+    std::vector<Group> groups;
+    std::vector<uint32_t> slots;   ///< Index + 1 into groups; 0 is empty
+
+    /** Return the index of the group with the given key, or -1 if it
+        isn't present.
+    */
+    template<typename It>
+    ssize_t find(uint64_t hash, It keyBegin, It keyEnd) const
+    {
+        if (slots.empty())
+            return -1;
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;  ;  i = (i + 1) & mask) {
+            uint32_t slot = slots[i];
+            if (slot == 0)
+                return -1;
+            const Group & group = groups[slot - 1];
+            if (group.hash == hash
+                && std::equal(keyBegin, keyEnd, group.key.begin(),
+                              keyElementsEquivalent))
+                return slot - 1;
+        }
+    }
+
+    /** Add a group, which must not already be present, and return its
+        index.
+    */
+    size_t insert(uint64_t hash, RowKey key, GroupMapValue aggs)
+    {
+        if ((groups.size() + 1) * 4 > slots.size() * 3)
+            rehash(std::max<size_t>(16, slots.size() * 2));
+        groups.push_back({ hash, std::move(key), std::move(aggs) });
+        place(hash, groups.size());
+        return groups.size() - 1;
+    }
+
+private:
+    void place(uint64_t hash, uint32_t slotValue)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = slotValue;
+    }
+
+    void rehash(size_t numSlots)
+    {
+        slots.clear();
+        slots.resize(numSlots, 0);
+        for (size_t i = 0;  i < groups.size();  ++i)
+            place(groups[i].hash, i + 1);
+    }
+};
+
+/** Rough estimate of the memory used by a group, used to decide when the
+    groups need to be spilled to disk.
+*/
+size_t estimateGroupMemory(const RowKey & key, size_t numAggregators)
+{
+    size_t result = sizeof(GroupHashTable::Group) + 2 * sizeof(uint32_t)
+        + key.size() * sizeof(ExpressionValue)
+        + numAggregators * AGGREGATOR_MEMORY_ESTIMATE;
+    for (auto & k: key) {
+        if (k.isAtom() && k.getAtom().isString())
+            result += k.getAtom().toStringLength();
+    }
+    return result;
+}
+
+/// Temporary file holding the input rows for the groups of one partition
+/// that didn't fit within the memory budget.
+typedef SpillFile<std::vector<ExpressionValue> > GroupSpillFile;
+
+/// Key, output row and ORDER BY values of a group that was selected.
+typedef std::tuple<RowKey, NamedRowValue, std::vector<ExpressionValue> >
+    GroupOutput;
+
+/// Temporary file holding the output rows of a spilled partition, in key
+/// order.
+typedef SpillFile<GroupOutput> GroupOutputFile;
+
+} // file scope
+
 /*****************************************************************************/
 /* BOUND GROUP BY QUERY                                                      */
 /*****************************************************************************/
 
+size_t
+BoundGroupByQuery::
+defaultMemoryBudget()
+{
+    return MLDB_GROUP_BY_MEMORY_BUDGET;
+}
+
 BoundGroupByQuery::
 BoundGroupByQuery(const SelectExpression & select,
                   const Dataset & from,
@@ -1384,7 +2392,8 @@ BoundGroupByQuery(const SelectExpression & select,
                   const std::vector< std::shared_ptr<SqlExpression> >& aggregatorsExpr,
                   const SqlExpression & having,
                   const SqlExpression & rowName,
-                  const OrderByExpression & orderBy)
+                  const OrderByExpression & orderBy,
+                  size_t memoryBudget)
     : from(from),
       when(when),
       where(where),
@@ -1394,7 +2403,8 @@ BoundGroupByQuery(const SelectExpression & select,
       select(select),
       having(having),
       orderBy(orderBy),
-      numBuckets(1)
+      numBuckets(1),
+      memoryBudget(memoryBudget)
 {
     for (auto & g: groupBy.clauses) {
         calc.push_back(g);
@@ -1442,12 +2452,9 @@ execute(RowProcessor processor,
                        std::vector<ExpressionValue> >
         SortedRow;
 
-    std::vector<SortedRow> rowsSorted;
-    std::atomic<ssize_t> groupsDone(0);
+    typedef GroupHashTable::Group Group;
 
-    typedef std::vector<ExpressionValue> RowKey;
-    typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+    std::vector<SortedRow> rowsSorted;
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1471,108 +2478,316 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    size_t numKeys = groupBy.clauses.size();
+    size_t numAggregators = groupContext->outputAgg.size();
+
+    // Each bucket has its own hash table for each partition of the groups,
+    // so that no locking is required to record a row.
+    std::vector<std::vector<GroupHashTable> > accum
+        (numBuckets, std::vector<GroupHashTable>(NUM_GROUP_PARTITIONS));
+
+    // Once we go over the memory budget, partitions are spilled one by one:
+    // the groups already in memory continue to be aggregated there, but
+    // rows for new groups in the partition are written to disk and
+    // replayed when the partition is merged.
+    std::atomic<size_t> memoryUsed(0);
+    std::atomic<bool> spilled[NUM_GROUP_PARTITIONS];
+    for (auto & s: spilled)
+        s = false;
+    std::vector<std::shared_ptr<GroupSpillFile> >
+        spillFiles(NUM_GROUP_PARTITIONS);
+    std::mutex spillMutex;
+
+    auto spillPartition = [&] (size_t partition)
+        {
+            std::unique_lock<std::mutex> guard(spillMutex);
+            if (spilled[partition])
+                return;
+            spillFiles[partition] = std::make_shared<GroupSpillFile>("GROUP BY");
+            spilled[partition] = true;
+        };
+
+    // Add a new group for the key of the given row, returning its index
+    auto addGroup = [&] (GroupHashTable & table,
+                         uint64_t hash,
+                         const std::vector<ExpressionValue> & calc)
+        {
+            GroupMapValue aggs;
+            //initialize aggregator data
+            groupContext->initializePerThreadAggregators(aggs);
+            return table.insert(hash,
+                                RowKey(calc.begin(), calc.begin() + numKeys),
+                                std::move(aggs));
+        };
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
-       RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
+        uint64_t hash = hashKey(calc.begin(), calc.begin() + numKeys);
+        size_t partition = hash >> (64 - GROUP_PARTITION_BITS);
+        GroupHashTable & table = accum[groupNum][partition];
+
+        ssize_t index = table.find(hash, calc.begin(),
+                                   calc.begin() + numKeys);
+        if (index != -1) {
+            groupContext->aggregateRow(table.groups[index].aggs, calc);
+            return true;
+        }
 
-       auto pair = map.insert({rowKey, GroupMapValue()});
-       auto & iter = pair.first;
-       if (pair.second)
-       {
-          //initialize aggregator data
-          groupContext->initializePerThreadAggregators(iter->second);
-       }
+        if (spilled[partition]) {
+            spillFiles[partition]->write(calc);
+            return true;
+        }
 
-       groupContext->aggregateRow(iter->second, calc);
+        index = addGroup(table, hash, calc);
+        groupContext->aggregateRow(table.groups[index].aggs, calc);
 
-       return true;
+        size_t groupMemory = estimateGroupMemory(table.groups[index].key,
+                                                 numAggregators);
+        if (memoryUsed.fetch_add(groupMemory) + groupMemory > memoryBudget)
+            spillPartition(partition);
+
+        return true;
     };  
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
-  
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
-    {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
+
+    // Merge the buckets of each partition in fixed order, and replay any
+    // spilled rows, giving a list of groups per partition sorted by key.
+    std::vector<std::shared_ptr<std::vector<Group> > >
+        partitionGroups(NUM_GROUP_PARTITIONS);
+
+    auto compareKeys = [] (const Group & group1, const Group & group2)
         {
-            for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
-            {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
-                auto destiter = pair.first;
-                if (pair.second)
-                {
-                    //initialize aggregator data
-                    groupContext->initializePerThreadAggregators(destiter->second);
+            return group1.key < group2.key;
+        };
+
+    auto mergePartition = [&] (size_t partition)
+        {
+            GroupHashTable merged;
+
+            for (auto & bucket: accum) {
+                GroupHashTable & table = bucket[partition];
+                if (merged.groups.empty()) {
+                    merged = std::move(table);
+                    continue;
                 }
 
-                groupContext->mergeThreadMap(destiter->second, it->second);
+                for (auto & group: table.groups) {
+                    ssize_t index = merged.find(group.hash, group.key.begin(),
+                                                group.key.end());
+                    if (index == -1) {
+                        merged.insert(group.hash, std::move(group.key),
+                                      std::move(group.aggs));
+                    }
+                    else {
+                        groupContext->mergeThreadMap(merged.groups[index].aggs,
+                                                     group.aggs);
+                    }
+                }
+
+                table = GroupHashTable();
+            }
+
+            if (spilled[partition]) {
+                auto onSpilledRow = [&] (const std::vector<ExpressionValue> & calc)
+                    {
+                        uint64_t hash = hashKey(calc.begin(),
+                                                calc.begin() + numKeys);
+                        ssize_t index = merged.find(hash, calc.begin(),
+                                                    calc.begin() + numKeys);
+                        if (index == -1)
+                            index = addGroup(merged, hash, calc);
+                        groupContext->aggregateRow(merged.groups[index].aggs,
+                                                   calc);
+                    };
+
+                spillFiles[partition]->forEachRow(onSpilledRow);
+                spillFiles[partition].reset();
             }
+
+            std::sort(merged.groups.begin(), merged.groups.end(), compareKeys);
+
+            partitionGroups[partition]
+                = std::make_shared<std::vector<Group> >
+                    (std::move(merged.groups));
+        };
+
+    // Partitions that were entirely in memory are merged in parallel.
+    parallelMap(0, NUM_GROUP_PARTITIONS,
+                [&] (size_t partition)
+                {
+                    if (!spilled[partition])
+                        mergePartition(partition);
+                });
+
+    if (groupContext->evaluateEmptyGroups && groupBy.clauses.empty()) {
+        bool anyGroups = false;
+        for (size_t partition = 0;  partition < NUM_GROUP_PARTITIONS;
+             ++partition) {
+            if (spilled[partition] || !partitionGroups[partition]->empty())
+                anyGroups = true;
         }
-    }
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
-        && groupBy.clauses.empty())
-    {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
+        if (!anyGroups) {
+            partitionGroups[0]->emplace_back();
+            groupContext->initializePerThreadAggregators
+                (partitionGroups[0]->back().aggs);
+        }
     }
 
-    //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
-    {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+    // Evaluate HAVING, the select and the ORDER BY in parallel for the
+    // groups between begin and end, appending the selected ones to
+    // outputs.  The groups are freed once they have been evaluated.
+    auto evaluateGroups = [&] (std::vector<Group> & groups,
+                               size_t begin, size_t end,
+                               std::vector<GroupOutput> & outputs)
+        {
+            std::vector<GroupOutput> evaluated(end - begin);
+            std::vector<char> selected(end - begin, false);
 
-         // Create the context to evaluate the row name and order by
-        NamedRowValue outputRow;
+            auto doOutputs = [&] (size_t first, size_t last)
+                {
+                    for (size_t i = first;  i < last;  ++i) {
+                        const Group & group = groups[i];
+                        GroupOutput & output = evaluated[i - begin];
 
-        auto rowContext = groupContext->getRowScope(outputRow, rowKey);
+                        // Create the context to evaluate the row name and order by
+                        NamedRowValue & outputRow = std::get<1>(output);
 
-        //Evaluate the HAVING expression
-        ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
+                        auto rowContext = groupContext->getRowScope(outputRow, group.key,
+                                                                    group.aggs);
 
-        if (!havingResult.isTrue())
-            continue;
+                        //Evaluate the HAVING expression
+                        ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
 
-        outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
-        outputRow.rowHash = outputRow.rowName;        
+                        if (!havingResult.isTrue())
+                            continue;
 
-        //Evaluating the whole bound select expression
-        ExpressionValue result = boundSelect(rowContext, GET_ALL);
-        result.mergeToRowDestructive(outputRow.columns);
+                        outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
+                        outputRow.rowHash = outputRow.rowName;
 
-        //In case of no output ordering, we can early exit
-        if (boundOrderBy.empty()) {
-            ssize_t n = groupsDone.fetch_add(1);
-            if (limit != -1 && n >= limit)
-               break;
+                        //Evaluating the whole bound select expression
+                        ExpressionValue result = boundSelect(rowContext, GET_ALL);
+                        result.mergeToRowDestructive(outputRow.columns);
 
-            processor(outputRow);
-        }
-        else
+                        if (!boundOrderBy.empty())
+                            std::get<2>(output) = boundOrderBy.apply(rowContext);
+
+                        selected[i - begin] = true;
+                    }
+                };
+
+            parallelMapChunked(begin, end, GROUPS_PER_OUTPUT_TASK, doOutputs);
+
+            for (size_t i = begin;  i < end;  ++i) {
+                if (selected[i - begin]) {
+                    std::get<0>(evaluated[i - begin]) = std::move(groups[i].key);
+                    outputs.emplace_back(std::move(evaluated[i - begin]));
+                }
+                groups[i] = Group();
+            }
+        };
+
+    // Reader for a partition that is in memory.  Its groups are evaluated
+    // in blocks of increasing size as they are merged, so that a LIMIT
+    // only evaluates the groups it needs and only one block of output rows
+    // per partition is held at once.
+    auto memoryReader = [&] (std::shared_ptr<std::vector<Group> > groups)
+        -> OrderedExecutor::RunReader
         {
-             //Else we add the result to the output rows
-            std::vector<ExpressionValue> sortFields
-            = boundOrderBy.apply(rowContext);
+            struct State {
+                State()
+                    : done(0), blockSize(MIN_GROUPS_PER_OUTPUT_BLOCK), pos(0)
+                {
+                }
 
-            std::vector<ExpressionValue> calcd;
-                
-            rowsSorted.emplace_back(std::move(sortFields),
-                                    std::move(outputRow),
-                                    std::move(calcd));
-        }           
+                size_t done;                     ///< Groups evaluated so far
+                size_t blockSize;                ///< Groups in next block
+                std::vector<GroupOutput> block;  ///< Current block of outputs
+                size_t pos;                      ///< Next output in block
+            };
+
+            auto state = std::make_shared<State>();
+
+            return [=,&evaluateGroups] (GroupOutput & output) -> bool
+                {
+                    while (state->pos == state->block.size()) {
+                        if (state->done == groups->size())
+                            return false;
+                        size_t end = std::min(state->done + state->blockSize,
+                                              groups->size());
+                        state->block.clear();
+                        state->pos = 0;
+                        evaluateGroups(*groups, state->done, end, state->block);
+                        state->done = end;
+                        state->blockSize
+                            = std::min(state->blockSize * 2,
+                                       MAX_GROUPS_PER_OUTPUT_BLOCK);
+                    }
+
+                    output = std::move(state->block[state->pos++]);
+                    return true;
+                };
+        };
+
+    // Spilled partitions are merged one at a time, so that only one of them
+    // needs to be brought back into memory at once.  Their groups are
+    // evaluated straight away, and the output rows of those selected are
+    // written back to disk in key order.
+    std::vector<OrderedExecutor::RunReader> readers;
+
+    for (size_t partition = 0;  partition < NUM_GROUP_PARTITIONS;
+         ++partition) {
+        if (!spilled[partition]) {
+            readers.emplace_back(memoryReader(partitionGroups[partition]));
+            continue;
+        }
+
+        mergePartition(partition);
+
+        std::vector<Group> & groups = *partitionGroups[partition];
+        auto file = std::make_shared<GroupOutputFile>("GROUP BY");
+        std::vector<GroupOutput> block;
+
+        for (size_t begin = 0;  begin < groups.size();
+             begin += MAX_GROUPS_PER_OUTPUT_BLOCK) {
+            size_t end = std::min(begin + MAX_GROUPS_PER_OUTPUT_BLOCK,
+                                  groups.size());
+            block.clear();
+            evaluateGroups(groups, begin, end, block);
+            for (auto & output: block)
+                file->write(output);
+        }
+
+        partitionGroups[partition].reset();
+        readers.emplace_back(OrderedExecutor::fileRunReader(file));
     }
 
-    if (boundOrderBy.empty())
+    // The partitions are merged on the group key, as we always output
+    // in key order before any ORDER BY is applied
+    auto compareOutputs = [] (const GroupOutput & output1,
+                              const GroupOutput & output2)
+        {
+            return std::get<0>(output1) < std::get<0>(output2);
+        };
+
+    //In case of no output ordering, we output in key order
+    if (boundOrderBy.empty()) {
+        ssize_t n = 0;
+        auto onOutput = [&] (GroupOutput & output) -> bool
+            {
+                if (limit != -1 && n >= limit)
+                    return false;
+                ++n;
+                return processor(std::get<1>(output));
+            };
+
+        OrderedExecutor::mergeReaders(readers, compareOutputs, onOutput);
         return;
+    }
 
     // Compare two rows according to the sort criteria
     auto compareRows = [&] (const SortedRow & row1,
@@ -1582,29 +2797,48 @@ execute(RowProcessor processor,
                                      std::get<0>(row2));
         };
 
-    // Sort our output rows
-    std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    ExcAssertGreaterEqual(offset, 0);
+
+    size_t maxRows = limit == -1
+        ? std::numeric_limits<size_t>::max() : offset + limit;
 
-    auto doSelect = [&] (int rowNum) -> bool
+    // The sort is stable, so rows that are equal on the ORDER BY stay in
+    // key order.  That means that with a LIMIT we can sort as we go and
+    // drop the rows that can no longer be output.
+    auto sortRows = [&] ()
         {
-            auto & row = std::get<1>(rowsSorted[rowNum]);
-
-            /* Finally, pass to the terminator to continue. */
-            return processor(row);
+            std::stable_sort(rowsSorted.begin(), rowsSorted.end(),
+                             compareRows);
+            if (rowsSorted.size() > maxRows)
+                rowsSorted.resize(maxRows);
         };
 
-    // Now select only the required subset of sorted rows
-    if (limit == -1)
-        limit = rowsSorted.size();
+    //Else we add the results to the output rows
+    auto onOutput = [&] (GroupOutput & output) -> bool
+        {
+            std::vector<ExpressionValue> calcd;
 
-    ExcAssertGreaterEqual(offset, 0);
+            rowsSorted.emplace_back(std::move(std::get<2>(output)),
+                                    std::move(std::get<1>(output)),
+                                    std::move(calcd));
+
+            if (limit != -1
+                && rowsSorted.size() >= 2 * maxRows + GROUPS_PER_OUTPUT_TASK)
+                sortRows();
+
+            return true;
+        };
+
+    OrderedExecutor::mergeReaders(readers, compareOutputs, onOutput);
 
-    ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-    ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
+    // Sort our output rows, and select only the required subset
+    sortRows();
 
-    for (unsigned i = begin;  i < end;  ++i) {
-        doSelect(i);
-    } 
+    for (size_t i = offset;  i < rowsSorted.size();  ++i) {
+        /* Finally, pass to the terminator to continue. */
+        if (!processor(std::get<1>(rowsSorted[i])))
+            return;
+    }
 }
 
 } // namespace MLDB
@@ -84,6 +84,15 @@ struct BoundSelectQuery {
     const OrderByExpression & orderBy;
     std::shared_ptr<SqlExpressionDatasetScope> context;
 
+    /// Approximate number of bytes that the rows of an ORDER BY query may
+    /// use while they are being sorted before sorted runs of them are
+    /// spilled to disk.
+    size_t sortMemoryBudget;
+
+    /// Default for sortMemoryBudget, from the MLDB_ORDER_BY_MEMORY_BUDGET
+    /// environment variable.
+    static size_t defaultSortMemoryBudget();
+
     /** Note on the ordering of rows
      *  Users are expecting determinist results (e.g. repeated queries
      *  should return rows in the same order).  When creating this object
@@ -99,7 +108,8 @@ struct BoundSelectQuery {
                      const SqlExpression & where,
                      const OrderByExpression & orderBy,
                      std::vector<std::shared_ptr<SqlExpression> > calc,
-                     int numBuckets = -1);
+                     int numBuckets = -1,
+                     size_t sortMemoryBudget = defaultSortMemoryBudget());
 
     void execute(RowProcessorEx processor,
                  ssize_t offset,
@@ -133,7 +143,8 @@ struct BoundGroupByQuery {
                      const std::vector< std::shared_ptr<SqlExpression> >& aggregatorsExpr,
                      const SqlExpression & having,
                      const SqlExpression & rowName,
-                     const OrderByExpression & orderBy);
+                     const OrderByExpression & orderBy,
+                     size_t memoryBudget = defaultMemoryBudget());
 
     void execute(RowProcessor processor,
             ssize_t offset, ssize_t limit,
@@ -172,6 +183,13 @@ struct BoundGroupByQuery {
 
     size_t numBuckets;
 
+    /// Approximate number of bytes that the groups may use while rows are
+    /// being aggregated before new groups are spilled to disk.
+    size_t memoryBudget;
+
+    /// Default for memoryBudget, from the MLDB_GROUP_BY_MEMORY_BUDGET
+    /// environment variable.
+    static size_t defaultMemoryBudget();
 };
 
 } // namespace MLDB
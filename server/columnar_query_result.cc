@@ -0,0 +1,390 @@
+/** columnar_query_result.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Binary columnar encoding of query results.
+*/
+
+#include "columnar_query_result.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/ext/highwayhash.h"
+#include "mldb/utils/json_utils.h"
+#include "mldb/types/value_description.h"
+#include "mldb/http/http_exception.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Integers with a larger magnitude can't be exactly stored in a double
+static const int64_t MAX_EXACT_DOUBLE_INT = 1LL << 53;
+
+void pad(std::string & out)
+{
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+template<typename T>
+void appendPod(std::string & out, const T & val)
+{
+    out.append((const char *)&val, sizeof(val));
+}
+
+/** A string stored elsewhere, used as a key of the dictionary. */
+struct StringRef {
+    const char * data;
+    uint32_t length;
+
+    bool operator == (const StringRef & other) const
+    {
+        return length == other.length
+            && std::memcmp(data, other.data, length) == 0;
+    }
+};
+
+struct StringRefHash {
+    size_t operator () (const StringRef & str) const
+    {
+        return highwayHash(defaultSeedStable.u64, str.data, str.length);
+    }
+};
+
+/** Values of a column within a batch, in row order. */
+struct ColumnValues {
+    ColumnName name;
+    std::vector<std::pair<uint32_t, const CellValue *> > values;
+};
+
+/** Write a column of dictionary encoded values, where getString returns
+    the dictionary entry for each value.
+*/
+template<typename GetString>
+void writeDictionary(std::string & out, const ColumnValues & column,
+                     size_t numRows, const GetString & getString)
+{
+    std::unordered_map<StringRef, uint32_t, StringRefHash> index;
+    std::vector<StringRef> entries;
+    std::vector<uint32_t> codes(numRows, 0);
+
+    // JSON encodings need to live somewhere while they are in the index
+    std::vector<std::string> storage;
+    storage.reserve(column.values.size());
+
+    for (auto & v: column.values) {
+        // Nulls are left with index zero, as they are masked by the bitmap
+        if (v.second->empty())
+            continue;
+        StringRef str = getString(*v.second, storage);
+        auto res = index.insert({ str, (uint32_t)entries.size() });
+        if (res.second)
+            entries.push_back(str);
+        codes[v.first] = res.first->second;
+    }
+
+    appendPod(out, (uint32_t)entries.size());
+    appendPod(out, (uint32_t)0);
+
+    uint32_t offset = 0;
+    appendPod(out, offset);
+    for (auto & e: entries) {
+        offset += e.length;
+        appendPod(out, offset);
+    }
+    pad(out);
+
+    for (auto & e: entries)
+        out.append(e.data, e.length);
+    pad(out);
+
+    out.append((const char *)codes.data(), codes.size() * sizeof(uint32_t));
+    pad(out);
+}
+
+/** Decide how a column will be represented. */
+ColumnarQueryResultEncoder::ColumnType
+getColumnType(const ColumnValues & column)
+{
+    bool hasInt = false, hasLargeInt = false, hasFloat = false;
+    bool hasString = false, hasTimestamp = false, hasBlob = false;
+    bool hasOther = false;
+
+    for (auto & v: column.values) {
+        const CellValue & val = *v.second;
+        switch (val.cellType()) {
+        case CellValue::EMPTY:
+            break;
+        case CellValue::INTEGER:
+            if (val.isInt64()) {
+                int64_t i = val.toInt();
+                if (i > MAX_EXACT_DOUBLE_INT || i < -MAX_EXACT_DOUBLE_INT)
+                    hasLargeInt = true;
+                hasInt = true;
+            }
+            else {
+                // Unsigned and too large for an int64
+                hasOther = true;
+            }
+            break;
+        case CellValue::FLOAT:
+            hasFloat = true;
+            break;
+        case CellValue::ASCII_STRING:
+        case CellValue::UTF8_STRING:
+            hasString = true;
+            break;
+        case CellValue::TIMESTAMP:
+            hasTimestamp = true;
+            break;
+        case CellValue::BLOB:
+            hasBlob = true;
+            break;
+        default:
+            hasOther = true;
+        }
+    }
+
+    int numKinds = (hasInt || hasFloat) + hasString + hasTimestamp
+        + hasBlob + hasOther;
+
+    if (numKinds == 0)
+        return ColumnarQueryResultEncoder::NULLS;
+    if (numKinds > 1)
+        return ColumnarQueryResultEncoder::JSON;
+    if (hasInt && !hasFloat)
+        return ColumnarQueryResultEncoder::INT64;
+    if (hasFloat)
+        return hasLargeInt
+            ? ColumnarQueryResultEncoder::JSON
+            : ColumnarQueryResultEncoder::FLOAT64;
+    if (hasString)
+        return ColumnarQueryResultEncoder::STRING;
+    if (hasTimestamp)
+        return ColumnarQueryResultEncoder::TIMESTAMP;
+    if (hasBlob)
+        return ColumnarQueryResultEncoder::BLOB;
+    return ColumnarQueryResultEncoder::JSON;
+}
+
+void writeColumn(std::string & out, const ColumnValues & column,
+                 size_t numRows)
+{
+    auto type = getColumnType(column);
+
+    Utf8String name = column.name.toUtf8String();
+    appendPod(out, (uint32_t)name.rawLength());
+    appendPod(out, (uint8_t)type);
+    out.append(3, '\0');
+    out.append(name.rawData(), name.rawLength());
+    pad(out);
+
+    if (type == ColumnarQueryResultEncoder::NULLS)
+        return;
+
+    size_t bitmapStart = out.size();
+    out.append((numRows + 7) / 8, '\0');
+    for (auto & v: column.values) {
+        if (!v.second->empty())
+            out[bitmapStart + v.first / 8] |= (1 << (v.first % 8));
+    }
+    pad(out);
+
+    switch (type) {
+    case ColumnarQueryResultEncoder::INT64: {
+        std::vector<int64_t> vals(numRows, 0);
+        for (auto & v: column.values) {
+            if (!v.second->empty())
+                vals[v.first] = v.second->toInt();
+        }
+        out.append((const char *)vals.data(), vals.size() * sizeof(int64_t));
+        break;
+    }
+    case ColumnarQueryResultEncoder::FLOAT64: {
+        std::vector<double> vals(numRows, 0.0);
+        for (auto & v: column.values) {
+            if (!v.second->empty())
+                vals[v.first] = v.second->toDouble();
+        }
+        out.append((const char *)vals.data(), vals.size() * sizeof(double));
+        break;
+    }
+    case ColumnarQueryResultEncoder::TIMESTAMP: {
+        std::vector<double> vals(numRows, 0.0);
+        for (auto & v: column.values) {
+            if (!v.second->empty())
+                vals[v.first]
+                    = v.second->toTimestamp().secondsSinceEpoch();
+        }
+        out.append((const char *)vals.data(), vals.size() * sizeof(double));
+        break;
+    }
+    case ColumnarQueryResultEncoder::STRING: {
+        writeDictionary(out, column, numRows,
+                        [] (const CellValue & val, std::vector<std::string> &)
+                        {
+                            return StringRef{ val.stringChars(),
+                                    val.toStringLength() };
+                        });
+        break;
+    }
+    case ColumnarQueryResultEncoder::BLOB: {
+        writeDictionary(out, column, numRows,
+                        [] (const CellValue & val, std::vector<std::string> &)
+                        {
+                            return StringRef{ (const char *)val.blobData(),
+                                    val.blobLength() };
+                        });
+        break;
+    }
+    case ColumnarQueryResultEncoder::JSON: {
+        writeDictionary(out, column, numRows,
+                        [] (const CellValue & val,
+                            std::vector<std::string> & storage)
+                        {
+                            storage.emplace_back(jsonEncodeStr(val));
+                            return StringRef{ storage.back().data(),
+                                    (uint32_t)storage.back().size() };
+                        });
+        break;
+    }
+    default:
+        throw HttpReturnException(500, "Unknown columnar column type");
+    }
+
+    pad(out);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR QUERY RESULT ENCODER                                             */
+/*****************************************************************************/
+
+ColumnarQueryResultEncoder::
+ColumnarQueryResultEncoder(bool rowNames, bool rowHashes,
+                           bool sortColumns, size_t batchSize)
+    : rowNames(rowNames), rowHashes(rowHashes), sortColumns(sortColumns),
+      batchSize(batchSize)
+{
+}
+
+void
+ColumnarQueryResultEncoder::
+writeHeader(std::string & out)
+{
+    out.append("MLDBCOLS", 8);
+    appendPod(out, (uint32_t)1);
+    appendPod(out, (uint32_t)0);
+}
+
+void
+ColumnarQueryResultEncoder::
+addRow(MatrixNamedRow & row)
+{
+    rows.emplace_back(std::move(row));
+}
+
+bool
+ColumnarQueryResultEncoder::
+batchFull() const
+{
+    return rows.size() >= batchSize;
+}
+
+void
+ColumnarQueryResultEncoder::
+writeBatch(std::string & out)
+{
+    if (rows.empty())
+        return;
+
+    size_t numRows = rows.size();
+
+    // Row names and hashes are stored as cells, so that they can be
+    // written like any other string column
+    std::vector<CellValue> names, hashes;
+    if (rowNames) {
+        names.reserve(numRows);
+        for (auto & r: rows)
+            names.emplace_back(r.rowName.toUtf8String());
+    }
+    if (rowHashes) {
+        hashes.reserve(numRows);
+        for (auto & r: rows)
+            hashes.emplace_back(r.rowHash.toString());
+    }
+
+    // Find the values of each column, in the order in which the columns
+    // are first seen
+    std::vector<ColumnValues> columns;
+    ML::Lightweight_Hash<ColumnHash, int> columnIndex;
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        for (auto & c: rows[i].columns) {
+            const ColumnName & columnName = std::get<0>(c);
+            auto res = columnIndex.insert({columnName, columns.size()});
+            if (res.second) {
+                columns.emplace_back();
+                columns.back().name = columnName;
+            }
+            auto & values = columns[res.first->second].values;
+
+            // If there are several values for a cell, the last one wins
+            if (!values.empty() && values.back().first == i)
+                values.back().second = &std::get<1>(c);
+            else values.emplace_back(i, &std::get<1>(c));
+        }
+    }
+
+    if (sortColumns) {
+        std::sort(columns.begin(), columns.end(),
+                  [] (const ColumnValues & c1, const ColumnValues & c2)
+                  {
+                      return c1.name < c2.name;
+                  });
+    }
+
+    appendPod(out, (uint32_t)numRows);
+    appendPod(out, (uint32_t)(columns.size() + rowNames + rowHashes));
+
+    auto writeImplicit = [&] (const char * name,
+                              const std::vector<CellValue> & vals)
+        {
+            ColumnValues column;
+            column.name = ColumnName(name);
+            column.values.reserve(numRows);
+            for (size_t i = 0;  i < numRows;  ++i)
+                column.values.emplace_back(i, &vals[i]);
+            writeColumn(out, column, numRows);
+        };
+
+    if (rowNames)
+        writeImplicit("_rowName", names);
+    if (rowHashes)
+        writeImplicit("_rowHash", hashes);
+
+    for (auto & c: columns)
+        writeColumn(out, c, numRows);
+
+    rows.clear();
+}
+
+void
+ColumnarQueryResultEncoder::
+writeEnd(std::string & out)
+{
+    writeBatch(out);
+    appendPod(out, (uint32_t)0);
+    appendPod(out, (uint32_t)0);
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,112 @@
+/** columnar_query_result.h                                        -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Binary columnar encoding of query results.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include <string>
+#include <vector>
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMNAR QUERY RESULT ENCODER                                             */
+/*****************************************************************************/
+
+/** Encodes the rows of a query result in a compact binary columnar
+    format, so that clients can load them into typed arrays without
+    having to parse JSON.  This is the `columnar` output format of the
+    query API.
+
+    All integers are little endian, and every field starts at a multiple
+    of 8 bytes from the start of the stream, so that the arrays can be
+    used in place.  The stream is:
+
+    - A 16 byte header: the magic "MLDBCOLS", a uint32 version (1) and a
+      uint32 that is zero.
+    - A sequence of batches of rows.  Each batch starts with a uint32
+      number of rows and a uint32 number of columns, followed by the
+      columns.  The columns present may differ from one batch to the
+      next; a column that is missing from a batch is null in all of its
+      rows.
+    - An end marker, which looks like a batch with zero rows and zero
+      columns.  A stream without one has been truncated by an error.
+
+    Each column is:
+
+    - A uint32 name length, a uint8 type and three bytes of padding,
+      followed by the UTF-8 name.
+    - Unless the type is NULLS, a bitmap with one bit per row (least
+      significant bit first), which is set where the row has a value.
+    - The values, one per row (including null rows, where the value is
+      zero), depending upon the type:
+      - INT64: int64 values;
+      - FLOAT64: double values;
+      - TIMESTAMP: double values, in seconds since the epoch;
+      - STRING, BLOB and JSON: a uint32 dictionary size and a uint32 of
+        padding, then dictionary size + 1 uint32 offsets into the
+        dictionary data, then the dictionary data, then a uint32
+        dictionary index per row.  STRING entries are UTF-8 strings,
+        BLOB entries are bytes, and JSON entries are the JSON encoding
+        of the value, which is used for columns with mixed types and for
+        types with no direct representation.
+
+    Each of these parts is padded with zeros to a multiple of 8 bytes.
+
+    Only the latest value of each cell is kept, without its timestamp,
+    as for the `aos` and `soa` formats.
+*/
+
+struct ColumnarQueryResultEncoder {
+
+    enum ColumnType {
+        NULLS = 0,
+        INT64 = 1,
+        FLOAT64 = 2,
+        TIMESTAMP = 3,
+        STRING = 4,
+        BLOB = 5,
+        JSON = 6
+    };
+
+    /** Create an encoder.  rowNames and rowHashes add _rowName and
+        _rowHash columns, and sortColumns sorts the columns of each batch
+        by name.  A batch is written every batchSize rows.
+    */
+    ColumnarQueryResultEncoder(bool rowNames, bool rowHashes,
+                               bool sortColumns,
+                               size_t batchSize = 16384);
+
+    /** Write the stream header to the output. */
+    void writeHeader(std::string & out);
+
+    /** Add a row to the current batch.  Its contents are moved out. */
+    void addRow(MatrixNamedRow & row);
+
+    /** Is the current batch full, meaning writeBatch should be called? */
+    bool batchFull() const;
+
+    /** Write the current batch, if it has rows, and start a new one. */
+    void writeBatch(std::string & out);
+
+    /** Write any rows remaining and the end marker. */
+    void writeEnd(std::string & out);
+
+private:
+    bool rowNames;
+    bool rowHashes;
+    bool sortColumns;
+    size_t batchSize;
+
+    /// Rows of the current batch
+    std::vector<MatrixNamedRow> rows;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -10,6 +10,7 @@
 #include "mldb/server/dataset_collection.h"
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/server/mldb_server.h"
+#include "mldb/server/columnar_query_result.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/jml/utils/lightweight_hash.h"
@@ -66,7 +67,119 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
-void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
+namespace {
+
+const std::string COLUMNAR_CONTENT_TYPE = "application/x-mldb-columnar";
+
+/** Writes the encoding of a query result to a connection as it is
+    produced.  A result that fits within a single chunk is sent as a
+    normal response.  Otherwise, the response switches to HTTP chunked
+    transfer encoding and each chunk is sent as soon as it is full, so
+    that neither the encoded result nor the time to its first byte grow
+    with the size of the result.
+*/
+struct QueryResultStream {
+    static const size_t CHUNK_SIZE = 65536;
+
+    QueryResultStream(RestConnection & connection,
+                      std::string contentType = "application/json")
+        : connection(connection), contentType(std::move(contentType)),
+          context(buffer), started(false)
+    {
+        buffer.reserve(CHUNK_SIZE + CHUNK_SIZE / 4);
+    }
+
+    RestConnection & connection;
+    std::string contentType;
+    std::string buffer;
+    StringJsonPrintingContext context;
+    bool started;
+
+    template<typename T>
+    void print(const T & val)
+    {
+        static auto desc = getDefaultDescriptionSharedT<T>();
+        desc->printJson(&val, context);
+    }
+
+    /** Send what has been encoded so far if it fills a chunk.  Returns
+        false if the client has gone away, in which case there is no
+        point in continuing.
+    */
+    bool flushIfFull()
+    {
+        if (buffer.size() < CHUNK_SIZE)
+            return true;
+
+        if (!started) {
+            connection.sendHttpResponseHeader(200, contentType,
+                                              RestConnection::CHUNKED_ENCODING);
+            started = true;
+        }
+
+        // The printing context holds a reference to buffer, so swap the
+        // contents out rather than replacing it
+        std::string chunk;
+        chunk.reserve(CHUNK_SIZE + CHUNK_SIZE / 4);
+        chunk.swap(buffer);
+        connection.sendPayload(std::move(chunk));
+
+        return connection.isConnected();
+    }
+
+    void finish()
+    {
+        if (!started) {
+            connection.sendResponse(200, std::move(buffer), contentType);
+            return;
+        }
+        if (!buffer.empty()) {
+            std::string chunk;
+            chunk.swap(buffer);
+            connection.sendPayload(std::move(chunk));
+        }
+        connection.finishResponse();
+    }
+};
+
+/** Apply the special output rules for cells in the table format. */
+CellValue tableCellValue(CellValue cellValue)
+{
+    if (cellValue.isTimestamp())
+    {
+        //in table format print dates as epoch
+        return cellValue.coerceToString();
+    }
+    else if (cellValue.isTimeinterval())
+    {
+        //in table format print time intervals as string
+        return cellValue.coerceToString();
+    }
+    else if (cellValue.isDouble())
+    {
+        //in table format print 'special' floats as string
+        double value = cellValue.toDouble();
+        if (std::isnan(value))
+        {
+            std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
+            return CellValue(stringVal);
+        }
+        else if (std::isinf(value))
+        {
+            std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
+            return CellValue(stringVal);
+        }
+    }
+    else if (cellValue.isPath()) {
+        return CellValue(cellValue.coerceToPath().toUtf8String());
+    }
+
+    return cellValue;
+}
+
+} // file scope
+
+void runHttpQuery(std::function<bool (const std::function<bool (MatrixNamedRow & row)> & onRow)> runQuery,
                   RestConnection & connection,
                   const std::string & format,
                   bool createHeaders,
@@ -74,184 +187,227 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool rowHashes,
                   bool sortColumns)
 {
-    std::vector<MatrixNamedRow> sparseOutput = runQuery();
-
-    if (sortColumns) {
-        for (auto & r: sparseOutput) {
-            std::sort(r.columns.begin(), r.columns.end());
-        }
+    if (format != "full" && format != "" && format != "sparse"
+        && format != "soa" && format != "aos" && format != "table"
+        && format != "columnar") {
+        connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
+        return;
     }
 
-    if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
-    }
-    else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnName, CellValue> > > output;
-        output.reserve(sparseOutput.size());
+    QueryResultStream stream(connection,
+                             format == "columnar"
+                             ? COLUMNAR_CONTENT_TYPE : "application/json");
 
-        for (auto & row: sparseOutput) {
+    // Rows of the columnar format are encoded a batch at a time
+    ColumnarQueryResultEncoder columnar(rowNames, rowHashes, sortColumns);
 
-            std::vector<std::pair<ColumnName, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+    // Columns of the soa format, which can only be written once all rows
+    // have been seen.  Each one has an entry for each row up to the last
+    // one in which it appeared.
+    std::map<ColumnName, std::vector<CellValue> > soaColumns;
+    size_t numRows = 0;
 
-            if (rowNames)
-                rowOut.emplace_back(ColumnName("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnName("_rowHash"), row.rowHash.toString());
+    // Rows of the table format, with their values indexed by column
+    // number.  These can only be written once all columns are known.
+    std::vector<ColumnName> tableColumns;
+    ML::Lightweight_Hash<ColumnHash, int> tableColumnIndex;
+    std::vector<std::vector<std::pair<int, CellValue> > > tableRows;
 
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
+    auto onRow = [&] (MatrixNamedRow & row) -> bool
+        {
+            if (sortColumns)
+                std::sort(row.columns.begin(), row.columns.end());
 
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+            if (format == "full" || format == "") {
+                stream.context.newArrayElement();
+                stream.print(row);
+            }
+            else if (format == "sparse") {
+                std::vector<std::pair<ColumnName, CellValue> > rowOut;
+                rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+                if (rowNames)
+                    rowOut.emplace_back(ColumnName("_rowName"), row.rowName.toUtf8String());
+                if (rowHashes)
+                    rowOut.emplace_back(ColumnName("_rowHash"), row.rowHash.toString());
+
+                for (auto & c: row.columns) {
+                    rowOut.emplace_back(std::move(std::get<0>(c)),
+                                        std::move(std::get<1>(c)));
+                }
 
-            output.emplace_back(std::move(rowOut));
-        }
+                std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
-    else if (format == "soa") {
-        // Structure of arrays; one array per column
-        std::map<ColumnName, std::vector<CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-            if (rowNames)
-                output[ColumnName("_rowName")]
-                    .push_back(sparseOutput[i].rowName.toUtf8String());
-            if (rowHashes)
-                output[ColumnName("_rowHash")]
-                    .push_back(sparseOutput[i].rowHash.toString());
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnName & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-
-                std::vector<CellValue> & vals = output[col];
-                if (vals.empty())
-                    vals.resize(sparseOutput.size());
-                vals[i] = val;
-            }
-        }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
-    else if (format == "aos") {
-        // Array of structures; one structure per row
-        std::vector<std::map<ColumnName, CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnName, CellValue> row;
-
-            if (rowNames)
-                row[ColumnName("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnName("_rowHash")] = sparseOutput[i].rowHash.toString();
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnName & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
+                stream.context.newArrayElement();
+                stream.print(rowOut);
             }
+            else if (format == "aos") {
+                // Array of structures; one structure per row
+                std::map<ColumnName, CellValue> rowOut;
 
-            output.emplace_back(std::move(row));
-        }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
-    else if (format == "table") {
-        // TODO: the SQL knows what columns could be created... this could
-        // be greatly optimized.
-
-        // First, find all columns
-        std::vector<ColumnName> columns;
-        ML::Lightweight_Hash<ColumnHash, int> columnIndex;
-        for (auto & o: sparseOutput) {
-            for (auto & c: o.columns) {
-                auto & columnName = std::get<0>(c);
-                if (columnIndex.insert({columnName, columns.size()}).second) {
-                    columns.push_back(columnName);
+                if (rowNames)
+                    rowOut[ColumnName("_rowName")] = row.rowName.toUtf8String();
+                if (rowHashes)
+                    rowOut[ColumnName("_rowHash")] = row.rowHash.toString();
+
+                for (auto & c: row.columns) {
+                    rowOut[std::get<0>(c)] = std::move(std::get<1>(c));
                 }
+
+                stream.context.newArrayElement();
+                stream.print(rowOut);
             }
-        }
+            else if (format == "soa") {
+                // Structure of arrays; one array per column
+                if (rowNames)
+                    soaColumns[ColumnName("_rowName")]
+                        .push_back(row.rowName.toUtf8String());
+                if (rowHashes)
+                    soaColumns[ColumnName("_rowHash")]
+                        .push_back(row.rowHash.toString());
+
+                for (auto & c: row.columns) {
+                    std::vector<CellValue> & vals = soaColumns[std::get<0>(c)];
+                    vals.resize(numRows + 1);
+                    vals[numRows] = std::move(std::get<1>(c));
+                }
+            }
+            else if (format == "table") {
+                std::vector<std::pair<int, CellValue> > rowOut;
+                rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+                if (rowNames)
+                    rowOut.emplace_back(-2, row.rowName.toUtf8String());
+                if (rowHashes)
+                    rowOut.emplace_back(-1, row.rowHash.toString());
+
+                for (auto & c: row.columns) {
+                    auto & columnName = std::get<0>(c);
+                    auto res = tableColumnIndex.insert({columnName, tableColumns.size()});
+                    if (res.second)
+                        tableColumns.push_back(columnName);
+                    rowOut.emplace_back(res.first->second,
+                                        tableCellValue(std::move(std::get<1>(c))));
+                }
 
-        if (sortColumns) {
-            std::sort(columns.begin(), columns.end());
-            for (size_t i = 0;  i < columns.size();  ++i) {
-                columnIndex[columns[i]] = i;
+                tableRows.emplace_back(std::move(rowOut));
             }
-        }
+            else if (format == "columnar") {
+                columnar.addRow(row);
+                if (columnar.batchFull())
+                    columnar.writeBatch(stream.buffer);
+            }
+
+            ++numRows;
+            return stream.flushIfFull();
+        };
 
-        // Now, send them back
-        std::vector<std::vector<CellValue> > output;
-        output.reserve(sparseOutput.size() + createHeaders);
+    // Formats that are written a row at a time are wrapped in an array
+    bool rowAtATime = format != "soa" && format != "table"
+        && format != "columnar";
 
-        if (createHeaders) {
+    try {
+        if (rowAtATime)
+            stream.context.startArray();
+        else if (format == "columnar")
+            columnar.writeHeader(stream.buffer);
 
-            std::vector<CellValue> headers;
-            if (rowNames)
-                headers.push_back("_rowName");
-            if (rowHashes)
-                headers.push_back("_rowHash");
+        // If the stream has not started, exceptions will be turned into
+        // an error response by our caller
+        runQuery(onRow);
 
-            for (auto & c: columns) {
-                headers.push_back(c.toUtf8String());
+        if (rowAtATime) {
+            stream.context.endArray();
+        }
+        else if (format == "columnar") {
+            columnar.writeEnd(stream.buffer);
+        }
+        else if (format == "soa") {
+            stream.context.startObject();
+            for (auto & c: soaColumns) {
+                c.second.resize(numRows);
+                stream.context.startMember(keyToString(c.first));
+                stream.print(c.second);
+                // Free the memory as we go
+                std::vector<CellValue>().swap(c.second);
+                stream.flushIfFull();
             }
-            output.push_back(headers);
+            stream.context.endObject();
         }
-
-        for (auto & row: sparseOutput) {
-            std::vector<CellValue> rowOut(columns.size() + rowNames + rowHashes);
-            if (rowNames)
-                rowOut[0] = row.rowName.toUtf8String();
-            if (rowHashes)
-                rowOut[rowNames] = row.rowHash.toString();
-
-            for (auto & c: row.columns) {
-                const ColumnName & columnName = std::get<0>(c);
-                CellValue cellValue = std::get<1>(c);
-
-                //Special output options for table format
-                if (cellValue.isTimestamp())
-                {
-                    //in table format print dates as epoch
-                    cellValue = cellValue.coerceToString();
+        else if (format == "table") {
+            // Map from the order in which columns were seen to their
+            // position in the output
+            std::vector<int> columnPosition(tableColumns.size());
+            for (size_t i = 0;  i < tableColumns.size();  ++i)
+                columnPosition[i] = i;
+
+            if (sortColumns) {
+                std::vector<int> order(tableColumns.size());
+                for (size_t i = 0;  i < order.size();  ++i)
+                    order[i] = i;
+                std::sort(order.begin(), order.end(),
+                          [&] (int i1, int i2)
+                          {
+                              return tableColumns[i1] < tableColumns[i2];
+                          });
+                std::vector<ColumnName> sorted;
+                sorted.reserve(tableColumns.size());
+                for (size_t i = 0;  i < order.size();  ++i) {
+                    columnPosition[order[i]] = i;
+                    sorted.push_back(tableColumns[order[i]]);
                 }
-                else if (cellValue.isTimeinterval())
-                {
-                    //in table format print time intervals as string
-                    cellValue = cellValue.coerceToString();
-                }
-                else if (cellValue.isDouble())
-                {
-                    //in table format print 'special' floats as string
-                    double value = cellValue.toDouble();
-                    if (std::isnan(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
-                        cellValue = CellValue(stringVal);
-                    }
-                    else if (std::isinf(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
-                        cellValue = CellValue(stringVal);
-                    }
+                tableColumns.swap(sorted);
+            }
+
+            stream.context.startArray();
+
+            if (createHeaders) {
+                std::vector<CellValue> headers;
+                if (rowNames)
+                    headers.push_back("_rowName");
+                if (rowHashes)
+                    headers.push_back("_rowHash");
+
+                for (auto & c: tableColumns) {
+                    headers.push_back(c.toUtf8String());
                 }
-                else if (cellValue.isPath()) {
-                    cellValue = CellValue(cellValue.coerceToPath().toUtf8String());
+                stream.context.newArrayElement();
+                stream.print(headers);
+            }
+
+            std::vector<CellValue> rowOut;
+            for (auto & row: tableRows) {
+                rowOut.clear();
+                rowOut.resize(tableColumns.size() + rowNames + rowHashes);
+                for (auto & c: row) {
+                    if (c.first == -2)
+                        rowOut[0] = std::move(c.second);
+                    else if (c.first == -1)
+                        rowOut[rowNames] = std::move(c.second);
+                    else rowOut[columnPosition[c.first] + rowHashes + rowNames]
+                             = std::move(c.second);
                 }
+                std::vector<std::pair<int, CellValue> >().swap(row);
 
-                rowOut[columnIndex[columnName] + rowHashes + rowNames] = std::move(cellValue);
+                stream.context.newArrayElement();
+                stream.print(rowOut);
+                if (!stream.flushIfFull())
+                    break;
             }
 
-            output.push_back(rowOut);
+            stream.context.endArray();
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
-    else {
-        connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
+        stream.finish();
+    } catch (const std::exception & exc) {
+        if (!stream.started)
+            throw;
+
+        // Too late to send an error response.  Close the connection
+        // without finishing the chunked response, so that the client
+        // sees an incomplete transfer rather than a truncated document.
+        connection.abortResponse("error streaming query result: "
+                                 + std::string(exc.what()));
     }
 }
 
@@ -628,10 +784,10 @@ queryStructured(const Dataset * dataset,
     //cerr << "limit = " << limit << endl;
     //cerr << "offset = " << offset << endl;
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (const std::function<bool (MatrixNamedRow & row)> & onRow)
         {
-            return dataset->queryStructured
-                (selectParsed, whenParsed, *whereParsed, orderByParsed,
+            return dataset->queryStructuredIncremental
+                (onRow, selectParsed, whenParsed, *whereParsed, orderByParsed,
                  groupByParsed, *havingParsed, *rowNameParsed, offset, limit);
         };
 
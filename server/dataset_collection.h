@@ -22,12 +22,21 @@ namespace MLDB {
 /** Run a query (by calling the given function) and format and return the
     results in HTTP based upon the given flag.
 
+    runQuery must pass each row of the result to the given function as it
+    is produced, and stop if it returns false (which happens when the
+    client has disconnected).  The full, sparse and aos formats are
+    encoded and sent as the rows arrive, using chunked transfer encoding
+    once the response is larger than a single chunk.  The soa and table
+    formats need to see every row before writing anything, so the rows
+    are accumulated (in a compact form) first.  The columnar format is
+    sent a batch at a time (see ColumnarQueryResultEncoder).
+
     - format: output format of results
     - createHeaders: table result formats will include a header row
     - rowNames: add a '_rowName' column
     - rowHashes: add a '_rowHash' column
 */
-void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
+void runHttpQuery(std::function<bool (const std::function<bool (MatrixNamedRow & row)> & onRow)> runQuery,
                   RestConnection & connection,
                   const std::string & format,
                   bool createHeaders,
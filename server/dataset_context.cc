@@ -81,7 +81,24 @@ doGetFunction(const Utf8String & tableName,
                     }
                 };
 
-            return BoundFunction(exec, applier->info.output);
+            BoundFunction result(exec, applier->info.output);
+
+            // Pass a batch of rows to the function at once, so that it
+            // can amortize its per-call overhead
+            if (!args.empty()) {
+                result.execBatch
+                    = [=] (std::vector<std::vector<ExpressionValue> > & batchArgs,
+                           const std::vector<const SqlRowScope *> & rows)
+                    {
+                        std::vector<ExpressionValue> inputs;
+                        inputs.reserve(batchArgs.size());
+                        for (auto & a: batchArgs)
+                            inputs.emplace_back(std::move(a.at(0)));
+                        return applier->applyBatch(inputs);
+                    };
+            }
+
+            return result;
         }
     }
 
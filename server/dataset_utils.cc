@@ -6,8 +6,10 @@
 */
 
 #include "mldb/server/dataset_utils.h"
+#include "mldb/server/per_thread_accumulator.h"
 #include "mldb/http/http_exception.h"
 #include <algorithm>
+#include <atomic>
 
 using namespace std;
 using namespace ML;
@@ -205,5 +207,92 @@ getColumnNames() const
     return result;
 }
 
+
+/******************************************************************************/
+/* PARALLEL RECORDER                                                          */
+/******************************************************************************/
+
+struct ParallelRecorder::Itl
+{
+    Itl(Dataset & dataset, size_t batchSize) :
+        chunks(dataset.getChunkRecorder()), batchSize(batchSize), numChunks(0)
+    {}
+
+    struct ThreadRecorder
+    {
+        std::unique_ptr<Recorder> recorder;
+        std::vector<std::pair<RowName, Row> > rows;
+    };
+
+    Dataset::MultiChunkRecorder chunks;
+    PerThreadAccumulator<ThreadRecorder> threads;
+    size_t batchSize;
+    std::atomic<size_t> numChunks;
+
+    ThreadRecorder & get()
+    {
+        ThreadRecorder & thread = threads.get();
+        if (!thread.recorder) {
+            thread.recorder = chunks.newChunk(numChunks++);
+            thread.rows.reserve(batchSize);
+        }
+        return thread;
+    }
+
+    void flush(ThreadRecorder & thread)
+    {
+        if (thread.rows.empty()) return;
+        thread.recorder->recordRowsDestructive(std::move(thread.rows));
+        thread.rows.clear();
+        thread.rows.reserve(batchSize);
+    }
+
+    void record(RowName rowName, Row row)
+    {
+        ThreadRecorder & thread = get();
+        thread.rows.emplace_back(std::move(rowName), std::move(row));
+        if (thread.rows.size() >= batchSize)
+            flush(thread);
+    }
+};
+
+ParallelRecorder::
+ParallelRecorder(Dataset & dataset, size_t batchSize) :
+    itl(new Itl(dataset, batchSize))
+{}
+
+ParallelRecorder::
+~ParallelRecorder()
+{}
+
+void
+ParallelRecorder::
+recordRow(const RowName & rowName, const Row & row)
+{
+    itl->record(rowName, row);
+}
+
+void
+ParallelRecorder::
+recordRowDestructive(RowName rowName, Row row)
+{
+    itl->record(std::move(rowName), std::move(row));
+}
+
+void
+ParallelRecorder::
+commit()
+{
+    itl->threads.forEach([&] (Itl::ThreadRecorder * thread)
+        {
+            if (!thread->recorder) return;
+            itl->flush(*thread);
+            thread->recorder->finishedChunk();
+            thread->recorder.reset();
+        });
+
+    itl->chunks.commit();
+}
+
 } // namespace MLDB
 } // namepsace Datacratic
@@ -65,5 +65,35 @@ private:
     std::vector< std::shared_ptr<ColumnIndex> > indexes;
 };
 
+
+/******************************************************************************/
+/* PARALLEL RECORDER                                                          */
+/******************************************************************************/
+
+/** Records rows into a dataset from many threads at once.  Each thread gets
+    its own recorder from the dataset's getChunkRecorder(), and its rows are
+    batched and handed to that recorder together, so that threads never
+    contend on a lock to record a row.
+
+    Once all threads have finished recording, commit() must be called from a
+    single thread to flush the remaining rows and commit the dataset.
+ */
+struct ParallelRecorder
+{
+    typedef std::vector<std::tuple<ColumnName, CellValue, Date> > Row;
+
+    ParallelRecorder(Dataset & dataset, size_t batchSize = 1024);
+    ~ParallelRecorder();
+
+    void recordRow(const RowName & rowName, const Row & row);
+    void recordRowDestructive(RowName rowName, Row row);
+
+    void commit();
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
 } // namespace MLDB
 } // namespace Datacratic
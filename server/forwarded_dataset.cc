@@ -139,6 +139,25 @@ queryStructured(const SelectExpression & select,
             groupBy, having, rowName, offset, limit, alias);
 }
 
+bool
+ForwardedDataset::
+queryStructuredIncremental(std::function<bool (MatrixNamedRow & row)> onRow,
+                           const SelectExpression & select,
+                           const WhenExpression & when,
+                           const SqlExpression & where,
+                           const OrderByExpression & orderBy,
+                           const TupleExpression & groupBy,
+                           const SqlExpression & having,
+                           const SqlExpression & rowName,
+                           ssize_t offset,
+                           ssize_t limit,
+                           Utf8String alias) const
+{
+    ExcAssert(underlying);
+    return underlying->queryStructuredIncremental(onRow, select, when, where,
+            orderBy, groupBy, having, rowName, offset, limit, alias);
+}
+
 std::vector<MatrixNamedRow>
 ForwardedDataset::
 queryString(const Utf8String & query) const
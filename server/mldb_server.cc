@@ -267,9 +267,9 @@ runHttpQuery(const Utf8String& qsQuery,
         qsQuery != "" ? qsQuery.rawString() : bQuery.rawString());
     SqlExpressionMldbScope mldbContext(this);
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (const std::function<bool (MatrixNamedRow & row)> & onRow)
         {
-            return queryFromStatement(stm, mldbContext);
+            return queryFromStatementIncremental(onRow, stm, mldbContext);
         };
 
     MLDB::runHttpQuery(runQuery,
@@ -18,11 +18,11 @@
 #include "mldb/base/hash.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/sql/join_utils.h"
+#include "mldb/sql/sql_regex.h"
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/clamp.hpp>
 #include "mldb/ext/edlib/src/edlib.h"
 
-#include <boost/regex/icu.hpp>
 #include <iterator>
 #include <thread>
 #include <mutex>
@@ -905,8 +905,8 @@ static RegisterBuiltin registerImplicitCast(implicit_cast, "implicit_cast");
     it's a constant value or not.
 */
 struct RegexHelper {
-    RegexHelper(BoundSqlExpression expr_)
-        : expr(std::move(expr_))
+    RegexHelper(BoundSqlExpression expr_, RegexEngine engine)
+        : expr(std::move(expr_)), engine(engine)
     {
         if (expr.metadata.isConstant) {
             isPrecompiled = true;
@@ -915,7 +915,7 @@ struct RegexHelper {
         else isPrecompiled = false;
     }
 
-    boost::u32regex compile(const ExpressionValue & val) const
+    std::shared_ptr<const SqlRegex> compile(const ExpressionValue & val) const
     {
         Utf8String regexStr;
         try {
@@ -929,14 +929,12 @@ struct RegexHelper {
                  "value", val);
         }
         try {
-            return boost::make_u32regex(regexStr.rawData());
+            return std::make_shared<SqlRegex>(regexStr, engine);
         } JML_CATCH_ALL {
             rethrowHttpException
                 (400, "Error when compiling regex '"
                  + regexStr + "' from expression " + expr.expr->surface + "': "
-                 + ML::getExceptionString()
-                 + ".  Regular expressions must adhere to Perl-style "
-                 + "regular expression syntax.",
+                 + ML::getExceptionString(),
                  "expr", expr,
                  "value", val);
         }
@@ -945,136 +943,143 @@ struct RegexHelper {
     /// The expression that the regex came from, to help with error messages
     BoundSqlExpression expr;
 
+    /// The engine used to run the regex
+    RegexEngine engine;
+
     /// The pre-compiled version of that expression, when it's constant
-    boost::u32regex precompiled;
+    std::shared_ptr<const SqlRegex> precompiled;
 
     /// Is it actually constant (and precompiled), or computed on the fly?
     bool isPrecompiled;
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const = 0;
+                                  const SqlRegex & regex) const = 0;
 
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & scope)
     {
         if (isPrecompiled) {
-            return apply(args, scope, precompiled);
+            return apply(args, scope, *precompiled);
         }
         else {
-            return apply(args, scope, compile(args.at(1)));
+            return apply(args, scope, *compile(args.at(1)));
         }
     }
 };
 
+/** Return the regex engine given as the optional last argument of a regex
+    function, which must be a constant string.
+*/
+static RegexEngine
+getRegexEngine(const std::vector<BoundSqlExpression> & args,
+               size_t numArgs, const std::string & fctName)
+{
+    if (args.size() != numArgs + 1) {
+        checkArgsSize(args.size(), numArgs, fctName);
+        return REGEX_AUTO;
+    }
+
+    const BoundSqlExpression & engineArg = args[numArgs];
+    if (!engineArg.metadata.isConstant
+        || !engineArg.constantValue().isString()) {
+        throw HttpReturnException
+            (400, "function " + fctName + " expected a constant string "
+             "('auto', 're2' or 'boost') as the regex engine argument",
+             "expr", engineArg);
+    }
+    return parseRegexEngine(engineArg.constantValue().toUtf8String());
+}
+
 struct ApplyRegexReplace: public RegexHelper {
-    ApplyRegexReplace(BoundSqlExpression e)
-        : RegexHelper(std::move(e))
+    ApplyRegexReplace(BoundSqlExpression e, RegexEngine engine)
+        : RegexHelper(std::move(e), engine)
     {
     }
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const SqlRegex & regex) const
     {
-        checkArgsSize(args.size(), 3);
+        ExcAssertGreaterEqual(args.size(), 3);
 
         if (args[0].empty() || args[1].empty() || args[2].empty())
             return ExpressionValue::null(calcTs(args[0], args[1], args[2]));
 
-        std::basic_string<char32_t> matchStr = args[0].toWideString();
-        std::basic_string<char32_t> replacementStr = args[2].toWideString();
-
-        std::basic_string<int32_t>
-            matchStr2(matchStr.begin(), matchStr.end());
-        std::basic_string<int32_t>
-            replacementStr2(replacementStr.begin(), replacementStr.end());
-
-        auto result = boost::u32regex_replace(matchStr2, regex, replacementStr2);
-        std::basic_string<char32_t> result2(result.begin(), result.end());
-
-        return ExpressionValue(result2, calcTs(args[0], args[1], args[2]));
+        return ExpressionValue(regex.replace(args[0].toUtf8String(),
+                                             args[2].toUtf8String()),
+                               calcTs(args[0], args[1], args[2]));
     }
 };
 
 BoundFunction regex_replace(const std::vector<BoundSqlExpression> & args)
 {
-    // regex_replace(string, regex, replacement)
-    checkArgsSize(args.size(), 3);
+    // regex_replace(string, regex, replacement[, engine])
+    RegexEngine engine = getRegexEngine(args, 3, "regex_replace");
 
-    return {ApplyRegexReplace(args[1]),
+    return {ApplyRegexReplace(args[1], engine),
             std::make_shared<Utf8StringValueInfo>()};
 }
 
 static RegisterBuiltin registerRegexReplace(regex_replace, "regex_replace");
 
 struct ApplyRegexMatch: public RegexHelper {
-    ApplyRegexMatch(BoundSqlExpression e)
-        : RegexHelper(std::move(e))
+    ApplyRegexMatch(BoundSqlExpression e, RegexEngine engine)
+        : RegexHelper(std::move(e), engine)
     {
     }
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const SqlRegex & regex) const
     {
-        // TODO: should be able to pass utf-8 string directly in
-
-        checkArgsSize(args.size(), 2);
+        ExcAssertGreaterEqual(args.size(), 2);
 
         if (args[0].empty() || args[1].empty())
             return ExpressionValue::null(calcTs(args[0], args[1]));
 
-        std::basic_string<char32_t> matchStr = args[0].toWideString();
-        
-        auto result = boost::u32regex_match(matchStr.begin(), matchStr.end(),
-                                            regex);
-        return ExpressionValue(result, calcTs(args[0], args[1]));
+        return ExpressionValue(regex.match(args[0].toUtf8String()),
+                               calcTs(args[0], args[1]));
     }
 };
                      
 BoundFunction regex_match(const std::vector<BoundSqlExpression> & args)
 {
-    // regex_match(string, regex)
-    checkArgsSize(args.size(), 2);
+    // regex_match(string, regex[, engine])
+    RegexEngine engine = getRegexEngine(args, 2, "regex_match");
 
-    return {ApplyRegexMatch(args[1]),
+    return {ApplyRegexMatch(args[1], engine),
             std::make_shared<BooleanValueInfo>()};
 }
 
 static RegisterBuiltin registerRegexMatch(regex_match, "regex_match");
 
 struct ApplyRegexSearch: public RegexHelper {
-    ApplyRegexSearch(BoundSqlExpression e)
-        : RegexHelper(std::move(e))
+    ApplyRegexSearch(BoundSqlExpression e, RegexEngine engine)
+        : RegexHelper(std::move(e), engine)
     {
     }
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const SqlRegex & regex) const
     {
-        // TODO: should be able to pass utf-8 string directly in
-
-        checkArgsSize(args.size(), 2);
+        ExcAssertGreaterEqual(args.size(), 2);
 
         if (args[0].empty() || args[1].empty())
             return ExpressionValue::null(calcTs(args[0], args[1]));
 
-        std::basic_string<char32_t> searchStr = args[0].toWideString();
-        
-        auto result = boost::u32regex_search(searchStr.begin(), searchStr.end(),
-                                            regex);
-        return ExpressionValue(result, calcTs(args[0], args[1]));
+        return ExpressionValue(regex.search(args[0].toUtf8String()),
+                               calcTs(args[0], args[1]));
     }
 };
                      
 BoundFunction regex_search(const std::vector<BoundSqlExpression> & args)
 {
-    // regex_search(string, regex)
-    checkArgsSize(args.size(), 2);
+    // regex_search(string, regex[, engine])
+    RegexEngine engine = getRegexEngine(args, 2, "regex_search");
 
-    return {ApplyRegexSearch(args[1]),
+    return {ApplyRegexSearch(args[1], engine),
             std::make_shared<BooleanValueInfo>()};
 }
 
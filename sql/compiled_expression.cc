@@ -0,0 +1,416 @@
+/** compiled_expression.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compilation of scalar SQL expressions into a flat program.
+*/
+
+#include "compiled_expression.h"
+#include "sql_expression_operations.h"
+#include "sql_utils.h"
+#include "cell_value.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/http/http_exception.h"
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Integers with a magnitude under this are exactly representable as a
+/// double, and so compare the same way whether as integers or doubles
+constexpr double MAX_EXACT_INTEGER = 9007199254740992.0;  // 2^53
+
+/** Walks a SqlExpression, emitting instructions into the program.  While
+    compiling, input registers are given negative numbers (-1 for the
+    first input) and temporaries positive ones; they are renumbered once
+    the number of inputs is known.
+*/
+struct ExpressionCompiler {
+    ExpressionCompiler(CompiledSqlExpression & output,
+                       const Utf8String & alias)
+        : output(output), alias(alias), numTemporaries(0)
+    {
+    }
+
+    CompiledSqlExpression & output;
+    const Utf8String & alias;
+    int numTemporaries;
+
+    typedef CompiledSqlExpression::Type Type;
+    typedef CompiledSqlExpression::OpCode OpCode;
+
+    /** Compile the given expression, returning the register holding its
+        value and setting its type.  Returns zero (which is never a valid
+        register while compiling) if the expression is unsupported.
+    */
+    int compile(const SqlExpression & expr, Type & type)
+    {
+        if (auto read = dynamic_cast<const ReadColumnExpression *>(&expr)) {
+            ColumnName columnName = removeTableName(alias, read->columnName);
+            if (columnName.empty())
+                return 0;
+            type = CompiledSqlExpression::NUMBER;
+            for (size_t i = 0;  i < output.inputs.size();  ++i) {
+                if (output.inputs[i] == columnName)
+                    return -(int)i - 1;
+            }
+            output.inputs.emplace_back(std::move(columnName));
+            return -(int)output.inputs.size();
+        }
+        else if (auto constant
+                 = dynamic_cast<const ConstantExpression *>(&expr)) {
+            if (!constant->constant.isAtom())
+                return 0;
+            double value = 0.0;
+            auto state = CompiledSqlExpression::loadCell
+                (constant->constant.getAtom(), value);
+            if (state == CompiledSqlExpression::UNSUPPORTED)
+                return 0;
+            type = CompiledSqlExpression::NUMBER;
+            int dest = ++numTemporaries;
+            emit(CompiledSqlExpression::CONSTANT, dest, 0, 0, value, state);
+            return dest;
+        }
+        else if (auto arith
+                 = dynamic_cast<const ArithmeticExpression *>(&expr)) {
+            OpCode op;
+            if (arith->op == "+")
+                op = CompiledSqlExpression::ADD;
+            else if (arith->op == "-")
+                op = arith->lhs
+                    ? CompiledSqlExpression::SUBTRACT
+                    : CompiledSqlExpression::NEGATE;
+            else if (arith->op == "*")
+                op = CompiledSqlExpression::MULTIPLY;
+            else if (arith->op == "/")
+                op = CompiledSqlExpression::DIVIDE;
+            else return 0;  // modulus has integer semantics; not supported
+
+            if (!arith->lhs && op != CompiledSqlExpression::NEGATE)
+                return 0;
+            return compileOperator(op, arith->lhs.get(), *arith->rhs,
+                                   CompiledSqlExpression::NUMBER,
+                                   CompiledSqlExpression::NUMBER, type);
+        }
+        else if (auto comparison
+                 = dynamic_cast<const ComparisonExpression *>(&expr)) {
+            OpCode op;
+            if (comparison->op == "=" || comparison->op == "==")
+                op = CompiledSqlExpression::EQUAL;
+            else if (comparison->op == "!=")
+                op = CompiledSqlExpression::NOT_EQUAL;
+            else if (comparison->op == "<")
+                op = CompiledSqlExpression::LESS;
+            else if (comparison->op == "<=")
+                op = CompiledSqlExpression::LESS_EQUAL;
+            else if (comparison->op == ">")
+                op = CompiledSqlExpression::GREATER;
+            else if (comparison->op == ">=")
+                op = CompiledSqlExpression::GREATER_EQUAL;
+            else return 0;
+
+            return compileOperator(op, comparison->lhs.get(), *comparison->rhs,
+                                   CompiledSqlExpression::NUMBER,
+                                   CompiledSqlExpression::BOOLEAN, type);
+        }
+        else if (auto boolean
+                 = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+            OpCode op;
+            if (boolean->op == "AND" && boolean->lhs)
+                op = CompiledSqlExpression::AND;
+            else if (boolean->op == "OR" && boolean->lhs)
+                op = CompiledSqlExpression::OR;
+            else if (boolean->op == "NOT" && !boolean->lhs)
+                op = CompiledSqlExpression::NOT;
+            else return 0;
+
+            return compileOperator(op, boolean->lhs.get(), *boolean->rhs,
+                                   CompiledSqlExpression::BOOLEAN,
+                                   CompiledSqlExpression::BOOLEAN, type);
+        }
+
+        return 0;
+    }
+
+    /** Compile an operator whose operand(s) must have type argType, and
+        that produces a value of type resultType.  Unary operators have a
+        null lhs.
+    */
+    int compileOperator(OpCode op,
+                        const SqlExpression * lhs,
+                        const SqlExpression & rhs,
+                        Type argType, Type resultType, Type & type)
+    {
+        int lhsReg = 0;
+        if (lhs) {
+            Type lhsType;
+            lhsReg = compile(*lhs, lhsType);
+            if (lhsReg == 0 || lhsType != argType)
+                return 0;
+        }
+
+        Type rhsType;
+        int rhsReg = compile(rhs, rhsType);
+        if (rhsReg == 0 || rhsType != argType)
+            return 0;
+
+        type = resultType;
+        int dest = ++numTemporaries;
+        emit(op, dest, lhsReg, rhsReg);
+        return dest;
+    }
+
+    void emit(OpCode op, int dest, int lhs, int rhs, double constant = 0.0,
+              CompiledSqlExpression::State constantState
+                  = CompiledSqlExpression::VALUE)
+    {
+        CompiledSqlExpression::Instruction instr;
+        instr.op = op;
+        instr.dest = dest;
+        instr.lhs = lhs;
+        instr.rhs = rhs;
+        instr.constant = constant;
+        instr.constantState = constantState;
+        output.program.push_back(instr);
+    }
+
+    /// Convert a register from the numbering used during compilation
+    int renumber(int reg) const
+    {
+        if (reg < 0)
+            return -reg - 1;
+        return reg - 1 + output.inputs.size();
+    }
+};
+
+typedef CompiledSqlExpression::State State;
+
+// Arithmetic follows the CellValue operators: a null on the left gives
+// null, but a null on the right returns the left hand side unchanged.
+template<typename Op>
+void executeArithmetic(const double * lv, const State * ls,
+                       const double * rv, const State * rs,
+                       double * dv, State * ds,
+                       size_t n, Op op)
+{
+    for (size_t i = 0;  i < n;  ++i) {
+        dv[i] = op(lv[i], rv[i]);
+        ds[i] = std::max(ls[i], rs[i]);
+    }
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (ds[i] == CompiledSqlExpression::NULL_VALUE
+            && ls[i] == CompiledSqlExpression::VALUE) {
+            dv[i] = lv[i];
+            ds[i] = CompiledSqlExpression::VALUE;
+        }
+    }
+}
+
+// Comparisons follow ComparisonExpression: a null on either side gives
+// null.  NaNs and inexact integers are ordered differently by CellValue
+// than by IEEE comparisons, so they are left to the bound expression.
+template<typename Op>
+void executeComparison(const double * lv, const State * ls,
+                       const double * rv, const State * rs,
+                       double * dv, State * ds,
+                       size_t n, Op op)
+{
+    for (size_t i = 0;  i < n;  ++i) {
+        dv[i] = op(lv[i], rv[i]);
+        ds[i] = std::max(ls[i], rs[i]);
+    }
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (ds[i] != CompiledSqlExpression::VALUE)
+            continue;
+        if (!(std::abs(lv[i]) < MAX_EXACT_INTEGER)
+            || !(std::abs(rv[i]) < MAX_EXACT_INTEGER))
+            ds[i] = CompiledSqlExpression::UNSUPPORTED;
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPILED SQL EXPRESSION                                                   */
+/*****************************************************************************/
+
+std::shared_ptr<const CompiledSqlExpression>
+CompiledSqlExpression::
+compile(const SqlExpression & expr, const Utf8String & alias)
+{
+    auto result = std::make_shared<CompiledSqlExpression>();
+
+    ExpressionCompiler compiler(*result, alias);
+    Type type;
+    int reg = compiler.compile(expr, type);
+    if (reg == 0 || result->inputs.empty())
+        return nullptr;
+
+    for (auto & instr: result->program) {
+        instr.dest = compiler.renumber(instr.dest);
+        if (instr.op != CONSTANT) {
+            if (instr.op != NEGATE && instr.op != NOT)
+                instr.lhs = compiler.renumber(instr.lhs);
+            instr.rhs = compiler.renumber(instr.rhs);
+        }
+    }
+
+    result->numRegisters = result->inputs.size() + compiler.numTemporaries;
+    result->result = compiler.renumber(reg);
+    result->resultType = type;
+
+    return result;
+}
+
+CompiledSqlExpression::State
+CompiledSqlExpression::
+loadCell(const CellValue & cell, double & value)
+{
+    if (cell.empty())
+        return NULL_VALUE;
+    if (cell.isInteger()) {
+        if (!cell.isInt64())
+            return UNSUPPORTED;
+        return loadInteger(cell.toInt(), value);
+    }
+    if (cell.cellType() == CellValue::FLOAT) {
+        value = cell.toDouble();
+        return VALUE;
+    }
+    return UNSUPPORTED;
+}
+
+CompiledSqlExpression::State
+CompiledSqlExpression::
+loadInteger(int64_t val, double & value)
+{
+    value = val;
+    if (!(std::abs(value) < MAX_EXACT_INTEGER))
+        return UNSUPPORTED;
+    return VALUE;
+}
+
+void
+CompiledSqlExpression::
+initRegisters(Registers & registers, size_t batchSize) const
+{
+    registers.resize(numRegisters, batchSize);
+}
+
+void
+CompiledSqlExpression::
+execute(Registers & registers, size_t n) const
+{
+    ExcAssertLessEqual(n, registers.batchSize);
+
+    for (const Instruction & instr: program) {
+        double * dv = registers.value(instr.dest);
+        State * ds = registers.state(instr.dest);
+
+        if (instr.op == CONSTANT) {
+            std::fill(dv, dv + n, instr.constant);
+            std::fill(ds, ds + n, instr.constantState);
+            continue;
+        }
+
+        const double * rv = registers.value(instr.rhs);
+        const State * rs = registers.state(instr.rhs);
+
+        if (instr.op == NEGATE || instr.op == NOT) {
+            for (size_t i = 0;  i < n;  ++i) {
+                dv[i] = instr.op == NEGATE ? -rv[i] : !rv[i];
+                ds[i] = rs[i];
+            }
+            continue;
+        }
+
+        const double * lv = registers.value(instr.lhs);
+        const State * ls = registers.state(instr.lhs);
+
+        switch (instr.op) {
+        case ADD:
+            executeArithmetic(lv, ls, rv, rs, dv, ds, n,
+                              std::plus<double>());
+            break;
+        case SUBTRACT:
+            executeArithmetic(lv, ls, rv, rs, dv, ds, n,
+                              std::minus<double>());
+            break;
+        case MULTIPLY:
+            executeArithmetic(lv, ls, rv, rs, dv, ds, n,
+                              std::multiplies<double>());
+            break;
+        case DIVIDE:
+            executeArithmetic(lv, ls, rv, rs, dv, ds, n,
+                              std::divides<double>());
+            break;
+        case EQUAL:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::equal_to<double>());
+            break;
+        case NOT_EQUAL:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::not_equal_to<double>());
+            break;
+        case LESS:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::less<double>());
+            break;
+        case LESS_EQUAL:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::less_equal<double>());
+            break;
+        case GREATER:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::greater<double>());
+            break;
+        case GREATER_EQUAL:
+            executeComparison(lv, ls, rv, rs, dv, ds, n,
+                              std::greater_equal<double>());
+            break;
+
+        case AND:
+            // Same as BooleanOperatorExpression: false if either side is
+            // false, otherwise null if either is null, otherwise true
+            for (size_t i = 0;  i < n;  ++i) {
+                bool lfalse = ls[i] == VALUE && !lv[i];
+                bool rfalse = rs[i] == VALUE && !rv[i];
+                dv[i] = !(lfalse || rfalse);
+                ds[i] = std::max(ls[i], rs[i]);
+                if (ds[i] == NULL_VALUE && (lfalse || rfalse))
+                    ds[i] = VALUE;
+            }
+            break;
+
+        case OR:
+            // True if either side is true, otherwise null if either is
+            // null, otherwise false
+            for (size_t i = 0;  i < n;  ++i) {
+                bool ltrue = ls[i] == VALUE && lv[i];
+                bool rtrue = rs[i] == VALUE && rv[i];
+                dv[i] = ltrue || rtrue;
+                ds[i] = std::max(ls[i], rs[i]);
+                if (ds[i] == NULL_VALUE && (ltrue || rtrue))
+                    ds[i] = VALUE;
+            }
+            break;
+
+        default:
+            throw HttpReturnException(500, "Unknown compiled expression opcode");
+        }
+    }
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,157 @@
+/** compiled_expression.h                                          -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compilation of scalar SQL expressions into a flat, register based
+    program that is evaluated over a batch of rows at a time.
+*/
+
+#pragma once
+
+#include "path.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace Datacratic {
+namespace MLDB {
+
+struct SqlExpression;
+struct CellValue;
+
+
+/*****************************************************************************/
+/* COMPILED SQL EXPRESSION                                                   */
+/*****************************************************************************/
+
+/** A scalar SQL expression that has been lowered from a tree of bound
+    closures into a sequence of typed instructions.  Each register holds
+    one value per row of a batch, and each instruction loops over the
+    whole batch, so that there is one dispatch per operation per batch
+    rather than one indirect call (and one ExpressionValue) per operation
+    per row.
+
+    Only the subset of SQL that can be computed exactly over numbers is
+    supported: column reads, numeric constants, + - * / and unary minus,
+    comparisons, and AND, OR and NOT over comparisons.  The compile()
+    function returns null for anything else, in which case the caller
+    should use the bound expression instead.
+
+    Even within that subset, a value may be encountered that can't be
+    handled (for example a string in a numeric column, a NaN in a
+    comparison or an integer too big to be represented exactly as a
+    double).  The rows involved come out in the UNSUPPORTED state, and
+    the caller must evaluate the bound expression for them.
+
+    Only values are computed, not timestamps, so this is currently used
+    for filtering rows and not for producing output.
+*/
+
+struct CompiledSqlExpression {
+
+    /// Static type of the value in a register
+    enum Type {
+        NUMBER,     ///< Numeric value, stored as a double
+        BOOLEAN     ///< Boolean value, stored as 0.0 or 1.0
+    };
+
+    /// State of a value in a register for a given row
+    enum State: uint8_t {
+        VALUE = 0,       ///< Value is present
+        NULL_VALUE = 1,  ///< Value is null
+        UNSUPPORTED = 2  ///< Can't be computed; evaluate the row another way
+    };
+
+    enum OpCode {
+        CONSTANT,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        NEGATE,
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        AND,
+        OR,
+        NOT
+    };
+
+    struct Instruction {
+        OpCode op;
+        int dest;
+        int lhs;
+        int rhs;
+        double constant;
+        State constantState;
+    };
+
+    /** Storage for the registers of a program over a batch of rows.  The
+        first inputs.size() registers hold the values of the input columns,
+        and must be filled in by the caller before execute() is called.
+    */
+    struct Registers {
+        void resize(size_t numRegisters, size_t batchSize)
+        {
+            this->batchSize = batchSize;
+            values.resize(numRegisters * batchSize);
+            states.resize(numRegisters * batchSize);
+        }
+
+        double * value(int reg) { return &values[reg * batchSize]; }
+        const double * value(int reg) const { return &values[reg * batchSize]; }
+        State * state(int reg) { return &states[reg * batchSize]; }
+        const State * state(int reg) const { return &states[reg * batchSize]; }
+
+        size_t batchSize = 0;
+        std::vector<double> values;
+        std::vector<State> states;
+    };
+
+    /** Compile the given expression.  Column names are looked up with
+        the table name given in alias removed.  Returns null if the
+        expression uses anything that isn't supported, or if it doesn't
+        read any columns (in which case there is nothing to gain).
+    */
+    static std::shared_ptr<const CompiledSqlExpression>
+    compile(const SqlExpression & expr, const Utf8String & alias = "");
+
+    /** Convert a cell into a value that can be loaded into an input
+        register.  Returns the state, and sets value if it is VALUE.
+    */
+    static State loadCell(const CellValue & cell, double & value);
+
+    /** Convert an integer into a value that can be loaded into an input
+        register, checking that it can be represented exactly.
+    */
+    static State loadInteger(int64_t val, double & value);
+
+    /** Allocate the registers to execute over batches of the given size. */
+    void initRegisters(Registers & registers, size_t batchSize) const;
+
+    /** Run the program over the first n rows of the registers.  The result
+        is left in register result.
+    */
+    void execute(Registers & registers, size_t n) const;
+
+    /// Columns read by the expression, in the order of the input registers
+    std::vector<ColumnName> inputs;
+
+    /// Instructions to execute, in order
+    std::vector<Instruction> program;
+
+    /// Total number of registers, including the input registers
+    int numRegisters = 0;
+
+    /// Register holding the result
+    int result = -1;
+
+    /// Type of the result
+    Type resultType = NUMBER;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -520,9 +520,10 @@ select(const TupleExpression & tup)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-sort(OrderByExpression orderBy)
+sort(OrderByExpression orderBy, ssize_t maxRows)
 {
-    return std::make_shared<OrderByElement>(shared_from_this(), orderBy);
+    return std::make_shared<OrderByElement>(shared_from_this(), orderBy,
+                                            maxRows);
 }
 
 std::shared_ptr<PipelineElement>
@@ -534,10 +535,16 @@ partition(int numElements)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-statement(SelectStatement& stm, GetParamInfo getParamInfo)
+statement(SelectStatement& stm, GetParamInfo getParamInfo, bool applyLimit)
 {
     auto root = shared_from_this();
 
+    // Number of rows that will be taken from the output, which bounds the
+    // number of rows the final sort needs to keep
+    ssize_t maxRows = -1;
+    if (applyLimit && stm.limit != -1)
+        maxRows = stm.offset + stm.limit;
+
     bool hasGroupBy = !stm.groupBy.empty();
     std::vector< std::shared_ptr<SqlExpression> > aggregators = stm.select.findAggregators(hasGroupBy);
 
@@ -560,7 +567,7 @@ statement(SelectStatement& stm, GetParamInfo getParamInfo)
             ->partition(stm.groupBy.clauses.size())
             ->where(stm.having)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
     }
@@ -573,7 +580,7 @@ statement(SelectStatement& stm, GetParamInfo getParamInfo)
                    OrderByExpression(), getParamInfo)
             ->where(stm.where)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
         }
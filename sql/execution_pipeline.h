@@ -367,8 +367,12 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(const OrderByExpression & select);
 
+    /** Sort the rows.  If maxRows is not -1, only the first maxRows
+        rows will be taken from the output, which allows for less memory
+        and work to be used.
+    */
     std::shared_ptr<PipelineElement>
-    sort(OrderByExpression sortBy);
+    sort(OrderByExpression sortBy, ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement>
     select(const TupleExpression & tup);
@@ -385,9 +389,14 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(std::shared_ptr<SqlExpression> select);
 
-    // return a pipeline that will execute the specified statement
+    /** Return a pipeline that will execute the specified statement.  If
+        applyLimit is true, the caller promises to take no more than
+        offset + limit rows from the output (it's still the caller's job
+        to skip the offset and apply the limit).
+    */
     std::shared_ptr<PipelineElement>
-    statement(SelectStatement& statement, GetParamInfo getParamInfo);
+    statement(SelectStatement& statement, GetParamInfo getParamInfo,
+              bool applyLimit = true);
 };
 
 } // namespace MLDB
@@ -13,6 +13,10 @@
 #include "mldb/types/set_description.h"
 #include "mldb/types/tuple_description.h"
 #include "table_expression_operations.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/parallel.h"
+#include "mldb/core/dataset.h"
 #include <algorithm>
 #include "mldb/sql/sql_expression_operations.h"
 
@@ -474,7 +478,10 @@ SubSelectElement(std::shared_ptr<PipelineElement> root,
                  const Utf8String& asName) : root(root), asName(asName) {
     if (!orderBy.clauses.empty())
         stm.orderBy = orderBy;
-    pipeline = root->statement(stm, getParamInfo);
+    // The sub select doesn't apply the offset and limit, and its order may
+    // have been replaced by the one required by the outer query, so we
+    // can't restrict its sort.
+    pipeline = root->statement(stm, getParamInfo, false /* applyLimit */);
 }
 
 std::shared_ptr<BoundPipelineElement>
@@ -849,19 +856,78 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     auto leftEmbedding = std::make_shared<EmbeddingLiteralExpression>(leftclauses.clauses);
     auto rightEmbedding = std::make_shared<EmbeddingLiteralExpression>(rightclauses.clauses);
 
+    // Get the number of rows on a side of the join, if it's a dataset.  We
+    // keep the bound table so that it doesn't need to be bound again.
+    auto getRowCount = [&] (const std::shared_ptr<TableExpression> & table,
+                            BoundTableExpression & bound) -> ssize_t
+        {
+            if (table->getType() != "dataset")
+                return -1;
+            if (!bound)
+                bound = table->bind(*root->bind()->outputScope());
+            if (!bound.dataset)
+                return -1;
+            return bound.dataset->getMatrixView()->getRowCount();
+        };
+
+    strategy = MERGE_SORTED;
+    if (condition.style == AnnotatedJoinCondition::EQUIJOIN
+        && joinQualification == JOIN_INNER) {
+        ssize_t leftRows = getRowCount(left, this->boundLeft);
+        ssize_t rightRows = getRowCount(right, this->boundRight);
+        strategy = chooseStrategy(condition, joinQualification,
+                                  leftRows, rightRows);
+    }
+
+    // A hash join doesn't need either side to be sorted
+    OrderByExpression leftOrderBy, rightOrderBy;
+    if (strategy == MERGE_SORTED) {
+        leftOrderBy = condition.left.orderBy;
+        rightOrderBy = condition.right.orderBy;
+    }
+
     leftImpl= root
         ->where(constantWhere)
-        ->from(left, boundLeft, when, selectAll, leftCondition,
-               condition.left.orderBy)
+        ->from(left, this->boundLeft, when, selectAll, leftCondition,
+               leftOrderBy)
         ->select(leftEmbedding);
 
     rightImpl = root
         ->where(constantWhere)
-        ->from(right, boundRight, when, selectAll, rightCondition,
-               condition.right.orderBy)
+        ->from(right, this->boundRight, when, selectAll, rightCondition,
+               rightOrderBy)
         ->select(rightEmbedding);
 }
 
+size_t JoinElement::hashJoinMaxBuildRows = 10000000;
+size_t JoinElement::hashJoinMinProbeRows = 100000;
+double JoinElement::hashJoinMinSizeRatio = 10.0;
+
+JoinElement::EquiJoinStrategy
+JoinElement::
+chooseStrategy(const AnnotatedJoinCondition & condition,
+               JoinQualification joinQualification,
+               ssize_t leftRows, ssize_t rightRows)
+{
+    // Outer joins rely on both sides being sorted to find the rows that
+    // don't match
+    if (condition.style != AnnotatedJoinCondition::EQUIJOIN
+        || joinQualification != JOIN_INNER
+        || leftRows < 0 || rightRows < 0)
+        return MERGE_SORTED;
+
+    bool buildLeft = leftRows <= rightRows;
+    size_t buildRows = buildLeft ? leftRows : rightRows;
+    size_t probeRows = buildLeft ? rightRows : leftRows;
+
+    if (buildRows > hashJoinMaxBuildRows
+        || probeRows < hashJoinMinProbeRows
+        || probeRows < hashJoinMinSizeRatio * buildRows)
+        return MERGE_SORTED;
+
+    return buildLeft ? HASH_BUILD_LEFT : HASH_BUILD_RIGHT;
+}
+
 std::shared_ptr<BoundPipelineElement>
 JoinElement::
 bind() const
@@ -870,7 +936,8 @@ bind() const
                                    leftImpl->bind(),
                                    rightImpl->bind(),
                                    condition,
-                                   joinQualification);
+                                   joinQualification,
+                                   strategy);
 }
 
 
@@ -1254,6 +1321,172 @@ restart()
 }
 
 
+/*****************************************************************************/
+/* HASH JOIN EXECUTOR                                                        */
+/*****************************************************************************/
+
+/// Number of partitions of the hash table, which are built in parallel
+static constexpr size_t NUM_HASH_JOIN_PARTITIONS = 32;
+
+/// Number of rows taken from the probe side to be joined in parallel
+static constexpr size_t HASH_JOIN_PROBE_BATCH_SIZE = 1024;
+
+JoinElement::HashJoinExecutor::
+HashJoinExecutor(const Bound * parent,
+                 std::shared_ptr<ElementExecutor> root,
+                 std::shared_ptr<ElementExecutor> left,
+                 std::shared_ptr<ElementExecutor> right,
+                 bool buildLeft)
+    : parent(parent),
+      root(std::move(root)),
+      left(std::move(left)),
+      right(std::move(right)),
+      buildLeft(buildLeft),
+      built(false)
+{
+    ExcAssert(parent && this->root && this->left && this->right);
+}
+
+/** Return the pivot value of a row from one side of the join, or null if
+    it can't match anything.
+*/
+static ExpressionValue getJoinPivot(const PipelineResults & row)
+{
+    const ExpressionValue & embedding = row.values.back();
+    if (embedding.empty())
+        return ExpressionValue();
+    return embedding.getColumn(0, GET_ALL);
+}
+
+void
+JoinElement::HashJoinExecutor::
+buildTable()
+{
+    ElementExecutor & build = buildLeft ? *left : *right;
+
+    std::vector<std::pair<ExpressionValue, std::shared_ptr<PipelineResults> > >
+        rows;
+    std::vector<std::vector<size_t> > rowsInPartition(NUM_HASH_JOIN_PARTITIONS);
+
+    while (auto row = build.take()) {
+        ExpressionValue pivot = getJoinPivot(*row);
+        // Nulls never match anything in an inner join
+        if (pivot.empty())
+            continue;
+        size_t partition = pivot.hash() % NUM_HASH_JOIN_PARTITIONS;
+        rowsInPartition[partition].push_back(rows.size());
+        rows.emplace_back(std::move(pivot), std::move(row));
+    }
+
+    partitions.clear();
+    partitions.resize(NUM_HASH_JOIN_PARTITIONS);
+
+    auto buildPartition = [&] (size_t partition)
+        {
+            Partition & table = partitions[partition];
+            for (size_t i: rowsInPartition[partition]) {
+                table[rows[i].first].emplace_back(std::move(rows[i].second));
+            }
+        };
+
+    parallelMap(0, NUM_HASH_JOIN_PARTITIONS, buildPartition);
+
+    built = true;
+}
+
+bool
+JoinElement::HashJoinExecutor::
+probeBatch()
+{
+    ElementExecutor & probe = buildLeft ? *right : *left;
+
+    std::vector<std::shared_ptr<PipelineResults> > batch;
+    batch.reserve(HASH_JOIN_PROBE_BATCH_SIZE);
+    while (batch.size() < HASH_JOIN_PROBE_BATCH_SIZE) {
+        auto row = probe.take();
+        if (!row)
+            break;
+        batch.emplace_back(std::move(row));
+    }
+
+    if (batch.empty())
+        return false;
+
+    // Joined rows for each probe row, in the order of the build side
+    std::vector<std::vector<std::shared_ptr<PipelineResults> > >
+        joined(batch.size());
+
+    auto doRow = [&] (size_t n)
+        {
+            const PipelineResults & probeRow = *batch[n];
+            ExpressionValue pivot = getJoinPivot(probeRow);
+            if (pivot.empty())
+                return;
+
+            const Partition & table
+                = partitions[pivot.hash() % NUM_HASH_JOIN_PARTITIONS];
+            auto it = table.find(pivot);
+            if (it == table.end())
+                return;
+
+            for (auto & buildRow: it->second) {
+                const PipelineResults & l = buildLeft ? *buildRow : probeRow;
+                const PipelineResults & r = buildLeft ? probeRow : *buildRow;
+
+                // The output is the left row followed by the right row, each
+                // without the selected join condition
+                auto result = std::make_shared<PipelineResults>(l);
+                result->values.pop_back();
+                result->values.insert(result->values.end(),
+                                      r.values.begin(), r.values.end() - 1);
+
+                ExpressionValue storage;
+                if (!parent->crossWhere_(*result, storage, GET_LATEST).isTrue())
+                    continue;
+
+                joined[n].emplace_back(std::move(result));
+            }
+        };
+
+    parallelMap(0, batch.size(), doRow);
+
+    for (auto & rows: joined) {
+        for (auto & row: rows)
+            ready.emplace_back(std::move(row));
+    }
+
+    return true;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+take()
+{
+    if (!built)
+        buildTable();
+
+    while (ready.empty()) {
+        if (!probeBatch())
+            return nullptr;
+    }
+
+    auto result = std::move(ready.front());
+    ready.pop_front();
+    return result;
+}
+
+void
+JoinElement::HashJoinExecutor::
+restart()
+{
+    left->restart();
+    right->restart();
+    partitions.clear();
+    ready.clear();
+    built = false;
+}
+
+
 /*****************************************************************************/
 /* BOUND JOIN EXECUTOR                                                       */
 /*****************************************************************************/
@@ -1263,14 +1496,16 @@ Bound(std::shared_ptr<BoundPipelineElement> root,
       std::shared_ptr<BoundPipelineElement> left,
       std::shared_ptr<BoundPipelineElement> right,
       AnnotatedJoinCondition condition,
-      JoinQualification joinQualification)
+      JoinQualification joinQualification,
+      EquiJoinStrategy strategy)
     : root_(std::move(root)),
       left_(std::move(left)),
       right_(std::move(right)),
       outputScope_(createOutputScope()),
       crossWhere_(condition.crossWhere->bind(*outputScope_)),
       condition_(std::move(condition)),
-      joinQualification_(joinQualification)
+      joinQualification_(joinQualification),
+      strategy_(strategy)
 {
 }
 
@@ -1320,6 +1555,14 @@ start(const BoundParameters & getParam) const
              right_->start(getParam));
 
     case AnnotatedJoinCondition::EQUIJOIN:
+        if (strategy_ != MERGE_SORTED) {
+            return std::make_shared<HashJoinExecutor>
+                (this,
+                 root_->start(getParam),
+                 left_->start(getParam),
+                 right_->start(getParam),
+                 strategy_ == HASH_BUILD_LEFT);
+        }
         return std::make_shared<EquiJoinExecutor>
             (this,
              root_->start(getParam),
@@ -1777,8 +2020,9 @@ outputScope() const
 
 OrderByElement::
 OrderByElement(std::shared_ptr<PipelineElement> source,
-               OrderByExpression orderBy)
-    : source(source), orderBy(orderBy)
+               OrderByExpression orderBy,
+               ssize_t maxRows)
+    : source(source), orderBy(orderBy), maxRows(maxRows)
 {
 }
 
@@ -1786,7 +2030,7 @@ std::shared_ptr<BoundPipelineElement>
 OrderByElement::
 bind() const
 {
-    return std::make_shared<Bound>(source->bind(), orderBy);
+    return std::make_shared<Bound>(source->bind(), orderBy, maxRows);
 }
 
 
@@ -1794,6 +2038,10 @@ bind() const
 /* ORDER BY ELEMENT EXECUTOR                                                 */
 /*****************************************************************************/
 
+/// Minimum number of rows for each run of a parallel sort; below this a
+/// single threaded sort is faster
+static constexpr size_t MIN_ROWS_PER_SORT_RUN = 10000;
+
 OrderByElement::Executor::
 Executor(const Bound * parent,
          std::shared_ptr<ElementExecutor> source)
@@ -1810,15 +2058,6 @@ take()
     // from the input, sort it, and get it ready to serve up as results
     // of the query.
     if (numDone == -1) {
-        // Get and sort the input
-
-        while (true) {
-            std::shared_ptr<PipelineResults> input = source->take();
-            if (!input)
-                break;
-            sorted.emplace_back(std::move(input));
-        }
-
         // We assume that the fields to sort on are at the end of the
         // list of fields.
         int offset
@@ -1833,7 +2072,66 @@ take()
                                              offset);
             };
 
-        std::sort(sorted.begin(), sorted.end(), compare);
+        ssize_t maxRows = parent->maxRows_;
+
+        if (maxRows != -1) {
+            // Only the first maxRows rows will be taken, so we keep those
+            // in a heap with the greatest at the top, and throw away
+            // anything that sorts after it.  Memory is O(maxRows) rather
+            // than the size of the input.  maxRows comes from the query's
+            // OFFSET and LIMIT, so the heap grows as rows arrive rather
+            // than being reserved up front.
+            while (true) {
+                std::shared_ptr<PipelineResults> input = source->take();
+                if (!input)
+                    break;
+                if ((ssize_t)sorted.size() < maxRows) {
+                    sorted.emplace_back(std::move(input));
+                    std::push_heap(sorted.begin(), sorted.end(), compare);
+                }
+                else if (maxRows > 0 && compare(input, sorted.front())) {
+                    std::pop_heap(sorted.begin(), sorted.end(), compare);
+                    sorted.back() = std::move(input);
+                    std::push_heap(sorted.begin(), sorted.end(), compare);
+                }
+            }
+
+            std::sort_heap(sorted.begin(), sorted.end(), compare);
+        }
+        else {
+            while (true) {
+                std::shared_ptr<PipelineResults> input = source->take();
+                if (!input)
+                    break;
+                sorted.emplace_back(std::move(input));
+            }
+
+            // Split into one run per core, which are sorted in parallel
+            // and then merged together
+            size_t numRuns
+                = std::min<size_t>(numCpus(),
+                                   sorted.size() / MIN_ROWS_PER_SORT_RUN);
+
+            if (numRuns > 1) {
+                typedef std::vector<std::shared_ptr<PipelineResults> > Run;
+                std::vector<std::shared_ptr<Run> > runs;
+                size_t runSize = (sorted.size() + numRuns - 1) / numRuns;
+                for (size_t i = 0;  i < sorted.size();  i += runSize) {
+                    auto start = sorted.begin() + i;
+                    auto end = sorted.begin()
+                        + std::min(i + runSize, sorted.size());
+                    runs.emplace_back(std::make_shared<Run>
+                                      (std::make_move_iterator(start),
+                                       std::make_move_iterator(end)));
+                }
+
+                sorted = parallelMergeSort(runs, compare,
+                                           MIN_ROWS_PER_SORT_RUN);
+            }
+            else {
+                std::sort(sorted.begin(), sorted.end(), compare);
+            }
+        }
                 
         numDone = 0;
     }
@@ -1863,10 +2161,12 @@ restart()
 
 OrderByElement::Bound::
 Bound(std::shared_ptr<BoundPipelineElement> source,
-      const OrderByExpression & orderBy)
+      const OrderByExpression & orderBy,
+      ssize_t maxRows)
     : source_(std::move(source)),
       scope_(source_->outputScope()),
-      orderBy_(orderBy.bindAll(*scope_))
+      orderBy_(orderBy.bindAll(*scope_)),
+      maxRows_(maxRows)
 {
     ExcAssert(scope_->inLexicalScope());
 }
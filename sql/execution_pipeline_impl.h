@@ -9,6 +9,8 @@
 
 #include "execution_pipeline.h"
 #include "join_utils.h"
+#include <unordered_map>
+#include <deque>
 
 namespace Datacratic {
 namespace MLDB {
@@ -317,6 +319,33 @@ struct JoinElement: public PipelineElement {
     std::shared_ptr<PipelineElement> leftImpl;
     std::shared_ptr<PipelineElement> rightImpl;
 
+    /** How an equijoin is executed. */
+    enum EquiJoinStrategy {
+        MERGE_SORTED,       ///< Sort both sides on the pivot and merge them
+        HASH_BUILD_LEFT,    ///< Load the left side into a hash table
+        HASH_BUILD_RIGHT    ///< Load the right side into a hash table
+    };
+
+    EquiJoinStrategy strategy;
+
+    /** An inner equijoin uses a hash join when the smaller side has at most
+        hashJoinMaxBuildRows rows, and the larger side has at least
+        hashJoinMinProbeRows rows and hashJoinMinSizeRatio times as many
+        rows as the smaller one.  Both sides must be datasets so that their
+        row counts are known.
+    */
+    static size_t hashJoinMaxBuildRows;
+    static size_t hashJoinMinProbeRows;
+    static double hashJoinMinSizeRatio;
+
+    /** Choose the strategy for the join, from the number of rows on each
+        side (-1 if unknown).
+    */
+    static EquiJoinStrategy
+    chooseStrategy(const AnnotatedJoinCondition & condition,
+                   JoinQualification joinQualification,
+                   ssize_t leftRows, ssize_t rightRows);
+
     struct Bound;
 
     /** Execution runs over all left rows for each right row.  The complexity is
@@ -366,6 +395,53 @@ struct JoinElement: public PipelineElement {
         virtual void restart();
     };
 
+    /** Execution loads the rows of the smaller side into a hash table on
+        the pivot value, and then streams the rows of the larger side,
+        looking each of them up in the table.  Neither side needs to be
+        sorted, so the complexity is O(left rows + right rows + output
+        rows).  This is only used for inner joins.  The canonical example
+        is joining a large fact table to a small dimension table, as in
+        `SELECT * FROM facts JOIN dims ON facts.dimId = dims.id`.
+
+        The table is partitioned on the hash of the pivot so that it can be
+        built in parallel, and the larger side is looked up in parallel in
+        batches.  Rows are output in the order of the larger side.
+    */
+    struct HashJoinExecutor: public ElementExecutor {
+        HashJoinExecutor(const Bound * parent,
+                         std::shared_ptr<ElementExecutor> root,
+                         std::shared_ptr<ElementExecutor> left,
+                         std::shared_ptr<ElementExecutor> right,
+                         bool buildLeft);
+
+        const Bound * parent;
+        std::shared_ptr<ElementExecutor> root, left, right;
+
+        /// Is the left side the one loaded into the hash table?
+        bool buildLeft;
+
+        /// Rows of the build side for each pivot value, in each partition
+        typedef std::unordered_map<ExpressionValue,
+                                   std::vector<std::shared_ptr<PipelineResults> > >
+            Partition;
+        std::vector<Partition> partitions;
+        bool built;
+
+        /// Joined rows that are ready to be returned
+        std::deque<std::shared_ptr<PipelineResults> > ready;
+
+        void buildTable();
+
+        /** Take a batch of rows from the probe side and join them, adding
+            the result to ready.  Returns false when there are no more.
+        */
+        bool probeBatch();
+
+        virtual std::shared_ptr<PipelineResults> take();
+
+        virtual void restart();
+    };
+
     struct Bound: public BoundPipelineElement {
 
         /** Bind this in.  The main difficulty is with the output scope, which
@@ -376,7 +452,8 @@ struct JoinElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> left,
               std::shared_ptr<BoundPipelineElement> right,
               AnnotatedJoinCondition condition,
-              JoinQualification joinQualification);
+              JoinQualification joinQualification,
+              EquiJoinStrategy strategy);
 
         std::shared_ptr<BoundPipelineElement> root_;
         std::shared_ptr<BoundPipelineElement> left_;
@@ -385,6 +462,7 @@ struct JoinElement: public PipelineElement {
         BoundSqlExpression crossWhere_;
         AnnotatedJoinCondition condition_;
         JoinQualification joinQualification_;
+        EquiJoinStrategy strategy_;
 
         /** Our output scope has:
             - The left and right tables
@@ -597,14 +675,20 @@ struct SelectElement: public PipelineElement {
 
 /** Implements an order by clause, by taking all of the elements and sorting
     them in-memory.
+
+    If maxRows is not -1, then only the first maxRows rows will ever be
+    taken (for example, because the query has a LIMIT), and only those are
+    kept while the input is read.
 */
 
 struct OrderByElement: public PipelineElement {
     OrderByElement(std::shared_ptr<PipelineElement> source,
-                   OrderByExpression orderBy);
+                   OrderByExpression orderBy,
+                   ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement> source;
     OrderByExpression orderBy;
+    ssize_t maxRows;
 
     struct Bound;
 
@@ -627,11 +711,13 @@ struct OrderByElement: public PipelineElement {
     struct Bound: public BoundPipelineElement {
 
         Bound(std::shared_ptr<BoundPipelineElement> source,
-              const OrderByExpression & orderBy);
+              const OrderByExpression & orderBy,
+              ssize_t maxRows);
 
         std::shared_ptr<BoundPipelineElement> source_;
         std::shared_ptr<PipelineExpressionScope> scope_;
         BoundOrderByExpression orderBy_;
+        ssize_t maxRows_;
         
         std::shared_ptr<ElementExecutor>
         start(const BoundParameters & getParam) const;
@@ -0,0 +1,162 @@
+/** path_intern_table.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Table of interned paths.
+*/
+
+#include "path_intern_table.h"
+#include "mldb/arch/exception.h"
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PATH INTERN TABLE                                                         */
+/*****************************************************************************/
+
+constexpr uint32_t PathInternTable::NOT_FOUND;
+
+PathInternTable::
+PathInternTable()
+    : numEntries(0)
+{
+    for (auto & b: blocks)
+        b = nullptr;
+    allSlots.emplace_back(new Slots(1024));
+    slots = allSlots.back().get();
+}
+
+PathInternTable::
+~PathInternTable()
+{
+    for (auto & b: blocks)
+        delete[] b.load();
+}
+
+const std::shared_ptr<PathInternTable> &
+PathInternTable::
+global()
+{
+    // Never destroyed, so that ids stay valid during static destruction
+    static auto * result
+        = new std::shared_ptr<PathInternTable>(new PathInternTable());
+    return *result;
+}
+
+uint32_t
+PathInternTable::
+findImpl(const Slots & slots, const Path & path, uint64_t newHash) const
+{
+    for (size_t i = newHash & slots.mask;  ;  i = (i + 1) & slots.mask) {
+        uint32_t val = slots.slots[i].load(std::memory_order_acquire);
+        if (val == 0)
+            return NOT_FOUND;
+        const Entry & entry = getEntry(val - 1);
+        if (entry.newHash == newHash && entry.path == path)
+            return val - 1;
+    }
+}
+
+uint32_t
+PathInternTable::
+find(const Path & path) const
+{
+    return findImpl(*slots.load(std::memory_order_acquire), path,
+                    path.newHash());
+}
+
+void
+PathInternTable::
+insertSlot(Slots & slots, uint32_t id, uint64_t newHash)
+{
+    for (size_t i = newHash & slots.mask;  ;  i = (i + 1) & slots.mask) {
+        if (slots.slots[i].load(std::memory_order_relaxed) == 0) {
+            slots.slots[i].store(id + 1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+uint32_t
+PathInternTable::
+intern(const Path & path)
+{
+    uint64_t newHash = path.newHash();
+
+    uint32_t result = findImpl(*slots.load(std::memory_order_acquire),
+                               path, newHash);
+    if (result != NOT_FOUND)
+        return result;
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // Someone else may have added it while we were waiting for the lock
+    Slots * current = slots.load(std::memory_order_relaxed);
+    result = findImpl(*current, path, newHash);
+    if (result != NOT_FOUND)
+        return result;
+
+    uint32_t id = numEntries.load(std::memory_order_relaxed);
+    if (id == NOT_FOUND - 1)
+        throw ML::Exception("Path intern table is full");
+
+    uint32_t n = id + MIN_BLOCK_SIZE;
+    int bit = 31 - __builtin_clz(n);
+    Entry * block = blocks[bit - MIN_BLOCK_BITS].load(std::memory_order_relaxed);
+    if (!block) {
+        block = new Entry[1U << bit];
+        blocks[bit - MIN_BLOCK_BITS].store(block, std::memory_order_release);
+    }
+
+    Entry & entry = block[n - (1U << bit)];
+    entry.path = path;
+    entry.hash = path.hash();
+    entry.newHash = newHash;
+
+    // Keep the table at most half full, so that probe sequences are short
+    if ((id + 1) * 2 > current->mask + 1) {
+        std::unique_ptr<Slots> newSlots(new Slots((current->mask + 1) * 2));
+        for (uint32_t i = 0;  i < id;  ++i)
+            insertSlot(*newSlots, i, getEntry(i).newHash);
+        allSlots.emplace_back(std::move(newSlots));
+        current = allSlots.back().get();
+    }
+
+    // Publish the entry before the slot that points to it, then the table
+    numEntries.store(id + 1, std::memory_order_release);
+    insertSlot(*current, id, newHash);
+    slots.store(current, std::memory_order_release);
+
+    return id;
+}
+
+size_t
+PathInternTable::
+memusage() const
+{
+    size_t result = sizeof(*this);
+
+    size_t n = size();
+    for (size_t i = 0;  i < NUM_BLOCKS;  ++i) {
+        if (!blocks[i].load(std::memory_order_acquire))
+            break;
+        result += (MIN_BLOCK_SIZE << i) * sizeof(Entry);
+    }
+
+    for (size_t i = 0;  i < n;  ++i)
+        result += getPath(i).memusage() - sizeof(Path);
+
+    Slots * current = slots.load(std::memory_order_acquire);
+    result += (current->mask + 1) * sizeof(uint32_t);
+
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
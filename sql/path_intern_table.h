@@ -0,0 +1,154 @@
+/** path_intern_table.h                                            -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Table of interned paths.
+*/
+
+#pragma once
+
+#include "path.h"
+#include "mldb/base/exc_assert.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PATH INTERN TABLE                                                         */
+/*****************************************************************************/
+
+/** Table that maps paths (normally column names) onto compact integer ids,
+    and caches their hashes.  Storing the id instead of the path saves
+    memory where the same name is stored many times (for example, once
+    per chunk of a dataset), and looking up the hash of an id is much
+    cheaper than recalculating it.
+
+    Ids are allocated densely from zero and never reused; a path, once
+    interned, stays in the table for the lifetime of the table.  So it
+    should be used for things like column names that have a bounded
+    cardinality, not for row names, and normally owned by the structure
+    whose names it holds (for example, a dataset) so that it's freed with
+    it.  Structures that opt in can instead use the table returned by
+    global(), so that ids are comparable between them and names they have
+    in common are stored once, at the cost of never being freed.
+
+    Looking up a path or id never takes a lock.  Interning a new path
+    takes a lock that is held only long enough to insert it.
+*/
+
+struct PathInternTable {
+    PathInternTable();
+    ~PathInternTable();
+
+    PathInternTable(const PathInternTable & other) = delete;
+    void operator = (const PathInternTable & other) = delete;
+
+    /// Value returned by find() for paths that are not in the table
+    static constexpr uint32_t NOT_FOUND = (uint32_t)-1;
+
+    /// Return the table shared by the whole process.  It's never destroyed.
+    static const std::shared_ptr<PathInternTable> & global();
+
+    /** Return the id of the given path, adding it to the table if it's not
+        already there.
+    */
+    uint32_t intern(const Path & path);
+
+    /** Return the id of the given path, or NOT_FOUND if it has never been
+        interned.
+    */
+    uint32_t find(const Path & path) const;
+
+    /// Return the path with the given id
+    const Path & getPath(uint32_t id) const
+    {
+        return getEntry(id).path;
+    }
+
+    /// Return the cached value of getPath(id).hash()
+    uint64_t getHash(uint32_t id) const
+    {
+        return getEntry(id).hash;
+    }
+
+    /// Return the cached value of getPath(id).newHash()
+    uint64_t getNewHash(uint32_t id) const
+    {
+        return getEntry(id).newHash;
+    }
+
+    /// Return the number of paths that have been interned
+    size_t size() const
+    {
+        return numEntries.load(std::memory_order_acquire);
+    }
+
+    /// Return the memory used by the table, including the paths
+    size_t memusage() const;
+
+private:
+    struct Entry {
+        Path path;
+        uint64_t hash;
+        uint64_t newHash;
+    };
+
+    /// Entries are stored in blocks of doubling size, so that they never
+    /// move once they are created and reading them needs no lock.  Block
+    /// n holds MIN_BLOCK_SIZE << n entries.
+    static constexpr unsigned MIN_BLOCK_BITS = 10;
+    static constexpr unsigned MIN_BLOCK_SIZE = 1 << MIN_BLOCK_BITS;
+    static constexpr unsigned NUM_BLOCKS = 32 - MIN_BLOCK_BITS;
+
+    std::atomic<Entry *> blocks[NUM_BLOCKS];
+
+    const Entry & getEntry(uint32_t id) const
+    {
+        ExcAssertLess(id, size());
+        uint32_t n = id + MIN_BLOCK_SIZE;
+        int bit = 31 - __builtin_clz(n);
+        return blocks[bit - MIN_BLOCK_BITS].load(std::memory_order_acquire)
+            [n - (1U << bit)];
+    }
+
+    /** Open addressed hash table from newHash to id + 1, with zero for an
+        empty slot.  When it needs to grow, it's copied into a new table
+        that replaces it; the old one is kept until the intern table is
+        destroyed as a concurrent lookup may still be reading it.
+    */
+    struct Slots {
+        Slots(size_t capacity)
+            : mask(capacity - 1), slots(new std::atomic<uint32_t>[capacity])
+        {
+            for (size_t i = 0;  i < capacity;  ++i)
+                slots[i] = 0;
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    };
+
+    std::atomic<Slots *> slots;
+
+    /// All slot tables ever allocated, including the current one
+    std::vector<std::unique_ptr<Slots> > allSlots;
+
+    /// Number of entries that are readable
+    std::atomic<uint32_t> numEntries;
+
+    /// Serializes insertions
+    std::mutex mutex;
+
+    uint32_t findImpl(const Slots & slots, const Path & path,
+                      uint64_t newHash) const;
+    void insertSlot(Slots & slots, uint32_t id, uint64_t newHash);
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -17,16 +17,22 @@ SQL_EXPRESSION_SOURCES := \
 	execution_pipeline.cc \
 	execution_pipeline_impl.cc \
 	sql_utils.cc \
+	sql_regex.cc \
 	path.cc \
+	path_intern_table.cc \
 	dataset_types.cc \
 	sql_expression_operations.cc \
+	compiled_expression.cc \
 
 # Unfortunately the S2 library needs you to mess with the include path as its includes
 # aren't prefixed.
 $(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
 
+# RE2's headers include each other relative to the root of its tree
+$(eval $(call set_compile_option,sql_regex.cc,-Imldb/ext/re2))
+
 # NOTE: the SQL library should NOT depend on MLDB.  See the comment in testing/testing.mk
-$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),types utils value_description any ml json_diff highwayhash hash s2 edlib))
+$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),types utils value_description any ml json_diff highwayhash hash s2 edlib re2))
 
 $(eval $(call include_sub_make,sql_testing,testing,sql_testing.mk))
 
@@ -114,6 +114,21 @@ BoundSqlExpression(ExecFunction exec,
 {
 }
 
+std::vector<ExpressionValue>
+BoundSqlExpression::
+applyBatch(const std::vector<const SqlRowScope *> & rows,
+           const VariableFilter & filter) const
+{
+    if (execBatch)
+        return execBatch(rows, filter);
+
+    std::vector<ExpressionValue> result;
+    result.reserve(rows.size());
+    for (auto & r: rows)
+        result.emplace_back((*this)(*r, filter));
+    return result;
+}
+
 ExpressionValue
 BoundSqlExpression::
 constantValue() const
@@ -3106,7 +3121,38 @@ bind(SqlBindingScope & context) const
             return storage = std::move(ExpressionValue(std::move(result)));
         };
 
-    return BoundSqlExpression(exec, this, outputInfo, isConstant);
+    BoundSqlExpression bound(exec, this, outputInfo, isConstant);
+
+    bool anyBatch = false;
+    for (auto & c: boundClauses)
+        anyBatch = anyBatch || c.execBatch;
+
+    if (anyBatch) {
+        // Run each clause over the whole batch, so that those that can
+        // process a batch at once get to do so
+        bound.execBatch = [=] (const std::vector<const SqlRowScope *> & rows,
+                               const VariableFilter & filter)
+            {
+                std::vector<StructValue> results(rows.size());
+                for (auto & r: results)
+                    r.reserve(boundClauses.size());
+
+                for (auto & c: boundClauses) {
+                    std::vector<ExpressionValue> vals
+                        = c.applyBatch(rows, filter);
+                    for (size_t i = 0;  i < rows.size();  ++i)
+                        vals[i].mergeToRowDestructive(results[i]);
+                }
+
+                std::vector<ExpressionValue> output;
+                output.reserve(rows.size());
+                for (auto & r: results)
+                    output.emplace_back(std::move(r));
+                return output;
+            };
+    }
+
+    return bound;
 }
 
 Utf8String
@@ -166,7 +166,18 @@ struct BoundSqlExpression {
     
     operator bool () const { return !!exec; };
 
+    /** Function type to execute the expression over a batch of rows at
+        once, returning one value per row.  This is optional; it's provided
+        by expressions (such as calls to user functions) that can amortize
+        their per-call overhead over a batch, and by those that contain
+        them.
+    */
+    typedef std::function<std::vector<ExpressionValue>
+                          (const std::vector<const SqlRowScope *> & rows,
+                           const VariableFilter & filter)> ExecBatchFunction;
+
     ExecFunction exec;
+    ExecBatchFunction execBatch;
     std::shared_ptr<const SqlExpression> expr;
 
     /// What kind of value does this return?
@@ -199,6 +210,13 @@ struct BoundSqlExpression {
         return res;
     }
 
+    /** Execute the expression over each of the given rows.  This uses
+        execBatch if there is one, or otherwise calls exec on each row.
+    */
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<const SqlRowScope *> & rows,
+               const VariableFilter & filter) const;
+
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
@@ -334,7 +352,18 @@ struct BoundFunction {
 
     operator bool () const { return !!exec; }
 
+    /** Optional version of exec that is called with the arguments for a
+        batch of rows at once, for functions that are more efficient when
+        they process several rows together.  The arguments may be moved
+        from.
+    */
+    typedef std::function<std::vector<ExpressionValue>
+                          (std::vector<std::vector<ExpressionValue> > & args,
+                           const std::vector<const SqlRowScope *> & rows)>
+        ExecBatch;
+
     Exec exec;
+    ExecBatch execBatch;
     std::shared_ptr<ExpressionValueInfo> resultInfo;
     VariableFilter filter; // allows function to filter variable as they need
 
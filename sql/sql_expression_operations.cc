@@ -16,6 +16,7 @@
 #include "mldb/server/dataset_context.h"
 #include "mldb/base/scope.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/sql_regex.h"
 #include "mldb/jml/stats/distribution.h"
 
 using namespace std;
@@ -2257,9 +2258,10 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 fn.resultInfo};
     }
     else {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            {[=] (const SqlRowScope & row,
+                  ExpressionValue & storage,
+                  const VariableFilter & filter) -> const ExpressionValue &
                 {
                     std::vector<ExpressionValue> evaluatedArgs;
                     evaluatedArgs.reserve(boundArgs.size());
@@ -2270,6 +2272,40 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 },
                 this,
                 fn.resultInfo};
+
+        bool anyArgBatch = false;
+        for (auto & a: boundArgs)
+            anyArgBatch = anyArgBatch || a.execBatch;
+
+        if (fn.execBatch || anyArgBatch) {
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter & filter)
+                {
+                    std::vector<std::vector<ExpressionValue> >
+                        evaluatedArgs(rows.size());
+                    for (auto & args: evaluatedArgs)
+                        args.reserve(boundArgs.size());
+
+                    for (auto & a: boundArgs) {
+                        std::vector<ExpressionValue> vals
+                            = a.applyBatch(rows, fn.filter);
+                        for (size_t i = 0;  i < rows.size();  ++i)
+                            evaluatedArgs[i].emplace_back(std::move(vals[i]));
+                    }
+
+                    if (fn.execBatch)
+                        return fn.execBatch(evaluatedArgs, rows);
+
+                    std::vector<ExpressionValue> output;
+                    output.reserve(rows.size());
+                    for (size_t i = 0;  i < rows.size();  ++i)
+                        output.emplace_back(fn(evaluatedArgs[i], *rows[i]));
+                    return output;
+                };
+        }
+
+        return result;
     }
 }
 
@@ -2391,10 +2427,11 @@ bind(SqlBindingScope & outerScope) const
 
     BoundSqlExpression extractBound = extract->bind(extractScope);
 
-    return {[=] (const SqlRowScope & row,		
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
-            {		
+    BoundSqlExpression result
+        {[=] (const SqlRowScope & row,
+              ExpressionValue & storage,
+              const VariableFilter & filter) -> const ExpressionValue &
+            {
                 ExpressionValue storage2;
                 const ExpressionValue & fromOutput
                     = fromBound(row, storage2, filter);
@@ -2403,8 +2440,30 @@ bind(SqlBindingScope & outerScope) const
 
                 return extractBound(extractRowScope, storage, filter);
             },
-            this,		
+            this,
             extractBound.info};
+
+    if (fromBound.execBatch) {
+        // Extract from each of the batch of outputs
+        result.execBatch
+            = [=] (const std::vector<const SqlRowScope *> & rows,
+                   const VariableFilter & filter)
+            {
+                std::vector<ExpressionValue> fromOutputs
+                    = fromBound.applyBatch(rows, filter);
+
+                std::vector<ExpressionValue> output;
+                output.reserve(rows.size());
+                for (auto & fromOutput: fromOutputs) {
+                    auto extractRowScope
+                        = extractScope.getRowScope(fromOutput);
+                    output.emplace_back(extractBound(extractRowScope, filter));
+                }
+                return output;
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -3109,6 +3168,14 @@ bind(SqlBindingScope & scope) const
     BoundSqlExpression boundLeft  = left->bind(scope);
     BoundSqlExpression boundRight  = right->bind(scope);
 
+    // Compile the pattern once if it's a constant string
+    std::shared_ptr<const SqlLikeMatcher> precompiled;
+    if (boundRight.metadata.isConstant
+        && boundRight.constantValue().isString()) {
+        precompiled = std::make_shared<SqlLikeMatcher>
+            (boundRight.constantValue().toUtf8String());
+    }
+
     return {[=] (const SqlRowScope & rowScope,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
@@ -3132,9 +3199,12 @@ bind(SqlBindingScope & scope) const
                         "hand value to be a string, got " + filterEV.getTypeAsString());
 
             Utf8String valueString = value.toUtf8String();
-            Utf8String filterString = filterEV.toUtf8String();
 
-            bool matched = matchSqlFilter(valueString, filterString);
+            bool matched;
+            if (precompiled)
+                matched = (*precompiled)(valueString);
+            else matched = matchSqlFilter(valueString,
+                                          filterEV.toUtf8String());
 
             return storage = std::move(ExpressionValue(matched != isnegative,
                                         std::max(value.getEffectiveTimestamp(),
@@ -3625,6 +3695,26 @@ bind(SqlBindingScope & scope) const
             };
 
         BoundSqlExpression result(exec, this, info);
+
+        if (exprBound.execBatch) {
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter & filter)
+                {
+                    std::vector<ExpressionValue> vals
+                        = exprBound.applyBatch(rows, filter);
+                    for (auto & val: vals) {
+                        if (val.isAtom())
+                            throw HttpReturnException
+                                (400, "Expression with AS * must return a row",
+                                 "valueReturned", val,
+                                 "ast", print(),
+                                 "surface", surface);
+                    }
+                    return vals;
+                };
+        }
+
         return result;
     }
     else {
@@ -3667,7 +3757,29 @@ bind(SqlBindingScope & scope) const
         
         auto info = std::make_shared<RowValueInfo>(knownColumns, SCHEMA_CLOSED);
 
-        return BoundSqlExpression(exec, this, info);
+        BoundSqlExpression result(exec, this, info);
+
+        if (exprBound.execBatch) {
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter & filter)
+                {
+                    std::vector<ExpressionValue> vals
+                        = exprBound.applyBatch(rows, filter);
+
+                    // Nest each value within the structure of the alias
+                    for (auto & val: vals) {
+                        for (ssize_t i = alias.size() - 1;  i >= 0;  --i) {
+                            StructValue row;
+                            row.emplace_back(alias[i], std::move(val));
+                            val = std::move(row);
+                        }
+                    }
+                    return vals;
+                };
+        }
+
+        return result;
     }
 }
 
@@ -0,0 +1,433 @@
+/** sql_regex.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Regular expression and LIKE pattern matching for SQL.
+*/
+
+#include "sql_regex.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "re2/re2.h"
+
+#include <boost/regex.hpp>    //These have defines that conflits with some of our own, so we can't put regex stuff just anywhere.
+#include <boost/regex/icu.hpp>
+
+#include <cstring>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* REGEX ENGINE                                                              */
+/*****************************************************************************/
+
+RegexEngine parseRegexEngine(const Utf8String & name)
+{
+    if (name == "auto")
+        return REGEX_AUTO;
+    else if (name == "re2")
+        return REGEX_RE2;
+    else if (name == "boost")
+        return REGEX_BOOST;
+    throw HttpReturnException(400, "Unknown regex engine '" + name
+                              + "': must be 'auto', 're2' or 'boost'",
+                              "engine", name);
+}
+
+
+/*****************************************************************************/
+/* SQL REGEX                                                                 */
+/*****************************************************************************/
+
+namespace {
+
+/// Characters that are special anywhere in a Perl regex
+bool isRegexMetaChar(char c)
+{
+    return strchr("\\^$.|?*+()[]{}", c) && c != 0;
+}
+
+/// Return the number of bytes of the literal string that any match of
+/// the regex must start with.
+size_t getLiteralPrefixLength(const std::string & pattern)
+{
+    // An alternation anywhere may not require the prefix
+    if (pattern.find('|') != std::string::npos)
+        return 0;
+
+    size_t len = 0;
+    while (len < pattern.size() && !isRegexMetaChar(pattern[len]))
+        ++len;
+
+    // If the character after the prefix makes the last (UTF-8) character
+    // optional, it's not part of the prefix
+    if (len < pattern.size() && len > 0
+        && strchr("?*{", pattern[len])) {
+        --len;
+        while (len > 0 && (pattern[len] & 0xc0) == 0x80)
+            --len;
+    }
+
+    return len;
+}
+
+/// Does the regex use the Perl or POSIX character classes (\w, \d, \s,
+/// \b and [:alpha:] and friends), which RE2 only supports for ASCII
+/// characters?
+bool usesAsciiOnlyClasses(const std::string & pattern)
+{
+    for (size_t i = 0;  i + 1 < pattern.size();  ++i) {
+        if (pattern[i] == '\\') {
+            if (strchr("wWdDsSbB", pattern[i + 1]))
+                return true;
+            ++i;  // skip the escaped character
+        }
+        else if (pattern[i] == '[' && pattern[i + 1] == ':')
+            return true;
+    }
+    return false;
+}
+
+/** Convert a Perl format replacement string, as used by Boost, into an
+    RE2 rewrite string.  Returns false if it uses a feature that RE2 can't
+    do, or a group that the regex doesn't have.
+*/
+bool convertReplacement(const std::string & replacement,
+                        int numGroups,
+                        std::string & rewrite)
+{
+    rewrite.clear();
+    rewrite.reserve(replacement.size() + 8);
+
+    for (size_t i = 0;  i < replacement.size();  ++i) {
+        char c = replacement[i];
+        if (c == '\\') {
+            // Escapes in Perl format strings aren't the same as in RE2
+            return false;
+        }
+        else if (c != '$') {
+            rewrite += c;
+            continue;
+        }
+
+        if (i + 1 == replacement.size())
+            return false;
+
+        char next = replacement[++i];
+        int group = -1;
+        if (next == '$') {
+            rewrite += '$';
+            continue;
+        }
+        else if (next == '&') {
+            group = 0;
+        }
+        else if (next >= '0' && next <= '9'
+                 && (i + 1 == replacement.size()
+                     || !isdigit(replacement[i + 1]))) {
+            group = next - '0';
+        }
+        else if (next == '{' && i + 2 < replacement.size()
+                 && isdigit(replacement[i + 1])
+                 && replacement[i + 2] == '}') {
+            group = replacement[i + 1] - '0';
+            i += 2;
+        }
+        else return false;
+
+        if (group > numGroups)
+            return false;
+        rewrite += '\\';
+        rewrite += char('0' + group);
+    }
+
+    return true;
+}
+
+} // file scope
+
+struct SqlRegex::Itl {
+    Itl(const Utf8String & pattern, RegexEngine engine)
+        : pattern(pattern), useBoostForUnicode(false)
+    {
+        const std::string & str = pattern.rawString();
+
+        prefixLength = getLiteralPrefixLength(str);
+        isLiteral = prefixLength == str.size();
+
+        if (engine != REGEX_BOOST) {
+            RE2::Options options;
+            options.set_log_errors(false);
+            options.set_encoding(RE2::Options::EncodingUTF8);
+
+            // Boost's defaults: . matches a newline, and ^ and $ match at
+            // the start and end of each line
+            options.set_dot_nl(true);
+
+            re2.reset(new RE2("(?m)" + str, options));
+            if (!re2->ok()) {
+                if (engine == REGEX_RE2) {
+                    throw HttpReturnException
+                        (400, "Regex '" + pattern + "' can't be compiled "
+                         "with RE2: " + Utf8String(re2->error())
+                         + ".  Use the 'boost' or 'auto' engine for "
+                         "backreferences and lookaround.",
+                         "regex", pattern);
+                }
+                re2.reset();
+            }
+            else if (engine == REGEX_AUTO && usesAsciiOnlyClasses(str)) {
+                useBoostForUnicode = true;
+            }
+        }
+
+        if (!re2 || useBoostForUnicode)
+            getBoost();
+    }
+
+    Utf8String pattern;
+
+    /// RE2 version of the regex, or null if it can't be used
+    std::unique_ptr<RE2> re2;
+
+    /// Is the Boost version used for non-ASCII strings?
+    bool useBoostForUnicode;
+
+    /// Return the Boost version of the regex, compiling it the first time.
+    /// It's only compiled when RE2 can't be used for everything.
+    const boost::u32regex & getBoost() const
+    {
+        std::call_once(boostCompiled, [&] ()
+            {
+                try {
+                    boostRegex = boost::make_u32regex(pattern.rawData());
+                } JML_CATCH_ALL {
+                    rethrowHttpException
+                        (400, "Error when compiling regex '"
+                         + pattern + "': " + ML::getExceptionString()
+                         + ".  Regular expressions must adhere to Perl-style "
+                         + "regular expression syntax.",
+                         "regex", pattern);
+                }
+            });
+        return boostRegex;
+    }
+
+    /// Number of bytes of the literal string that every match starts with
+    size_t prefixLength;
+
+    /// Is the entire regex a literal string?
+    bool isLiteral;
+
+    /// Boost version of the regex, set by getBoost()
+    mutable boost::u32regex boostRegex;
+    mutable std::once_flag boostCompiled;
+
+    /// Should RE2 be used for the given string?
+    bool useRe2(const Utf8String & str) const
+    {
+        return re2 && (!useBoostForUnicode || str.isAscii());
+    }
+};
+
+SqlRegex::
+SqlRegex(const Utf8String & pattern, RegexEngine engine)
+    : itl(new Itl(pattern, engine)), pattern_(pattern), engine_(engine)
+{
+}
+
+SqlRegex::
+~SqlRegex()
+{
+}
+
+bool
+SqlRegex::
+hasRe2() const
+{
+    return !!itl->re2;
+}
+
+bool
+SqlRegex::
+usesBoost() const
+{
+    return !itl->re2 || itl->useBoostForUnicode;
+}
+
+bool
+SqlRegex::
+match(const Utf8String & str) const
+{
+    const std::string & s = str.rawString();
+    const std::string & p = pattern_.rawString();
+
+    if (itl->isLiteral)
+        return s == p;
+    if (s.compare(0, itl->prefixLength, p, 0, itl->prefixLength) != 0)
+        return false;
+
+    if (itl->useRe2(str))
+        return RE2::FullMatch(re2::StringPiece(s.data(), s.size()), *itl->re2);
+    return boost::u32regex_match(str.begin(), str.end(), itl->getBoost());
+}
+
+bool
+SqlRegex::
+search(const Utf8String & str) const
+{
+    const std::string & s = str.rawString();
+    const std::string & p = pattern_.rawString();
+
+    // Look for the literal part with memmem, which is vectorized
+    if (itl->prefixLength > 0
+        && !memmem(s.data(), s.size(), p.data(), itl->prefixLength))
+        return false;
+    if (itl->isLiteral)
+        return true;
+
+    if (itl->useRe2(str))
+        return RE2::PartialMatch(re2::StringPiece(s.data(), s.size()),
+                                 *itl->re2);
+    return boost::u32regex_search(str.begin(), str.end(), itl->getBoost());
+}
+
+Utf8String
+SqlRegex::
+replace(const Utf8String & str, const Utf8String & replacement) const
+{
+    const std::string & s = str.rawString();
+
+    if (itl->prefixLength > 0
+        && !memmem(s.data(), s.size(), pattern_.rawData(), itl->prefixLength))
+        return str;
+
+    if (itl->useRe2(str)) {
+        std::string rewrite;
+        if (convertReplacement(replacement.rawString(),
+                               itl->re2->NumberOfCapturingGroups(),
+                               rewrite)) {
+            std::string result = s;
+            RE2::GlobalReplace(&result, *itl->re2,
+                               re2::StringPiece(rewrite.data(), rewrite.size()));
+            return Utf8String(std::move(result), false /* check */);
+        }
+
+        // Otherwise fall back to Boost for the replacement format
+        if (engine_ == REGEX_RE2) {
+            throw HttpReturnException
+                (400, "Replacement '" + replacement + "' can't be used "
+                 "with the RE2 engine; only $n, ${n}, $& and $$ are "
+                 "supported.",
+                 "regex", pattern_,
+                 "replacement", replacement);
+        }
+    }
+
+    std::basic_string<int32_t> matchStr(str.begin(), str.end());
+    std::basic_string<int32_t> replacementStr(replacement.begin(),
+                                              replacement.end());
+    auto result = boost::u32regex_replace(matchStr, itl->getBoost(),
+                                          replacementStr);
+    return std::basic_string<char32_t>(result.begin(), result.end());
+}
+
+
+/*****************************************************************************/
+/* SQL LIKE MATCHER                                                          */
+/*****************************************************************************/
+
+SqlLikeMatcher::
+SqlLikeMatcher(const Utf8String & pattern)
+    : empty(pattern.empty())
+{
+    const std::string & str = pattern.rawString();
+
+    if (str.find('_') != std::string::npos) {
+        // Needs a regex to match single characters
+        std::string regexStr;
+        size_t start = 0;
+        for (size_t i = 0;  i <= str.size();  ++i) {
+            if (i < str.size() && str[i] != '%' && str[i] != '_')
+                continue;
+            regexStr += RE2::QuoteMeta(re2::StringPiece(str.data() + start,
+                                                        i - start));
+            if (i < str.size())
+                regexStr += str[i] == '%' ? ".*" : ".";
+            start = i + 1;
+        }
+        regex = std::make_shared<SqlRegex>(Utf8String(regexStr, false),
+                                           REGEX_RE2);
+        return;
+    }
+
+    // Split into the literal segments between the %s
+    size_t start = 0;
+    for (;;) {
+        size_t pos = str.find('%', start);
+        if (pos == std::string::npos) {
+            segments.emplace_back(str, start);
+            break;
+        }
+        segments.emplace_back(str, start, pos - start);
+        start = pos + 1;
+    }
+}
+
+SqlLikeMatcher::
+~SqlLikeMatcher()
+{
+}
+
+bool
+SqlLikeMatcher::
+operator () (const Utf8String & value) const
+{
+    // This is historical behaviour, and means that '' LIKE '%' is false
+    if (empty || value.empty())
+        return false;
+
+    if (regex)
+        return regex->match(value);
+
+    const std::string & s = value.rawString();
+
+    // No wildcards: exact match
+    if (segments.size() == 1)
+        return s == segments[0];
+
+    // The first segment must be a prefix and the last a suffix, and the
+    // others must appear in order in between them
+    const std::string & first = segments.front();
+    const std::string & last = segments.back();
+    if (s.size() < first.size() + last.size())
+        return false;
+    if (s.compare(0, first.size(), first) != 0)
+        return false;
+    if (s.compare(s.size() - last.size(), last.size(), last) != 0)
+        return false;
+
+    const char * p = s.data() + first.size();
+    const char * e = s.data() + s.size() - last.size();
+    for (size_t i = 1;  i + 1 < segments.size();  ++i) {
+        const std::string & seg = segments[i];
+        if (seg.empty())
+            continue;
+        const char * found = (const char *)memmem(p, e - p, seg.data(), seg.size());
+        if (!found)
+            return false;
+        p = found + seg.size();
+    }
+
+    return true;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
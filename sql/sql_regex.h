@@ -0,0 +1,119 @@
+/** sql_regex.h                                                    -*- C++ -*-
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Regular expression and LIKE pattern matching for SQL.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include <memory>
+#include <vector>
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* REGEX ENGINE                                                              */
+/*****************************************************************************/
+
+/** Which regular expression engine is used to run a regex. */
+
+enum RegexEngine {
+    REGEX_AUTO,   ///< RE2, or Boost for what RE2 can't do (default)
+    REGEX_RE2,    ///< RE2 only; an error for regexes it can't handle
+    REGEX_BOOST   ///< Boost.Regex only
+};
+
+/// Parse the name of an engine ("auto", "re2" or "boost")
+RegexEngine parseRegexEngine(const Utf8String & name);
+
+
+/*****************************************************************************/
+/* SQL REGEX                                                                 */
+/*****************************************************************************/
+
+/** A compiled Perl-style regular expression, with the semantics of the
+    regex_match, regex_search and regex_replace SQL functions.
+
+    By default, it is run with RE2, which takes time linear in the length
+    of the string, rather than the backtracking Boost.Regex engine.  Boost
+    is still used for the features RE2 doesn't support (backreferences,
+    lookaround, ...), and for the Perl character classes like \w, which
+    are ASCII-only in RE2, when the string isn't pure ASCII.  The flags are
+    set so that both engines treat newlines the same way.
+
+    Literal regexes, and the literal prefix of other regexes, are matched
+    with plain string comparisons before any engine is run.
+*/
+
+struct SqlRegex {
+    SqlRegex(const Utf8String & pattern, RegexEngine engine = REGEX_AUTO);
+    ~SqlRegex();
+
+    /// Does the whole of str match?
+    bool match(const Utf8String & str) const;
+
+    /// Does any part of str match?
+    bool search(const Utf8String & str) const;
+
+    /** Replace all matches in str with the given replacement, which uses
+        Perl format ($1, ${1}, $& and $$ for substitutions).
+    */
+    Utf8String replace(const Utf8String & str,
+                       const Utf8String & replacement) const;
+
+    const Utf8String & pattern() const { return pattern_; }
+
+    /// Engine that was requested
+    RegexEngine engine() const { return engine_; }
+
+    /// Can this regex be run with RE2?
+    bool hasRe2() const;
+
+    /// Is Boost used for some or all strings?
+    bool usesBoost() const;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+    Utf8String pattern_;
+    RegexEngine engine_;
+};
+
+
+/*****************************************************************************/
+/* SQL LIKE MATCHER                                                          */
+/*****************************************************************************/
+
+/** A compiled SQL LIKE pattern, where % matches any sequence of
+    characters and _ any single character; all other characters match
+    themselves.
+
+    Patterns made only of literals and % are matched with string
+    comparisons and searches for each literal segment in turn; only
+    patterns with _ need a (linear time) regex.
+*/
+
+struct SqlLikeMatcher {
+    SqlLikeMatcher(const Utf8String & pattern);
+    ~SqlLikeMatcher();
+
+    bool operator () (const Utf8String & value) const;
+
+private:
+    /// Literal parts of the pattern, between the %s
+    std::vector<std::string> segments;
+
+    /// Is the pattern empty, which never matches?
+    bool empty;
+
+    /// Regex for patterns with _, which is null for the others
+    std::shared_ptr<const SqlRegex> regex;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,107 @@
+/** path_intern_table_test.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the path intern table.
+*/
+
+#include "mldb/sql/path_intern_table.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <atomic>
+#include <iostream>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE(test_intern_basics)
+{
+    PathInternTable table;
+    BOOST_CHECK_EQUAL(table.size(), 0);
+
+    Path p1 = Path::parse("x.y");
+    Path p2 = PathElement("a very long column name that needs to go on the heap");
+
+    BOOST_CHECK_EQUAL(table.find(p1), PathInternTable::NOT_FOUND);
+
+    uint32_t id1 = table.intern(p1);
+    uint32_t id2 = table.intern(p2);
+    BOOST_CHECK_EQUAL(id1, 0);
+    BOOST_CHECK_EQUAL(id2, 1);
+    BOOST_CHECK_EQUAL(table.size(), 2);
+
+    // Interning again gives back the same id
+    BOOST_CHECK_EQUAL(table.intern(Path::parse("x.y")), id1);
+    BOOST_CHECK_EQUAL(table.find(p2), id2);
+    BOOST_CHECK_EQUAL(table.size(), 2);
+
+    BOOST_CHECK_EQUAL(table.getPath(id1), p1);
+    BOOST_CHECK_EQUAL(table.getPath(id2), p2);
+    BOOST_CHECK_EQUAL(table.getHash(id1), p1.hash());
+    BOOST_CHECK_EQUAL(table.getNewHash(id2), p2.newHash());
+
+    // The path with one element x.y is different to that with two
+    BOOST_CHECK_EQUAL(table.find(PathElement("x.y")),
+                      PathInternTable::NOT_FOUND);
+
+    BOOST_CHECK_GT(table.memusage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_intern_multithreaded)
+{
+    PathInternTable table;
+
+    // Enough columns that the table needs to grow several times while
+    // it's being read from other threads
+    static const int NUM_PATHS = 100000;
+    static const int NUM_THREADS = 8;
+
+    std::vector<uint32_t> ids[NUM_THREADS];
+
+    // Boost test assertions aren't thread safe, so count the errors instead
+    std::atomic<int> errors(0);
+
+    auto doThread = [&] (int threadNum)
+        {
+            ids[threadNum].resize(NUM_PATHS);
+            for (int i = 0;  i < NUM_PATHS;  ++i) {
+                // Each thread goes through the paths in a different order
+                int n = (i + threadNum * 12345) % NUM_PATHS;
+                Path path({PathElement("column"), PathElement(n)});
+                uint32_t id = table.intern(path);
+                ids[threadNum][n] = id;
+                if (!(table.getPath(id) == path) || table.find(path) != id)
+                    ++errors;
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < NUM_THREADS;  ++i)
+        threads.emplace_back(doThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors.load(), 0);
+    BOOST_CHECK_EQUAL(table.size(), NUM_PATHS);
+
+    // All threads agree on the ids
+    for (int i = 1;  i < NUM_THREADS;  ++i)
+        BOOST_CHECK(ids[i] == ids[0]);
+}
+
+BOOST_AUTO_TEST_CASE(test_global_table)
+{
+    Path p = PathElement("test_global_table");
+    uint32_t id = PathInternTable::global()->intern(p);
+    BOOST_CHECK_EQUAL(PathInternTable::global(), PathInternTable::global());
+    BOOST_CHECK_EQUAL(PathInternTable::global()->find(p), id);
+
+    // A table of its own doesn't share ids with the global one
+    PathInternTable table;
+    BOOST_CHECK_EQUAL(table.find(p), PathInternTable::NOT_FOUND);
+}
@@ -0,0 +1,123 @@
+/** sql_regex_test.cc
+    agent, 17 October 2026
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of regex and LIKE matching for SQL.
+*/
+
+#include "mldb/sql/sql_regex.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE(test_engines_agree)
+{
+    // Each engine must give the same results
+    for (auto engine: { REGEX_AUTO, REGEX_RE2, REGEX_BOOST }) {
+        BOOST_TEST_CHECKPOINT("engine " << engine);
+
+        BOOST_CHECK(SqlRegex("abc", engine).match("abc"));
+        BOOST_CHECK(!SqlRegex("abc", engine).match("abcd"));
+        BOOST_CHECK(SqlRegex("abc", engine).search("xabcd"));
+        BOOST_CHECK(!SqlRegex("abc", engine).search("xabd"));
+        BOOST_CHECK(SqlRegex("ab?c", engine).match("ac"));
+        BOOST_CHECK(SqlRegex("ab+c", engine).search("xxabbbcx"));
+        BOOST_CHECK(!SqlRegex("ab+c", engine).search("xxacx"));
+
+        // . matches a newline, and ^ and $ match at line boundaries
+        BOOST_CHECK(SqlRegex("b.c", engine).match("b\nc"));
+        BOOST_CHECK(SqlRegex("^b$", engine).search("a\nb\nc"));
+
+        // Non-ASCII characters are matched one at a time
+        BOOST_CHECK(SqlRegex("h.llo", engine).match("h\xc3\xa9llo"));
+
+        BOOST_CHECK_EQUAL(SqlRegex("(\\w+)@(\\w+)", engine)
+                          .replace("joe@host, ann@box", "$2:$1"),
+                          "host:joe, box:ann");
+        BOOST_CHECK_EQUAL(SqlRegex("o", engine).replace("foo", "[$&${0}$$]"),
+                          "f[oo$][oo$]");
+        BOOST_CHECK_EQUAL(SqlRegex("", engine).replace("ab", "-"), "-a-b-");
+        BOOST_CHECK_EQUAL(SqlRegex("z", engine).replace("ab", "-"), "ab");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_boost_fallback)
+{
+    // Backreferences and lookaround need Boost
+    SqlRegex backref("(a)\\1");
+    BOOST_CHECK(!backref.hasRe2());
+    BOOST_CHECK(backref.usesBoost());
+    BOOST_CHECK(backref.match("aa"));
+    BOOST_CHECK(!backref.match("ab"));
+
+    BOOST_CHECK(SqlRegex("a(?=b)").search("ab"));
+    BOOST_CHECK(!SqlRegex("a(?=b)").search("ac"));
+
+    BOOST_CHECK_THROW(SqlRegex("(a)\\1", REGEX_RE2), std::exception);
+    BOOST_CHECK_THROW(SqlRegex("(a", REGEX_AUTO), std::exception);
+
+    // Simple regexes don't use it
+    BOOST_CHECK(!SqlRegex("a+b").usesBoost());
+
+    // \w is Unicode aware, which RE2 isn't, so Boost is used for non-ASCII
+    // strings
+    SqlRegex word("\\w+");
+    BOOST_CHECK(word.hasRe2());
+    BOOST_CHECK(word.usesBoost());
+    BOOST_CHECK(word.match("hello"));
+    BOOST_CHECK(word.match("h\xc3\xa9llo"));
+
+    // Replacements with escapes use the Boost format
+    BOOST_CHECK_EQUAL(SqlRegex("(o)").replace("fo", "\\t$1"), "f\to");
+    BOOST_CHECK_THROW(SqlRegex("(o)", REGEX_RE2).replace("fo", "\\t$1"),
+                      std::exception);
+
+    BOOST_CHECK_EQUAL(parseRegexEngine("re2"), REGEX_RE2);
+    BOOST_CHECK_THROW(parseRegexEngine("pcre"), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(test_like)
+{
+    auto like = [] (const char * value, const char * pattern)
+        {
+            return SqlLikeMatcher(pattern)(value);
+        };
+
+    BOOST_CHECK(like("drollic", "%"));
+    BOOST_CHECK(like("drollic", "%o%"));
+    BOOST_CHECK(!like("citharize", "%o%"));
+    BOOST_CHECK(like("egrote", "______"));
+    BOOST_CHECK(!like("drollic", "______"));
+    BOOST_CHECK(like("drollic", "___ll__"));
+    BOOST_CHECK(like("egrote", "%t_"));
+    BOOST_CHECK(like("hyometer", "hyo%"));
+    BOOST_CHECK(!like("ichthyarchy", "hyo%"));
+    BOOST_CHECK(like("axbyc", "a%b%c"));
+    BOOST_CHECK(!like("acb", "a%b%c"));
+    BOOST_CHECK(!like("abc", "ab%bc"));
+    BOOST_CHECK(like("abc", "abc"));
+
+    // Regex characters match themselves
+    BOOST_CHECK(like("foo[baar", "%[____"));
+    BOOST_CHECK(like("z*", "%*%"));
+    BOOST_CHECK(like("boo.x", "___.%"));
+    BOOST_CHECK(!like("boox", "___.%"));
+    BOOST_CHECK(like("(ab)", "%(__)%"));
+    BOOST_CHECK(like("a+b", "a+b"));
+    BOOST_CHECK(!like("aab", "a+b"));
+    BOOST_CHECK(like("gardev^iance", "%^%"));
+
+    // _ matches a whole character
+    BOOST_CHECK(like("h\xc3\xa9llo", "h_llo"));
+
+    // Empty strings never match
+    BOOST_CHECK(!like("", "%"));
+    BOOST_CHECK(!like("abc", ""));
+}
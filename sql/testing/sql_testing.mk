@@ -3,3 +3,5 @@
 # This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
 
 $(eval $(call test,path_test,sql_expression,boost))
+$(eval $(call test,path_intern_table_test,sql_expression,boost))
+$(eval $(call test,sql_regex_test,sql_expression,boost))
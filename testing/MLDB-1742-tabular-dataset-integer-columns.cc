@@ -187,3 +187,31 @@ BOOST_AUTO_TEST_CASE( test_big_pos_neg_range_and_nulls )
 
     freezeAndTest(vals);
 }
+
+// Integers with a common multiple are stored divided by the multiple
+BOOST_AUTO_TEST_CASE( test_frozen_ints_common_multiple )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        vals.push_back(1000000 + i * 1000);
+    }
+    vals.emplace_back();  // add a null
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(ML::type_name(*frozen),
+                      "Datacratic::MLDB::IntegerFrozenColumn");
+
+    // 1001 values of 10 bits each, rather than 20 bits each
+    BOOST_CHECK_LT(frozen->memusage(), 1001 * 20 / 8);
+
+    size_t numDistinct = 0;
+    frozen->forEachDistinctValue([&] (const CellValue & val)
+                                 {
+                                     BOOST_CHECK(val.empty()
+                                                 || val.toInt() % 1000 == 0);
+                                     ++numDistinct;
+                                     return true;
+                                 });
+    BOOST_CHECK_EQUAL(numDistinct, 1001);
+}
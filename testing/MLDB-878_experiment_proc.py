@@ -635,6 +635,46 @@ class Mldb878Test(MldbUnitTest):  # noqa
                 }
             })
 
+    def test_concurrent_folds(self):
+        # folds run concurrently must give the same results as when they
+        # are run one after the other
+        def run_folds(name, params):
+            conf = {
+                "type": "classifier.experiment",
+                "params": {
+                    "experimentName": name,
+                    "inputData": "select {* EXCLUDING(label)} as features, label from toy",
+                    "kfold": 4,
+                    "modelFileUrlPattern":
+                        "file://build/x86_64/tmp/concurrent_folds_$runid.cls",
+                    "algorithm": "dt",
+                    "mode": "boolean",
+                    "outputAccuracyDataset": True,
+                    "evalTrain": True,
+                    "runOnCreation": True
+                }
+            }
+            conf["params"].update(params)
+            rez = mldb.put("/v1/procedures/" + name, conf)
+            return rez.json()["status"]["firstRun"]["status"]
+
+        serial = run_folds("serial_folds", {})
+        concurrent = run_folds("concurrent_folds", {"maxConcurrentFolds": 0})
+        budgeted = run_folds("budgeted_folds", {"maxConcurrentFolds": 0,
+                                                "memoryBudget": 1})
+
+        self.assertEqual(len(concurrent["folds"]), 4)
+        for rez in [concurrent, budgeted]:
+            for i in xrange(4):
+                for k in ["resultsTest", "resultsTrain"]:
+                    self.assertEqual(serial["folds"][i][k], rez["folds"][i][k])
+            self.assertEqual(serial["aggregatedTest"]["auc"],
+                             rez["aggregatedTest"]["auc"])
+
+        # each fold wrote its own results dataset
+        for i in xrange(4):
+            mldb.get("/v1/datasets/concurrent_folds_results_%d" % i)
+
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,72 @@
+#
+# columnar_query_result_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the binary columnar output format of the query API, which must
+# decode to the same result as the soa format.
+#
+
+import array
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# More than a single batch
+NUM_ROWS = 20000
+
+class ColumnarQueryResultTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            cols = [['x', i, 0], ['f', i / 4.0, 0],
+                    ['label', 'label %d' % (i % 10), 0]]
+            # Only appears in the second batch
+            if i > 17000 and i % 2 == 0:
+                cols.append(['late', i, 0])
+            if i % 5 == 0:
+                cols.append(['mixed', 'five' if i % 10 else i, 0])
+            ds.record_row('r%05d' % i, cols)
+        ds.commit()
+
+    def test_same_as_soa(self):
+        query = 'SELECT * FROM ds ORDER BY x'
+        expected = mldb.get('/v1/query', q=query, format='soa').json()
+        res = mldb.query_columnar(query)
+
+        self.assertEqual(sorted(res.keys()), sorted(expected.keys()))
+        for k, v in expected.items():
+            self.assertEqual(len(res[k]), NUM_ROWS)
+            self.assertEqual(list(res[k]), v, k)
+
+    def test_typed_arrays(self):
+        res = mldb.query_columnar('SELECT x, f FROM ds ORDER BY x')
+        self.assertIsInstance(res['x'], array.array)
+        self.assertEqual(res['x'].typecode, 'q')
+        self.assertIsInstance(res['f'], array.array)
+        self.assertEqual(res['f'].typecode, 'd')
+        self.assertEqual(res['f'][3], 0.75)
+
+    def test_types(self):
+        res = mldb.query_columnar(
+            "SELECT 1 AS i, 1.5 AS d, 'hello' AS s, NULL AS n, "
+            "TIMESTAMP '2016-05-10T00:00:00Z' AS t, "
+            "[1, 2] AS a NAMED 'row'")
+        self.assertEqual(list(res['_rowName']), ['row'])
+        self.assertEqual(list(res['i']), [1])
+        self.assertEqual(list(res['d']), [1.5])
+        self.assertEqual(list(res['s']), ['hello'])
+        self.assertEqual(list(res['n']), [None])
+        self.assertEqual(list(res['t']), [1462838400.0])
+        self.assertEqual(list(res['a.0']), [1])
+
+    def test_empty(self):
+        res = mldb.query_columnar('SELECT * FROM ds WHERE x < 0')
+        self.assertEqual(res, {})
+
+    def test_error(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query_columnar('SELECT * FROM no_such_dataset')
+
+mldb.run_tests()
@@ -0,0 +1,174 @@
+/* compiled_expression_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that WHERE clauses evaluated by compiled expressions give the same
+   results as the bound expressions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular_dataset.h"
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/sql/compiled_expression.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/rest/poly_entity.h"
+#include "mldb/types/vector_description.h"
+#include <limits>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_compile_supported )
+{
+    auto compile = [] (const std::string & expr)
+        {
+            return CompiledSqlExpression::compile(*SqlExpression::parse(expr));
+        };
+
+    auto compiled = compile("x * 2 + y > 3 AND NOT (x = y)");
+    BOOST_REQUIRE(compiled);
+    BOOST_CHECK_EQUAL(compiled->inputs.size(), 2);
+    BOOST_CHECK_EQUAL(compiled->resultType, CompiledSqlExpression::BOOLEAN);
+
+    BOOST_CHECK(compile("-x / 3"));
+    BOOST_CHECK(compile("t.x < NULL"));
+
+    // Not supported; these use the bound expression
+    BOOST_CHECK(!compile("x % 3 = 1"));
+    BOOST_CHECK(!compile("x = 'hello'"));
+    BOOST_CHECK(!compile("x AND y"));
+    BOOST_CHECK(!compile("abs(x) > 1"));
+    BOOST_CHECK(!compile("1 + 2 > 3"));
+}
+
+BOOST_AUTO_TEST_CASE( test_compile_execute )
+{
+    auto compiled = CompiledSqlExpression::compile
+        (*SqlExpression::parse("x + y < 3 OR y > 10"));
+    BOOST_REQUIRE(compiled);
+    BOOST_REQUIRE_EQUAL(compiled->inputs.size(), 2);
+
+    CompiledSqlExpression::Registers registers;
+    compiled->initRegisters(registers, 4);
+
+    std::vector<CellValue> x = { 1, CellValue(), 2.5, "string" };
+    std::vector<CellValue> y = { 1, 20, CellValue(), 1 };
+
+    for (size_t i = 0;  i < 4;  ++i) {
+        registers.state(0)[i]
+            = CompiledSqlExpression::loadCell(x[i], registers.value(0)[i]);
+        registers.state(1)[i]
+            = CompiledSqlExpression::loadCell(y[i], registers.value(1)[i]);
+    }
+
+    compiled->execute(registers, 4);
+
+    const double * values = registers.value(compiled->result);
+    const CompiledSqlExpression::State * states
+        = registers.state(compiled->result);
+
+    // 1 + 1 < 3
+    BOOST_CHECK_EQUAL(states[0], CompiledSqlExpression::VALUE);
+    BOOST_CHECK_EQUAL(values[0], 1.0);
+    // NULL + 20 is NULL, but 20 > 10 is true
+    BOOST_CHECK_EQUAL(states[1], CompiledSqlExpression::VALUE);
+    BOOST_CHECK_EQUAL(values[1], 1.0);
+    // 2.5 + NULL is 2.5, which is less than 3
+    BOOST_CHECK_EQUAL(states[2], CompiledSqlExpression::VALUE);
+    BOOST_CHECK_EQUAL(values[2], 1.0);
+    // Strings can't be handled
+    BOOST_CHECK_EQUAL(states[3], CompiledSqlExpression::UNSUPPORTED);
+}
+
+std::vector<RowName> runWhere(const Dataset & dataset,
+                              const std::string & where)
+{
+    auto stm = SelectStatement::parse("SELECT * FROM ds WHERE " + where
+                                      + " ORDER BY rowName()");
+    auto rows = dataset.queryStructured(stm.select, stm.when, *stm.where,
+                                        stm.orderBy, stm.groupBy,
+                                        *stm.having, *stm.rowName,
+                                        stm.offset, stm.limit, "");
+    std::vector<RowName> result;
+    for (auto & r: rows)
+        result.push_back(r.rowName);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_where )
+{
+    MldbServer server;
+
+    server.init();
+
+    PolyConfig tabularConfig;
+    tabularConfig.params = TabularDatasetConfig();
+    TabularDataset tabular(&server, tabularConfig, nullptr);
+
+    PolyConfig sparseConfig;
+    sparseConfig.params = MutableSparseMatrixDatasetConfig();
+    MutableSparseMatrixDataset sparse(&server, sparseConfig, nullptr);
+
+    Date ts = Date::fromSecondsSinceEpoch(1462500000);
+
+    std::vector<std::pair<RowName, std::vector<std::tuple<ColumnName, CellValue, Date> > > > rows;
+    for (int i = 0;  i < 5000;  ++i) {
+        std::vector<std::tuple<ColumnName, CellValue, Date> > cols;
+        cols.emplace_back(ColumnName("i"), i, ts);
+        cols.emplace_back(ColumnName("x"), i % 101 - 50, ts);
+
+        // Mostly numbers, with the odd null, NaN, string and huge integer
+        CellValue y;
+        if (i % 97 == 0)
+            y = std::numeric_limits<double>::quiet_NaN();
+        else if (i % 89 == 0)
+            y = "string";
+        else if (i % 83 == 0)
+            y = (int64_t)1 << 60;
+        else if (i % 7)
+            y = i * 0.25;
+        cols.emplace_back(ColumnName("y"), y, ts);
+
+        cols.emplace_back(ColumnName("t"),
+                          Date::fromSecondsSinceEpoch(i), ts);
+        rows.emplace_back(RowName("row" + std::to_string(i)),
+                          std::move(cols));
+    }
+
+    tabular.recordRows(rows);
+    tabular.commit();
+    sparse.recordRows(rows);
+    sparse.commit();
+
+    std::vector<std::string> queries = {
+        "x > 10",
+        "x * 2 + y > 100",
+        "y / x < 3 AND x != 0",
+        "NOT (y > 500) OR x = 3",
+        "-x >= y - 1000",
+        "x + NULL > 20",
+        "y = y",
+        "t > 10 AND x < 0",
+        "i - x < 1000 AND (y < 200 OR y > 1000)"
+    };
+
+    for (auto & query: queries) {
+        cerr << query << endl;
+
+        SqlExpressionDatasetScope scope(tabular, "");
+        auto where = SqlExpression::parse(query);
+        auto generator = tabular.generateRowsWhere(scope, "", *where, 0, -1);
+        cerr << generator.explain << endl;
+
+        auto expected = runWhere(sparse, query);
+        auto result = runWhere(tabular, query);
+
+        BOOST_CHECK_EQUAL(jsonEncodeStr(expected), jsonEncodeStr(result));
+    }
+}
@@ -0,0 +1,82 @@
+/* csv_scanner_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the vectorized CSV structural character scanner.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/csv_scanner.h"
+#include <string>
+#include <vector>
+#include <random>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_scan_csv_structure )
+{
+    std::mt19937 rng(1);
+    const std::string alphabet = std::string("ab1,\"\x7f\xc3\xa9 ") + '\0';
+
+    for (size_t length: { 0, 1, 15, 16, 31, 32, 33, 63, 64, 65, 127,
+                200, 4095, 4096, 4097, 10000 }) {
+        // Scan from an unaligned offset to check unaligned loads
+        std::string data(length + 3, 'x');
+        for (size_t i = 3;  i < data.size();  ++i)
+            data[i] = alphabet[rng() % alphabet.size()];
+        const char * line = data.data() + 3;
+
+        std::vector<uint64_t> masks(CSV_NUM_MASKS * ((length + 63) / 64));
+        scanCsvStructure(line, length, ',', '"', masks.data());
+
+        for (size_t i = 0;  i < length;  ++i) {
+            char c = line[i];
+            const uint64_t * word = &masks[i / 64 * CSV_NUM_MASKS];
+            auto isSet = [&] (CsvScanMask kind)
+                {
+                    return (bool)(word[kind] & (uint64_t(1) << (i % 64)));
+                };
+            BOOST_REQUIRE_EQUAL(isSet(CSV_SEPARATORS), c == ',');
+            BOOST_REQUIRE_EQUAL(isSet(CSV_QUOTES), c == '"');
+            BOOST_REQUIRE_EQUAL(isSet(CSV_EIGHT_BIT), (c & 0x80) != 0);
+            BOOST_REQUIRE_EQUAL(isSet(CSV_INVALID_ASCII), c == 0 || c == 127);
+        }
+
+        // Bits past the end of the line must be clear
+        if (length % 64) {
+            for (unsigned m = 0;  m < CSV_NUM_MASKS;  ++m)
+                BOOST_CHECK_EQUAL(masks[masks.size() - CSV_NUM_MASKS + m]
+                                  >> (length % 64), 0);
+        }
+
+        CsvStructuralIndex index(line, length, ',', '"');
+        const char * end = line + length;
+
+        for (size_t i = 0;  i < length;  i += 7) {
+            const char * p = line + i;
+            const char * sep = p;
+            while (sep < end && *sep != ',')
+                ++sep;
+            BOOST_REQUIRE_EQUAL(index.nextSeparator(p) - line, sep - line);
+
+            const char * quote = p;
+            while (quote < end && *quote != '"')
+                ++quote;
+            BOOST_REQUIRE_EQUAL(index.nextQuote(p) - line, quote - line);
+
+            const char * rangeEnd = std::min(end, p + 1 + i % 150);
+            bool eightBit = false, invalid = false;
+            for (const char * q = p;  q < rangeEnd;  ++q) {
+                eightBit = eightBit || (*q & 0x80);
+                invalid = invalid || *q == 0 || *q == 127;
+            }
+            BOOST_REQUIRE_EQUAL(index.hasEightBit(p, rangeEnd), eightBit);
+            BOOST_REQUIRE_EQUAL(index.hasInvalidAscii(p, rangeEnd), invalid);
+        }
+    }
+}
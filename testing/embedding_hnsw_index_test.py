@@ -0,0 +1,76 @@
+#
+# embedding_hnsw_index_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the approximate (hnsw) nearest neighbours index of the embedding
+# dataset, which must agree with the exact vantage point tree when it is
+# allowed to consider every row.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 400
+NUM_DIMS = 60
+
+class EmbeddingHnswIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        rows = [('r%d' % i, [random.gauss(0, 1) for _ in range(NUM_DIMS)])
+                for i in range(NUM_ROWS)]
+
+        for name, config in [('exact', {}),
+                             ('approx', {'index' : 'hnsw',
+                                         'hnswEfSearch' : NUM_ROWS})]:
+            config['metric'] = 'cosine'
+            ds = mldb.create_dataset({'id' : name, 'type' : 'embedding',
+                                      'params' : config})
+
+            # The approximate index has rows added on a second commit
+            for i, (row_name, coords) in enumerate(rows):
+                ds.record_row(row_name,
+                              [['x%02d' % j, v, 0]
+                               for j, v in enumerate(coords)])
+                if i == NUM_ROWS // 2:
+                    ds.commit()
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + name, {
+                'type' : 'embedding.neighbors',
+                'params' : {'dataset' : name, 'defaultNumNeighbors' : 5}
+            })
+
+    def test_same_as_exact(self):
+        for i in range(0, NUM_ROWS, 37):
+            expected = mldb.query(
+                "select nn_exact({coords: 'r%d'})[distances] as *" % i)
+            res = mldb.query(
+                "select nn_approx({coords: 'r%d'})[distances] as *" % i)
+            self.assertEqual(res[0], expected[0])
+            for v1, v2 in zip(res[1][1:], expected[1][1:]):
+                self.assertAlmostEqual(v1, v2, places=5)
+
+    def test_batch(self):
+        # Applied over a whole dataset, which looks up the neighbours of a
+        # batch of rows at once
+        res = mldb.query("""
+            select nn_approx({coords: {*}})[neighbors] as *
+            from exact order by rowName()
+        """)
+        self.assertEqual(len(res), NUM_ROWS + 1)
+
+        # Each row is its own nearest neighbour
+        for row in res[1:]:
+            self.assertEqual(row[1], row[0])
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({'id' : 'bad', 'type' : 'embedding',
+                                 'params' : {'index' : 'hnsw',
+                                             'hnswNumNeighbors' : 1}})
+
+mldb.run_tests()
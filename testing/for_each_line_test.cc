@@ -89,3 +89,46 @@ BOOST_AUTO_TEST_CASE( test_forEachLine_throw )
 
     BOOST_CHECK_THROW(forEachLineStr(stream, processLine), ML::Exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_forEachLineBlock_multi_lines )
+{
+    // Records span lines when a newline is within a quoted value, but
+    // not when a quote appears in the middle of an unquoted value
+    vector<string> expected;
+    string data;
+    for (int i = 0; i < 100000; i++) {
+        string record;
+        if (i % 10 == 3)
+            record = to_string(i) + ",\"multi\nline \"\" value\"";
+        else if (i % 10 == 7)
+            record = to_string(i) + ",12\"";
+        else record = to_string(i) + ",\"value\"";
+        expected.emplace_back(record);
+        data += record + "\r\n";
+    }
+    istringstream stream(data);
+
+    vector<string> result(expected.size());
+    auto onLine = [&] (const char * line, size_t length,
+                       int64_t blockNumber, int64_t lineNum)
+        {
+            result.at(lineNum) = string(line, length);
+            return true;
+        };
+
+    forEachLineBlock(stream, onLine, -1 /* maxLines */, 8 /* parallelism */,
+                     nullptr, nullptr, '"', ',');
+    BOOST_CHECK(result == expected);
+
+    // Check that maxLines is respected exactly
+    istringstream stream2(data);
+    atomic<int> count(0);
+    auto countLine = [&] (const char * line, size_t length,
+                          int64_t blockNumber, int64_t lineNum)
+        {
+            ++count;
+            return true;
+        };
+    forEachLineBlock(stream2, countLine, 12345, 8, nullptr, nullptr, '"', ',');
+    BOOST_CHECK_EQUAL(count, 12345);
+}
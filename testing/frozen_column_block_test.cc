@@ -0,0 +1,293 @@
+/* frozen_column_block_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that block decoding of frozen columns gives the same values as
+   accessing them one at a time.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/arch/demangle.h"
+#include "mldb/types/date.h"
+#include <limits>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+void checkBlocks(const std::vector<CellValue> & cells,
+                 const std::string & expectedType)
+{
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < cells.size();  ++i) {
+        if (!cells[i].empty())
+            col.add(i, cells[i]);
+    }
+
+    std::shared_ptr<FrozenColumn> frozen = col.freeze();
+    BOOST_CHECK_EQUAL(ML::type_name(*frozen), expectedType);
+
+    // Blocks of odd sizes that don't line up with the storage, including
+    // ones that extend past the end of the column
+    for (uint32_t blockSize: { 1, 7, 64, 1000, 1024, 5000 }) {
+        FrozenColumnBlock block;
+        for (uint32_t start = 0;  start < cells.size();  start += blockSize) {
+            frozen->decodeBlock(start, blockSize, block);
+            BOOST_REQUIRE_EQUAL(block.startRow, start);
+            BOOST_REQUIRE_EQUAL(block.numRows, blockSize);
+            for (uint32_t i = 0;  i < blockSize;  ++i) {
+                CellValue expected;
+                if (start + i < cells.size())
+                    expected = cells[start + i];
+                BOOST_REQUIRE_EQUAL(block.isPresent(i), !expected.empty());
+                BOOST_REQUIRE_EQUAL(block.get(i), expected);
+            }
+        }
+    }
+
+    // forEach is implemented in terms of blocks
+    size_t n = 0;
+    frozen->forEach([&] (size_t row, const CellValue & val)
+                    {
+                        BOOST_REQUIRE_EQUAL(val, cells.at(row));
+                        ++n;
+                        return true;
+                    });
+    BOOST_CHECK_EQUAL(n, frozen->size());
+
+    // The zone map must never exclude a value that's in the column
+    ColumnZoneMap zone = ColumnZoneMap::build(*frozen, cells.size());
+    size_t numNulls = 0;
+    for (auto & c: cells) {
+        if (c.empty()) {
+            ++numNulls;
+            continue;
+        }
+        BOOST_CHECK(zone.mayContain(c));
+        BOOST_CHECK(zone.mayContainRange(&c, true, &c, true));
+    }
+    BOOST_CHECK_EQUAL(zone.numNulls, numNulls);
+    BOOST_CHECK_EQUAL(zone.numValues, cells.size() - numNulls);
+}
+
+BOOST_AUTO_TEST_CASE( test_integer_column_blocks )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i) {
+        if (i % 11 == 0)
+            vals.emplace_back();
+        else vals.emplace_back(i * (i % 2 ? 1 : -1));
+    }
+
+    checkBlocks(vals, "Datacratic::MLDB::IntegerFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_table_column_blocks )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i) {
+        switch (i % 5) {
+        case 0: vals.emplace_back("hello");  break;
+        case 1: vals.emplace_back(1.5);  break;
+        case 2: vals.emplace_back();  break;
+        case 3: vals.emplace_back(Date::fromSecondsSinceEpoch(i % 17));  break;
+        case 4: vals.emplace_back("world");  break;
+        }
+    }
+
+    checkBlocks(vals, "Datacratic::MLDB::TableFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_column_blocks )
+{
+    std::vector<CellValue> vals(10000);
+    vals[3] = "three";
+    vals[1023] = "end of first block";
+    vals[1024] = "start of second block";
+    vals[5000] = "five thousand";
+    vals[9999] = 2.5;
+
+    checkBlocks(vals, "Datacratic::MLDB::SparseTableFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_double_column_blocks )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i) {
+        if (i % 7 == 0)
+            vals.emplace_back();
+        else if (i % 13 == 0)
+            vals.emplace_back(i);
+        else vals.emplace_back(i * 0.1);
+    }
+    vals[5] = std::numeric_limits<double>::quiet_NaN();
+    vals[6] = -std::numeric_limits<double>::infinity();
+
+    checkBlocks(vals, "Datacratic::MLDB::DoubleFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_float_column_blocks )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i) {
+        vals.emplace_back(i + 0.25);
+    }
+
+    checkBlocks(vals, "Datacratic::MLDB::DoubleFrozenColumn");
+
+    // Every value is exactly representable in single precision, so it
+    // should take 4 bytes per value
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < vals.size();  ++i)
+        col.add(i, vals[i]);
+    BOOST_CHECK_LT(col.freeze()->memusage(), vals.size() * sizeof(double));
+}
+
+BOOST_AUTO_TEST_CASE( test_timestamp_column_blocks )
+{
+    // Whole minutes, stored as seconds with a multiplier of 60
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i) {
+        if (i % 17 == 0)
+            vals.emplace_back();
+        else vals.emplace_back
+                 (Date::fromSecondsSinceEpoch(1460000000 + i * 60));
+    }
+
+    checkBlocks(vals, "Datacratic::MLDB::TimestampFrozenColumn");
+
+    // Milliseconds
+    vals.clear();
+    for (int i = 0;  i < 3000;  ++i) {
+        vals.emplace_back
+            (Date::fromSecondsSinceEpoch((1460000000123LL + i * 7) / 1000.0));
+    }
+
+    checkBlocks(vals, "Datacratic::MLDB::TimestampFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_run_length_column_blocks )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 3000;  ++i)
+        vals.emplace_back("hello");
+    for (int i = 0;  i < 1000;  ++i)
+        vals.emplace_back();
+    for (int i = 0;  i < 3000;  ++i)
+        vals.emplace_back(Date::fromSecondsSinceEpoch(1));
+    for (int i = 0;  i < 10;  ++i)
+        vals.emplace_back("hello");
+
+    checkBlocks(vals, "Datacratic::MLDB::RunLengthFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_zone_map_pruning )
+{
+    TabularDatasetColumn col;
+    for (int i = 100;  i < 200;  ++i)
+        col.add(i, i);
+    auto frozen = col.freeze();
+
+    ColumnZoneMap zone = ColumnZoneMap::build(*frozen, 300);
+    BOOST_CHECK_EQUAL(zone.numNulls, 200);
+    BOOST_CHECK_EQUAL(zone.minValue, 100);
+    BOOST_CHECK_EQUAL(zone.maxValue, 199);
+
+    CellValue v50(50), v100(100), v199(199), v300(300), v400(400);
+
+    BOOST_CHECK(!zone.mayContain(v50));
+    BOOST_CHECK(!zone.mayContain(v300));
+    BOOST_CHECK(!zone.mayContain(CellValue("hello")));
+
+    // x < 100 and x <= 100
+    BOOST_CHECK(!zone.mayContainRange(nullptr, false, &v100, false));
+    BOOST_CHECK(zone.mayContainRange(nullptr, false, &v100, true));
+
+    // x > 199 and x >= 199
+    BOOST_CHECK(!zone.mayContainRange(&v199, false, nullptr, false));
+    BOOST_CHECK(zone.mayContainRange(&v199, true, nullptr, false));
+
+    // x BETWEEN 300 AND 400 and x BETWEEN 50 AND 100
+    BOOST_CHECK(!zone.mayContainRange(&v300, true, &v400, true));
+    BOOST_CHECK(zone.mayContainRange(&v50, true, &v100, true));
+
+    // An empty column can't contain anything
+    ColumnZoneMap empty;
+    BOOST_CHECK(!empty.mayContain(v100));
+    BOOST_CHECK(!empty.mayContainRange(nullptr, false, nullptr, false));
+}
+
+BOOST_AUTO_TEST_CASE( test_frozen_column_index )
+{
+    // Sparse column with a mix of common values (which are stored as
+    // bitmaps) and rare ones (which are stored as row lists)
+    static const size_t NUM_ROWS = 5000;
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < NUM_ROWS;  ++i) {
+        if (i % 7 == 0)
+            continue;
+        col.add(i, i % 3 == 0 ? CellValue(i % 10) : CellValue(i));
+    }
+    auto frozen = col.freeze();
+
+    auto index = FrozenColumnIndex::build(*frozen, NUM_ROWS);
+    BOOST_REQUIRE(index);
+    BOOST_CHECK(!index->bitmaps.empty());
+    BOOST_CHECK(!index->rowNumbers.empty());
+    BOOST_CHECK_GT(index->memusage(), 0);
+
+    auto checkRange = [&] (const CellValue * lower, bool lowerInclusive,
+                           const CellValue * upper, bool upperInclusive)
+        {
+            auto matches = [&] (const CellValue & val)
+                {
+                    if (lower && (lowerInclusive ? val < *lower : val <= *lower))
+                        return false;
+                    if (upper && (upperInclusive ? *upper < val : *upper <= val))
+                        return false;
+                    return true;
+                };
+
+            std::vector<uint32_t> expected;
+            for (size_t i = 0;  i < NUM_ROWS;  ++i) {
+                CellValue val = frozen->get(i);
+                if (!val.empty() && matches(val))
+                    expected.push_back(i);
+            }
+
+            std::vector<uint32_t> rows;
+            index->findRange(lower, lowerInclusive, upper, upperInclusive,
+                             matches, rows);
+            std::sort(rows.begin(), rows.end());
+            BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(),
+                                          expected.begin(), expected.end());
+            return rows.size();
+        };
+
+    CellValue v3(3), v8(8), v100(100), v1000(1000), vstr("hello");
+
+    // Equality with a common value, a rare value and a missing value
+    BOOST_CHECK_GT(checkRange(&v3, true, &v3, true), 0);
+    BOOST_CHECK_EQUAL(checkRange(&v1000, true, &v1000, true), 1);
+    BOOST_CHECK_EQUAL(checkRange(&v100, true, &v100, true), 0);
+
+    checkRange(nullptr, false, &v8, false);
+    checkRange(nullptr, false, &v8, true);
+    checkRange(&v100, false, nullptr, false);
+    checkRange(&v3, true, &v1000, true);
+    checkRange(nullptr, false, nullptr, false);
+
+    // A bound of another class doesn't narrow the range
+    checkRange(&vstr, true, nullptr, false);
+
+    // Values of different classes can't be indexed
+    TabularDatasetColumn mixed;
+    mixed.add(0, 1);
+    mixed.add(1, "one");
+    BOOST_CHECK(!FrozenColumnIndex::build(*mixed.freeze(), 2));
+}
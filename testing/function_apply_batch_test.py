@@ -0,0 +1,106 @@
+#
+# function_apply_batch_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that user functions called from a query over a batch of rows (which
+# scores classifiers as a single matrix) give the same output as when they
+# are applied to each row individually.
+#
+
+import json
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class FunctionApplyBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put("/v1/procedures/import", {
+            "type": "import.text",
+            "params": {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                "outputDataset": "iris",
+                "runOnCreation": True,
+                "headers": ["a", "b", "c", "d", "class"]
+            }
+        })
+
+        for name, label in [('cat', 'class'),
+                            ('bool', "class = 'Iris-setosa'"),
+                            ('reg', 'a')]:
+            mldb.put("/v1/procedures/train_" + name, {
+                'type' : 'classifier.train',
+                'params' : {
+                    'trainingData' :
+                        'SELECT {b, c, d} AS features, %s AS label FROM iris'
+                        % label,
+                    "modelFileUrl": "file://tmp/function_apply_batch_%s.cls"
+                        % name,
+                    "algorithm": "dt",
+                    "mode": {'cat' : 'categorical',
+                             'bool' : 'boolean',
+                             'reg' : 'regression'}[name],
+                    "functionName": "cls_" + name,
+                    "runOnCreation": True
+                }
+            })
+
+    def check_function(self, name, order_by):
+        rows = mldb.query("""
+            SELECT %s({features: {b, c, d}}) AS *, b, c, d
+            FROM iris %s
+        """ % (name, order_by))
+
+        header = rows[0]
+        self.assertEqual(len(rows), 151)
+        for row in rows[1:]:
+            values = dict(zip(header, row))
+            features = {k : values[k] for k in ['b', 'c', 'd']}
+            expected = mldb.get('/v1/functions/%s/application' % name,
+                                input=json.dumps({'features' : features}))
+            for k, v in expected.json()['output'].items():
+                if isinstance(v, dict):
+                    for label, score in v.items():
+                        self.assertAlmostEqual(
+                            values['%s.%s' % (k, label)], score, places=5)
+                else:
+                    self.assertAlmostEqual(values[k], v, places=5)
+
+    def test_categorical(self):
+        self.check_function('cls_cat', '')
+        self.check_function('cls_cat', 'ORDER BY rowName()')
+
+    def test_boolean(self):
+        self.check_function('cls_bool', '')
+        self.check_function('cls_bool', 'ORDER BY rowName()')
+
+    def test_regression(self):
+        self.check_function('cls_reg', 'ORDER BY rowName()')
+
+    def test_extract(self):
+        batched = mldb.query("""
+            SELECT cls_bool({features: {b, c, d}})[score] AS score
+            FROM iris ORDER BY rowName()
+        """)
+        whole = mldb.query("""
+            SELECT cls_bool({features: {b, c, d}}) AS *
+            FROM iris ORDER BY rowName()
+        """)
+        self.assertEqual(batched, whole)
+
+    def test_multiple_values(self):
+        # A row with two values for a feature can't be scored densely, and
+        # is scored on its own within the batch
+        ds = mldb.create_dataset({'id' : 'multi', 'type' : 'sparse.mutable'})
+        ds.record_row('r1', [['b', 3, 0], ['c', 1, 0], ['d', 0.2, 0]])
+        ds.record_row('r2', [['b', 3, 0], ['b', 4, 1], ['c', 5, 0],
+                             ['d', 2, 0]])
+        ds.commit()
+        res = mldb.query("""
+            SELECT cls_bool({features: {b, c, d}})[score] AS score
+            FROM multi ORDER BY rowName()
+        """)
+        self.assertEqual(len(res), 3)
+
+mldb.run_tests()
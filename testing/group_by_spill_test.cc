@@ -0,0 +1,117 @@
+/* group_by_spill_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that GROUP BY queries give the same results when their groups are
+   spilled to disk as when they are kept in memory.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/bound_queries.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/vector_description.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+std::string runQuery(const Dataset & dataset, const std::string & query,
+                     size_t memoryBudget)
+{
+    auto stm = SelectStatement::parse(query);
+
+    // Find the aggregators in the same way as Dataset::queryStructured
+    auto aggregators = stm.select.findAggregators(true /* withGroupBy */);
+    auto havingAggregators = stm.having->findAggregators(true);
+    auto orderByAggregators = stm.orderBy.findAggregators(true);
+    aggregators.insert(aggregators.end(), havingAggregators.begin(),
+                       havingAggregators.end());
+    aggregators.insert(aggregators.end(), orderByAggregators.begin(),
+                       orderByAggregators.end());
+
+    std::vector<MatrixNamedRow> rows;
+    auto onRow = [&] (NamedRowValue & row)
+        {
+            rows.emplace_back(row.flattenDestructive());
+            return true;
+        };
+
+    BoundGroupByQuery(stm.select, dataset, "", stm.when, *stm.where,
+                      stm.groupBy, aggregators, *stm.having, *stm.rowName,
+                      stm.orderBy, memoryBudget)
+        .execute({onRow, false /*processInParallel*/}, stm.offset, stm.limit,
+                 nullptr);
+
+    // The JSON representation of the rows doesn't distinguish timestamps
+    // from strings, so record the type of each value too
+    std::vector<int> types;
+    for (auto & row: rows)
+        for (auto & c: row.columns)
+            types.push_back(std::get<1>(c).cellType());
+
+    return jsonEncodeStr(rows) + jsonEncodeStr(types);
+}
+
+BOOST_AUTO_TEST_CASE( test_group_by_spill )
+{
+    MldbServer server;
+
+    server.init();
+
+    PolyConfig pconfig;
+    pconfig.params = MutableSparseMatrixDatasetConfig();
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+
+    Date ts = Date::fromSecondsSinceEpoch(1462300000);
+
+    std::vector<std::pair<RowName, std::vector<std::tuple<ColumnName, CellValue, Date> > > > rows;
+    for (int i = 0;  i < 5000;  ++i) {
+        std::vector<std::tuple<ColumnName, CellValue, Date> > cols;
+        cols.emplace_back(ColumnName("k"), i % 211, ts);
+        cols.emplace_back(ColumnName("s"),
+                          "user" + std::to_string(i * 7 % 97), ts);
+        cols.emplace_back(ColumnName("x"), i, ts);
+        if (i % 3)
+            cols.emplace_back(ColumnName("y"), i * 0.5, ts);
+        cols.emplace_back(ColumnName("t"), ts.plusSeconds(i % 53), ts);
+        rows.emplace_back(RowName("row" + std::to_string(i)),
+                          std::move(cols));
+    }
+
+    dataset.recordRows(rows);
+    dataset.commit();
+
+    std::vector<std::string> queries = {
+        "SELECT count(*) AS c, sum(x) AS sx, min(y) AS my FROM ds GROUP BY k",
+        "SELECT count(*) AS c, max(x) AS mx FROM ds GROUP BY s, k % 7",
+        "SELECT avg(y) AS ay FROM ds GROUP BY k HAVING count(*) > 23",
+        "SELECT count(*) AS c FROM ds GROUP BY s ORDER BY sum(x) DESC LIMIT 10",
+        "SELECT count(*) AS c FROM ds GROUP BY {k, s}",
+        "SELECT count(*) AS c FROM ds WHERE x < 0 GROUP BY k",
+        "SELECT sum(y) AS sy FROM ds GROUP BY x LIMIT 700",
+        "SELECT count(*) AS c FROM ds GROUP BY x ORDER BY x % 13 LIMIT 50 OFFSET 120",
+        "SELECT t, count(*) AS c, sum(x) AS sx FROM ds GROUP BY t",
+        "SELECT max(t) AS mt, min(t) AS lt FROM ds GROUP BY k ORDER BY max(t), k"
+    };
+
+    for (auto & query: queries) {
+        cerr << query << endl;
+
+        std::string inMemory
+            = runQuery(dataset, query, BoundGroupByQuery::defaultMemoryBudget());
+
+        // Spill most partitions as soon as they have a few groups
+        std::string spilled = runQuery(dataset, query, 4096);
+
+        // Spill every partition as soon as it has a single group
+        std::string allSpilled = runQuery(dataset, query, 1);
+
+        BOOST_CHECK_EQUAL(inMemory, spilled);
+        BOOST_CHECK_EQUAL(inMemory, allSpilled);
+    }
+}
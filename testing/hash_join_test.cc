@@ -0,0 +1,126 @@
+/* hash_join_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that hash joins give the same results as sort-merge joins.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/server/mldb_server.h"
+#include "mldb/sql/execution_pipeline_impl.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/rest/poly_entity.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/types/pair_description.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_choose_strategy )
+{
+    AnnotatedJoinCondition equijoin;
+    equijoin.style = AnnotatedJoinCondition::EQUIJOIN;
+
+    auto choose = [&] (ssize_t leftRows, ssize_t rightRows,
+                       JoinQualification qualification = JOIN_INNER)
+        {
+            return JoinElement::chooseStrategy(equijoin, qualification,
+                                               leftRows, rightRows);
+        };
+
+    BOOST_CHECK_EQUAL(choose(1000, 10000000), JoinElement::HASH_BUILD_LEFT);
+    BOOST_CHECK_EQUAL(choose(10000000, 1000), JoinElement::HASH_BUILD_RIGHT);
+
+    // Sizes are too similar, too small or unknown
+    BOOST_CHECK_EQUAL(choose(5000000, 10000000), JoinElement::MERGE_SORTED);
+    BOOST_CHECK_EQUAL(choose(10, 1000), JoinElement::MERGE_SORTED);
+    BOOST_CHECK_EQUAL(choose(-1, 10000000), JoinElement::MERGE_SORTED);
+
+    // Outer joins are always merged
+    BOOST_CHECK_EQUAL(choose(1000, 10000000, JOIN_LEFT),
+                      JoinElement::MERGE_SORTED);
+}
+
+BOOST_AUTO_TEST_CASE( test_hash_join_results )
+{
+    MldbServer server;
+
+    server.init();
+
+    string httpBoundAddress = server.bindTcp(PortRange(17000,18000), "127.0.0.1");
+
+    server.start();
+
+    HttpRestProxy proxy(httpBoundAddress);
+
+    typedef std::vector<std::tuple<ColumnName, CellValue, Date> > Columns;
+    typedef std::vector<std::pair<RowName, Columns> > Rows;
+
+    Date ts = Date::fromSecondsSinceEpoch(1462400000);
+
+    auto createDataset = [&] (const std::string & name, const Rows & rows)
+        {
+            PolyConfig config;
+            config.type = "sparse.mutable";
+            proxy.put("/v1/datasets/" + name, jsonEncode(config));
+            proxy.post("/v1/datasets/" + name + "/multirows", jsonEncode(rows));
+            proxy.post("/v1/datasets/" + name + "/commit");
+        };
+
+    // Fact table, with some rows that have no matching dimension and some
+    // with no dimension at all
+    Rows facts;
+    for (int i = 0;  i < 3000;  ++i) {
+        Columns cols;
+        cols.emplace_back(ColumnName("id"), i, ts);
+        if (i % 13)
+            cols.emplace_back(ColumnName("dimId"), i * 7 % 60, ts);
+        cols.emplace_back(ColumnName("value"), i * 0.5, ts);
+        facts.emplace_back(RowName("fact" + std::to_string(i)), cols);
+    }
+    createDataset("facts", facts);
+
+    // Dimension table, with duplicate keys
+    Rows dims;
+    for (int i = 0;  i < 50;  ++i) {
+        Columns cols;
+        cols.emplace_back(ColumnName("id"), i % 45, ts);
+        cols.emplace_back(ColumnName("label"), "dim" + std::to_string(i), ts);
+        dims.emplace_back(RowName("dim" + std::to_string(i)), cols);
+    }
+    createDataset("dims", dims);
+
+    std::vector<std::string> queries = {
+        "SELECT f.id, d.label FROM facts AS f JOIN dims AS d "
+        "ON f.dimId = d.id ORDER BY f.id, d.label",
+        "SELECT f.id, d.label FROM dims AS d JOIN facts AS f "
+        "ON f.dimId = d.id ORDER BY f.id, d.label",
+        "SELECT f.id, d.label FROM facts AS f JOIN dims AS d "
+        "ON f.dimId = d.id AND f.value > 100 AND d.label != 'dim3' "
+        "ORDER BY f.id, d.label",
+        "SELECT count(*) FROM facts AS f JOIN dims AS d ON f.dimId = d.id"
+    };
+
+    size_t oldMinProbeRows = JoinElement::hashJoinMinProbeRows;
+
+    for (auto & query: queries) {
+        cerr << query << endl;
+
+        JoinElement::hashJoinMinProbeRows = oldMinProbeRows;
+        auto merged = proxy.get("/v1/query", { { "q", query } });
+        BOOST_REQUIRE_EQUAL(merged.code(), 200);
+
+        JoinElement::hashJoinMinProbeRows = 0;
+        auto hashed = proxy.get("/v1/query", { { "q", query } });
+        BOOST_REQUIRE_EQUAL(hashed.code(), 200);
+
+        BOOST_CHECK_EQUAL(merged.body(), hashed.body());
+    }
+
+    JoinElement::hashJoinMinProbeRows = oldMinProbeRows;
+}
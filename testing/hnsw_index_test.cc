@@ -0,0 +1,172 @@
+/* hnsw_index_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the approximate nearest neighbours graph index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+#include <random>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+namespace {
+
+/** Points in a high dimensional space that lie near a lower dimensional
+    subspace, like most real embeddings.
+*/
+std::vector<std::vector<float> >
+makePoints(int numPoints, int numDims, int numLatent, std::mt19937 & rng)
+{
+    std::normal_distribution<float> normal;
+
+    std::vector<std::vector<float> > projection(numLatent);
+    for (auto & p: projection) {
+        for (int i = 0;  i < numDims;  ++i)
+            p.push_back(normal(rng));
+    }
+
+    std::vector<std::vector<float> > result(numPoints);
+    for (auto & r: result) {
+        r.resize(numDims, 0.0);
+        for (auto & p: projection) {
+            float z = normal(rng);
+            for (int i = 0;  i < numDims;  ++i)
+                r[i] += z * p[i];
+        }
+    }
+
+    return result;
+}
+
+float euclidean(const std::vector<float> & v1, const std::vector<float> & v2)
+{
+    double total = 0.0;
+    for (unsigned i = 0;  i < v1.size();  ++i)
+        total += (v1[i] - v2[i]) * (v1[i] - v2[i]);
+    return sqrt(total);
+}
+
+/** Proportion of the true k nearest neighbours that the index finds, over
+    a set of queries.
+*/
+double recall(const HnswIndex & index,
+              const std::vector<std::vector<float> > & points,
+              const std::vector<std::vector<float> > & queries,
+              int k, int efSearch)
+{
+    int found = 0;
+
+    for (auto & q: queries) {
+        std::vector<std::pair<float, int> > expected;
+        for (unsigned i = 0;  i < points.size();  ++i)
+            expected.emplace_back(euclidean(q, points[i]), i);
+        std::partial_sort(expected.begin(), expected.begin() + k,
+                          expected.end());
+
+        auto res = index.search([&] (int i) { return euclidean(q, points[i]); },
+                                k, INFINITY, efSearch);
+
+        BOOST_CHECK_EQUAL(res.size(), k);
+        for (unsigned i = 1;  i < res.size();  ++i)
+            BOOST_CHECK_LE(res[i - 1].first, res[i].first);
+
+        for (auto & r: res) {
+            for (int i = 0;  i < k;  ++i)
+                found += expected[i].second == r.second;
+        }
+    }
+
+    return found / (double)(k * queries.size());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    HnswIndex index;
+    BOOST_CHECK_EQUAL(index.size(), 0);
+    BOOST_CHECK(index.search([] (int) { return 0.0f; }, 10, INFINITY, 50)
+                .empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_small_is_exact )
+{
+    // When every item is a candidate the search is exhaustive
+    std::mt19937 rng(1);
+    auto points = makePoints(50, 10, 10, rng);
+
+    HnswIndex index;
+    index.insert(points.size(),
+                 [&] (int i, int j) { return euclidean(points[i], points[j]); });
+
+    BOOST_CHECK_EQUAL(index.size(), 50);
+    BOOST_CHECK_EQUAL(recall(index, points, makePoints(20, 10, 10, rng),
+                             10, 100),
+                      1.0);
+
+    // Each point is its own nearest neighbour, and maxDistance is respected
+    for (unsigned i = 0;  i < points.size();  ++i) {
+        auto res = index.search([&] (int j) { return euclidean(points[i], points[j]); },
+                                5, 0.0, 50);
+        BOOST_REQUIRE_EQUAL(res.size(), 1);
+        BOOST_CHECK_EQUAL(res[0].second, i);
+        BOOST_CHECK_EQUAL(res[0].first, 0.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_recall_high_dimensions )
+{
+    std::mt19937 rng(2);
+    auto points = makePoints(10000, 100, 10, rng);
+    auto queries = makePoints(100, 100, 10, rng);
+
+    auto dist = [&] (int i, int j) { return euclidean(points[i], points[j]); };
+
+    // Insert in two parts, the second large enough to be done in parallel
+    HnswIndex index(16, 100);
+    index.insert(2000, dist);
+    BOOST_CHECK_EQUAL(index.size(), 2000);
+    index.insert(points.size(), dist);
+    BOOST_CHECK_EQUAL(index.size(), points.size());
+
+    double r = recall(index, points, queries, 10, 50);
+    cerr << "recall@10 with efSearch 50 = " << r << endl;
+    BOOST_CHECK_GT(r, 0.95);
+
+    // A larger search effort can't make it worse
+    double r2 = recall(index, points, queries, 10, 200);
+    cerr << "recall@10 with efSearch 200 = " << r2 << endl;
+    BOOST_CHECK_GE(r2, r);
+
+    // Serialization round trip gives the same answers
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        index.serialize(store);
+    }
+
+    HnswIndex reconstituted;
+    {
+        std::istringstream istream(stream.str());
+        ML::DB::Store_Reader store(istream);
+        reconstituted.reconstitute(store);
+    }
+
+    BOOST_CHECK_EQUAL(reconstituted.size(), index.size());
+    for (auto & q: queries) {
+        auto qdist = [&] (int i) { return euclidean(q, points[i]); };
+        BOOST_CHECK(index.search(qdist, 10, INFINITY, 50)
+                    == reconstituted.search(qdist, 10, INFINITY, 50));
+    }
+}
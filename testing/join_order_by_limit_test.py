@@ -0,0 +1,52 @@
+# join_order_by_limit_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Check that ORDER BY with a LIMIT over a join, which only keeps the top
+# rows while sorting, gives the same rows as a full sort.
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class JoinOrderByLimitTest(MldbUnitTest):
+
+    @classmethod
+    def setUpClass(self):
+        ds1 = mldb.create_dataset({ "id": "left", "type": "sparse.mutable" })
+        ds2 = mldb.create_dataset({ "id": "right", "type": "sparse.mutable" })
+        for i in range(200):
+            ds1.record_row("row%d" % i, [["k", i % 50, 0], ["x", (i * 37) % 200, 0]])
+        for i in range(50):
+            ds2.record_row("row%d" % i, [["k", i, 0], ["y", i * 2, 0]])
+        ds1.commit()
+        ds2.commit()
+
+    def check(self, orderBy, offset, limit):
+        query = """
+                SELECT left.x AS x, right.y AS y
+                FROM left JOIN right ON left.k = right.k
+                ORDER BY %s
+                """ % orderBy
+
+        full = mldb.query(query)
+        limited = mldb.query(query + " OFFSET %d LIMIT %d" % (offset, limit))
+
+        self.assertEqual(limited[0], full[0])
+        self.assertEqual(limited[1:], full[1 + offset:1 + offset + limit])
+
+    def test_limit(self):
+        self.check("x", 0, 10)
+
+    def test_offset_and_limit(self):
+        self.check("x DESC", 17, 5)
+
+    def test_limit_past_end(self):
+        self.check("y, x", 190, 100)
+
+    def test_zero_limit(self):
+        res = mldb.query("""
+            SELECT left.x FROM left JOIN right ON left.k = right.k
+            ORDER BY left.x LIMIT 0
+        """)
+        self.assertEqual(len(res), 1)
+
+mldb.run_tests()
@@ -0,0 +1,63 @@
+#
+# joined_dataset_lazy_index_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that the joined dataset only builds the index of each side's rows
+# when a column is read, and that it reports its memory usage.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class JoinedDatasetLazyIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'lhs', 'type' : 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('l%d' % i, [['k', i % 5, 0], ['x', i, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'rhs', 'type' : 'sparse.mutable'})
+        for i in range(5):
+            ds.record_row('r%d' % i, [['k', i, 0], ['y', i * 10, 0]])
+        ds.commit()
+
+        mldb.put('/v1/datasets/joined', {
+            'type' : 'joined',
+            'params' : {
+                'left' : 'lhs',
+                'right' : 'rhs',
+                'on' : 'lhs.k = rhs.k'
+            }
+        })
+
+    def get_status(self):
+        return mldb.get('/v1/datasets/joined').json()['status']
+
+    def test_status(self):
+        status = self.get_status()
+        self.assertEqual(status['rowCount'], 10)
+        self.assertEqual(status['columnCount'], 4)
+        self.assertGreater(status['rowMemory'], 0)
+
+    def test_rows(self):
+        res = mldb.query('SELECT lhs.x, rhs.y FROM joined ORDER BY lhs.x')
+        self.assertEqual(res[0], ['_rowName', 'lhs.x', 'rhs.y'])
+        self.assertEqual(len(res), 11)
+        for row in res[1:]:
+            x = row[1]
+            self.assertEqual(row[0], '[l%d]-[r%d]' % (x, x % 5))
+            self.assertEqual(row[2], (x % 5) * 10)
+
+    def test_column_builds_side_index(self):
+        # Each right row joins with two left rows, and so its value
+        # appears in both of them
+        values = mldb.get('/v1/datasets/joined/columns/rhs.y/values').json()
+        self.assertEqual(sorted(values), [0, 10, 20, 30, 40])
+        self.assertGreater(self.get_status()['sideIndexMemory'], 0)
+
+        res = mldb.get('/v1/datasets/joined/columns/lhs.x/values').json()
+        self.assertEqual(sorted(res), list(range(10)))
+
+mldb.run_tests()
@@ -0,0 +1,86 @@
+#
+# jseval_batch_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that jseval gives the same results when it's run over batches of
+# rows, with numeric and non-numeric arguments, and that it keeps
+# statistics on its calls.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class JsevalBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'tabular'})
+        for i in range(100):
+            row = [['x', i, 0], ['s', 'row%d' % i, 0]]
+            if i % 3 != 0:
+                row.append(['y', i * 0.5, 0])
+            ds.record_row('r%03d' % i, row)
+        ds.commit()
+
+    def get_stats(self):
+        res = mldb.query('SELECT jseval_stats() AS *')
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_numeric_arguments(self):
+        res = mldb.query("""
+            SELECT jseval('return x * 2 + y', 'x,y', x, coalesce(y, 0))
+                   AS z
+            FROM ds ORDER BY rowName()""")
+        self.assertEqual(len(res), 101)
+        for i, row in enumerate(res[1:]):
+            y = i * 0.5 if i % 3 != 0 else 0
+            self.assertEqual(row[1], i * 2 + y)
+
+    def test_mixed_arguments(self):
+        # y is null for some rows, and s is a string, so they can't be
+        # passed as numbers
+        res = mldb.query("""
+            SELECT jseval('return s + ":" + (y === null ? "null" : x)',
+                          's,x,y', s, x, y) AS z
+            FROM ds ORDER BY rowName()""")
+        for i, row in enumerate(res[1:]):
+            expected = 'row%d:%s' % (i, 'null' if i % 3 == 0 else i)
+            self.assertEqual(row[1], expected)
+
+    def test_row_results(self):
+        res = mldb.query("""
+            SELECT jseval('return { a: x, b: s }', 'x,s', x, s) AS *
+            FROM ds WHERE x < 3 ORDER BY rowName()""")
+        self.assertEqual(res[0], ['_rowName', 'a', 'b'])
+        self.assertEqual(res[1:], [['r000', 0, 'row0'],
+                                   ['r001', 1, 'row1'],
+                                   ['r002', 2, 'row2']])
+
+    def test_exception(self):
+        with self.assertMldbRaises(
+                expected_regexp="Exception running jseval script"):
+            mldb.query("""
+                SELECT jseval('if (x == 50) throw "fifty"; return x',
+                              'x', x)
+                FROM ds""")
+
+    def test_compile_error(self):
+        with self.assertMldbRaises(
+                expected_regexp="Exception compiling jseval script"):
+            mldb.query("SELECT jseval('syntax error', 'x', x) FROM ds")
+
+    def test_stats(self):
+        before = self.get_stats()
+        mldb.query("SELECT jseval('return x + 1', 'x', x) FROM ds")
+        after = self.get_stats()
+
+        self.assertGreaterEqual(after['isolates'], 1)
+        self.assertGreater(after['functionsCompiled'],
+                           before['functionsCompiled'])
+        self.assertGreater(after['calls'], before['calls'])
+        self.assertEqual(after['rows'] - before['rows'], 100)
+        self.assertGreater(after['callSeconds'], 0)
+        self.assertGreaterEqual(after['maxCallSeconds'],
+                                after['meanCallMicroseconds'] / 1e6)
+
+mldb.run_tests()
@@ -0,0 +1,133 @@
+/* order_by_spill_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that ORDER BY queries give the same results when sorted runs of
+   their rows are spilled to disk as when they are sorted in memory.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/bound_queries.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/vector_description.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+/** Describe the type of each of the values in the rows, which the JSON
+    representation of the rows doesn't distinguish.
+*/
+std::vector<std::string> describeTypes(const std::vector<NamedRowValue> & rows)
+{
+    std::vector<std::string> result;
+    for (auto & row: rows) {
+        for (auto & c: row.columns) {
+            const ExpressionValue & val = std::get<1>(c);
+            std::string type = val.getTypeAsString();
+            if (val.isAtom())
+                type += std::to_string((int)val.getAtom().cellType());
+            else if (val.isEmbedding())
+                type += std::to_string((int)val.getSpecializedValueInfo()
+                                       ->getEmbeddingType());
+            result.emplace_back(std::move(type));
+        }
+    }
+    return result;
+}
+
+std::string runQuery(const Dataset & dataset, const std::string & query,
+                     size_t sortMemoryBudget)
+{
+    auto stm = SelectStatement::parse(query);
+
+    std::vector<NamedRowValue> rows;
+    auto onRow = [&] (NamedRowValue & row,
+                      std::vector<ExpressionValue> & calc,
+                      int rowNum)
+        {
+            rows.emplace_back(std::move(row));
+            return true;
+        };
+
+    BoundSelectQuery(stm.select, dataset, "", stm.when, *stm.where,
+                     stm.orderBy, {}, -1 /* numBuckets */, sortMemoryBudget)
+        .execute(onRow, false /* processInParallel */,
+                 stm.offset, stm.limit, nullptr);
+
+    return jsonEncodeStr(rows) + jsonEncodeStr(describeTypes(rows));
+}
+
+BOOST_AUTO_TEST_CASE( test_order_by_spill )
+{
+    MldbServer server;
+
+    server.init();
+
+    PolyConfig pconfig;
+    pconfig.params = MutableSparseMatrixDatasetConfig();
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+
+    Date ts = Date::fromSecondsSinceEpoch(1462300000);
+
+    std::vector<std::pair<RowName, std::vector<std::tuple<ColumnName, CellValue, Date> > > > rows;
+    for (int i = 0;  i < 5000;  ++i) {
+        std::vector<std::tuple<ColumnName, CellValue, Date> > cols;
+        cols.emplace_back(ColumnName("s"),
+                          "user" + std::to_string(i * 7 % 97), ts);
+        cols.emplace_back(ColumnName("x"), i, ts);
+        if (i % 3)
+            cols.emplace_back(ColumnName("y"), i * 0.5, ts);
+        cols.emplace_back(ColumnName("f"),
+                          i % 5 ? i * 0.25 : std::nan(""), ts);
+        cols.emplace_back(ColumnName("t"),
+                          ts.plusSeconds(i * 37 % 1000), ts);
+        cols.emplace_back(ColumnName("b"),
+                          CellValue::blob(std::string("\0b", 2)
+                                          + std::to_string(i % 89)), ts);
+        rows.emplace_back(RowName("row" + std::to_string(i)),
+                          std::move(cols));
+    }
+
+    dataset.recordRows(rows);
+    dataset.commit();
+
+    // Each query has a total order, so that the output is deterministic
+    std::vector<std::string> queries = {
+        "SELECT * FROM ds ORDER BY x DESC",
+        "SELECT s, x FROM ds ORDER BY s, x",
+        "SELECT x, y FROM ds ORDER BY y, x LIMIT 100",
+        "SELECT x FROM ds ORDER BY s DESC, x OFFSET 4900",
+        "SELECT x FROM ds ORDER BY x % 100, x LIMIT 50 OFFSET 1000",
+        "SELECT x FROM ds WHERE x % 2 = 0 ORDER BY rowName()",
+        "SELECT x FROM ds WHERE x < 0 ORDER BY x",
+        "SELECT x, f FROM ds ORDER BY f, x",
+        "SELECT x, t FROM ds ORDER BY t DESC, x",
+        "SELECT x, b FROM ds ORDER BY b, x",
+        "SELECT x, [x % 7, x] AS e FROM ds ORDER BY e DESC",
+        "SELECT x, normalize([x % 11 + 1, 2], 2) AS n FROM ds ORDER BY n, x"
+    };
+
+    for (auto & query: queries) {
+        cerr << query << endl;
+
+        std::string inMemory
+            = runQuery(dataset, query,
+                       BoundSelectQuery::defaultSortMemoryBudget());
+
+        // A budget that is a fraction of the size of the rows, so that a
+        // few runs are spilled
+        std::string spilled = runQuery(dataset, query, 256 * 1024);
+        BOOST_CHECK_EQUAL(inMemory, spilled);
+
+        // A budget small enough that many runs are spilled, which are
+        // merged into bigger runs as they are written
+        std::string cascaded = runQuery(dataset, query, 16 * 1024);
+        BOOST_CHECK_EQUAL(inMemory, cascaded);
+    }
+}
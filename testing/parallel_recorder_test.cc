@@ -0,0 +1,118 @@
+/* parallel_recorder_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that rows recorded from many threads at once with a ParallelRecorder
+   all end up in the dataset once it's committed.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular_dataset.h"
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/dataset_utils.h"
+#include <thread>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+// Number of rows recorded by each thread.  The last one records fewer rows
+// than the batch size, so they are only flushed by commit().
+static const std::vector<int> ROWS_PER_THREAD = { 1000, 537, 250, 7 };
+static const size_t BATCH_SIZE = 100;
+
+static RowName getRowName(int thread, int i)
+{
+    return RowName("t" + std::to_string(thread) + "r" + std::to_string(i));
+}
+
+void recordAndCheck(Dataset & dataset)
+{
+    Date ts = Date::fromSecondsSinceEpoch(1462300000);
+
+    ParallelRecorder recorder(dataset, BATCH_SIZE);
+
+    auto doThread = [&] (int thread)
+        {
+            for (int i = 0;  i < ROWS_PER_THREAD[thread];  ++i) {
+                ParallelRecorder::Row row;
+                row.emplace_back(ColumnName("thread"), thread, ts);
+                row.emplace_back(ColumnName("x"), i, ts);
+                if (i % 2)
+                    row.emplace_back(ColumnName("odd"), "yes", ts);
+                recorder.recordRowDestructive(getRowName(thread, i),
+                                              std::move(row));
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < ROWS_PER_THREAD.size();  ++i)
+        threads.emplace_back(doThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    recorder.commit();
+
+    auto view = dataset.getMatrixView();
+
+    size_t totalRows = 0;
+    for (int n: ROWS_PER_THREAD)
+        totalRows += n;
+    BOOST_CHECK_EQUAL(view->getRowCount(), totalRows);
+
+    int errors = 0;
+    for (int thread = 0;  thread < ROWS_PER_THREAD.size();  ++thread) {
+        for (int i = 0;  i < ROWS_PER_THREAD[thread];  ++i) {
+            RowName rowName = getRowName(thread, i);
+            if (!view->knownRow(rowName)) {
+                ++errors;
+                continue;
+            }
+
+            std::map<ColumnName, CellValue> columns;
+            for (auto & c: view->getRow(rowName).columns)
+                columns[std::get<0>(c)] = std::get<1>(c);
+
+            if (columns[ColumnName("thread")] != thread
+                || columns[ColumnName("x")] != i
+                || columns[ColumnName("odd")]
+                   != (i % 2 ? CellValue("yes") : CellValue()))
+                ++errors;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_recorder_tabular )
+{
+    MldbServer server;
+
+    server.init();
+
+    TabularDatasetConfig config;
+    config.unknownColumns = UC_ADD;
+
+    PolyConfig pconfig;
+    pconfig.params = config;
+    TabularDataset dataset(&server, pconfig, nullptr);
+
+    recordAndCheck(dataset);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_recorder_sparse )
+{
+    MldbServer server;
+
+    server.init();
+
+    PolyConfig pconfig;
+    pconfig.params = MutableSparseMatrixDatasetConfig();
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+
+    recordAndCheck(dataset);
+}
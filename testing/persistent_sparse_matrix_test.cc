@@ -0,0 +1,190 @@
+/* persistent_sparse_matrix_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the persistent backend of the sparse matrix dataset.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include "mldb/plugins/persistent_sparse_matrix.h"
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/rest/poly_entity.h"
+#include "mldb/types/vector_description.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+/** Return the values of the entries in the given row, in order. */
+std::vector<uint64_t> getRow(MatrixReadTransaction & trans, uint64_t row)
+{
+    std::vector<uint64_t> result;
+    trans.iterateRow(row, [&] (const BaseEntry & entry)
+                     {
+                         result.push_back(entry.val);
+                         return true;
+                     });
+    return result;
+}
+
+void writeRows(BaseMatrix & matrix, uint64_t first, uint64_t last,
+               uint64_t val)
+{
+    auto trans = matrix.startWriteTransaction();
+    for (uint64_t i = first;  i < last;  ++i) {
+        BaseEntry entry(i % 7, 1, val, 1, { "meta" + std::to_string(i) });
+        trans->recordRow(i, &entry, 1);
+    }
+    trans->commit();
+}
+
+BOOST_AUTO_TEST_CASE( test_persistent_matrix )
+{
+    std::string dir = "./tmp/persistent_sparse_matrix_test";
+    boost::filesystem::remove_all(dir);
+
+    {
+        // Compact every 1000 entries
+        PersistentBaseMatrix matrix(dir, 1000);
+
+        auto before = matrix.startReadTransaction();
+
+        for (unsigned i = 0;  i < 10;  ++i)
+            writeRows(matrix, i * 500, i * 500 + 600, i);
+        matrix.waitForCompaction();
+
+        // Snapshot isolation: nothing written after the start is visible
+        BOOST_CHECK_EQUAL(before->rowCount(), 0);
+        BOOST_CHECK(!before->knownRow(10));
+
+        auto after = matrix.startReadTransaction();
+        BOOST_CHECK_EQUAL(after->rowCount(), 5100);
+
+        // Row 550 was written by the first two transactions
+        BOOST_CHECK_EQUAL(jsonEncodeStr(getRow(*after, 550)), "[0,1]");
+        BOOST_CHECK_EQUAL(jsonEncodeStr(getRow(*after, 5050)), "[9]");
+
+        // Segments are merged as they are compacted
+        BOOST_CHECK_GE(matrix.segmentCount(), 1);
+        BOOST_CHECK_LT(matrix.segmentCount(), 10);
+
+        // A write transaction sees its own writes, but nobody else does
+        auto write = matrix.startWriteTransaction();
+        BaseEntry entry(1, 2, 3, 4);
+        write->recordRow(100000, &entry, 1);
+        BOOST_CHECK(write->knownRow(100000));
+        BOOST_CHECK_EQUAL(write->rowCount(), 5101);
+        BOOST_CHECK(!matrix.startReadTransaction()->knownRow(100000));
+        write->commit();
+        BOOST_CHECK(matrix.startReadTransaction()->knownRow(100000));
+
+        // Snapshot isolation: a read transaction started before the
+        // commit doesn't see it
+        BOOST_CHECK(!after->knownRow(100000));
+    }
+
+    // Simulate a crash in the middle of a write to the log
+    {
+        PersistentBaseMatrix matrix(dir, 1000000);
+        writeRows(matrix, 200000, 200010, 42);
+    }
+
+    for (auto it = boost::filesystem::directory_iterator(dir);
+         it != boost::filesystem::directory_iterator();  ++it) {
+        std::string name = it->path().filename().string();
+        if (name.find("log-") == 0
+            && boost::filesystem::file_size(it->path()) > 0) {
+            int fd = open(it->path().c_str(), O_WRONLY | O_APPEND);
+            BOOST_REQUIRE_NE(fd, -1);
+            BOOST_REQUIRE_EQUAL(write(fd, "garbage", 7), 7);
+            close(fd);
+        }
+    }
+
+    {
+        PersistentBaseMatrix matrix(dir, 1000000);
+        auto trans = matrix.startReadTransaction();
+        BOOST_CHECK_EQUAL(trans->rowCount(), 5111);
+        BOOST_CHECK_EQUAL(jsonEncodeStr(getRow(*trans, 550)), "[0,1]");
+        BOOST_CHECK_EQUAL(jsonEncodeStr(getRow(*trans, 100000)), "[3]");
+        BOOST_CHECK_EQUAL(jsonEncodeStr(getRow(*trans, 200005)), "[42]");
+
+        std::string meta;
+        trans->iterateRow(4321, [&] (const BaseEntry & entry)
+                          {
+                              meta = entry.metadata.at(0);
+                              return false;
+                          });
+        BOOST_CHECK_EQUAL(meta, "meta4321");
+
+        // Optimizing doesn't rewrite the existing segments
+        size_t numSegments = matrix.segmentCount();
+        matrix.optimize();
+        matrix.waitForCompaction();
+        BOOST_CHECK_GE(matrix.segmentCount(), 1);
+        BOOST_CHECK_LE(matrix.segmentCount(), numSegments + 1);
+
+        // Once everything is compacted, it can be streamed
+        matrix.compactAll();
+        matrix.waitForCompaction();
+        BOOST_CHECK_EQUAL(matrix.segmentCount(), 1);
+        trans = matrix.startReadTransaction();
+        BOOST_REQUIRE(trans->isSingleReadEntry());
+        auto stream = trans->getStream();
+        stream->initAt(10);
+        BOOST_CHECK_EQUAL(stream->next(), 10);
+        BOOST_CHECK_EQUAL(stream->current(), 11);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_persistent_dataset )
+{
+    std::string dir = "./tmp/persistent_sparse_dataset_test";
+    boost::filesystem::remove_all(dir);
+
+    MldbServer server;
+    server.init();
+
+    MutableSparseMatrixDatasetConfig config;
+    config.dataDirectoryUrl = Url("file://" + dir);
+    PolyConfig pconfig;
+    pconfig.params = config;
+
+    Date ts = Date::fromSecondsSinceEpoch(1462700000);
+
+    std::vector<RowName> rowNames;
+    {
+        MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+        for (unsigned i = 0;  i < 100;  ++i) {
+            std::vector<std::tuple<ColumnName, CellValue, Date> > vals;
+            vals.emplace_back(ColumnName("x"), i, ts);
+            vals.emplace_back(ColumnName("y"), "value " + std::to_string(i), ts);
+            dataset.recordRow(RowName("row" + std::to_string(i)), vals);
+        }
+        dataset.commit();
+        rowNames = dataset.getMatrixView()->getRowNames();
+    }
+
+    // The data is still there when the dataset is opened again
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+    auto view = dataset.getMatrixView();
+    BOOST_CHECK_EQUAL(view->getRowCount(), 100);
+    BOOST_CHECK_EQUAL(jsonEncodeStr(view->getRowNames()),
+                      jsonEncodeStr(rowNames));
+
+    auto row = view->getRow(RowName("row42"));
+    BOOST_REQUIRE_EQUAL(row.columns.size(), 2);
+    for (auto & c: row.columns) {
+        if (std::get<0>(c) == ColumnName("x"))
+            BOOST_CHECK_EQUAL(std::get<1>(c), 42);
+        else BOOST_CHECK_EQUAL(std::get<1>(c), "value 42");
+        BOOST_CHECK_EQUAL(std::get<2>(c), ts);
+    }
+}
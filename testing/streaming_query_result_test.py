@@ -0,0 +1,85 @@
+#
+# streaming_query_result_test.py
+# agent, 2026-10-17
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that query results that are larger than a single chunk are returned
+# correctly in all formats.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 3000
+
+class StreamingQueryResultTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            cols = [['x', i, 0], ['label', 'row number %d' % i, 0]]
+            # Only some rows have this column, and it first appears late
+            if i % 3 == 0 and i > 100:
+                cols.append(['y', i * 2, 0])
+            ds.record_row('r%04d' % i, cols)
+        ds.commit()
+
+    def query(self, format, **kwargs):
+        return mldb.get('/v1/query', q='SELECT * FROM ds ORDER BY x',
+                        format=format, **kwargs).json()
+
+    def test_full(self):
+        res = self.query('full')
+        self.assertEqual(len(res), NUM_ROWS)
+        for i, row in enumerate(res):
+            self.assertEqual(row['rowName'], 'r%04d' % i)
+            cols = {c[0] : c[1] for c in row['columns']}
+            self.assertEqual(cols['x'], i)
+            self.assertEqual(cols['label'], 'row number %d' % i)
+            self.assertEqual(cols.get('y'), i * 2 if i % 3 == 0 and i > 100
+                             else None)
+
+    def test_sparse(self):
+        res = self.query('sparse', rowNames='true')
+        self.assertEqual(len(res), NUM_ROWS)
+        self.assertEqual(res[102],
+                         [['_rowName', 'r0102'], ['label', 'row number 102'],
+                          ['x', 102], ['y', 204]])
+
+    def test_aos(self):
+        res = self.query('aos')
+        self.assertEqual(len(res), NUM_ROWS)
+        self.assertEqual(res[5], {'_rowName' : 'r0005', 'x' : 5,
+                                  'label' : 'row number 5'})
+        self.assertEqual(res[2001]['y'], 4002)
+
+    def test_soa(self):
+        res = self.query('soa')
+        self.assertEqual(sorted(res.keys()), ['_rowName', 'label', 'x', 'y'])
+        for k, v in res.items():
+            self.assertEqual(len(v), NUM_ROWS)
+        self.assertEqual(res['x'], list(range(NUM_ROWS)))
+        self.assertEqual(res['y'][100], None)
+        self.assertEqual(res['y'][102], 204)
+        self.assertEqual(res['y'][NUM_ROWS - 1], None)
+
+    def test_table(self):
+        res = self.query('table', sortColumns='true')
+        self.assertEqual(len(res), NUM_ROWS + 1)
+        self.assertEqual(res[0], ['_rowName', 'label', 'x', 'y'])
+        self.assertEqual(res[1], ['r0000', 'row number 0', 0, None])
+        self.assertEqual(res[103], ['r0102', 'row number 102', 102, 204])
+
+    def test_dataset_query_route(self):
+        res = mldb.get('/v1/datasets/ds/query', orderBy='x', limit=2000,
+                       offset=10, format='table').json()
+        self.assertEqual(len(res), 2001)
+        self.assertEqual(res[1][0], 'r0010')
+
+    def test_unknown_format(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            self.query('nonexistent')
+        self.assertEqual(re.exception.response.status_code, 400)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,149 @@
+/* tabular_dataset_persistence_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that frozen columns survive a round trip through the on-disk
+   (memory mapped) format.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/plugins/frozen_serialization.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/url.h"
+#include "mldb/types/date.h"
+#include "mldb/sql/path.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/demangle.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+void saveAndReload(const std::vector<CellValue> & cells,
+                   const std::string & expectedType)
+{
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < cells.size();  ++i) {
+        col.add(i, cells[i]);
+    }
+
+    std::shared_ptr<FrozenColumn> frozen = col.freeze();
+    BOOST_CHECK_EQUAL(ML::type_name(*frozen), expectedType);
+
+    Url url("file://tmp/tabular_dataset_persistence_test.mldbfrz");
+
+    auto writeContents = [&] (ML::DB::Store_Writer & metadata,
+                              FrozenBlockWriter & blocks)
+        {
+            frozen->serialize(metadata, blocks);
+        };
+
+    saveFrozenFile(url, "test", 1, writeContents);
+
+    std::shared_ptr<FrozenColumn> reloaded;
+
+    auto readContents = [&] (ML::DB::Store_Reader & metadata,
+                             const FrozenBlockReader & blocks)
+        {
+            reloaded = FrozenColumn::reconstitute(metadata, blocks);
+        };
+
+    loadFrozenFile(url, "test", 1, readContents);
+
+    BOOST_REQUIRE(reloaded);
+    BOOST_CHECK_EQUAL(ML::type_name(*reloaded), expectedType);
+    BOOST_CHECK_EQUAL(reloaded->size(), frozen->size());
+
+    for (size_t i = 0;  i < cells.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(reloaded->get(i), cells[i]);
+    }
+
+    // The wrong file type or version must be rejected
+    BOOST_CHECK_THROW(loadFrozenFile(url, "test2", 1, readContents),
+                      std::exception);
+    BOOST_CHECK_THROW(loadFrozenFile(url, "test", 2, readContents),
+                      std::exception);
+
+    tryEraseUriObject(url.toString());
+}
+
+BOOST_AUTO_TEST_CASE( test_integer_column_round_trip )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        vals.push_back(i);
+        vals.push_back(-i);
+    }
+    vals.emplace_back();
+
+    saveAndReload(vals, "Datacratic::MLDB::IntegerFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_table_column_round_trip )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        switch (i % 6) {
+        case 0: vals.emplace_back("hello");  break;
+        case 1: vals.emplace_back(Utf8String("h\xc3\xa9llo"));  break;
+        case 2: vals.emplace_back(1.5);  break;
+        case 3: vals.emplace_back(Date::fromSecondsSinceEpoch(i));  break;
+        case 4: vals.emplace_back(CellValue::blob("bl\0b", 4));  break;
+        case 5: vals.emplace_back(CellValue::fromMonthDaySecond(1, 2, 3.0));
+            break;
+        }
+    }
+
+    saveAndReload(vals, "Datacratic::MLDB::TableFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_column_round_trip )
+{
+    std::vector<CellValue> vals(10000);
+    vals[3] = "three";
+    vals[5000] = "five thousand";
+    vals[9999] = CellValue(Path({ "a", "b" }));
+
+    saveAndReload(vals, "Datacratic::MLDB::SparseTableFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_double_column_round_trip )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        vals.push_back(i * 0.1);
+        vals.push_back(i + 0.5);
+    }
+    vals.emplace_back();
+
+    saveAndReload(vals, "Datacratic::MLDB::DoubleFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_timestamp_column_round_trip )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        vals.emplace_back(Date::fromSecondsSinceEpoch(1460000000 + i * 3600));
+    }
+    vals.emplace_back();
+
+    saveAndReload(vals, "Datacratic::MLDB::TimestampFrozenColumn");
+}
+
+BOOST_AUTO_TEST_CASE( test_run_length_column_round_trip )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i)
+        vals.emplace_back("first");
+    for (int i = 0;  i < 1000;  ++i)
+        vals.emplace_back();
+    for (int i = 0;  i < 1000;  ++i)
+        vals.emplace_back("second");
+
+    saveAndReload(vals, "Datacratic::MLDB::RunLengthFrozenColumn");
+}
@@ -0,0 +1,100 @@
+/* tabular_dataset_streaming_commit_test.cc
+   agent, 17 October 2026
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that the rows of a tabular dataset can be queried as soon as their
+   chunk has been frozen, before the dataset is committed.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/base/thread_pool.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+void recordRows(Recorder & recorder, int begin, int end)
+{
+    Date ts = Date::fromSecondsSinceEpoch(1462300000);
+
+    for (int i = begin;  i < end;  ++i) {
+        std::vector<std::tuple<ColumnName, CellValue, Date> > cols;
+        cols.emplace_back(ColumnName("x"), i, ts);
+        cols.emplace_back(ColumnName("s"), "row" + std::to_string(i), ts);
+        recorder.recordRow(RowName("row" + std::to_string(i)), cols);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_query_before_commit )
+{
+    MldbServer server;
+
+    server.init();
+
+    PolyConfig pconfig;
+    pconfig.params = TabularDatasetConfig();
+    TabularDataset dataset(&server, pconfig, nullptr);
+
+    auto recorders = dataset.getChunkRecorder();
+
+    // Nothing is visible until the first chunk has been frozen
+    auto recorder1 = recorders.newChunk(0);
+    recordRows(*recorder1, 0, 1000);
+    BOOST_CHECK_EQUAL(dataset.getMatrixView()->getRowCount(), 0);
+
+    recorder1->finishedChunk();
+    ThreadPool::instance().waitForAll();
+
+    auto view1 = dataset.getMatrixView();
+    BOOST_CHECK_EQUAL(view1->getRowCount(), 1000);
+    BOOST_CHECK(view1->knownRow(RowName("row999")));
+    BOOST_CHECK_EQUAL(dataset.getColumnIndex()
+                      ->getColumnDense(ColumnName("x")).size(),
+                      1000);
+
+    // A second chunk is added to new snapshots, but not to the one we
+    // already have
+    auto recorder2 = recorders.newChunk(1);
+    recordRows(*recorder2, 1000, 1500);
+    recorder2->finishedChunk();
+    ThreadPool::instance().waitForAll();
+
+    BOOST_CHECK_EQUAL(dataset.getMatrixView()->getRowCount(), 1500);
+    BOOST_CHECK_EQUAL(view1->getRowCount(), 1000);
+    BOOST_CHECK(!view1->knownRow(RowName("row1000")));
+
+    // The status is read without building a snapshot
+    Json::Value status = dataset.getStatus().asJson();
+    BOOST_CHECK_EQUAL(status["rowCount"].asInt(), 1500);
+    BOOST_CHECK_EQUAL(status["columnCount"].asInt(), 2);
+
+    // Once nobody holds the last snapshot, it's extended with new chunks
+    // in place; the first one is unaffected
+    auto recorder4 = recorders.newChunk(3);
+    recordRows(*recorder4, 2000, 2200);
+    recorder4->finishedChunk();
+    ThreadPool::instance().waitForAll();
+
+    auto view2 = dataset.getMatrixView();
+    BOOST_CHECK_EQUAL(view2->getRowCount(), 1700);
+    BOOST_CHECK(view2->knownRow(RowName("row1499")));
+    BOOST_CHECK(view2->knownRow(RowName("row2199")));
+    BOOST_CHECK_EQUAL(view1->getRowCount(), 1000);
+
+    // The commit waits for chunks that are still being frozen
+    auto recorder3 = recorders.newChunk(2);
+    recordRows(*recorder3, 1500, 1600);
+    recorder3->finishedChunk();
+    recorders.commit();
+
+    auto committed = dataset.getMatrixView();
+    BOOST_CHECK_EQUAL(committed->getRowCount(), 1800);
+    BOOST_CHECK(committed->knownRow(RowName("row1599")));
+    BOOST_CHECK_EQUAL(view1->getRowCount(), 1000);
+    BOOST_CHECK_EQUAL(view2->getRowCount(), 1700);
+}
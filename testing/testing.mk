@@ -360,6 +360,7 @@ $(eval $(call mldb_unit_test,MLDB-1636-row-column-path.js))
 $(eval $(call mldb_unit_test,MLDB-1648-path-values.js))
 $(eval $(call mldb_unit_test,MLDB-1562-join-with-in.js))
 $(eval $(call mldb_unit_test,MLDB-1802-select-orderby.py))
+$(eval $(call mldb_unit_test,join_order_by_limit_test.py))
 $(eval $(call test,MLDB-1360-sparse-mutable-multithreaded-insert,mldb,boost))
 $(eval $(call mldb_unit_test,MLDBFB-440_error_on_ds_wo_cols.py))
 $(eval $(call mldb_unit_test,MLDBFB-509_pushed_non_printable_char_cant_query.py))
@@ -393,6 +394,17 @@ $(eval $(call mldb_unit_test,import_text_test.py))
 $(eval $(call mldb_unit_test,alias_resolving_test.py))
 $(eval $(call mldb_unit_test,MLDB-1753_useragent_function.py))
 $(eval $(call test,MLDB-1742-tabular-dataset-integer-columns,mldb,boost))
+$(eval $(call test,tabular_dataset_persistence_test,mldb,boost))
+$(eval $(call test,tabular_dataset_streaming_commit_test,mldb,boost))
+$(eval $(call test,frozen_column_block_test,mldb,boost))
+$(eval $(call test,group_by_spill_test,mldb,boost))
+$(eval $(call test,order_by_spill_test,mldb,boost))
+$(eval $(call test,parallel_recorder_test,mldb,boost))
+$(eval $(call test,hash_join_test,mldb,boost))
+$(eval $(call test,compiled_expression_test,mldb,boost))
+$(eval $(call test,csv_scanner_test,mldb,boost))
+$(eval $(call test,persistent_sparse_matrix_test,mldb,boost))
+$(eval $(call test,hnsw_index_test,mldb,boost))
 $(eval $(call mldb_unit_test,summary_stats_proc_test.py))
 $(eval $(call mldb_unit_test,MLDB-1766_dt_categorical.py))
 $(eval $(call mldb_unit_test,MLDB-1750-dist-tables.py))
@@ -404,3 +416,9 @@ $(eval $(call mldb_unit_test,builtin_hash_fct_test.py))
 $(eval $(call mldb_unit_test,MLDB-1792_aggregator_error_message.py))
 $(eval $(call test,MLDBFB-239-s3-test,aws vfs_handlers,boost $(MANUAL_IF_NO_S3)))
 $(eval $(call mldb_unit_test,MLDB-1755-column-execution-memory-use.js))
+$(eval $(call mldb_unit_test,streaming_query_result_test.py))
+$(eval $(call mldb_unit_test,columnar_query_result_test.py))
+$(eval $(call mldb_unit_test,function_apply_batch_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_index_test.py))
+$(eval $(call mldb_unit_test,joined_dataset_lazy_index_test.py))
+$(eval $(call mldb_unit_test,jseval_batch_test.py))